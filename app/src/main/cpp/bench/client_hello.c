@@ -0,0 +1,208 @@
+/**
+ * client_hello.c
+ *
+ * Synthetic TLS ClientHello records shaped like real clients: extension
+ * set and order, cipher suite count, key share sizes (X25519, P-256,
+ * X25519MLKEM768) and an outer ECH extension. Contents are filler; only
+ * structure and sizes matter to the bypass engine.
+ */
+
+#include "client_hello.h"
+
+#include <string.h>
+
+typedef struct {
+    uint8_t* buf;
+    uint32_t len;
+    uint32_t ext_len_pos;
+} HelloBuilder;
+
+static const char* const PROFILE_NAMES[CLIENT_HELLO_PROFILE_COUNT] = {
+    "chrome", "firefox", "curl"
+};
+
+// Forward declarations
+static void hb_u8(HelloBuilder* hb, uint8_t v);
+static void hb_u16(HelloBuilder* hb, uint16_t v);
+static void hb_fill(HelloBuilder* hb, uint32_t n);
+static void hb_ext(HelloBuilder* hb, uint16_t type, uint16_t len);
+static void hb_sni(HelloBuilder* hb, const char* host);
+static void hb_key_share(HelloBuilder* hb, bool grease, bool pq, bool p256);
+static void hb_ech(HelloBuilder* hb, uint16_t payload_len);
+
+/**
+ * Get profile name
+ */
+const char* client_hello_profile_name(ClientHelloProfile profile) {
+    if ((unsigned)profile >= CLIENT_HELLO_PROFILE_COUNT) return "unknown";
+    return PROFILE_NAMES[profile];
+}
+
+/**
+ * Look up profile by name
+ */
+int client_hello_find_profile(const char* name) {
+    for (int i = 0; i < CLIENT_HELLO_PROFILE_COUNT; i++) {
+        if (strcmp(name, PROFILE_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * Build ClientHello record
+ */
+uint32_t client_hello_build(uint8_t* buf, ClientHelloProfile profile, bool pq, bool ech,
+                            const char* host) {
+    if (host == NULL || strlen(host) > CLIENT_HELLO_MAX_HOST) return 0;
+    
+    HelloBuilder builder = { .buf = buf, .len = 0 };
+    HelloBuilder* hb = &builder;
+    
+    // Record and handshake headers (lengths patched below)
+    hb_u8(hb, 0x16); hb_u16(hb, 0x0301); hb_u16(hb, 0);
+    hb_u8(hb, 0x01); hb_u8(hb, 0); hb_u16(hb, 0);
+    hb_u16(hb, 0x0303);
+    hb_fill(hb, 32);                          // Random
+    hb_u8(hb, 32); hb_fill(hb, 32);           // Legacy session ID (compat mode)
+    
+    uint16_t suites = profile == CLIENT_HELLO_CHROME ? 16 : profile == CLIENT_HELLO_FIREFOX ? 17 : 31;
+    hb_u16(hb, suites * 2);
+    hb_fill(hb, suites * 2);
+    hb_u8(hb, 1); hb_u8(hb, 0);               // Compression: null
+    
+    hb->ext_len_pos = hb->len;
+    hb_u16(hb, 0);
+    
+    switch (profile) {
+        case CLIENT_HELLO_CHROME:
+            // Chrome permutes extensions per connection; one fixed permutation
+            hb_ext(hb, 0x0a0a, 0);            // GREASE
+            hb_ext(hb, 0x0012, 0);            // signed_certificate_timestamp
+            hb_ext(hb, 0x0023, 0);            // session_ticket
+            hb_sni(hb, host);
+            hb_ext(hb, 0x002d, 2);            // psk_key_exchange_modes
+            hb_ext(hb, 0x000d, 18);           // signature_algorithms
+            hb_ext(hb, 0x000a, pq ? 12 : 10); // supported_groups
+            hb_ext(hb, 0x0010, 14);           // ALPN h2, http/1.1
+            hb_ext(hb, 0x0005, 5);            // status_request
+            hb_ext(hb, 0x44cd, 5);            // application_settings
+            hb_ext(hb, 0x0017, 0);            // extended_master_secret
+            hb_ext(hb, 0x001b, 3);            // compress_certificate
+            hb_key_share(hb, true, pq, false);
+            if (ech) hb_ech(hb, 208);
+            hb_ext(hb, 0x002b, 7);            // supported_versions
+            hb_ext(hb, 0xff01, 1);            // renegotiation_info
+            hb_ext(hb, 0x000b, 2);            // ec_point_formats
+            hb_ext(hb, 0x1a1a, 1);            // GREASE
+            break;
+        
+        case CLIENT_HELLO_FIREFOX:
+            hb_sni(hb, host);
+            hb_ext(hb, 0x0017, 0);
+            hb_ext(hb, 0xff01, 1);
+            hb_ext(hb, 0x000a, pq ? 16 : 14);
+            hb_ext(hb, 0x000b, 2);
+            hb_ext(hb, 0x0023, 0);
+            hb_ext(hb, 0x0010, 14);
+            hb_ext(hb, 0x0005, 5);
+            hb_ext(hb, 0x0022, 10);           // delegated_credentials
+            hb_key_share(hb, false, pq, true);
+            hb_ext(hb, 0x002b, 5);
+            hb_ext(hb, 0x000d, 24);
+            hb_ext(hb, 0x002d, 2);
+            hb_ext(hb, 0x001c, 2);            // record_size_limit
+            hb_ext(hb, 0x001b, 7);
+            if (ech) hb_ech(hb, 240);
+            break;
+        
+        case CLIENT_HELLO_CURL:
+            hb_sni(hb, host);
+            hb_ext(hb, 0x000b, 4);
+            hb_ext(hb, 0x000a, pq ? 26 : 22);
+            hb_ext(hb, 0x0023, 0);
+            hb_ext(hb, 0x0010, 14);
+            hb_ext(hb, 0x0016, 0);            // encrypt_then_mac
+            hb_ext(hb, 0x0017, 0);
+            hb_ext(hb, 0x000d, 48);
+            hb_ext(hb, 0x002b, 5);
+            hb_ext(hb, 0x002d, 2);
+            hb_key_share(hb, false, pq, false);
+            if (ech) hb_ech(hb, 176);
+            break;
+        
+        default:
+            return 0;
+    }
+    
+    uint32_t ext_len = hb->len - hb->ext_len_pos - 2;
+    uint32_t record_len = hb->len - 5;
+    uint32_t handshake_len = hb->len - 9;
+    hb->buf[hb->ext_len_pos] = ext_len >> 8;
+    hb->buf[hb->ext_len_pos + 1] = ext_len & 0xFF;
+    hb->buf[3] = record_len >> 8;
+    hb->buf[4] = record_len & 0xFF;
+    hb->buf[6] = (handshake_len >> 16) & 0xFF;
+    hb->buf[7] = (handshake_len >> 8) & 0xFF;
+    hb->buf[8] = handshake_len & 0xFF;
+    
+    return hb->len;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+static void hb_u8(HelloBuilder* hb, uint8_t v) {
+    hb->buf[hb->len++] = v;
+}
+
+static void hb_u16(HelloBuilder* hb, uint16_t v) {
+    hb->buf[hb->len++] = v >> 8;
+    hb->buf[hb->len++] = v & 0xFF;
+}
+
+static void hb_fill(HelloBuilder* hb, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++, hb->len++) hb->buf[hb->len] = (uint8_t)(hb->len * 131 + 7);
+}
+
+/**
+ * Extension with opaque body of the given length
+ */
+static void hb_ext(HelloBuilder* hb, uint16_t type, uint16_t len) {
+    hb_u16(hb, type);
+    hb_u16(hb, len);
+    hb_fill(hb, len);
+}
+
+static void hb_sni(HelloBuilder* hb, const char* host) {
+    uint16_t name_len = (uint16_t)strlen(host);
+    hb_u16(hb, 0x0000);
+    hb_u16(hb, name_len + 5);
+    hb_u16(hb, name_len + 3);
+    hb_u8(hb, 0);
+    hb_u16(hb, name_len);
+    memcpy(hb->buf + hb->len, host, name_len);
+    hb->len += name_len;
+}
+
+/**
+ * key_share with X25519 (+ P-256 for Firefox), optional X25519MLKEM768
+ * and optional GREASE share (Chrome)
+ */
+static void hb_key_share(HelloBuilder* hb, bool grease, bool pq, bool p256) {
+    uint16_t list_len = 36 + (grease ? 5 : 0) + (pq ? 1220 : 0) + (p256 ? 69 : 0);
+    hb_u16(hb, 0x0033);
+    hb_u16(hb, list_len + 2);
+    hb_u16(hb, list_len);
+    if (grease) { hb_u16(hb, 0x2a2a); hb_u16(hb, 1); hb_fill(hb, 1); }
+    if (pq) { hb_u16(hb, 0x11ec); hb_u16(hb, 1216); hb_fill(hb, 1216); }
+    hb_u16(hb, 0x001d); hb_u16(hb, 32); hb_fill(hb, 32);
+    if (p256) { hb_u16(hb, 0x0017); hb_u16(hb, 65); hb_fill(hb, 65); }
+}
+
+/**
+ * encrypted_client_hello (outer): HPKE suite, config id, enc and payload
+ */
+static void hb_ech(HelloBuilder* hb, uint16_t payload_len) {
+    hb_ext(hb, 0xfe0d, 1 + 4 + 1 + 2 + 32 + 2 + payload_len);
+}
@@ -0,0 +1,59 @@
+/**
+ * client_hello.h
+ *
+ * Synthetic TLS ClientHello records for benchmarks and load generation
+ */
+
+#ifndef CLIENT_HELLO_H
+#define CLIENT_HELLO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Buffer size that holds any fingerprint with the longest allowed host
+#define CLIENT_HELLO_MAX_LEN 4096
+#define CLIENT_HELLO_MAX_HOST 255
+
+// Client fingerprints
+typedef enum {
+    CLIENT_HELLO_CHROME = 0,    // GREASE, ALPS, shuffled order (fixed here)
+    CLIENT_HELLO_FIREFOX,       // SNI first, X25519 + P-256 shares
+    CLIENT_HELLO_CURL,          // OpenSSL 3 defaults
+    CLIENT_HELLO_PROFILE_COUNT
+} ClientHelloProfile;
+
+/**
+ * Build a ClientHello record as sent by the given client
+ * @param buf Output buffer of at least CLIENT_HELLO_MAX_LEN bytes
+ * @param profile Client fingerprint
+ * @param pq Add an X25519MLKEM768 key share (pushes the record past one MSS)
+ * @param ech Add an outer encrypted_client_hello extension
+ * @param host SNI hostname (at most CLIENT_HELLO_MAX_HOST characters)
+ * @return Record length, 0 if host is too long
+ */
+uint32_t client_hello_build(uint8_t* buf, ClientHelloProfile profile, bool pq, bool ech,
+                            const char* host);
+
+/**
+ * Get profile name ("chrome", "firefox", "curl")
+ * @param profile Client fingerprint
+ * @return Static string, "unknown" if out of range
+ */
+const char* client_hello_profile_name(ClientHelloProfile profile);
+
+/**
+ * Look up profile by name
+ * @param name Profile name
+ * @return Profile, -1 if unknown
+ */
+int client_hello_find_profile(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLIENT_HELLO_H
@@ -0,0 +1,659 @@
+/**
+ * conn_bench.c
+ *
+ * Connection load generator and minimal server for the netns testbed
+ * (bench/netns_testbed.sh).
+ *
+ * Server: accepts TLS and HTTP on the given ports. A TLS ClientHello is
+ * answered with a ServerHello record; anything sent after it is counted
+ * and the total returned as 8 bytes once the client shuts down writing.
+ * An HTTP request is answered with 204 No Content. A QUIC long header
+ * datagram on any of the ports is answered with one short datagram.
+ *
+ * Client: opens connections from parallel workers and reports one JSON
+ * line with time to connect, time to ServerHello (or first HTTP response
+ * byte, or first QUIC reply), bulk upload throughput, and CPU per
+ * connection of the client and, with -C, of another process (the daemon).
+ *
+ * Usage: netrix_conn_bench server [-p port]...
+ *        netrix_conn_bench client -a addr [-p port] [-m tls|http|bulk|quic] [-n conns]
+ *                                 [-P parallel] [-f profile] [-q] [-e] [-s sni]
+ *                                 [-x bytes] [-b bytes] [-t timeout_ms] [-C pid] [-L label]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "client_hello.h"
+#ifdef NETRIX_HAVE_OPENSSL
+#include "quic_initial.h"
+#endif
+
+#define MAX_PORTS 8
+#define MAX_PARALLEL 1024
+#define BULK_CHUNK 16384
+#define HTTP_MAX_REQUEST 8192
+
+typedef enum {
+    MODE_TLS,
+    MODE_HTTP,
+    MODE_BULK,
+    MODE_QUIC
+} ConnMode;
+
+// Client configuration
+static struct {
+    struct sockaddr_in addr;
+    ConnMode mode;
+    uint32_t conns;
+    uint32_t parallel;
+    ClientHelloProfile profile;
+    bool pq;
+    bool ech;
+    const char* sni;
+    uint32_t split;             // Send the first request bytes in their own write
+    uint64_t bulk_bytes;
+    uint32_t timeout_ms;
+    pid_t cpu_pid;
+    const char* label;
+} g_cfg = {
+    .mode = MODE_TLS,
+    .conns = 100,
+    .parallel = 8,
+    .profile = CLIENT_HELLO_CHROME,
+    .pq = false,
+    .ech = false,
+    .sni = "www.example.com",
+    .split = 0,
+    .bulk_bytes = 16 * 1024 * 1024,
+    .timeout_ms = 5000,
+    .cpu_pid = 0,
+    .label = ""
+};
+
+// Per connection result
+typedef struct {
+    uint32_t connect_us;
+    uint32_t handshake_us;      // Connect start to ServerHello / first response byte
+    uint64_t bulk_ns;           // First bulk byte to server acknowledgement (bulk_conn_mbps)
+    bool ok;
+} ConnResult;
+
+static ConnResult* g_results;
+static atomic_uint g_next_conn;
+
+// Forward declarations
+static int run_server(int argc, char* argv[]);
+static int run_client(int argc, char* argv[]);
+static void* server_accept_thread(void* arg);
+static void* server_conn_thread(void* arg);
+static void* server_udp_thread(void* arg);
+static void* client_worker(void* arg);
+static bool client_connection(ConnResult* r, const uint8_t* hello, uint32_t hello_len,
+                              const char* request, uint8_t* chunk);
+static bool client_quic(ConnResult* r, const uint8_t* hello, uint32_t hello_len, uint32_t conn);
+static int send_request(int fd, const void* buf, size_t len);
+static int recv_exact(int fd, uint8_t* buf, size_t len);
+static int send_all(int fd, const void* buf, size_t len);
+static uint64_t now_ns(void);
+static double process_cpu_ms(pid_t pid);
+static uint32_t percentile(uint32_t* sorted, uint32_t count, double p);
+static int compare_u32(const void* a, const void* b);
+static void usage(const char* prog);
+
+int main(int argc, char* argv[]) {
+    signal(SIGPIPE, SIG_IGN);
+    
+    if (argc >= 2 && strcmp(argv[1], "server") == 0) return run_server(argc - 1, argv + 1);
+    if (argc >= 2 && strcmp(argv[1], "client") == 0) return run_client(argc - 1, argv + 1);
+    
+    usage(argv[0]);
+    return 1;
+}
+
+// ============================================================================
+// Server
+// ============================================================================
+
+static int run_server(int argc, char* argv[]) {
+    uint16_t ports[MAX_PORTS];
+    int port_count = 0;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "p:")) != -1) {
+        if (opt == 'p' && port_count < MAX_PORTS) {
+            ports[port_count++] = (uint16_t)atoi(optarg);
+        } else {
+            usage("netrix_conn_bench");
+            return 1;
+        }
+    }
+    if (port_count == 0) ports[port_count++] = 443;
+    
+    pthread_t threads[MAX_PORTS], udp_threads[MAX_PORTS];
+    for (int i = 0; i < port_count; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(ports[i]),
+            .sin_addr.s_addr = htonl(INADDR_ANY)
+        };
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) {
+            fprintf(stderr, "server: port %u: %s\n", ports[i], strerror(errno));
+            return 1;
+        }
+        
+        pthread_create(&threads[i], NULL, server_accept_thread, (void*)(intptr_t)fd);
+        
+        int udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (bind(udp_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            fprintf(stderr, "server: udp port %u: %s\n", ports[i], strerror(errno));
+            return 1;
+        }
+        pthread_create(&udp_threads[i], NULL, server_udp_thread, (void*)(intptr_t)udp_fd);
+        fprintf(stderr, "server: listening on port %u\n", ports[i]);
+    }
+    
+    for (int i = 0; i < port_count; i++) pthread_join(threads[i], NULL);
+    return 0;
+}
+
+static void* server_accept_thread(void* arg) {
+    int listen_fd = (int)(intptr_t)arg;
+    
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_attr_setstacksize(&attr, 256 * 1024);
+        if (pthread_create(&thread, &attr, server_conn_thread, (void*)(intptr_t)fd) != 0) {
+            close(fd);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    
+    close(listen_fd);
+    return NULL;
+}
+
+/**
+ * Serve one connection: TLS (ServerHello + upload counter) or HTTP (204)
+ */
+static void* server_conn_thread(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    uint8_t buf[BULK_CHUNK];
+    
+    if (recv_exact(fd, buf, 5) < 0) goto done;
+    
+    if (buf[0] == 0x16) {
+        // Read the rest of the ClientHello record (may arrive in pieces)
+        uint32_t record_len = (buf[3] << 8) | buf[4];
+        if (record_len > sizeof(buf) - 5 || recv_exact(fd, buf + 5, record_len) < 0) goto done;
+        
+        // ServerHello: TLS 1.2 record, handshake type 2, filler body
+        uint8_t server_hello[5 + 4 + 118];
+        memset(server_hello, 0, sizeof(server_hello));
+        server_hello[0] = 0x16;
+        server_hello[1] = 0x03;
+        server_hello[2] = 0x03;
+        server_hello[3] = 0;
+        server_hello[4] = 4 + 118;
+        server_hello[5] = 0x02;
+        server_hello[8] = 118;
+        server_hello[9] = 0x03;
+        server_hello[10] = 0x03;
+        if (send_all(fd, server_hello, sizeof(server_hello)) < 0) goto done;
+        
+        // Count uploaded bytes until the client shuts down writing
+        uint64_t total = 0;
+        ssize_t n;
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) total += (uint64_t)n;
+        
+        uint8_t ack[8];
+        for (int i = 0; i < 8; i++) ack[i] = (uint8_t)(total >> (56 - 8 * i));
+        send(fd, ack, sizeof(ack), MSG_NOSIGNAL);
+    } else {
+        // HTTP: read headers, answer 204
+        size_t len = 5;
+        while (len < HTTP_MAX_REQUEST - 1) {
+            if (len >= 4 && memcmp(buf + len - 4, "\r\n\r\n", 4) == 0) break;
+            ssize_t n = recv(fd, buf + len, HTTP_MAX_REQUEST - 1 - len, 0);
+            if (n <= 0) goto done;
+            len += (size_t)n;
+        }
+        
+        static const char response[] =
+            "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send_all(fd, response, sizeof(response) - 1);
+    }
+
+done:
+    close(fd);
+    return NULL;
+}
+
+/**
+ * Answer each QUIC long header datagram with a short reply
+ */
+static void* server_udp_thread(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    uint8_t buf[2048];
+    
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr*)&peer, &peer_len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n < 1 || !(buf[0] & 0x80)) continue;
+        
+        // Stands in for the server's Initial + Handshake flight
+        uint8_t reply[64];
+        memset(reply, 0, sizeof(reply));
+        reply[0] = 0xE0;
+        sendto(fd, reply, sizeof(reply), 0, (struct sockaddr*)&peer, peer_len);
+    }
+    
+    close(fd);
+    return NULL;
+}
+
+// ============================================================================
+// Client
+// ============================================================================
+
+static int run_client(int argc, char* argv[]) {
+    const char* addr = NULL;
+    uint16_t port = 0;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:m:n:P:f:qes:x:b:t:C:L:")) != -1) {
+        switch (opt) {
+            case 'a': addr = optarg; break;
+            case 'p': port = (uint16_t)atoi(optarg); break;
+            case 'm':
+                if (strcmp(optarg, "tls") == 0) g_cfg.mode = MODE_TLS;
+                else if (strcmp(optarg, "http") == 0) g_cfg.mode = MODE_HTTP;
+                else if (strcmp(optarg, "bulk") == 0) g_cfg.mode = MODE_BULK;
+                else if (strcmp(optarg, "quic") == 0) g_cfg.mode = MODE_QUIC;
+                else { usage("netrix_conn_bench"); return 1; }
+                break;
+            case 'n': g_cfg.conns = (uint32_t)atoi(optarg); break;
+            case 'P': g_cfg.parallel = (uint32_t)atoi(optarg); break;
+            case 'f': {
+                int profile = client_hello_find_profile(optarg);
+                if (profile < 0) { usage("netrix_conn_bench"); return 1; }
+                g_cfg.profile = (ClientHelloProfile)profile;
+                break;
+            }
+            case 'q': g_cfg.pq = true; break;
+            case 'e': g_cfg.ech = true; break;
+            case 's': g_cfg.sni = optarg; break;
+            case 'x': g_cfg.split = (uint32_t)atoi(optarg); break;
+            case 'b': g_cfg.bulk_bytes = strtoull(optarg, NULL, 0); break;
+            case 't': g_cfg.timeout_ms = (uint32_t)atoi(optarg); break;
+            case 'C': g_cfg.cpu_pid = (pid_t)atoi(optarg); break;
+            case 'L': g_cfg.label = optarg; break;
+            default: usage("netrix_conn_bench"); return 1;
+        }
+    }
+    
+    if (addr == NULL || g_cfg.conns == 0 || g_cfg.parallel == 0 ||
+        inet_pton(AF_INET, addr, &g_cfg.addr.sin_addr) != 1) {
+        usage("netrix_conn_bench");
+        return 1;
+    }
+#ifndef NETRIX_HAVE_OPENSSL
+    if (g_cfg.mode == MODE_QUIC) {
+        fprintf(stderr, "client: quic mode needs a build with OpenSSL\n");
+        return 1;
+    }
+#endif
+    if (port == 0) port = g_cfg.mode == MODE_HTTP ? 80 : 443;
+    if (g_cfg.parallel > MAX_PARALLEL) g_cfg.parallel = MAX_PARALLEL;
+    if (g_cfg.parallel > g_cfg.conns) g_cfg.parallel = g_cfg.conns;
+    g_cfg.addr.sin_family = AF_INET;
+    g_cfg.addr.sin_port = htons(port);
+    
+    g_results = calloc(g_cfg.conns, sizeof(ConnResult));
+    if (g_results == NULL) return 1;
+    atomic_store(&g_next_conn, 0);
+    
+    struct rusage ru_start, ru_end;
+    getrusage(RUSAGE_SELF, &ru_start);
+    double peer_cpu_start = g_cfg.cpu_pid > 0 ? process_cpu_ms(g_cfg.cpu_pid) : 0;
+    uint64_t wall_start = now_ns();
+    
+    pthread_t threads[MAX_PARALLEL];
+    for (uint32_t i = 0; i < g_cfg.parallel; i++) {
+        pthread_create(&threads[i], NULL, client_worker, NULL);
+    }
+    for (uint32_t i = 0; i < g_cfg.parallel; i++) pthread_join(threads[i], NULL);
+    
+    uint64_t wall_ns = now_ns() - wall_start;
+    double peer_cpu_ms = g_cfg.cpu_pid > 0 ? process_cpu_ms(g_cfg.cpu_pid) - peer_cpu_start : -1;
+    getrusage(RUSAGE_SELF, &ru_end);
+    double client_cpu_us =
+        (ru_end.ru_utime.tv_sec - ru_start.ru_utime.tv_sec) * 1e6 +
+        (ru_end.ru_utime.tv_usec - ru_start.ru_utime.tv_usec) +
+        (ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec) * 1e6 +
+        (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec);
+    
+    // Latency percentiles over successful connections
+    uint32_t* connect_us = malloc(g_cfg.conns * sizeof(uint32_t));
+    uint32_t* handshake_us = malloc(g_cfg.conns * sizeof(uint32_t));
+    uint32_t ok = 0;
+    uint64_t hs_sum = 0, bulk_ns = 0;
+    for (uint32_t i = 0; i < g_cfg.conns; i++) {
+        if (!g_results[i].ok) continue;
+        connect_us[ok] = g_results[i].connect_us;
+        handshake_us[ok] = g_results[i].handshake_us;
+        hs_sum += g_results[i].handshake_us;
+        bulk_ns += g_results[i].bulk_ns;
+        ok++;
+    }
+    qsort(connect_us, ok, sizeof(uint32_t), compare_u32);
+    qsort(handshake_us, ok, sizeof(uint32_t), compare_u32);
+    
+    static const char* const mode_names[] = { "tls", "http", "bulk", "quic" };
+    printf("{\"label\":\"%s\",\"mode\":\"%s\",\"profile\":\"%s\",\"pq\":%s,\"ech\":%s,"
+           "\"conns\":%u,\"parallel\":%u,\"ok\":%u,\"failed\":%u,\"wall_s\":%.3f,"
+           "\"connect_p50_us\":%u,\"connect_p99_us\":%u,"
+           "\"hs_p50_us\":%u,\"hs_p90_us\":%u,\"hs_p99_us\":%u,\"hs_mean_us\":%.1f,"
+           "\"bulk_conn_mbps\":%.1f,\"client_cpu_us_per_conn\":%.1f,"
+           "\"daemon_cpu_ms\":%.1f,\"daemon_cpu_us_per_conn\":%.1f}\n",
+           g_cfg.label, mode_names[g_cfg.mode], client_hello_profile_name(g_cfg.profile),
+           g_cfg.pq ? "true" : "false", g_cfg.ech ? "true" : "false",
+           g_cfg.conns, g_cfg.parallel, ok, g_cfg.conns - ok, wall_ns / 1e9,
+           percentile(connect_us, ok, 0.50), percentile(connect_us, ok, 0.99),
+           percentile(handshake_us, ok, 0.50), percentile(handshake_us, ok, 0.90),
+           percentile(handshake_us, ok, 0.99), ok ? (double)hs_sum / ok : 0.0,
+           g_cfg.mode == MODE_BULK && bulk_ns ? ok * g_cfg.bulk_bytes * 8e3 / bulk_ns : 0.0,
+           client_cpu_us / g_cfg.conns,
+           peer_cpu_ms, peer_cpu_ms >= 0 ? peer_cpu_ms * 1e3 / g_cfg.conns : -1.0);
+    
+    free(connect_us);
+    free(handshake_us);
+    free(g_results);
+    return ok == g_cfg.conns ? 0 : 2;
+}
+
+static void* client_worker(void* arg) {
+    (void)arg;
+    uint8_t hello[CLIENT_HELLO_MAX_LEN];
+    uint32_t hello_len = client_hello_build(hello, g_cfg.profile, g_cfg.pq, g_cfg.ech, g_cfg.sni);
+    
+    char request[512];
+    snprintf(request, sizeof(request),
+             "GET / HTTP/1.1\r\nHost: %s\r\nUser-Agent: netrix-conn-bench\r\n"
+             "Accept: */*\r\nConnection: close\r\n\r\n", g_cfg.sni);
+    
+    uint8_t* chunk = g_cfg.mode == MODE_BULK ? malloc(BULK_CHUNK) : NULL;
+    if (chunk != NULL) {
+        // Application data records so a reassembling middlebox sees valid framing
+        memset(chunk, 0xA5, BULK_CHUNK);
+        chunk[0] = 0x17;
+        chunk[1] = 0x03;
+        chunk[2] = 0x03;
+        chunk[3] = (BULK_CHUNK - 5) >> 8;
+        chunk[4] = (BULK_CHUNK - 5) & 0xFF;
+    }
+    
+    for (;;) {
+        uint32_t index = atomic_fetch_add(&g_next_conn, 1);
+        if (index >= g_cfg.conns) break;
+        if (g_cfg.mode == MODE_QUIC) {
+            g_results[index].ok = client_quic(&g_results[index], hello, hello_len, index);
+        } else {
+            g_results[index].ok = client_connection(&g_results[index], hello, hello_len, request, chunk);
+        }
+    }
+    
+    free(chunk);
+    return NULL;
+}
+
+/**
+ * One connection: connect, handshake, optional bulk upload
+ * @return true on success
+ */
+static bool client_connection(ConnResult* r, const uint8_t* hello, uint32_t hello_len,
+                              const char* request, uint8_t* chunk) {
+    uint64_t start = now_ns();
+    bool ok = false;
+    
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    
+    struct timeval tv = {
+        .tv_sec = g_cfg.timeout_ms / 1000,
+        .tv_usec = (g_cfg.timeout_ms % 1000) * 1000
+    };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    
+    if (connect(fd, (struct sockaddr*)&g_cfg.addr, sizeof(g_cfg.addr)) < 0) goto out;
+    r->connect_us = (uint32_t)((now_ns() - start) / 1000);
+    
+    uint8_t reply[16];
+    if (g_cfg.mode == MODE_HTTP) {
+        if (send_request(fd, request, strlen(request)) < 0) goto out;
+        if (recv_exact(fd, reply, 8) < 0 || memcmp(reply, "HTTP/1.", 7) != 0) goto out;
+        r->handshake_us = (uint32_t)((now_ns() - start) / 1000);
+        ok = true;
+        goto out;
+    }
+    
+    if (send_request(fd, hello, hello_len) < 0) goto out;
+    if (recv_exact(fd, reply, 6) < 0 || reply[0] != 0x16 || reply[5] != 0x02) goto out;
+    r->handshake_us = (uint32_t)((now_ns() - start) / 1000);
+    
+    if (g_cfg.mode == MODE_TLS) {
+        ok = true;
+        goto out;
+    }
+    
+    // Drain the rest of the ServerHello record
+    uint8_t rest[512];
+    uint32_t rest_len = ((reply[3] << 8) | reply[4]) - 1;
+    if (rest_len > sizeof(rest) || recv_exact(fd, rest, rest_len) < 0) goto out;
+    
+    uint64_t bulk_start = now_ns();
+    uint64_t sent = 0;
+    while (sent < g_cfg.bulk_bytes) {
+        size_t n = g_cfg.bulk_bytes - sent < BULK_CHUNK ? g_cfg.bulk_bytes - sent : BULK_CHUNK;
+        if (send_all(fd, chunk, n) < 0) goto out;
+        sent += n;
+    }
+    shutdown(fd, SHUT_WR);
+    
+    uint8_t ack[8];
+    if (recv_exact(fd, ack, sizeof(ack)) < 0) goto out;
+    uint64_t acked = 0;
+    for (int i = 0; i < 8; i++) acked = (acked << 8) | ack[i];
+    r->bulk_ns = now_ns() - bulk_start;
+    ok = (acked == g_cfg.bulk_bytes);
+
+out:
+    close(fd);
+    return ok;
+}
+
+/**
+ * One QUIC attempt: ClientHello in padded Initials, wait for any reply
+ * @return true if the server answered in time
+ */
+static bool client_quic(ConnResult* r, const uint8_t* hello, uint32_t hello_len, uint32_t conn) {
+#ifdef NETRIX_HAVE_OPENSSL
+    uint64_t start = now_ns();
+    bool ok = false;
+    
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return false;
+    
+    struct timeval tv = {
+        .tv_sec = g_cfg.timeout_ms / 1000,
+        .tv_usec = (g_cfg.timeout_ms % 1000) * 1000
+    };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (struct sockaddr*)&g_cfg.addr, sizeof(g_cfg.addr)) < 0) goto out;
+    r->connect_us = 0;
+    
+    // Connection IDs only need to differ between attempts
+    uint8_t dcid[8], scid[8];
+    uint64_t seed = start ^ ((uint64_t)conn << 32);
+    for (int i = 0; i < 8; i++) {
+        dcid[i] = (uint8_t)(seed >> (8 * i));
+        scid[i] = (uint8_t)(conn >> (8 * (i % 4))) ^ 0x5A;
+    }
+    
+    // CRYPTO carries the handshake message without the TLS record header
+    const uint8_t* crypto = hello + 5;
+    uint32_t crypto_len = hello_len - 5;
+    uint8_t packet[QUIC_MIN_INITIAL_SIZE + 64];
+    uint32_t pn = 0;
+    for (uint32_t off = 0; off < crypto_len; off += QUIC_INITIAL_CRYPTO_MAX, pn++) {
+        uint32_t n = crypto_len - off < QUIC_INITIAL_CRYPTO_MAX ? crypto_len - off : QUIC_INITIAL_CRYPTO_MAX;
+        int len = quic_initial_build(packet, sizeof(packet), dcid, sizeof(dcid), scid, sizeof(scid),
+                                     pn, crypto + off, n, off);
+        if (len < 0 || send(fd, packet, (size_t)len, 0) != len) goto out;
+    }
+    
+    uint8_t reply[256];
+    if (recv(fd, reply, sizeof(reply), 0) <= 0) goto out;
+    r->handshake_us = (uint32_t)((now_ns() - start) / 1000);
+    ok = true;
+
+out:
+    close(fd);
+    return ok;
+#else
+    (void)r;
+    (void)hello;
+    (void)hello_len;
+    (void)conn;
+    return false;
+#endif
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+static int recv_exact(int fd, uint8_t* buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, buf + got, len - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Send a request, as two writes (two segments with TCP_NODELAY) with -x
+ */
+static int send_request(int fd, const void* buf, size_t len) {
+    if (g_cfg.split == 0 || g_cfg.split >= len) return send_all(fd, buf, len);
+    
+    if (send_all(fd, buf, g_cfg.split) < 0) return -1;
+    return send_all(fd, (const uint8_t*)buf + g_cfg.split, len - g_cfg.split);
+}
+
+static int send_all(int fd, const void* buf, size_t len) {
+    const uint8_t* p = (const uint8_t*)buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * User + system CPU time of a process from /proc/<pid>/stat
+ */
+static double process_cpu_ms(pid_t pid) {
+    char path[64], line[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return -1;
+    char* ok = fgets(line, sizeof(line), f);
+    fclose(f);
+    if (ok == NULL) return -1;
+    
+    // Fields after the parenthesised command name; utime and stime are 14 and 15
+    char* p = strrchr(line, ')');
+    if (p == NULL) return -1;
+    unsigned long long utime = 0, stime = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+               &utime, &stime) != 2) {
+        return -1;
+    }
+    return (utime + stime) * 1000.0 / sysconf(_SC_CLK_TCK);
+}
+
+static uint32_t percentile(uint32_t* sorted, uint32_t count, double p) {
+    if (count == 0) return 0;
+    uint32_t index = (uint32_t)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s server [-p port]...\n"
+            "       %s client -a addr [-p port] [-m tls|http|bulk|quic] [-n conns] [-P parallel]\n"
+            "                 [-f chrome|firefox|curl] [-q] [-e] [-s sni] [-x bytes] [-b bytes]\n"
+            "                 [-t timeout_ms] [-C pid] [-L label]\n"
+            "  -q  add X25519MLKEM768 key share    -e  add ECH extension\n"
+            "  -x  send the first bytes of the ClientHello / request in a separate write\n"
+            "  -b  bytes uploaded per connection in bulk mode (default 16 MiB)\n"
+            "  -C  also report CPU time used by this process (e.g. the daemon)\n",
+            prog, prog);
+}
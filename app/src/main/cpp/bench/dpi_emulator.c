@@ -0,0 +1,882 @@
+/**
+ * dpi_emulator.c
+ *
+ * Inline DPI middlebox for the netns testbed (bench/netns_testbed.sh).
+ * Bridges two interfaces at L2 with AF_PACKET sockets and blocks flows
+ * whose client handshake names a blocklisted domain, the way deployed
+ * censorship boxes do:
+ *
+ *   sni      TLS SNI from a single segment (no reassembly)
+ *   reasm    TLS SNI from the first <depth> stream bytes, out-of-order
+ *            segments placed by sequence number
+ *   inorder  As reasm, but gives up on the flow at the first gap
+ *   host     HTTP Host header from a single segment
+ *   quic     SNI from a decrypted QUIC v1 client Initial
+ *
+ * A match either injects RST to both ends and drops the flow (rst) or
+ * silently drops the flow (blackhole). Traffic the box does not inspect
+ * is forwarded untouched. Oversized TCP frames handed over by the veth
+ * (GSO) are segmented in software so every mode sees wire-sized packets.
+ *
+ * Usage: netrix_dpi_emulator -c client_if -s server_if [-m mode[,mode...]]
+ *            [-d depth] [-a rst|blackhole] [-b domain]... [-S] [-j stats.json]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/virtio_net.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+
+#include "checksum.h"
+#ifdef NETRIX_HAVE_OPENSSL
+#include "quic_initial.h"
+#endif
+
+#define FRAME_MAX (65536 + 256)
+#define FLOW_TABLE_SIZE 65536           // Power of two
+#define FLOW_PROBE 32
+#define FLOW_IDLE_NS (60ULL * 1000000000ULL)
+#define DEFAULT_DEPTH 4096
+#define SINGLE_MAX_OFFSET 16384         // Single-packet modes stop looking after this
+#define MAX_BLOCKLIST 64
+#define SNI_MAX 256
+
+// TLS inspection depth
+typedef enum {
+    TLS_OFF,
+    TLS_SINGLE,
+    TLS_REASM,
+    TLS_INORDER
+} TlsMode;
+
+typedef enum {
+    ACTION_RST,
+    ACTION_BLACKHOLE
+} BlockAction;
+
+typedef enum {
+    FLOW_FREE = 0,
+    FLOW_INSPECT,
+    FLOW_CLEAN,                         // Decided: not blocked, no more inspection
+    FLOW_BLOCKED
+} FlowState;
+
+// Result of parsing a (possibly partial) client handshake
+typedef enum {
+    PARSE_NEED_MORE,
+    PARSE_NOT_HANDSHAKE,
+    PARSE_NO_NAME,
+    PARSE_NAME
+} ParseResult;
+
+// One client/server flow, keyed in client -> server direction
+typedef struct {
+    uint32_t cip, sip;
+    uint16_t cport, sport;
+    uint8_t proto;
+    uint8_t state;
+    bool have_isn;
+    uint32_t isn;                       // Sequence number of the first payload byte
+    uint32_t contiguous;                // Reassembled bytes from stream offset 0
+    uint8_t* buf;                       // Reassembly buffer (depth bytes)
+    uint8_t* have;                      // Byte map of filled positions
+    uint64_t last_ns;
+} Flow;
+
+// Configuration
+static struct {
+    const char* ifname[2];              // 0 = client side, 1 = server side
+    TlsMode tls;
+    bool host;
+    bool quic;
+    uint32_t depth;
+    BlockAction action;
+    const char* blocklist[MAX_BLOCKLIST];
+    int blocklist_count;
+    bool strict_host;                   // Case-sensitive "Host: " and value
+    const char* stats_path;
+} g_cfg = {
+    .tls = TLS_SINGLE,
+    .host = false,
+    .quic = false,
+    .depth = DEFAULT_DEPTH,
+    .action = ACTION_RST,
+    .blocklist_count = 0,
+    .strict_host = false,
+    .stats_path = NULL
+};
+
+// Counters reported on exit
+static struct {
+    uint64_t frames[2];
+    uint64_t gso_frames;
+    uint64_t segments;
+    uint64_t flows;
+    uint64_t blocked_tls;
+    uint64_t blocked_http;
+    uint64_t blocked_quic;
+    uint64_t clean;
+    uint64_t gave_up_depth;
+    uint64_t gave_up_gap;
+    uint64_t quic_undecryptable;
+    uint64_t rst_sent;
+    uint64_t dropped;
+    uint64_t flow_evictions;
+} g_stats;
+
+static int g_fd[2] = { -1, -1 };
+static Flow* g_flows;
+static volatile sig_atomic_t g_running = 1;
+
+// Forward declarations
+static int open_port(const char* ifname);
+static void handle_frame(int from, uint8_t* frame, uint32_t len);
+static bool handle_ipv4(int from, uint8_t* frame, uint32_t len);
+static bool inspect_tcp(const uint8_t* frame, Flow* flow,
+                        const struct iphdr* ip, const struct tcphdr* tcp,
+                        const uint8_t* payload, uint32_t payload_len);
+static bool inspect_udp(Flow* flow, const uint8_t* payload, uint32_t payload_len);
+static void segment_and_forward(int from, uint8_t* frame, uint32_t len,
+                                const struct virtio_net_hdr* vnet);
+static void forward(int from, const uint8_t* frame, uint32_t len, const struct virtio_net_hdr* vnet);
+static void send_rst(int port, const uint8_t* eth_src, const uint8_t* eth_dst,
+                     uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport,
+                     uint32_t seq, uint32_t ack, bool with_ack);
+static Flow* flow_lookup(uint32_t cip, uint32_t sip, uint16_t cport, uint16_t sport,
+                         uint8_t proto, uint64_t now);
+static void flow_reset(Flow* flow);
+static ParseResult parse_tls(const uint8_t* data, uint32_t len, char* name);
+static ParseResult parse_client_hello(const uint8_t* hs, uint32_t len, char* name);
+static ParseResult parse_http(const uint8_t* data, uint32_t len, char* name);
+static bool blocked_name(const char* name, bool exact_case);
+static uint64_t now_ns(void);
+static void write_stats(void);
+static void on_signal(int sig);
+static void usage(const char* prog);
+
+int main(int argc, char* argv[]) {
+    int opt;
+    bool mode_given = false;
+    
+    while ((opt = getopt(argc, argv, "c:s:m:d:a:b:Sj:h")) != -1) {
+        switch (opt) {
+            case 'c': g_cfg.ifname[0] = optarg; break;
+            case 's': g_cfg.ifname[1] = optarg; break;
+            case 'm': {
+                if (!mode_given) {
+                    g_cfg.tls = TLS_OFF;
+                    mode_given = true;
+                }
+                char* modes = strdup(optarg);
+                for (char* m = strtok(modes, ","); m != NULL; m = strtok(NULL, ",")) {
+                    if (strcmp(m, "sni") == 0) g_cfg.tls = TLS_SINGLE;
+                    else if (strcmp(m, "reasm") == 0) g_cfg.tls = TLS_REASM;
+                    else if (strcmp(m, "inorder") == 0) g_cfg.tls = TLS_INORDER;
+                    else if (strcmp(m, "host") == 0) g_cfg.host = true;
+                    else if (strcmp(m, "quic") == 0) g_cfg.quic = true;
+                    else if (strcmp(m, "pass") == 0) continue;
+                    else { usage(argv[0]); return 1; }
+                }
+                free(modes);
+                break;
+            }
+            case 'd': g_cfg.depth = (uint32_t)atoi(optarg); break;
+            case 'a':
+                if (strcmp(optarg, "rst") == 0) g_cfg.action = ACTION_RST;
+                else if (strcmp(optarg, "blackhole") == 0) g_cfg.action = ACTION_BLACKHOLE;
+                else { usage(argv[0]); return 1; }
+                break;
+            case 'b':
+                if (g_cfg.blocklist_count < MAX_BLOCKLIST) {
+                    g_cfg.blocklist[g_cfg.blocklist_count++] = optarg;
+                }
+                break;
+            case 'S': g_cfg.strict_host = true; break;
+            case 'j': g_cfg.stats_path = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    
+    if (g_cfg.ifname[0] == NULL || g_cfg.ifname[1] == NULL || g_cfg.depth < 64) {
+        usage(argv[0]);
+        return 1;
+    }
+#ifndef NETRIX_HAVE_OPENSSL
+    if (g_cfg.quic) {
+        fprintf(stderr, "dpi: quic mode needs a build with OpenSSL\n");
+        return 1;
+    }
+#endif
+    
+    g_flows = calloc(FLOW_TABLE_SIZE, sizeof(Flow));
+    if (g_flows == NULL) return 1;
+    
+    for (int i = 0; i < 2; i++) {
+        g_fd[i] = open_port(g_cfg.ifname[i]);
+        if (g_fd[i] < 0) return 1;
+    }
+    
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    static const char* const tls_names[] = { "off", "sni", "reasm", "inorder" };
+    fprintf(stderr, "dpi: %s <-> %s tls=%s depth=%u host=%d quic=%d action=%s\n",
+            g_cfg.ifname[0], g_cfg.ifname[1], tls_names[g_cfg.tls], g_cfg.depth,
+            g_cfg.host, g_cfg.quic, g_cfg.action == ACTION_RST ? "rst" : "blackhole");
+    
+    static uint8_t frame[FRAME_MAX];
+    struct pollfd pfd[2] = {
+        { .fd = g_fd[0], .events = POLLIN },
+        { .fd = g_fd[1], .events = POLLIN }
+    };
+    
+    while (g_running) {
+        if (poll(pfd, 2, 500) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        for (int i = 0; i < 2; i++) {
+            if (!(pfd[i].revents & POLLIN)) continue;
+            
+            // Drain what is queued on this port before polling again
+            for (int burst = 0; burst < 64; burst++) {
+                struct sockaddr_ll from;
+                socklen_t from_len = sizeof(from);
+                ssize_t n = recvfrom(g_fd[i], frame, sizeof(frame), MSG_DONTWAIT,
+                                     (struct sockaddr*)&from, &from_len);
+                if (n < 0) break;
+                
+                // Frames we transmitted on this port come back as outgoing
+                if (from.sll_pkttype == PACKET_OUTGOING) continue;
+                if ((size_t)n < sizeof(struct virtio_net_hdr) + ETH_HLEN) continue;
+                
+                g_stats.frames[i]++;
+                handle_frame(i, frame, (uint32_t)n);
+            }
+        }
+    }
+    
+    write_stats();
+    close(g_fd[0]);
+    close(g_fd[1]);
+    return 0;
+}
+
+// ============================================================================
+// Forwarding
+// ============================================================================
+
+/**
+ * AF_PACKET port with virtio-net headers (GSO metadata), promiscuous
+ */
+static int open_port(const char* ifname) {
+    int ifindex = (int)if_nametoindex(ifname);
+    if (ifindex == 0) {
+        fprintf(stderr, "dpi: no interface %s\n", ifname);
+        return -1;
+    }
+    
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd < 0) {
+        fprintf(stderr, "dpi: socket: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    int one = 1;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VNET_HDR, &one, sizeof(one)) < 0) {
+        fprintf(stderr, "dpi: PACKET_VNET_HDR: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    
+    struct sockaddr_ll addr = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ALL),
+        .sll_ifindex = ifindex
+    };
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "dpi: bind %s: %s\n", ifname, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    
+    struct packet_mreq mreq = {
+        .mr_ifindex = ifindex,
+        .mr_type = PACKET_MR_PROMISC
+    };
+    setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+    
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+    return fd;
+}
+
+/**
+ * Frame as read from a port: virtio_net_hdr followed by the Ethernet frame
+ */
+static void handle_frame(int from, uint8_t* frame, uint32_t len) {
+    struct virtio_net_hdr vnet;
+    memcpy(&vnet, frame, sizeof(vnet));
+    uint8_t* eth = frame + sizeof(vnet);
+    uint32_t eth_len = len - sizeof(vnet);
+    uint16_t ethertype = (eth[12] << 8) | eth[13];
+    
+    if (ethertype == ETH_P_IP && eth_len >= ETH_HLEN + sizeof(struct iphdr)) {
+        struct iphdr* ip = (struct iphdr*)(eth + ETH_HLEN);
+        
+        if ((vnet.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) == VIRTIO_NET_HDR_GSO_TCPV4 &&
+            ip->protocol == IPPROTO_TCP) {
+            g_stats.gso_frames++;
+            segment_and_forward(from, eth, eth_len, &vnet);
+            return;
+        }
+        if (vnet.gso_type == VIRTIO_NET_HDR_GSO_NONE && !handle_ipv4(from, eth, eth_len)) {
+            g_stats.dropped++;
+            return;
+        }
+    }
+    
+    forward(from, eth, eth_len, &vnet);
+}
+
+/**
+ * Split a TCP GSO frame into gso_size segments, inspect and forward each
+ */
+static void segment_and_forward(int from, uint8_t* frame, uint32_t len,
+                                const struct virtio_net_hdr* vnet) {
+    struct iphdr* ip = (struct iphdr*)(frame + ETH_HLEN);
+    uint32_t ip_len = ip->ihl * 4;
+    if (ETH_HLEN + ip_len + sizeof(struct tcphdr) > len) return;
+    struct tcphdr* tcp = (struct tcphdr*)((uint8_t*)ip + ip_len);
+    uint32_t tcp_len = tcp->doff * 4;
+    uint32_t hdr_len = ETH_HLEN + ip_len + tcp_len;
+    if (hdr_len > len || vnet->gso_size == 0) return;
+    
+    const uint8_t* payload = frame + hdr_len;
+    uint32_t payload_len = len - hdr_len;
+    uint32_t mss = vnet->gso_size;
+    uint32_t seq = ntohl(tcp->seq);
+    uint16_t id = ntohs(ip->id);
+    struct virtio_net_hdr plain = { .gso_type = VIRTIO_NET_HDR_GSO_NONE };
+    static uint8_t seg[FRAME_MAX];
+    
+    for (uint32_t off = 0, i = 0; off < payload_len; off += mss, i++) {
+        uint32_t chunk = payload_len - off < mss ? payload_len - off : mss;
+        bool last = off + chunk >= payload_len;
+        
+        memcpy(seg, frame, hdr_len);
+        memcpy(seg + hdr_len, payload + off, chunk);
+        
+        struct iphdr* sip = (struct iphdr*)(seg + ETH_HLEN);
+        struct tcphdr* stcp = (struct tcphdr*)((uint8_t*)sip + ip_len);
+        sip->tot_len = htons(ip_len + tcp_len + chunk);
+        sip->id = htons(id + i);
+        sip->check = 0;
+        sip->check = checksum_ip(sip);
+        stcp->seq = htonl(seq + off);
+        if (!last) {
+            stcp->fin = 0;
+            stcp->psh = 0;
+        }
+        if (i > 0) stcp->cwr = 0;
+        stcp->check = 0;
+        stcp->check = checksum_tcp(sip, stcp, seg + hdr_len, chunk);
+        
+        g_stats.segments++;
+        if (!handle_ipv4(from, seg, hdr_len + chunk)) {
+            g_stats.dropped++;
+            continue;
+        }
+        forward(from, seg, hdr_len + chunk, &plain);
+    }
+}
+
+static void forward(int from, const uint8_t* frame, uint32_t len, const struct virtio_net_hdr* vnet) {
+    struct iovec iov[2] = {
+        { .iov_base = (void*)vnet, .iov_len = sizeof(*vnet) },
+        { .iov_base = (void*)frame, .iov_len = len }
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+    
+    while (sendmsg(g_fd[!from], &msg, 0) < 0 && errno == ENOBUFS) {
+        // Egress queue full: yield and retry rather than drop
+        struct timespec ts = { 0, 20000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// ============================================================================
+// Inspection
+// ============================================================================
+
+/**
+ * Flow lookup and verdict for one IPv4 packet
+ * @return true to forward, false to drop
+ */
+static bool handle_ipv4(int from, uint8_t* frame, uint32_t len) {
+    struct iphdr* ip = (struct iphdr*)(frame + ETH_HLEN);
+    uint32_t ip_len = ip->ihl * 4;
+    uint32_t tot_len = ntohs(ip->tot_len);
+    if (ip_len < sizeof(struct iphdr) || tot_len < ip_len || ETH_HLEN + tot_len > len) return true;
+    
+    // Fragments are not reassembled by this box
+    if (ntohs(ip->frag_off) & 0x3FFF) return true;
+    
+    uint16_t sport, dport;
+    const uint8_t* l4 = (uint8_t*)ip + ip_len;
+    uint32_t l4_len = tot_len - ip_len;
+    
+    if (ip->protocol == IPPROTO_TCP && l4_len >= sizeof(struct tcphdr)) {
+        const struct tcphdr* tcp = (const struct tcphdr*)l4;
+        sport = ntohs(tcp->source);
+        dport = ntohs(tcp->dest);
+    } else if (ip->protocol == IPPROTO_UDP && l4_len >= sizeof(struct udphdr) && g_cfg.quic) {
+        const struct udphdr* udp = (const struct udphdr*)l4;
+        sport = ntohs(udp->source);
+        dport = ntohs(udp->dest);
+    } else {
+        return true;
+    }
+    
+    // Flows are keyed client -> server; only well-known server ports are tracked
+    uint16_t server_port = from == 0 ? dport : sport;
+    if (server_port != 443 && server_port != 80) return true;
+    
+    uint64_t now = now_ns();
+    Flow* flow = from == 0
+        ? flow_lookup(ip->saddr, ip->daddr, sport, dport, ip->protocol, now)
+        : flow_lookup(ip->daddr, ip->saddr, dport, sport, ip->protocol, now);
+    if (flow == NULL) return true;
+    
+    if (ip->protocol == IPPROTO_TCP) {
+        const struct tcphdr* tcp = (const struct tcphdr*)l4;
+        uint32_t tcp_len = tcp->doff * 4;
+        if (tcp_len < sizeof(struct tcphdr) || tcp_len > l4_len) return true;
+        
+        // A fresh SYN reuses the tuple (e.g. after our own RST)
+        if (from == 0 && tcp->syn && !tcp->ack) {
+            flow_reset(flow);
+            flow->have_isn = true;
+            flow->isn = ntohl(tcp->seq) + 1;
+        }
+        
+        if (flow->state == FLOW_BLOCKED) return false;
+        if (from != 0 || flow->state != FLOW_INSPECT) return true;
+        
+        return inspect_tcp(frame, flow, ip, tcp, l4 + tcp_len, l4_len - tcp_len);
+    }
+    
+    if (flow->state == FLOW_BLOCKED) return false;
+    if (from != 0 || flow->state != FLOW_INSPECT) return true;
+    return inspect_udp(flow, l4 + sizeof(struct udphdr), l4_len - sizeof(struct udphdr));
+}
+
+/**
+ * Client -> server TCP segment of a flow still under inspection
+ * @return true to forward, false to drop
+ */
+static bool inspect_tcp(const uint8_t* frame, Flow* flow,
+                        const struct iphdr* ip, const struct tcphdr* tcp,
+                        const uint8_t* payload, uint32_t payload_len) {
+    if (payload_len == 0) return true;
+    
+    uint32_t seq = ntohl(tcp->seq);
+    if (!flow->have_isn) {
+        // Joined mid-stream: first payload seen starts the stream
+        flow->have_isn = true;
+        flow->isn = seq;
+    }
+    uint32_t offset = seq - flow->isn;
+    
+    char name[SNI_MAX];
+    ParseResult result = PARSE_NOT_HANDSHAKE;
+    bool http = ntohs(tcp->dest) == 80;
+    
+    if (http) {
+        if (!g_cfg.host) {
+            flow->state = FLOW_CLEAN;
+            return true;
+        }
+        // Requests are matched per segment: a split Host line is missed
+        result = parse_http(payload, payload_len, name);
+        if (result == PARSE_NOT_HANDSHAKE && offset < SINGLE_MAX_OFFSET) return true;
+    } else if (g_cfg.tls == TLS_OFF) {
+        flow->state = FLOW_CLEAN;
+        return true;
+    } else if (g_cfg.tls == TLS_SINGLE) {
+        // Every segment that starts a record is parsed on its own
+        result = parse_tls(payload, payload_len, name);
+        if ((result == PARSE_NOT_HANDSHAKE || result == PARSE_NEED_MORE) &&
+            offset < SINGLE_MAX_OFFSET) {
+            return true;
+        }
+    } else {
+        if (flow->buf == NULL) {
+            flow->buf = malloc(g_cfg.depth);
+            flow->have = calloc(g_cfg.depth, 1);
+            if (flow->buf == NULL || flow->have == NULL) {
+                flow->state = FLOW_CLEAN;
+                return true;
+            }
+        }
+        
+        if (g_cfg.tls == TLS_INORDER && offset != flow->contiguous) {
+            if ((int32_t)(offset - flow->contiguous) < 0) return true;  // Retransmission
+            g_stats.gave_up_gap++;
+            flow->state = FLOW_CLEAN;
+            return true;
+        }
+        
+        // Place the segment in the window, then extend the contiguous prefix
+        if (offset < g_cfg.depth) {
+            uint32_t n = payload_len < g_cfg.depth - offset ? payload_len : g_cfg.depth - offset;
+            memcpy(flow->buf + offset, payload, n);
+            memset(flow->have + offset, 1, n);
+            while (flow->contiguous < g_cfg.depth && flow->have[flow->contiguous]) {
+                flow->contiguous++;
+            }
+        }
+        
+        result = parse_tls(flow->buf, flow->contiguous, name);
+        if (result == PARSE_NEED_MORE) {
+            if (flow->contiguous < g_cfg.depth) return true;
+            g_stats.gave_up_depth++;
+        }
+    }
+    
+    if (result != PARSE_NAME || !blocked_name(name, http && g_cfg.strict_host)) {
+        g_stats.clean++;
+        flow->state = FLOW_CLEAN;
+        return true;
+    }
+    
+    if (http) g_stats.blocked_http++;
+    else g_stats.blocked_tls++;
+    flow->state = FLOW_BLOCKED;
+    
+    if (g_cfg.action == ACTION_RST) {
+        const uint8_t* eth = frame;
+        // To the server in the client's name, and to the client in the server's
+        send_rst(1, eth + 6, eth, ip->saddr, ip->daddr, tcp->source, tcp->dest,
+                 seq, 0, false);
+        send_rst(0, eth, eth + 6, ip->daddr, ip->saddr, tcp->dest, tcp->source,
+                 ntohl(tcp->ack_seq), seq + payload_len, true);
+    }
+    return false;
+}
+
+/**
+ * Client -> server datagram on a QUIC port
+ * @return true to forward, false to drop
+ */
+static bool inspect_udp(Flow* flow, const uint8_t* payload, uint32_t payload_len) {
+#ifdef NETRIX_HAVE_OPENSSL
+    uint8_t crypto[4096];
+    int crypto_len = quic_initial_crypto(payload, payload_len, crypto, sizeof(crypto));
+    if (crypto_len < 0) {
+        g_stats.quic_undecryptable++;
+        flow->state = FLOW_CLEAN;
+        return true;
+    }
+    
+    // SNI must be in this Initial's CRYPTO data from offset 0
+    char name[SNI_MAX];
+    if (parse_client_hello(crypto, (uint32_t)crypto_len, name) != PARSE_NAME || !blocked_name(name, false)) {
+        g_stats.clean++;
+        flow->state = FLOW_CLEAN;
+        return true;
+    }
+    
+    // No RST for UDP: both actions drop the flow
+    g_stats.blocked_quic++;
+    flow->state = FLOW_BLOCKED;
+    return false;
+#else
+    (void)payload;
+    (void)payload_len;
+    flow->state = FLOW_CLEAN;
+    return true;
+#endif
+}
+
+static void send_rst(int port, const uint8_t* eth_src, const uint8_t* eth_dst,
+                     uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport,
+                     uint32_t seq, uint32_t ack, bool with_ack) {
+    uint8_t frame[ETH_HLEN + sizeof(struct iphdr) + sizeof(struct tcphdr)];
+    memset(frame, 0, sizeof(frame));
+    memcpy(frame, eth_dst, 6);
+    memcpy(frame + 6, eth_src, 6);
+    frame[12] = ETH_P_IP >> 8;
+    frame[13] = ETH_P_IP & 0xFF;
+    
+    struct iphdr* ip = (struct iphdr*)(frame + ETH_HLEN);
+    ip->version = 4;
+    ip->ihl = 5;
+    ip->tot_len = htons(sizeof(struct iphdr) + sizeof(struct tcphdr));
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_TCP;
+    ip->saddr = saddr;
+    ip->daddr = daddr;
+    ip->check = checksum_ip(ip);
+    
+    struct tcphdr* tcp = (struct tcphdr*)(ip + 1);
+    tcp->source = sport;
+    tcp->dest = dport;
+    tcp->seq = htonl(seq);
+    tcp->ack_seq = htonl(ack);
+    tcp->doff = 5;
+    tcp->rst = 1;
+    tcp->ack = with_ack;
+    tcp->check = checksum_tcp(ip, tcp, NULL, 0);
+    
+    // forward() sends out of the port opposite to "from"
+    struct virtio_net_hdr plain = { .gso_type = VIRTIO_NET_HDR_GSO_NONE };
+    forward(!port, frame, sizeof(frame), &plain);
+    g_stats.rst_sent++;
+}
+
+// ============================================================================
+// Flow table
+// ============================================================================
+
+static Flow* flow_lookup(uint32_t cip, uint32_t sip, uint16_t cport, uint16_t sport,
+                         uint8_t proto, uint64_t now) {
+    uint32_t h = cip * 2654435761u ^ sip ^ ((uint32_t)cport << 16 | sport) * 40503u ^ proto;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    
+    // Slots are never freed, so a free slot ends the probe chain
+    Flow* victim = NULL;
+    for (uint32_t i = 0; i < FLOW_PROBE; i++) {
+        Flow* f = &g_flows[(h + i) & (FLOW_TABLE_SIZE - 1)];
+        
+        if (f->state == FLOW_FREE) {
+            victim = f;
+            break;
+        }
+        if (f->cip == cip && f->sip == sip && f->cport == cport && f->sport == sport &&
+            f->proto == proto) {
+            f->last_ns = now;
+            return f;
+        }
+        if (victim == NULL || f->last_ns < victim->last_ns) victim = f;
+    }
+    
+    // Otherwise reuse the least recently seen slot
+    if (victim->state != FLOW_FREE && now - victim->last_ns <= FLOW_IDLE_NS) {
+        g_stats.flow_evictions++;
+    }
+    flow_reset(victim);
+    victim->cip = cip;
+    victim->sip = sip;
+    victim->cport = cport;
+    victim->sport = sport;
+    victim->proto = proto;
+    victim->last_ns = now;
+    g_stats.flows++;
+    return victim;
+}
+
+static void flow_reset(Flow* flow) {
+    free(flow->buf);
+    free(flow->have);
+    flow->buf = NULL;
+    flow->have = NULL;
+    flow->state = FLOW_INSPECT;
+    flow->have_isn = false;
+    flow->isn = 0;
+    flow->contiguous = 0;
+}
+
+// ============================================================================
+// Parsers (independent of the code under test)
+// ============================================================================
+
+/**
+ * TLS record prefix: handshake record carrying a ClientHello
+ */
+static ParseResult parse_tls(const uint8_t* data, uint32_t len, char* name) {
+    if (len < 1) return PARSE_NEED_MORE;
+    if (data[0] != 0x16) return PARSE_NOT_HANDSHAKE;
+    if (len < 5) return PARSE_NEED_MORE;
+    if (data[1] != 0x03) return PARSE_NOT_HANDSHAKE;
+    
+    uint32_t record_len = (data[3] << 8) | data[4];
+    uint32_t avail = len - 5 < record_len ? len - 5 : record_len;
+    ParseResult result = parse_client_hello(data + 5, avail, name);
+    
+    // Truncated by the record itself, not by missing bytes
+    if (result == PARSE_NEED_MORE && avail == record_len) return PARSE_NO_NAME;
+    return result;
+}
+
+/**
+ * ClientHello handshake message (TLS or QUIC CRYPTO stream)
+ */
+static ParseResult parse_client_hello(const uint8_t* hs, uint32_t len, char* name) {
+    if (len < 1) return PARSE_NEED_MORE;
+    if (hs[0] != 0x01) return PARSE_NOT_HANDSHAKE;
+    
+    // type(1) length(3) version(2) random(32)
+    uint32_t pos = 38;
+    if (pos + 1 > len) return PARSE_NEED_MORE;
+    pos += 1 + hs[pos];                                     // Session ID
+    if (pos + 2 > len) return PARSE_NEED_MORE;
+    pos += 2 + ((hs[pos] << 8) | hs[pos + 1]);              // Cipher suites
+    if (pos + 1 > len) return PARSE_NEED_MORE;
+    pos += 1 + hs[pos];                                     // Compression methods
+    if (pos + 2 > len) return PARSE_NEED_MORE;
+    uint32_t ext_end = pos + 2 + ((hs[pos] << 8) | hs[pos + 1]);
+    pos += 2;
+    
+    while (pos < ext_end) {
+        if (pos + 4 > len) return PARSE_NEED_MORE;
+        uint16_t type = (hs[pos] << 8) | hs[pos + 1];
+        uint16_t ext_len = (hs[pos + 2] << 8) | hs[pos + 3];
+        pos += 4;
+        
+        if (type == 0x0000) {
+            // server_name_list(2) type(1) length(2) name
+            if (pos + ext_len > len) return PARSE_NEED_MORE;
+            if (ext_len < 5 || hs[pos + 2] != 0) return PARSE_NO_NAME;
+            uint32_t name_len = (hs[pos + 3] << 8) | hs[pos + 4];
+            if (name_len == 0 || name_len >= SNI_MAX || 5 + name_len > ext_len) return PARSE_NO_NAME;
+            memcpy(name, hs + pos + 5, name_len);
+            name[name_len] = '\0';
+            return PARSE_NAME;
+        }
+        pos += ext_len;
+    }
+    
+    return PARSE_NO_NAME;
+}
+
+/**
+ * HTTP request in one segment: method at the start, Host header inside
+ */
+static ParseResult parse_http(const uint8_t* data, uint32_t len, char* name) {
+    static const char* const methods[] = {
+        "GET ", "POST ", "HEAD ", "PUT ", "DELETE ", "OPTIONS ", "CONNECT ", "PATCH "
+    };
+    bool request = false;
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        size_t n = strlen(methods[i]);
+        if (len >= n && memcmp(data, methods[i], n) == 0) {
+            request = true;
+            break;
+        }
+    }
+    if (!request) return PARSE_NOT_HANDSHAKE;
+    
+    // Header lines: "\r\nHost:" (any case unless strict)
+    for (uint32_t i = 0; i + 7 < len; i++) {
+        if (data[i] != '\r' || data[i + 1] != '\n') continue;
+        const char* line = (const char*)data + i + 2;
+        bool match = g_cfg.strict_host
+            ? memcmp(line, "Host: ", 6) == 0
+            : strncasecmp(line, "host:", 5) == 0;
+        if (!match) continue;
+        
+        uint32_t pos = i + 2 + 5;
+        while (pos < len && data[pos] == ' ') pos++;
+        uint32_t n = 0;
+        while (pos + n < len && data[pos + n] != '\r' && data[pos + n] != ':' && n < SNI_MAX - 1) {
+            name[n] = (char)data[pos + n];
+            n++;
+        }
+        name[n] = '\0';
+        return n > 0 ? PARSE_NAME : PARSE_NO_NAME;
+    }
+    
+    return PARSE_NO_NAME;
+}
+
+/**
+ * Domain or any subdomain of a blocklist entry ("*" blocks everything)
+ */
+static bool blocked_name(const char* name, bool exact_case) {
+    if (g_cfg.blocklist_count == 0) return true;
+    
+    size_t len = strlen(name);
+    for (int i = 0; i < g_cfg.blocklist_count; i++) {
+        const char* entry = g_cfg.blocklist[i];
+        size_t n = strlen(entry);
+        if (strcmp(entry, "*") == 0) return true;
+        if (len < n) continue;
+        
+        int diff = exact_case ? strcmp(name + len - n, entry) : strcasecmp(name + len - n, entry);
+        if (diff == 0 && (len == n || name[len - n - 1] == '.')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Counters as one JSON object (stdout, or -j path)
+ */
+static void write_stats(void) {
+    FILE* out = g_cfg.stats_path != NULL ? fopen(g_cfg.stats_path, "w") : stdout;
+    if (out == NULL) return;
+    
+    fprintf(out,
+            "{\"frames_c2s\":%llu,\"frames_s2c\":%llu,\"gso_frames\":%llu,\"segments\":%llu,"
+            "\"flows\":%llu,\"blocked_tls\":%llu,\"blocked_http\":%llu,\"blocked_quic\":%llu,"
+            "\"clean\":%llu,\"gave_up_depth\":%llu,\"gave_up_gap\":%llu,"
+            "\"quic_undecryptable\":%llu,\"rst_sent\":%llu,\"dropped\":%llu,"
+            "\"flow_evictions\":%llu}\n",
+            (unsigned long long)g_stats.frames[0], (unsigned long long)g_stats.frames[1],
+            (unsigned long long)g_stats.gso_frames, (unsigned long long)g_stats.segments,
+            (unsigned long long)g_stats.flows, (unsigned long long)g_stats.blocked_tls,
+            (unsigned long long)g_stats.blocked_http, (unsigned long long)g_stats.blocked_quic,
+            (unsigned long long)g_stats.clean, (unsigned long long)g_stats.gave_up_depth,
+            (unsigned long long)g_stats.gave_up_gap, (unsigned long long)g_stats.quic_undecryptable,
+            (unsigned long long)g_stats.rst_sent, (unsigned long long)g_stats.dropped,
+            (unsigned long long)g_stats.flow_evictions);
+    
+    if (out != stdout) fclose(out);
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    g_running = 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s -c client_if -s server_if [-m mode[,mode...]] [-d depth]\n"
+            "          [-a rst|blackhole] [-b domain]... [-S] [-j stats.json]\n"
+            "  -m  sni | reasm | inorder (TLS), host (HTTP), quic, pass (default sni)\n"
+            "  -d  reassembly depth in bytes for reasm/inorder (default %d)\n"
+            "  -b  block this domain and its subdomains (default: everything)\n"
+            "  -S  strict Host matching: case-sensitive \"Host: \" header and value\n",
+            prog, DEFAULT_DEPTH);
+}
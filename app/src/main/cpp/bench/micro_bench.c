@@ -0,0 +1,618 @@
+/**
+ * micro_bench.c
+ *
+ * Microbenchmarks for the per-packet kernels of the bypass engine:
+ * ClientHello detection and SNI extraction on Chrome/Firefox/curl
+ * fingerprints (with and without a post-quantum key share and ECH),
+ * whitelist lookup, TCP checksum, fragment construction and the HTTP
+ * Host scan. Results are written as JSON so runs can be compared across
+ * commits and architectures (x86_64, arm64).
+ *
+ * Usage: netrix_micro_bench [-t ms] [-r repeats] [-f filter] [-L label]
+ *                           [-o out.json] [-l]
+ *
+ * Each case is calibrated so one sample takes at least -t milliseconds,
+ * then sampled -r times; median and minimum ns/op are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/utsname.h>
+#include <arpa/inet.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+
+#include "checksum.h"
+#include "dpi_bypass.h"
+#include "netrix_log.h"
+#include "client_hello.h"
+
+// TCP payload of a full-sized first segment (MSS 1460 minus timestamps)
+#define FIRST_SEGMENT_PAYLOAD 1448
+
+// Largest IPv4 packet, used for the 64 KB checksum case
+#define MAX_PACKET 65535
+
+#define MAX_CASES 64
+#define MAX_REPEATS 51
+
+// Hostname carried in every ClientHello and HTTP request
+#define BENCH_HOST "rr4---sn-4g5lznl7.googlevideo.com"
+
+// Keep a value alive without letting the compiler hoist the loop body
+#define KEEP(x) __asm__ __volatile__("" : : "r"(x) : "memory")
+
+// One benchmark case
+typedef struct BenchCase {
+    char name[48];
+    const char* group;
+    void (*run)(const struct BenchCase* bc, uint64_t iters);
+    void (*setup)(const struct BenchCase* bc);
+    const uint8_t* data;       // Input buffer
+    uint32_t len;              // Input length
+    uint32_t offset;           // Case specific (payload offset, entry count)
+    uint32_t count;            // Case specific (payload length)
+    uint32_t bytes;            // Bytes processed per op, 0 if not meaningful
+    bool valid;                // Kernel produced the expected result on the input
+} BenchCase;
+
+// Measured result
+typedef struct {
+    uint64_t iterations;
+    double median_ns;
+    double min_ns;
+} BenchResult;
+
+// ClientHello record with room for the largest fingerprint
+typedef struct {
+    uint8_t buf[CLIENT_HELLO_MAX_LEN];
+} HelloBuffer;
+
+static BenchCase g_cases[MAX_CASES];
+static int g_case_count = 0;
+
+// Forward declarations
+static void add_hello_cases(void);
+static void add_whitelist_cases(void);
+static void add_checksum_cases(void);
+static void add_fragment_cases(void);
+static void add_http_cases(void);
+static BenchCase* add_case(const char* group, const char* name,
+                           void (*run)(const BenchCase*, uint64_t));
+static uint32_t build_tcp_packet(uint8_t* packet, const uint8_t* payload, uint32_t payload_len);
+static BenchResult measure(const BenchCase* bc, uint32_t min_ms, int repeats);
+static uint64_t now_ns(void);
+static void json_string(FILE* out, const char* s);
+static void cpu_model(char* buf, size_t size);
+static void usage(const char* prog);
+
+int main(int argc, char* argv[]) {
+    uint32_t min_ms = 50;
+    int repeats = 7;
+    const char* filter = NULL;
+    const char* label = "";
+    const char* out_path = NULL;
+    bool list_only = false;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "t:r:f:L:o:lh")) != -1) {
+        switch (opt) {
+            case 't': min_ms = (uint32_t)atoi(optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'f': filter = optarg; break;
+            case 'L': label = optarg; break;
+            case 'o': out_path = optarg; break;
+            case 'l': list_only = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    
+    if (min_ms == 0 || repeats <= 0 || repeats > MAX_REPEATS) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    // Fragment construction logs at INFO; keep it off the measurement
+    netrix_log_set_level(NETRIX_LOG_LEVEL_ERROR);
+    
+    add_hello_cases();
+    add_whitelist_cases();
+    add_checksum_cases();
+    add_fragment_cases();
+    add_http_cases();
+    
+    if (list_only) {
+        for (int i = 0; i < g_case_count; i++) printf("%s\n", g_cases[i].name);
+        return 0;
+    }
+    
+    FILE* out = stdout;
+    if (out_path != NULL) {
+        out = fopen(out_path, "w");
+        if (out == NULL) {
+            perror(out_path);
+            return 1;
+        }
+    }
+    
+    struct utsname uts;
+    if (uname(&uts) != 0) memset(&uts, 0, sizeof(uts));
+    char cpu[128];
+    cpu_model(cpu, sizeof(cpu));
+    
+    char timestamp[32];
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    
+    fprintf(out, "{\n  \"schema\": 1,\n  \"label\": ");
+    json_string(out, label);
+    fprintf(out, ",\n  \"timestamp\": \"%s\",\n  \"host\": {\n    \"arch\": ", timestamp);
+    json_string(out, uts.machine);
+    fprintf(out, ",\n    \"kernel\": ");
+    json_string(out, uts.release);
+    fprintf(out, ",\n    \"cpu\": ");
+    json_string(out, cpu);
+    fprintf(out, ",\n    \"cpus\": %ld,\n    \"compiler\": ", sysconf(_SC_NPROCESSORS_ONLN));
+    json_string(out, __VERSION__);
+#ifdef __OPTIMIZE__
+    fprintf(out, ",\n    \"optimized\": true\n  },\n");
+#else
+    fprintf(out, ",\n    \"optimized\": false\n  },\n");
+#endif
+    fprintf(out, "  \"config\": { \"min_sample_ms\": %u, \"repeats\": %d },\n", min_ms, repeats);
+    fprintf(out, "  \"results\": [");
+    
+    int written = 0;
+    for (int i = 0; i < g_case_count; i++) {
+        BenchCase* bc = &g_cases[i];
+        if (filter != NULL && strstr(bc->name, filter) == NULL) continue;
+        
+        if (bc->setup != NULL) bc->setup(bc);
+        BenchResult r = measure(bc, min_ms, repeats);
+        
+        fprintf(stderr, "%-36s %12.1f ns/op%s\n", bc->name, r.median_ns,
+                bc->valid ? "" : "  (INVALID)");
+        
+        fprintf(out, "%s\n    { \"name\": \"%s\", \"group\": \"%s\", \"iterations\": %llu, "
+                "\"ns_per_op\": %.2f, \"ns_per_op_min\": %.2f, \"bytes_per_op\": %u, "
+                "\"mb_per_s\": %.1f, \"valid\": %s }",
+                written ? "," : "", bc->name, bc->group, (unsigned long long)r.iterations,
+                r.median_ns, r.min_ns, bc->bytes,
+                bc->bytes && r.median_ns > 0 ? bc->bytes * 1e3 / r.median_ns : 0.0,
+                bc->valid ? "true" : "false");
+        written++;
+    }
+    
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+    
+    dpi_whitelist_clear();
+    return 0;
+}
+
+// ============================================================================
+// Case runners
+// ============================================================================
+
+static void run_tls_detect(const BenchCase* bc, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        KEEP(dpi_is_tls_client_hello(bc->data, bc->len));
+    }
+}
+
+static void run_sni_extract(const BenchCase* bc, uint64_t iters) {
+    char sni[256];
+    for (uint64_t i = 0; i < iters; i++) {
+        KEEP(dpi_extract_sni(bc->data, bc->len, sni, sizeof(sni)));
+    }
+}
+
+static void run_whitelist(const BenchCase* bc, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        KEEP(dpi_is_whitelisted((const char*)bc->data));
+    }
+}
+
+static void run_checksum(const BenchCase* bc, uint64_t iters) {
+    const struct iphdr* ip = (const struct iphdr*)bc->data;
+    const struct tcphdr* tcp = (const struct tcphdr*)(bc->data + 20);
+    for (uint64_t i = 0; i < iters; i++) {
+        KEEP(checksum_tcp(ip, tcp, bc->data + 40, bc->len - 40));
+    }
+}
+
+static void run_fragment(const BenchCase* bc, uint64_t iters) {
+    uint32_t out_len;
+    for (uint64_t i = 0; i < iters; i++) {
+        uint8_t* frag = dpi_create_tcp_fragment(bc->data, bc->len,
+                                                bc->data + 40 + bc->offset, bc->count,
+                                                bc->offset, &out_len);
+        KEEP(frag);
+        free(frag);
+    }
+}
+
+static void run_http_host(const BenchCase* bc, uint64_t iters) {
+    uint32_t host_len;
+    for (uint64_t i = 0; i < iters; i++) {
+        KEEP(dpi_find_http_host(bc->data, bc->len, &host_len));
+    }
+}
+
+static void setup_whitelist(const BenchCase* bc) {
+    char entry[64];
+    dpi_whitelist_clear();
+    for (uint32_t i = 0; i < bc->offset; i++) {
+        snprintf(entry, sizeof(entry), "svc%06u.cdn%u.example.net", i, i % 97);
+        dpi_whitelist_add(entry);
+    }
+}
+
+// ============================================================================
+// Case construction
+// ============================================================================
+
+/**
+ * SNI extraction on the first segment of each fingerprint
+ */
+static void add_hello_cases(void) {
+    static HelloBuffer hellos[CLIENT_HELLO_PROFILE_COUNT * 4];
+    uint32_t first_len = 0;
+    int n = 0;
+    
+    for (int p = 0; p < CLIENT_HELLO_PROFILE_COUNT; p++) {
+        for (int variant = 0; variant < 4; variant++) {
+            bool pq = variant & 1;
+            bool ech = variant & 2;
+            HelloBuffer* hello = &hellos[n++];
+            uint32_t total = client_hello_build(hello->buf, (ClientHelloProfile)p, pq, ech, BENCH_HOST);
+            if (first_len == 0) first_len = total;
+            
+            char name[48];
+            snprintf(name, sizeof(name), "%s%s%s", client_hello_profile_name((ClientHelloProfile)p),
+                     pq ? "_pq" : "", ech ? "_ech" : "");
+            
+            BenchCase* bc = add_case("sni_extract", name, run_sni_extract);
+            bc->data = hello->buf;
+            bc->len = total < FIRST_SEGMENT_PAYLOAD ? total : FIRST_SEGMENT_PAYLOAD;
+            
+            char sni[256];
+            bc->valid = dpi_is_tls_client_hello(bc->data, bc->len) &&
+                        dpi_extract_sni(bc->data, bc->len, sni, sizeof(sni)) > 0 &&
+                        strcmp(sni, BENCH_HOST) == 0;
+        }
+    }
+    
+    BenchCase* bc = add_case("tls_detect", "client_hello", run_tls_detect);
+    bc->data = hellos[0].buf;
+    bc->len = first_len;
+    bc->valid = dpi_is_tls_client_hello(bc->data, bc->len);
+}
+
+/**
+ * Whitelist lookup of a host that is not listed (the common case)
+ */
+static void add_whitelist_cases(void) {
+    static const struct {
+        uint32_t entries;
+        const char* name;
+    } sizes[] = {
+        { 10, "10" },
+        { 1000, "1k" },
+        { 100000, "100k" }
+    };
+    
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        BenchCase* bc = add_case("whitelist", sizes[i].name, run_whitelist);
+        bc->setup = setup_whitelist;
+        bc->data = (const uint8_t*)BENCH_HOST;
+        bc->offset = sizes[i].entries;
+        bc->valid = true;
+    }
+}
+
+/**
+ * TCP checksum over header-only, MTU-sized and maximum-sized packets
+ */
+static void add_checksum_cases(void) {
+    static uint8_t packet[MAX_PACKET];
+    static const struct {
+        uint32_t len;
+        const char* name;
+    } sizes[] = {
+        { 40, "40B" },
+        { 1400, "1400B" },
+        { MAX_PACKET, "64KB" }
+    };
+    
+    uint32_t seed = 0x9E3779B9;
+    for (uint32_t i = 0; i < MAX_PACKET; i++) {
+        seed = seed * 1103515245 + 12345;
+        packet[i] = (uint8_t)(seed >> 24);
+    }
+    
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        BenchCase* bc = add_case("checksum_tcp", sizes[i].name, run_checksum);
+        bc->data = packet;
+        bc->len = sizes[i].len;
+        bc->bytes = sizes[i].len;
+        
+        // Compare against a byte-wise RFC 1071 sum on a header-valid copy
+        build_tcp_packet(packet, packet + 40, sizes[i].len - 40);
+        struct iphdr* ip = (struct iphdr*)packet;
+        struct tcphdr* tcp = (struct tcphdr*)(packet + 20);
+        tcp->check = 0;
+        uint16_t check = checksum_tcp(ip, tcp, packet + 40, sizes[i].len - 40);
+        
+        uint32_t sum = ntohs(ip->saddr >> 16) + ntohs(ip->saddr & 0xFFFF) +
+                       ntohs(ip->daddr >> 16) + ntohs(ip->daddr & 0xFFFF) +
+                       IPPROTO_TCP + (sizes[i].len - 20);
+        tcp->check = check;
+        for (uint32_t b = 20; b < sizes[i].len; b += 2) {
+            sum += (packet[b] << 8) | (b + 1 < sizes[i].len ? packet[b + 1] : 0);
+        }
+        while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+        bc->valid = (sum == 0xFFFF);
+    }
+    
+    // Leave headers consistent with the largest case
+    build_tcp_packet(packet, packet + 40, MAX_PACKET - 40);
+}
+
+/**
+ * Fragments of a full first segment carrying a Chrome ClientHello, split at 2 bytes
+ */
+static void add_fragment_cases(void) {
+    static HelloBuffer hello;
+    static uint8_t packet[40 + FIRST_SEGMENT_PAYLOAD];
+    
+    uint32_t total = client_hello_build(hello.buf, CLIENT_HELLO_CHROME, true, true, BENCH_HOST);
+    uint32_t payload_len = total < FIRST_SEGMENT_PAYLOAD ? total : FIRST_SEGMENT_PAYLOAD;
+    uint32_t len = build_tcp_packet(packet, hello.buf, payload_len);
+    
+    BenchCase* bc = add_case("create_tcp_fragment", "head_2B", run_fragment);
+    bc->data = packet;
+    bc->len = len;
+    bc->offset = 0;
+    bc->count = 2;
+    bc->bytes = 42;
+    
+    bc = add_case("create_tcp_fragment", "tail", run_fragment);
+    bc->data = packet;
+    bc->len = len;
+    bc->offset = 2;
+    bc->count = payload_len - 2;
+    bc->bytes = len - 2;
+    
+    for (int i = g_case_count - 2; i < g_case_count; i++) {
+        uint32_t out_len = 0;
+        uint8_t* frag = dpi_create_tcp_fragment(g_cases[i].data, g_cases[i].len,
+                                                g_cases[i].data + 40 + g_cases[i].offset,
+                                                g_cases[i].count, g_cases[i].offset, &out_len);
+        g_cases[i].valid = frag != NULL && out_len == g_cases[i].bytes &&
+                           memcmp(frag + 40, packet + 40 + g_cases[i].offset, g_cases[i].count) == 0;
+        free(frag);
+    }
+}
+
+/**
+ * Host header scan on typical requests
+ */
+static void add_http_cases(void) {
+    static const struct {
+        const char* name;
+        const char* request;
+        bool has_host;
+    } requests[] = {
+        { "curl",
+          "GET /videoplayback?id=1 HTTP/1.1\r\n"
+          "Host: " BENCH_HOST "\r\n"
+          "User-Agent: curl/8.11.0\r\n"
+          "Accept: */*\r\n\r\n", true },
+        { "browser",
+          "GET /generate_204 HTTP/1.1\r\n"
+          "Host: " BENCH_HOST "\r\n"
+          "Connection: keep-alive\r\n"
+          "Upgrade-Insecure-Requests: 1\r\n"
+          "User-Agent: Mozilla/5.0 (Linux; Android 14; Pixel 8) AppleWebKit/537.36 "
+          "(KHTML, like Gecko) Chrome/131.0.0.0 Mobile Safari/537.36\r\n"
+          "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+          "image/avif,image/webp,*/*;q=0.8\r\n"
+          "Accept-Encoding: gzip, deflate\r\n"
+          "Accept-Language: en-US,en;q=0.9\r\n\r\n", true },
+        { "host_last",
+          "POST /api/v1/upload HTTP/1.1\r\n"
+          "User-Agent: okhttp/4.12.0\r\n"
+          "Content-Type: application/json; charset=utf-8\r\n"
+          "Accept-Encoding: gzip\r\n"
+          "Cookie: session=8f2b1c7d9e0a4b5c6d7e8f9a0b1c2d3e; prefs=dark; lang=en; "
+          "tracking=0a1b2c3d4e5f60718293a4b5c6d7e8f90a1b2c3d4e5f60718293a4b5c6d7e8f9\r\n"
+          "Content-Length: 512\r\n"
+          "host: " BENCH_HOST "\r\n\r\n", true },
+        { "no_host",
+          "GET / HTTP/1.0\r\n"
+          "User-Agent: Wget/1.21.4\r\n"
+          "Accept: */*\r\n"
+          "Accept-Encoding: identity\r\n"
+          "Connection: Keep-Alive\r\n\r\n", false }
+    };
+    
+    for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+        BenchCase* bc = add_case("http_host", requests[i].name, run_http_host);
+        bc->data = (const uint8_t*)requests[i].request;
+        bc->len = (uint32_t)strlen(requests[i].request);
+        bc->bytes = bc->len;
+        
+        uint32_t host_len = 0;
+        uint32_t offset = dpi_find_http_host(bc->data, bc->len, &host_len);
+        bc->valid = requests[i].has_host ?
+            (host_len == strlen(BENCH_HOST) && memcmp(bc->data + offset, BENCH_HOST, host_len) == 0) :
+            offset == 0;
+    }
+}
+
+static BenchCase* add_case(const char* group, const char* name,
+                           void (*run)(const BenchCase*, uint64_t)) {
+    if (g_case_count >= MAX_CASES) {
+        fprintf(stderr, "too many cases\n");
+        exit(1);
+    }
+    BenchCase* bc = &g_cases[g_case_count++];
+    memset(bc, 0, sizeof(*bc));
+    snprintf(bc->name, sizeof(bc->name), "%s/%s", group, name);
+    bc->group = group;
+    bc->run = run;
+    return bc;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Write IPv4/TCP headers in front of payload (payload may already be in place)
+ * @return Packet length
+ */
+static uint32_t build_tcp_packet(uint8_t* packet, const uint8_t* payload, uint32_t payload_len) {
+    uint32_t len = 40 + payload_len;
+    if (payload != packet + 40) memmove(packet + 40, payload, payload_len);
+    
+    struct iphdr* ip = (struct iphdr*)packet;
+    memset(ip, 0, 20);
+    ip->version = 4;
+    ip->ihl = 5;
+    ip->tot_len = htons(len > 0xFFFF ? 0xFFFF : len);
+    ip->id = htons(0x1234);
+    ip->frag_off = htons(0x4000);
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_TCP;
+    ip->saddr = htonl(0x0A000002);
+    ip->daddr = htonl(0x8EFA4A2E);
+    ip->check = checksum_ip(ip);
+    
+    struct tcphdr* tcp = (struct tcphdr*)(packet + 20);
+    memset(tcp, 0, 20);
+    tcp->source = htons(51234);
+    tcp->dest = htons(443);
+    tcp->seq = htonl(0x01020304);
+    tcp->ack_seq = htonl(0x0A0B0C0D);
+    tcp->doff = 5;
+    tcp->psh = 1;
+    tcp->ack = 1;
+    tcp->window = htons(502);
+    
+    return len;
+}
+
+/**
+ * Calibrate iteration count, then take repeated samples
+ */
+static BenchResult measure(const BenchCase* bc, uint32_t min_ms, int repeats) {
+    uint64_t target_ns = (uint64_t)min_ms * 1000000ULL;
+    uint64_t iters = 1;
+    uint64_t elapsed;
+    
+    // Grow until one sample is long enough to scale from (doubles as warmup)
+    for (;;) {
+        uint64_t start = now_ns();
+        bc->run(bc, iters);
+        elapsed = now_ns() - start;
+        if (elapsed >= target_ns / 10 || iters >= (1ULL << 40)) break;
+        iters *= elapsed < target_ns / 1000 ? 10 : 2;
+    }
+    if (elapsed < target_ns) {
+        iters = iters * target_ns / (elapsed ? elapsed : 1);
+    }
+    if (iters == 0) iters = 1;
+    
+    double samples[MAX_REPEATS];
+    for (int i = 0; i < repeats; i++) {
+        uint64_t start = now_ns();
+        bc->run(bc, iters);
+        samples[i] = (double)(now_ns() - start) / iters;
+    }
+    
+    // Insertion sort; repeats is small
+    for (int i = 1; i < repeats; i++) {
+        double v = samples[i];
+        int j = i - 1;
+        while (j >= 0 && samples[j] > v) {
+            samples[j + 1] = samples[j];
+            j--;
+        }
+        samples[j + 1] = v;
+    }
+    
+    BenchResult r = {
+        .iterations = iters,
+        .median_ns = samples[repeats / 2],
+        .min_ns = samples[0]
+    };
+    return r;
+}
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Write a JSON string literal
+ */
+static void json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * CPU model from /proc/cpuinfo ("model name" on x86, "Hardware"/"CPU part" on arm64)
+ */
+static void cpu_model(char* buf, size_t size) {
+    static const char* const keys[] = { "model name", "Hardware", "CPU part" };
+    char line[256];
+    buf[0] = '\0';
+    
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL) return;
+    
+    for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]) && buf[0] == '\0'; k++) {
+        rewind(f);
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (strncmp(line, keys[k], strlen(keys[k])) != 0) continue;
+            char* value = strchr(line, ':');
+            if (value == NULL) continue;
+            value++;
+            while (*value == ' ' || *value == '\t') value++;
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(buf, size, "%s", value);
+            break;
+        }
+    }
+    fclose(f);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [-t ms] [-r repeats] [-f filter] [-L label] [-o out.json] [-l]\n"
+            "  -t ms       Minimum duration of one sample (default 50)\n"
+            "  -r repeats  Samples per case, median is reported (default 7, max %d)\n"
+            "  -f filter   Only run cases whose name contains filter\n"
+            "  -L label    Free-form label stored in the output (e.g. commit id)\n"
+            "  -o file     Write JSON to file instead of stdout\n"
+            "  -l          List case names and exit\n",
+            prog, MAX_REPEATS);
+}
@@ -0,0 +1,341 @@
+#!/bin/bash
+#
+# netns_testbed.sh
+#
+# End-to-end cost of root mode on a Linux host: a client and a server
+# network namespace joined through a middle namespace (optionally with
+# netem RTT), nfqueue_daemon running in the client namespace with its
+# NFQUEUE rules, and netrix_conn_bench driving parallel TLS, HTTP and
+# bulk connections.
+#
+# For each BypassMethod and split delay it records time to ServerHello,
+# time to first HTTP response byte, bulk upload throughput through the
+# queue and daemon CPU per connection, next to a baseline without the
+# daemon. One JSON line per run is appended to the output file and a
+# summary table is printed at the end.
+#
+# The middle namespace is a plain kernel bridge unless -D is given. With
+# -D, each listed config runs netrix_dpi_emulator as the bridge instead
+# (mode[,mode...][:depth], e.g. "sni inorder reasm:2048 sni,host,quic"),
+# blocking the SNI/Host domain given with -k, and every method is scored
+# by success rate and added latency against a pass-through run.
+#
+# Usage: sudo netns_testbed.sh [-b build_dir] [-n conns] [-P parallel]
+#            [-m "NONE SPLIT ..."] [-d "0 10 50"] [-r rtt_ms] [-B bulk_bytes]
+#            [-f chrome|firefox|curl] [-q] [-e] [-o results.jsonl]
+#            [-D "dpi configs"] [-A rst|blackhole] [-k domain]
+#
+# Requires: ip, tc (for -r), iptables; the daemon socket is driven with
+# netrixctl from the build dir (socat or python3 if it is missing). The
+# daemon uses its compiled-in runtime dir (/run by default), so no other
+# daemon may be running on the host.
+
+set -eu
+
+BUILD=build
+CONNS=200
+PARALLEL=16
+METHODS="NONE SPLIT SPLIT_REVERSE DISORDER DISORDER_REVERSE OOB IPFRAG IPFRAG_REVERSE WINDOW_CLAMP"
+DELAYS="0 10 50"
+RTT_MS=20
+BULK_BYTES=$((16 * 1024 * 1024))
+PROFILE=chrome
+HELLO_FLAGS=""
+OUT=netns_results.jsonl
+DPI=""
+DPI_ACTION=rst
+DPI_DOMAIN=example.com
+SOCK=${NETRIX_SOCK:-/run/netrix.sock}
+
+NS_CLIENT=nx-client
+NS_SERVER=nx-server
+NS_DPI=nx-dpi
+CLIENT_IP=10.99.0.1
+SERVER_IP=10.99.0.2
+
+usage() {
+    sed -n '23,26p' "$0" | sed 's/^# \{0,1\}//'
+    exit 1
+}
+
+while getopts "b:n:P:m:d:r:B:f:qeo:D:A:k:h" opt; do
+    case $opt in
+        b) BUILD=$OPTARG ;;
+        n) CONNS=$OPTARG ;;
+        P) PARALLEL=$OPTARG ;;
+        m) METHODS=$OPTARG ;;
+        d) DELAYS=$OPTARG ;;
+        r) RTT_MS=$OPTARG ;;
+        B) BULK_BYTES=$OPTARG ;;
+        f) PROFILE=$OPTARG ;;
+        q) HELLO_FLAGS="$HELLO_FLAGS -q" ;;
+        e) HELLO_FLAGS="$HELLO_FLAGS -e" ;;
+        o) OUT=$OPTARG ;;
+        D) DPI=$OPTARG ;;
+        A) DPI_ACTION=$OPTARG ;;
+        k) DPI_DOMAIN=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+
+DAEMON=$BUILD/nfqueue_daemon
+BENCH=$BUILD/netrix_conn_bench
+EMULATOR=$BUILD/netrix_dpi_emulator
+
+# Blocked connections end in RST or a timeout; keep timeouts short under DPI
+TIMEOUT_MS=5000
+CONFIGS=none
+if [ -n "$DPI" ]; then
+    TIMEOUT_MS=1000
+    CONFIGS="pass $DPI"
+fi
+
+[ "$(id -u)" -eq 0 ] || { echo "must run as root" >&2; exit 1; }
+for bin in "$DAEMON" "$BENCH" ${DPI:+"$EMULATOR"}; do
+    [ -x "$bin" ] || { echo "missing $bin (build with cmake first)" >&2; exit 1; }
+done
+for tool in ip iptables; do
+    command -v $tool >/dev/null || { echo "missing $tool" >&2; exit 1; }
+done
+if [ -S "$SOCK" ]; then
+    echo "$SOCK exists; stop the running daemon first" >&2
+    exit 1
+fi
+
+# Send one JSON command to the daemon and print the reply
+ctl() {
+    if [ -x "$BUILD/netrixctl" ]; then
+        # Error replies (exit 2) are printed like any other reply
+        "$BUILD/netrixctl" -s "$SOCK" -t 5000 "$1" || [ $? -eq 2 ]
+    elif command -v socat >/dev/null; then
+        printf '%s' "$1" | socat -t 5 - UNIX-CONNECT:"$SOCK"
+    else
+        python3 -c 'import socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.settimeout(5)
+s.connect(sys.argv[1])
+s.sendall(sys.argv[2].encode())
+print(s.recv(4096).decode())' "$SOCK" "$1"
+    fi
+}
+
+# Extract a numeric field from a JSON line
+field() {
+    printf '%s' "$1" | sed -n "s/.*\"$2\":\([0-9.-]*\).*/\1/p"
+}
+
+SERVER_PID=""
+DAEMON_PID=""
+MIDDLE_PID=""
+DAEMON_UP=0
+
+cleanup() {
+    set +e
+    [ -n "$DAEMON_PID" ] && { ctl '{"cmd":"exit"}' >/dev/null 2>&1; sleep 0.5; kill "$DAEMON_PID" 2>/dev/null; }
+    [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null
+    [ -n "$MIDDLE_PID" ] && kill "$MIDDLE_PID" 2>/dev/null
+    ip netns del $NS_CLIENT 2>/dev/null
+    ip netns del $NS_DPI 2>/dev/null
+    ip netns del $NS_SERVER 2>/dev/null
+}
+trap cleanup EXIT INT TERM
+
+# ---------------------------------------------------------------------------
+# Topology
+# ---------------------------------------------------------------------------
+
+# client nx-c <-> nx-dc [middle] nx-ds <-> nx-s server
+ip netns add $NS_CLIENT
+ip netns add $NS_DPI
+ip netns add $NS_SERVER
+ip link add nx-c type veth peer name nx-dc
+ip link add nx-s type veth peer name nx-ds
+ip link set nx-c netns $NS_CLIENT
+ip link set nx-dc netns $NS_DPI
+ip link set nx-ds netns $NS_DPI
+ip link set nx-s netns $NS_SERVER
+ip -n $NS_CLIENT addr add $CLIENT_IP/24 dev nx-c
+ip -n $NS_SERVER addr add $SERVER_IP/24 dev nx-s
+for ns in $NS_CLIENT $NS_DPI $NS_SERVER; do
+    ip -n $ns link set lo up
+done
+ip -n $NS_CLIENT link set nx-c up
+ip -n $NS_DPI link set nx-dc up
+ip -n $NS_DPI link set nx-ds up
+ip -n $NS_SERVER link set nx-s up
+
+# middle <config>: kernel bridge ("none") or a DPI emulator instance
+middle() {
+    if [ -n "$MIDDLE_PID" ]; then
+        kill "$MIDDLE_PID"
+        wait "$MIDDLE_PID" 2>/dev/null || true
+        MIDDLE_PID=""
+    fi
+    if [ "$1" = none ]; then
+        ip -n $NS_DPI link add nx-br type bridge
+        ip -n $NS_DPI link set nx-dc master nx-br
+        ip -n $NS_DPI link set nx-ds master nx-br
+        ip -n $NS_DPI link set nx-br up
+        return
+    fi
+    local modes=${1%%:*} depth=4096
+    case $1 in *:*) depth=${1#*:} ;; esac
+    ip netns exec $NS_DPI "$EMULATOR" -c nx-dc -s nx-ds -m "$modes" -d "$depth" \
+        -a "$DPI_ACTION" -b "$DPI_DOMAIN" >/dev/null 2>&1 &
+    MIDDLE_PID=$!
+    sleep 0.3
+}
+
+if [ "$RTT_MS" -gt 0 ]; then
+    half=$(awk "BEGIN { print $RTT_MS / 2 }")
+    for dev in "$NS_CLIENT nx-c" "$NS_SERVER nx-s"; do
+        set -- $dev
+        ip netns exec "$1" tc qdisc add dev "$2" root netem delay "${half}ms" limit 100000 || {
+            echo "netem unavailable (modprobe sch_netem, or pass -r 0)" >&2
+            exit 1
+        }
+    done
+fi
+
+ip netns exec $NS_SERVER "$BENCH" server -p 443 -p 80 2>/dev/null &
+SERVER_PID=$!
+sleep 0.5
+
+: > "$OUT"
+
+# run <label> <mode> [extra client args]
+run() {
+    local label=$1 mode=$2
+    shift 2
+    local before after line
+    before=$( [ $DAEMON_UP -eq 1 ] && field "$(ctl '{"cmd":"status"}')" bypassed || echo 0)
+    line=$(ip netns exec $NS_CLIENT "$BENCH" client -a $SERVER_IP -m "$mode" \
+        -n "$CONNS" -P "$PARALLEL" -f "$PROFILE" $HELLO_FLAGS -s "www.$DPI_DOMAIN" \
+        -t "$TIMEOUT_MS" -L "$label" "$@" || true)
+    after=$( [ $DAEMON_UP -eq 1 ] && field "$(ctl '{"cmd":"status"}')" bypassed || echo 0)
+    [ -n "$line" ] || { echo "$config $label $mode: client failed" >&2; return; }
+    echo "${line%\}},\"dpi\":\"$config\",\"bypassed\":$((after - before))}" >> "$OUT"
+    echo "$config $label $mode: ok=$(field "$line" ok)/$CONNS hs_p50=$(field "$line" hs_p50_us)us" >&2
+}
+
+# QUIC is only exercised when a DPI config inspects it
+QUIC=0
+case "$DPI" in *quic*) QUIC=1 ;; esac
+
+# ---------------------------------------------------------------------------
+# Runs
+# ---------------------------------------------------------------------------
+
+ip netns exec $NS_CLIENT "$DAEMON" >/dev/null 2>&1 &
+DAEMON_PID=$!
+for _ in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$SOCK" ] && break
+    sleep 0.2
+done
+
+for config in $CONFIGS; do
+    middle "$config"
+
+    run baseline tls
+    run baseline http
+    [ $QUIC -eq 1 ] && run baseline quic
+    [ "$config" = none ] && run baseline bulk -n 4 -P 4 -b "$BULK_BYTES"
+
+    ctl '{"cmd":"start"}' >/dev/null
+    DAEMON_UP=1
+    # Measure the methods themselves: no load shedding, time budget, per-host strategy or RTT-scaled delay
+    ctl '{"cmd":"settings","shed_backlog":0,"shed_latency_us":0,"packet_budget_us":0,"auto_strategy":false,"split_delay_rtt_pct":0}' >/dev/null
+
+    for method in $METHODS; do
+        delays=$DELAYS
+        # No fragment delay to sweep
+        case $method in NONE|OOB|IPFRAG*|WINDOW_CLAMP) delays=0 ;; esac
+        first=1
+        for delay in $delays; do
+            ctl "{\"cmd\":\"settings\",\"method\":\"$method\",\"split_delay\":$delay}" >/dev/null
+            run "$method/$delay" tls -C "$DAEMON_PID"
+            run "$method/$delay" http -C "$DAEMON_PID"
+            [ $QUIC -eq 1 ] && run "$method/$delay" quic -C "$DAEMON_PID"
+            if [ $first -eq 1 ] && [ "$config" = none ]; then
+                # Only the first segment is delayed; bulk cost is the queue itself
+                run "$method/$delay" bulk -n 4 -P 4 -b "$BULK_BYTES" -C "$DAEMON_PID"
+                first=0
+            fi
+        done
+    done
+
+    ctl '{"cmd":"stop"}' >/dev/null
+    DAEMON_UP=0
+done
+
+# ---------------------------------------------------------------------------
+# Summary
+# ---------------------------------------------------------------------------
+
+awk '
+function f(line, key,    m) {
+    if (match(line, "\"" key "\":[-0-9.]+")) {
+        m = substr(line, RSTART, RLENGTH)
+        sub(/.*:/, "", m)
+        return m + 0
+    }
+    return 0
+}
+function s(line, key,    m) {
+    if (match(line, "\"" key "\":\"[^\"]*\"")) {
+        m = substr(line, RSTART, RLENGTH)
+        sub(/^[^:]*:"/, "", m)
+        sub(/"$/, "", m)
+        return m
+    }
+    return ""
+}
+{
+    label = s($0, "label"); mode = s($0, "mode"); dpi = s($0, "dpi")
+    ok = f($0, "ok"); conns = f($0, "conns"); p50 = f($0, "hs_p50_us")
+    # Added latency is against the undisturbed baseline (bridge or pass-through)
+    if (label == "baseline" && (dpi == "none" || dpi == "pass")) base[mode] = p50
+    added = ok ? p50 - base[mode] : 0
+    if (mode == "bulk") {
+        printf "%-16s %-22s %-5s %6d/%-6d %10s %10s %10s %10.1f Mbit/s %10.1f %8d\n", dpi, label,
+               mode, ok, conns, "-", "-", "-", f($0, "bulk_conn_mbps"),
+               f($0, "daemon_cpu_us_per_conn"), f($0, "bypassed")
+    } else {
+        printf "%-16s %-22s %-5s %6d/%-6d %10d %10d %+10d %17s %10.1f %8d\n", dpi, label, mode,
+               ok, conns, p50, f($0, "hs_p99_us"), added, "-",
+               f($0, "daemon_cpu_us_per_conn"), f($0, "bypassed")
+    }
+
+    # Score: highest success rate, then lowest added latency
+    if (dpi == "none" || dpi == "pass" || mode == "bulk") next
+    key = dpi SUBSEP mode
+    if (!(key in seen)) { seen[key] = 1; order[++n] = key }
+    rate = conns ? ok / conns : 0
+    if (label == "baseline") { unblocked[key] = (rate == 1); next }
+    if (!(key in best_rate) || rate > best_rate[key] ||
+        (rate == best_rate[key] && rate > 0 && added < best_added[key])) {
+        best_rate[key] = rate; best_added[key] = added; best_label[key] = label
+    }
+}
+END {
+    if (n == 0) exit
+    printf "\n%-16s %-5s %-22s %8s %10s\n", "dpi", "mode", "best method/delay", "success", "added_p50"
+    for (i = 1; i <= n; i++) {
+        split(order[i], k, SUBSEP)
+        if (unblocked[order[i]]) {
+            printf "%-16s %-5s %-22s %8s %10s\n", k[1], k[2], "(not blocked)", "-", "-"
+        } else if (best_rate[order[i]] == 0) {
+            printf "%-16s %-5s %-22s %7.1f%% %10s\n", k[1], k[2], "(nothing got through)", 0, "-"
+        } else {
+            printf "%-16s %-5s %-22s %7.1f%% %+10d\n", k[1], k[2], best_label[order[i]],
+                   best_rate[order[i]] * 100, best_added[order[i]]
+        }
+    }
+}' "$OUT" | {
+    printf "%-16s %-22s %-5s %13s %10s %10s %10s %17s %10s %8s\n" \
+        "dpi" "method/delay_ms" "mode" "ok/conns" "p50_us" "p99_us" "added_p50" "bulk/conn" \
+        "cpu_us/c" "bypassed"
+    cat
+}
+
+echo "results: $OUT" >&2
@@ -0,0 +1,316 @@
+/**
+ * pcap_file.c
+ * 
+ * Minimal pcap / pcapng reader and pcap writer for the benchmark tools.
+ */
+
+#include "pcap_file.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define PCAP_MAGIC_USEC     0xA1B2C3D4
+#define PCAP_MAGIC_NSEC     0xA1B23C4D
+#define PCAPNG_SHB          0x0A0D0D0A
+#define PCAPNG_IDB          0x00000001
+#define PCAPNG_SPB          0x00000003
+#define PCAPNG_EPB          0x00000006
+#define PCAPNG_BYTE_ORDER   0x1A2B3C4D
+#define PCAPNG_MAX_IFACES   32
+
+struct PcapReader {
+    uint8_t* data;
+    size_t size;
+    size_t pos;
+    bool ng;                   // pcapng
+    bool swapped;              // File byte order differs from host
+    bool nsec;                 // pcap: nanosecond timestamps
+    uint32_t linktype;         // pcap: link type
+    uint32_t if_linktype[PCAPNG_MAX_IFACES];
+    uint32_t if_count;
+};
+
+// Forward declarations
+static uint32_t rd32(const PcapReader* r, const uint8_t* p);
+static uint16_t rd16(const PcapReader* r, const uint8_t* p);
+static bool strip_link_layer(uint32_t linktype, const uint8_t** data, uint32_t* len);
+static int next_pcap(PcapReader* r, const uint8_t** l3, uint32_t* l3_len, uint64_t* ts_ns);
+static int next_pcapng(PcapReader* r, const uint8_t** l3, uint32_t* l3_len, uint64_t* ts_ns);
+
+/**
+ * Open file
+ */
+PcapReader* pcap_reader_open(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    
+    PcapReader* r = calloc(1, sizeof(PcapReader));
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    if (r == NULL || size < 24) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        free(r);
+        fclose(f);
+        return NULL;
+    }
+    
+    r->size = (size_t)size;
+    r->data = malloc(r->size);
+    if (r->data == NULL || fread(r->data, 1, r->size, f) != r->size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        free(r->data);
+        free(r);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    
+    uint32_t magic;
+    memcpy(&magic, r->data, 4);
+    
+    if (magic == PCAPNG_SHB) {
+        uint32_t bom;
+        memcpy(&bom, r->data + 8, 4);
+        r->ng = true;
+        r->swapped = (bom != PCAPNG_BYTE_ORDER);
+        return r;
+    }
+    
+    if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC) {
+        r->swapped = false;
+    } else if (__builtin_bswap32(magic) == PCAP_MAGIC_USEC ||
+               __builtin_bswap32(magic) == PCAP_MAGIC_NSEC) {
+        r->swapped = true;
+        magic = __builtin_bswap32(magic);
+    } else {
+        fprintf(stderr, "%s: unknown capture format (magic 0x%08X)\n", path, magic);
+        pcap_reader_close(r);
+        return NULL;
+    }
+    
+    r->nsec = (magic == PCAP_MAGIC_NSEC);
+    r->linktype = rd32(r, r->data + 20) & 0xFFFF;
+    r->pos = 24;
+    return r;
+}
+
+/**
+ * Next packet
+ */
+int pcap_reader_next(PcapReader* reader, const uint8_t** l3, uint32_t* l3_len, uint64_t* ts_ns) {
+    if (reader == NULL) return -1;
+    return reader->ng ? next_pcapng(reader, l3, l3_len, ts_ns)
+                      : next_pcap(reader, l3, l3_len, ts_ns);
+}
+
+/**
+ * Close
+ */
+void pcap_reader_close(PcapReader* reader) {
+    if (reader == NULL) return;
+    free(reader->data);
+    free(reader);
+}
+
+/**
+ * Create pcap file
+ */
+FILE* pcap_writer_open(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    
+    uint32_t hdr[6] = { PCAP_MAGIC_NSEC, 0x00040002, 0, 0, 65535, PCAP_LINKTYPE_RAW };
+    fwrite(hdr, sizeof(hdr), 1, f);
+    return f;
+}
+
+/**
+ * Append packet
+ */
+void pcap_writer_write(FILE* file, const uint8_t* data, uint32_t len, uint64_t ts_ns) {
+    if (file == NULL) return;
+    
+    uint32_t rec[4] = {
+        (uint32_t)(ts_ns / 1000000000ULL),
+        (uint32_t)(ts_ns % 1000000000ULL),
+        len,
+        len
+    };
+    fwrite(rec, sizeof(rec), 1, file);
+    fwrite(data, 1, len, file);
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+static uint32_t rd32(const PcapReader* r, const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return r->swapped ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t rd16(const PcapReader* r, const uint8_t* p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return r->swapped ? __builtin_bswap16(v) : v;
+}
+
+/**
+ * Advance data/len past the link layer header
+ * @return false if the packet is not IP or the link type is unsupported
+ */
+static bool strip_link_layer(uint32_t linktype, const uint8_t** data, uint32_t* len) {
+    const uint8_t* p = *data;
+    uint32_t n = *len;
+    uint16_t ethertype;
+    
+    switch (linktype) {
+        case PCAP_LINKTYPE_RAW:
+        case PCAP_LINKTYPE_IPV4:
+        case PCAP_LINKTYPE_IPV6:
+        case 12:  // LINKTYPE_RAW on some BSDs
+        case 14:
+            return n > 0;
+        
+        case PCAP_LINKTYPE_NULL:
+        case PCAP_LINKTYPE_LOOP:
+            if (n < 4) return false;
+            *data = p + 4;
+            *len = n - 4;
+            return true;
+        
+        case PCAP_LINKTYPE_ETHERNET: {
+            if (n < 14) return false;
+            uint32_t off = 12;
+            ethertype = (p[off] << 8) | p[off + 1];
+            // Skip VLAN / QinQ tags
+            while ((ethertype == 0x8100 || ethertype == 0x88A8) && off + 6 <= n) {
+                off += 4;
+                ethertype = (p[off] << 8) | p[off + 1];
+            }
+            off += 2;
+            if (off > n || (ethertype != 0x0800 && ethertype != 0x86DD)) return false;
+            *data = p + off;
+            *len = n - off;
+            return true;
+        }
+        
+        case PCAP_LINKTYPE_LINUX_SLL:
+            if (n < 16) return false;
+            ethertype = (p[14] << 8) | p[15];
+            if (ethertype != 0x0800 && ethertype != 0x86DD) return false;
+            *data = p + 16;
+            *len = n - 16;
+            return true;
+        
+        case PCAP_LINKTYPE_LINUX_SLL2:
+            if (n < 20) return false;
+            ethertype = (p[0] << 8) | p[1];
+            if (ethertype != 0x0800 && ethertype != 0x86DD) return false;
+            *data = p + 20;
+            *len = n - 20;
+            return true;
+        
+        default:
+            return false;
+    }
+}
+
+/**
+ * Next record of a classic pcap file
+ */
+static int next_pcap(PcapReader* r, const uint8_t** l3, uint32_t* l3_len, uint64_t* ts_ns) {
+    while (r->pos + 16 <= r->size) {
+        const uint8_t* rec = r->data + r->pos;
+        uint32_t sec = rd32(r, rec);
+        uint32_t frac = rd32(r, rec + 4);
+        uint32_t caplen = rd32(r, rec + 8);
+        
+        if (r->pos + 16 + caplen > r->size) return -1;
+        r->pos += 16 + caplen;
+        
+        const uint8_t* data = rec + 16;
+        uint32_t len = caplen;
+        if (!strip_link_layer(r->linktype, &data, &len)) continue;
+        
+        *l3 = data;
+        *l3_len = len;
+        if (ts_ns != NULL) {
+            *ts_ns = (uint64_t)sec * 1000000000ULL + (r->nsec ? frac : (uint64_t)frac * 1000);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Next packet block of a pcapng file
+ */
+static int next_pcapng(PcapReader* r, const uint8_t** l3, uint32_t* l3_len, uint64_t* ts_ns) {
+    while (r->pos + 12 <= r->size) {
+        const uint8_t* blk = r->data + r->pos;
+        uint32_t type;
+        memcpy(&type, blk, 4);
+        
+        if (type == PCAPNG_SHB) {
+            // New section: byte order and interfaces may change
+            uint32_t bom;
+            memcpy(&bom, blk + 8, 4);
+            r->swapped = (bom != PCAPNG_BYTE_ORDER);
+            r->if_count = 0;
+        } else {
+            type = rd32(r, blk);
+        }
+        
+        uint32_t blk_len = rd32(r, blk + 4);
+        if (blk_len < 12 || (blk_len & 3) != 0 || r->pos + blk_len > r->size) return -1;
+        r->pos += blk_len;
+        
+        const uint8_t* data = NULL;
+        uint32_t len = 0;
+        uint32_t linktype = 0;
+        uint64_t ts = 0;
+        
+        if (type == PCAPNG_IDB && blk_len >= 20) {
+            if (r->if_count < PCAPNG_MAX_IFACES) {
+                r->if_linktype[r->if_count++] = rd16(r, blk + 8);
+            }
+            continue;
+        } else if (type == PCAPNG_EPB && blk_len >= 32) {
+            uint32_t iface = rd32(r, blk + 8);
+            if (iface >= r->if_count) continue;
+            linktype = r->if_linktype[iface];
+            // Assume the default microsecond resolution (if_tsresol absent)
+            ts = (((uint64_t)rd32(r, blk + 12) << 32) | rd32(r, blk + 16)) * 1000;
+            len = rd32(r, blk + 20);
+            if (28 + len > blk_len - 4) continue;
+            data = blk + 28;
+        } else if (type == PCAPNG_SPB && blk_len >= 16) {
+            if (r->if_count == 0) continue;
+            linktype = r->if_linktype[0];
+            len = rd32(r, blk + 8);
+            if (len > blk_len - 16) len = blk_len - 16;
+            data = blk + 12;
+        } else {
+            continue;
+        }
+        
+        if (!strip_link_layer(linktype, &data, &len)) continue;
+        
+        *l3 = data;
+        *l3_len = len;
+        if (ts_ns != NULL) *ts_ns = ts;
+        return 1;
+    }
+    return 0;
+}
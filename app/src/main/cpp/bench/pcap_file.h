@@ -0,0 +1,73 @@
+/**
+ * pcap_file.h
+ * 
+ * Minimal pcap / pcapng reader and pcap writer for the benchmark tools.
+ * The reader strips the link layer and returns L3 packets.
+ */
+
+#ifndef PCAP_FILE_H
+#define PCAP_FILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Link types
+#define PCAP_LINKTYPE_NULL      0
+#define PCAP_LINKTYPE_ETHERNET  1
+#define PCAP_LINKTYPE_RAW       101
+#define PCAP_LINKTYPE_LOOP      108
+#define PCAP_LINKTYPE_LINUX_SLL 113
+#define PCAP_LINKTYPE_IPV4      228
+#define PCAP_LINKTYPE_IPV6      229
+#define PCAP_LINKTYPE_LINUX_SLL2 276
+
+typedef struct PcapReader PcapReader;
+
+/**
+ * Open a pcap or pcapng file (loaded into memory)
+ * @param path File path
+ * @return Reader or NULL on error (message on stderr)
+ */
+PcapReader* pcap_reader_open(const char* path);
+
+/**
+ * Read next packet
+ * @param reader Reader
+ * @param l3 Output: pointer to the network layer header (valid until close)
+ * @param l3_len Output: captured network layer length
+ * @param ts_ns Output: timestamp in nanoseconds (may be NULL)
+ * @return 1 packet read, 0 end of file, -1 malformed file
+ *         (packets with unsupported link layers are skipped)
+ */
+int pcap_reader_next(PcapReader* reader, const uint8_t** l3, uint32_t* l3_len, uint64_t* ts_ns);
+
+/**
+ * Close reader and free memory
+ */
+void pcap_reader_close(PcapReader* reader);
+
+/**
+ * Create a pcap file with LINKTYPE_RAW (packets start at the IP header)
+ * @param path File path
+ * @return File or NULL on error
+ */
+FILE* pcap_writer_open(const char* path);
+
+/**
+ * Append one packet
+ * @param file File from pcap_writer_open
+ * @param data Packet
+ * @param len Packet length
+ * @param ts_ns Timestamp in nanoseconds
+ */
+void pcap_writer_write(FILE* file, const uint8_t* data, uint32_t len, uint64_t ts_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCAP_FILE_H
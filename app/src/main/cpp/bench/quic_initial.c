@@ -0,0 +1,311 @@
+/**
+ * quic_initial.c
+ *
+ * QUIC v1 Initial packet protection (RFC 9001 section 5) with OpenSSL:
+ * HKDF-SHA256 initial secrets, AES-128-GCM payload protection and
+ * AES-128-ECB header protection.
+ */
+
+#include "quic_initial.h"
+
+#include <string.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+// RFC 9001 5.2
+static const uint8_t INITIAL_SALT[20] = {
+    0x38, 0x76, 0x2c, 0xf7, 0xf5, 0x59, 0x34, 0xb3, 0x4d, 0x17,
+    0x9a, 0xe6, 0xa4, 0xc8, 0x0c, 0xad, 0xcc, 0xbb, 0x7f, 0x0a
+};
+
+#define QUIC_VERSION_1 0x00000001
+#define AEAD_TAG_LEN 16
+#define PN_LEN 4
+
+// Client Initial keys
+typedef struct {
+    uint8_t key[16];
+    uint8_t iv[12];
+    uint8_t hp[16];
+} InitialKeys;
+
+// Forward declarations
+static void derive_client_keys(const uint8_t* dcid, uint8_t dcid_len, InitialKeys* keys);
+static void hkdf_expand_label(const uint8_t* secret, const char* label, uint8_t* out, uint8_t out_len);
+static int header_mask(const uint8_t* hp, const uint8_t* sample, uint8_t* mask);
+static int aead(int encrypt, const InitialKeys* keys, uint32_t pn,
+                const uint8_t* aad, uint32_t aad_len,
+                const uint8_t* in, uint32_t in_len, uint8_t* out);
+static uint32_t put_varint(uint8_t* p, uint64_t v);
+static int get_varint(const uint8_t* p, uint32_t len, uint32_t* pos, uint64_t* v);
+
+/**
+ * Build protected client Initial
+ */
+int quic_initial_build(uint8_t* out, uint32_t out_size,
+                       const uint8_t* dcid, uint8_t dcid_len,
+                       const uint8_t* scid, uint8_t scid_len, uint32_t pn,
+                       const uint8_t* crypto, uint32_t crypto_len, uint32_t crypto_offset) {
+    if (dcid_len > 20 || scid_len > 20 || crypto_len > QUIC_INITIAL_CRYPTO_MAX) return -1;
+    
+    uint8_t header[64];
+    uint32_t h = 0;
+    header[h++] = 0xC0 | (PN_LEN - 1);       // Long header, fixed bit, Initial
+    header[h++] = (QUIC_VERSION_1 >> 24) & 0xFF;
+    header[h++] = (QUIC_VERSION_1 >> 16) & 0xFF;
+    header[h++] = (QUIC_VERSION_1 >> 8) & 0xFF;
+    header[h++] = QUIC_VERSION_1 & 0xFF;
+    header[h++] = dcid_len;
+    memcpy(header + h, dcid, dcid_len);
+    h += dcid_len;
+    header[h++] = scid_len;
+    memcpy(header + h, scid, scid_len);
+    h += scid_len;
+    header[h++] = 0;                         // Token length
+    
+    // CRYPTO frame, then PADDING up to the minimum datagram size
+    uint8_t plain[QUIC_MIN_INITIAL_SIZE];
+    uint32_t p = 0;
+    plain[p++] = 0x06;
+    p += put_varint(plain + p, crypto_offset);
+    p += put_varint(plain + p, crypto_len);
+    memcpy(plain + p, crypto, crypto_len);
+    p += crypto_len;
+    
+    uint32_t fixed = h + 2 + PN_LEN + AEAD_TAG_LEN;
+    if (p + fixed < QUIC_MIN_INITIAL_SIZE) {
+        memset(plain + p, 0, QUIC_MIN_INITIAL_SIZE - fixed - p);
+        p = QUIC_MIN_INITIAL_SIZE - fixed;
+    }
+    
+    uint32_t length = PN_LEN + p + AEAD_TAG_LEN;
+    header[h++] = 0x40 | (length >> 8);     // 2-byte varint
+    header[h++] = length & 0xFF;
+    uint32_t pn_offset = h;
+    header[h++] = (pn >> 24) & 0xFF;
+    header[h++] = (pn >> 16) & 0xFF;
+    header[h++] = (pn >> 8) & 0xFF;
+    header[h++] = pn & 0xFF;
+    
+    if (h + p + AEAD_TAG_LEN > out_size) return -1;
+    
+    InitialKeys keys;
+    derive_client_keys(dcid, dcid_len, &keys);
+    
+    memcpy(out, header, h);
+    if (aead(1, &keys, pn, header, h, plain, p, out + h) < 0) return -1;
+    
+    // Header protection: sample starts 4 bytes after the packet number
+    uint8_t mask[16];
+    if (header_mask(keys.hp, out + pn_offset + 4, mask) < 0) return -1;
+    out[0] ^= mask[0] & 0x0F;
+    for (int i = 0; i < PN_LEN; i++) out[pn_offset + i] ^= mask[1 + i];
+    
+    return (int)(h + p + AEAD_TAG_LEN);
+}
+
+/**
+ * Decrypt client Initial, collect CRYPTO data
+ */
+int quic_initial_crypto(const uint8_t* packet, uint32_t len, uint8_t* out, uint32_t out_size) {
+    if (len < 7 || (packet[0] & 0xC0) != 0xC0 || ((packet[0] >> 4) & 0x03) != 0) return -1;
+    
+    uint32_t version = ((uint32_t)packet[1] << 24) | (packet[2] << 16) | (packet[3] << 8) | packet[4];
+    if (version != QUIC_VERSION_1) return -1;
+    
+    uint32_t pos = 5;
+    uint8_t dcid_len = packet[pos++];
+    if (dcid_len > 20 || pos + dcid_len + 1 > len) return -1;
+    const uint8_t* dcid = packet + pos;
+    pos += dcid_len;
+    uint8_t scid_len = packet[pos++];
+    if (scid_len > 20 || pos + scid_len > len) return -1;
+    pos += scid_len;
+    
+    uint64_t token_len, length;
+    if (get_varint(packet, len, &pos, &token_len) < 0 || pos + token_len > len) return -1;
+    pos += (uint32_t)token_len;
+    if (get_varint(packet, len, &pos, &length) < 0 || pos + length > len) return -1;
+    
+    uint32_t pn_offset = pos;
+    if (length < PN_LEN + AEAD_TAG_LEN || pn_offset + 4 + 16 > len) return -1;
+    
+    InitialKeys keys;
+    derive_client_keys(dcid, dcid_len, &keys);
+    
+    uint8_t mask[16];
+    if (header_mask(keys.hp, packet + pn_offset + 4, mask) < 0) return -1;
+    
+    // Unprotected header copy (used as AAD)
+    uint8_t header[128];
+    uint8_t first = packet[0] ^ (mask[0] & 0x0F);
+    uint32_t pn_len = (first & 0x03) + 1;
+    uint32_t header_len = pn_offset + pn_len;
+    if (header_len > sizeof(header)) return -1;
+    memcpy(header, packet, header_len);
+    header[0] = first;
+    
+    uint32_t pn = 0;
+    for (uint32_t i = 0; i < pn_len; i++) {
+        header[pn_offset + i] ^= mask[1 + i];
+        pn = (pn << 8) | header[pn_offset + i];
+    }
+    
+    uint32_t cipher_len = (uint32_t)length - pn_len;
+    if (cipher_len < AEAD_TAG_LEN || cipher_len > 4096) return -1;
+    
+    uint8_t plain[4096];
+    if (aead(0, &keys, pn, header, header_len, packet + header_len, cipher_len, plain) < 0) return -1;
+    uint32_t plain_len = cipher_len - AEAD_TAG_LEN;
+    
+    // Frames: PADDING, PING, CRYPTO; anything else ends the walk
+    uint32_t contiguous = 0;
+    pos = 0;
+    while (pos < plain_len) {
+        uint8_t type = plain[pos];
+        if (type == 0x00 || type == 0x01) {
+            pos++;
+            continue;
+        }
+        if (type != 0x06) break;
+        pos++;
+        
+        uint64_t offset, data_len;
+        if (get_varint(plain, plain_len, &pos, &offset) < 0 ||
+            get_varint(plain, plain_len, &pos, &data_len) < 0 ||
+            pos + data_len > plain_len) {
+            break;
+        }
+        if (offset + data_len <= out_size) {
+            memcpy(out + offset, plain + pos, (size_t)data_len);
+            if (offset <= contiguous && offset + data_len > contiguous) {
+                contiguous = (uint32_t)(offset + data_len);
+            }
+        }
+        pos += (uint32_t)data_len;
+    }
+    
+    return (int)contiguous;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * initial_secret = HKDF-Extract(salt, dcid); client keys from "client in"
+ */
+static void derive_client_keys(const uint8_t* dcid, uint8_t dcid_len, InitialKeys* keys) {
+    uint8_t initial_secret[32], client_secret[32];
+    unsigned int secret_len = sizeof(initial_secret);
+    
+    HMAC(EVP_sha256(), INITIAL_SALT, sizeof(INITIAL_SALT), dcid, dcid_len,
+         initial_secret, &secret_len);
+    hkdf_expand_label(initial_secret, "client in", client_secret, 32);
+    hkdf_expand_label(client_secret, "quic key", keys->key, 16);
+    hkdf_expand_label(client_secret, "quic iv", keys->iv, 12);
+    hkdf_expand_label(client_secret, "quic hp", keys->hp, 16);
+}
+
+/**
+ * TLS 1.3 HKDF-Expand-Label with empty context (single block, out_len <= 32)
+ */
+static void hkdf_expand_label(const uint8_t* secret, const char* label, uint8_t* out, uint8_t out_len) {
+    uint8_t info[64];
+    uint32_t n = 0;
+    size_t label_len = strlen(label);
+    
+    info[n++] = 0;
+    info[n++] = out_len;
+    info[n++] = (uint8_t)(6 + label_len);
+    memcpy(info + n, "tls13 ", 6);
+    n += 6;
+    memcpy(info + n, label, label_len);
+    n += (uint32_t)label_len;
+    info[n++] = 0;                           // Context length
+    info[n++] = 0x01;                        // HKDF-Expand block counter
+    
+    uint8_t block[32];
+    unsigned int block_len = sizeof(block);
+    HMAC(EVP_sha256(), secret, 32, info, n, block, &block_len);
+    memcpy(out, block, out_len);
+}
+
+static int header_mask(const uint8_t* hp, const uint8_t* sample, uint8_t* mask) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int out_len = 0, ok = 0;
+    
+    if (ctx != NULL &&
+        EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, hp, NULL) == 1 &&
+        EVP_CIPHER_CTX_set_padding(ctx, 0) == 1 &&
+        EVP_EncryptUpdate(ctx, mask, &out_len, sample, 16) == 1 && out_len == 16) {
+        ok = 1;
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+/**
+ * AES-128-GCM with nonce = iv XOR packet number; tag follows the ciphertext
+ */
+static int aead(int encrypt, const InitialKeys* keys, uint32_t pn,
+                const uint8_t* aad, uint32_t aad_len,
+                const uint8_t* in, uint32_t in_len, uint8_t* out) {
+    uint8_t nonce[12];
+    memcpy(nonce, keys->iv, sizeof(nonce));
+    nonce[8] ^= (pn >> 24) & 0xFF;
+    nonce[9] ^= (pn >> 16) & 0xFF;
+    nonce[10] ^= (pn >> 8) & 0xFF;
+    nonce[11] ^= pn & 0xFF;
+    
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx == NULL) return -1;
+    
+    int len = 0, ok = 0;
+    uint32_t data_len = encrypt ? in_len : in_len - AEAD_TAG_LEN;
+    
+    if (EVP_CipherInit_ex(ctx, EVP_aes_128_gcm(), NULL, keys->key, nonce, encrypt) == 1 &&
+        EVP_CipherUpdate(ctx, NULL, &len, aad, (int)aad_len) == 1 &&
+        EVP_CipherUpdate(ctx, out, &len, in, (int)data_len) == 1) {
+        if (encrypt) {
+            ok = EVP_CipherFinal_ex(ctx, out + len, &len) == 1 &&
+                 EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, AEAD_TAG_LEN, out + data_len) == 1;
+        } else {
+            ok = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, AEAD_TAG_LEN,
+                                     (void*)(in + data_len)) == 1 &&
+                 EVP_CipherFinal_ex(ctx, out + len, &len) == 1;
+        }
+    }
+    
+    EVP_CIPHER_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+static uint32_t put_varint(uint8_t* p, uint64_t v) {
+    if (v < 0x40) {
+        p[0] = (uint8_t)v;
+        return 1;
+    }
+    if (v < 0x4000) {
+        p[0] = 0x40 | (uint8_t)(v >> 8);
+        p[1] = v & 0xFF;
+        return 2;
+    }
+    p[0] = 0x80 | (uint8_t)(v >> 24);
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+    return 4;
+}
+
+static int get_varint(const uint8_t* p, uint32_t len, uint32_t* pos, uint64_t* v) {
+    if (*pos >= len) return -1;
+    uint32_t n = 1u << (p[*pos] >> 6);
+    if (*pos + n > len) return -1;
+    
+    uint64_t value = p[*pos] & 0x3F;
+    for (uint32_t i = 1; i < n; i++) value = (value << 8) | p[*pos + i];
+    *pos += n;
+    *v = value;
+    return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * quic_initial.h
+ *
+ * QUIC v1 client Initial packets (RFC 9001 initial keys): build a
+ * protected Initial carrying CRYPTO data, and recover the CRYPTO data
+ * from one. Requires OpenSSL libcrypto (NETRIX_HAVE_OPENSSL).
+ */
+
+#ifndef QUIC_INITIAL_H
+#define QUIC_INITIAL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Client Initial datagrams are padded to at least this size (RFC 9000 14.1)
+#define QUIC_MIN_INITIAL_SIZE 1200
+
+// CRYPTO bytes that fit one padded Initial with 8-byte connection IDs
+#define QUIC_INITIAL_CRYPTO_MAX 1100
+
+/**
+ * Build a protected client Initial packet
+ * @param out Output buffer (at least QUIC_MIN_INITIAL_SIZE + 64 bytes)
+ * @param out_size Output buffer size
+ * @param dcid Destination connection ID (keys are derived from it)
+ * @param dcid_len Destination connection ID length (max 20)
+ * @param scid Source connection ID
+ * @param scid_len Source connection ID length (max 20)
+ * @param pn Packet number
+ * @param crypto CRYPTO frame data (TLS handshake bytes)
+ * @param crypto_len CRYPTO data length (max QUIC_INITIAL_CRYPTO_MAX)
+ * @param crypto_offset Offset of this data in the CRYPTO stream
+ * @return Datagram length, -1 on error
+ */
+int quic_initial_build(uint8_t* out, uint32_t out_size,
+                       const uint8_t* dcid, uint8_t dcid_len,
+                       const uint8_t* scid, uint8_t scid_len, uint32_t pn,
+                       const uint8_t* crypto, uint32_t crypto_len, uint32_t crypto_offset);
+
+/**
+ * Decrypt a client Initial and collect its CRYPTO frames
+ * @param packet UDP payload
+ * @param len Payload length
+ * @param out Output: CRYPTO stream bytes placed at their stream offsets
+ * @param out_size Output buffer size
+ * @return Number of contiguous CRYPTO bytes from stream offset 0,
+ *         0 if none, -1 if not a decryptable v1 client Initial
+ */
+int quic_initial_crypto(const uint8_t* packet, uint32_t len, uint8_t* out, uint32_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QUIC_INITIAL_H
@@ -0,0 +1,377 @@
+/**
+ * replay_bench.c
+ *
+ * Replays a pcap/pcapng capture through dpi_bypass_process_packet() with
+ * the raw socket replaced by a counting (or capturing) sink.
+ * Reports packets/sec, ns/packet and allocations/packet per decision
+ * reason, and optionally the injected fragment sequence.
+ *
+ * Usage: netrix_replay_bench [-n loops] [-s seed] [-m method] [-p split]
+ *                            [-w out.pcap] [-v] capture.pcap[ng]
+ *
+ * Every loop after the first shifts TCP/UDP source ports by an offset
+ * derived from the seed, so repeated loops look like new flows while
+ * results stay identical across runs with the same seed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "dpi_bypass.h"
+#include "netrix_log.h"
+#include "pcap_file.h"
+
+// A captured IPv4 packet
+typedef struct {
+    uint8_t* data;
+    uint32_t len;
+} ReplayPacket;
+
+// Per decision reason accumulators
+typedef struct {
+    uint64_t packets;
+    uint64_t ns;
+    uint64_t allocs;
+} ReasonStats;
+
+// Allocation counting (via -Wl,--wrap=malloc,... see CMakeLists.txt)
+static volatile bool g_count_allocs = false;
+static uint64_t g_allocs = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    if (g_count_allocs) g_allocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    if (g_count_allocs) g_allocs++;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    if (g_count_allocs) g_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+// Injection sink state
+static struct {
+    uint64_t fragments;
+    uint64_t bytes;
+    FILE* capture;             // Write injected packets here (first loop)
+    bool verbose;              // Print fragment sequence (first loop)
+    uint32_t orig_seq;         // Sequence number of the packet being processed
+    uint64_t ts_ns;            // Capture timestamp for written packets
+} g_sink;
+
+// Forward declarations
+static int counting_sink(const uint8_t* packet, uint32_t len, uint32_t dst_ip, void* user_data);
+static uint64_t now_ns(void);
+static uint32_t xorshift32(uint32_t* state);
+static void shift_ports(uint8_t* packet, uint32_t len, uint16_t delta);
+static void fill_packet(NfqueuePacket* pkt, uint8_t* data, uint32_t len, uint32_t id);
+static BypassMethod parse_method(const char* name);
+static void usage(const char* prog);
+
+int main(int argc, char* argv[]) {
+    int loops = 10;
+    uint32_t seed = 1;
+    BypassMethod method = BYPASS_SPLIT;
+    int split_pos = 2;
+    const char* capture_path = NULL;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:m:p:w:vh")) != -1) {
+        switch (opt) {
+            case 'n': loops = atoi(optarg); break;
+            case 's': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'm': method = parse_method(optarg); break;
+            case 'p': split_pos = atoi(optarg); break;
+            case 'w': capture_path = optarg; break;
+            case 'v': g_sink.verbose = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    
+    if (optind >= argc || loops <= 0 || (int)method < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    // Load IPv4 packets
+    PcapReader* reader = pcap_reader_open(argv[optind]);
+    if (reader == NULL) return 1;
+    
+    ReplayPacket* packets = NULL;
+    uint32_t count = 0, capacity = 0, skipped = 0;
+    const uint8_t* l3;
+    uint32_t l3_len;
+    int rc;
+    
+    while ((rc = pcap_reader_next(reader, &l3, &l3_len, NULL)) == 1) {
+        if (l3_len < 20 || (l3[0] >> 4) != 4) {
+            skipped++;
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            packets = realloc(packets, capacity * sizeof(ReplayPacket));
+        }
+        packets[count].data = malloc(l3_len);
+        memcpy(packets[count].data, l3, l3_len);
+        packets[count].len = l3_len;
+        count++;
+    }
+    pcap_reader_close(reader);
+    
+    if (rc < 0) fprintf(stderr, "warning: capture truncated or malformed\n");
+    if (count == 0) {
+        fprintf(stderr, "no IPv4 packets in %s\n", argv[optind]);
+        return 1;
+    }
+    
+    // Quiet core logging; delays off so only CPU time is measured
+    netrix_log_set_level(NETRIX_LOG_LEVEL_ERROR);
+    
+    DpiBypassSettings settings = {
+        .method = method,
+        .first_packet_size = (uint16_t)split_pos,
+        .split_delay_ms = 0,
+        .split_count = 4,
+        .desync_https = true,
+        .desync_http = true,
+        .mix_host_case = true,
+        .block_quic = true,
+        .shed_backlog = 0,
+        .shed_latency_us = 0,
+        .packet_budget_us = 0
+    };
+    dpi_bypass_init(&settings);
+    dpi_set_inject_sink(counting_sink, NULL);
+    
+    if (capture_path != NULL) {
+        g_sink.capture = pcap_writer_open(capture_path);
+        if (g_sink.capture == NULL) return 1;
+    }
+    
+    // Calibrate timer overhead
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < 1000; i++) now_ns();
+    uint64_t timer_ns = (now_ns() - t0) / 1001;
+    
+    ReasonStats reasons[DPI_REASON_COUNT];
+    memset(reasons, 0, sizeof(reasons));
+    
+    uint8_t* scratch = malloc(65536);
+    uint32_t rng = seed ? seed : 1;
+    uint64_t total_ns = 0;
+    uint64_t total_allocs = 0;
+    uint64_t wall_start = now_ns();
+    uint32_t id = 0;
+    
+    for (int loop = 0; loop < loops; loop++) {
+        uint16_t delta = loop == 0 ? 0 : (uint16_t)xorshift32(&rng);
+        bool first = (loop == 0);
+        
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t len = packets[i].len > 65536 ? 65536 : packets[i].len;
+            memcpy(scratch, packets[i].data, len);
+            shift_ports(scratch, len, delta);
+            
+            NfqueuePacket pkt;
+            fill_packet(&pkt, scratch, len, ++id);
+            
+            uint32_t ihl = (scratch[0] & 0x0F) * 4;
+            g_sink.orig_seq = (pkt.protocol == IPPROTO_TCP && len >= ihl + 8) ?
+                ntohl(*(uint32_t*)(scratch + ihl + 4)) : 0;
+            g_sink.ts_ns = (uint64_t)id * 1000;
+            
+            FILE* capture = g_sink.capture;
+            bool verbose = g_sink.verbose;
+            if (!first) {
+                g_sink.capture = NULL;
+                g_sink.verbose = false;
+            }
+            
+            uint64_t allocs_before = g_allocs;
+            g_count_allocs = true;
+            uint64_t start = now_ns();
+            dpi_bypass_process_packet(&pkt, NULL);
+            uint64_t elapsed = now_ns() - start;
+            g_count_allocs = false;
+            
+            g_sink.capture = capture;
+            g_sink.verbose = verbose;
+            
+            elapsed = elapsed > timer_ns ? elapsed - timer_ns : 0;
+            DpiDecisionReason reason = dpi_bypass_last_reason();
+            uint64_t allocs = g_allocs - allocs_before;
+            
+            reasons[reason].packets++;
+            reasons[reason].ns += elapsed;
+            reasons[reason].allocs += allocs;
+            total_ns += elapsed;
+            total_allocs += allocs;
+            
+            if (verbose && first && reason == DPI_REASON_BYPASSED) {
+                printf("  ^ packet %u (%u bytes, seq %u)\n", i, len, g_sink.orig_seq);
+            }
+        }
+    }
+    
+    uint64_t wall_ns = now_ns() - wall_start;
+    uint64_t processed = (uint64_t)count * (uint64_t)loops;
+    
+    printf("\ncapture:    %s (%u IPv4 packets, %u skipped)\n", argv[optind], count, skipped);
+    printf("method:     %s, split=%d, loops=%d, seed=%u\n",
+           dpi_method_name(method), split_pos, loops, seed);
+    printf("processed:  %llu packets in %.3f s wall\n",
+           (unsigned long long)processed, wall_ns / 1e9);
+    printf("throughput: %.0f packets/s (%.1f ns/packet in process_packet, timer %llu ns)\n",
+           total_ns ? processed * 1e9 / total_ns : 0.0,
+           (double)total_ns / processed, (unsigned long long)timer_ns);
+    printf("allocs:     %.3f per packet\n", (double)total_allocs / processed);
+    printf("injected:   %llu fragments, %llu bytes\n\n",
+           (unsigned long long)g_sink.fragments, (unsigned long long)g_sink.bytes);
+    
+    printf("%-18s %12s %8s %12s %12s\n", "reason", "packets", "share", "ns/packet", "allocs/pkt");
+    for (int r = 0; r < DPI_REASON_COUNT; r++) {
+        if (reasons[r].packets == 0) continue;
+        printf("%-18s %12llu %7.2f%% %12.1f %12.3f\n",
+               dpi_reason_name((DpiDecisionReason)r),
+               (unsigned long long)reasons[r].packets,
+               100.0 * reasons[r].packets / processed,
+               (double)reasons[r].ns / reasons[r].packets,
+               (double)reasons[r].allocs / reasons[r].packets);
+    }
+    
+    if (g_sink.capture != NULL) fclose(g_sink.capture);
+    for (uint32_t i = 0; i < count; i++) free(packets[i].data);
+    free(packets);
+    free(scratch);
+    return 0;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Injection sink: count, optionally print and capture
+ */
+static int counting_sink(const uint8_t* packet, uint32_t len, uint32_t dst_ip, void* user_data) {
+    (void)dst_ip;
+    (void)user_data;
+    
+    g_sink.fragments++;
+    g_sink.bytes += len;
+    
+    if (g_sink.verbose) {
+        uint32_t ihl = (packet[0] & 0x0F) * 4;
+        if (packet[9] == IPPROTO_TCP && len >= ihl + 20) {
+            const uint8_t* tcp = packet + ihl;
+            uint32_t seq = ntohl(*(const uint32_t*)(tcp + 4));
+            uint32_t data_len = len - ihl - (tcp[12] >> 4) * 4;
+            printf("  frag seq=+%-6d len=%-5u flags=0x%02X ttl=%u\n",
+                   (int32_t)(seq - g_sink.orig_seq), data_len, tcp[13], packet[8]);
+        } else {
+            printf("  frag proto=%u len=%u\n", packet[9], len);
+        }
+    }
+    
+    if (g_sink.capture != NULL) {
+        pcap_writer_write(g_sink.capture, packet, len, g_sink.ts_ns);
+    }
+    
+    return 0;
+}
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Deterministic PRNG
+ */
+static uint32_t xorshift32(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/**
+ * Shift TCP/UDP source port of a first fragment (checksums are not fixed up;
+ * the bypass engine does not verify them)
+ */
+static void shift_ports(uint8_t* packet, uint32_t len, uint16_t delta) {
+    if (delta == 0) return;
+    uint32_t ihl = (packet[0] & 0x0F) * 4;
+    if (packet[9] != IPPROTO_TCP && packet[9] != IPPROTO_UDP) return;
+    if ((((packet[6] << 8) | packet[7]) & 0x1FFF) != 0) return;
+    if (len < ihl + 4) return;
+    
+    uint16_t port = (packet[ihl] << 8) | packet[ihl + 1];
+    port += delta;
+    packet[ihl] = port >> 8;
+    packet[ihl + 1] = port & 0xFF;
+}
+
+/**
+ * Build an NfqueuePacket the way nfqueue_handler's parser does
+ */
+static void fill_packet(NfqueuePacket* pkt, uint8_t* data, uint32_t len, uint32_t id) {
+    memset(pkt, 0, sizeof(*pkt));
+    pkt->packet_id = id;
+    pkt->payload = data;
+    pkt->payload_len = len;
+    pkt->recv_time_ns = now_ns();
+    
+    uint32_t ihl = (data[0] & 0x0F) * 4;
+    pkt->protocol = data[9];
+    memcpy(&pkt->src_ip, data + 12, 4);
+    memcpy(&pkt->dst_ip, data + 16, 4);
+    
+    if ((pkt->protocol == IPPROTO_TCP || pkt->protocol == IPPROTO_UDP) && len >= ihl + 4) {
+        pkt->src_port = (data[ihl] << 8) | data[ihl + 1];
+        pkt->dst_port = (data[ihl + 2] << 8) | data[ihl + 3];
+    }
+}
+
+/**
+ * Method name to enum (-1 if unknown)
+ */
+static BypassMethod parse_method(const char* name) {
+    for (int m = 0; m < BYPASS_METHOD_COUNT; m++) {
+        if (strcmp(name, dpi_method_name((BypassMethod)m)) == 0) return (BypassMethod)m;
+    }
+    fprintf(stderr, "unknown method '%s'\n", name);
+    return (BypassMethod)-1;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [-n loops] [-s seed] [-m method] [-p split] [-w out.pcap] [-v] capture\n"
+            "  -n LOOPS   replay the capture LOOPS times (default 10)\n"
+            "  -s SEED    seed for per-loop source port shifts (default 1)\n"
+            "  -m METHOD  none|split|split_reverse|disorder|disorder_reverse (default split)\n"
+            "  -p SIZE    first fragment size (default 2)\n"
+            "  -w FILE    write injected fragments of the first loop to a pcap\n"
+            "  -v         print the injected fragment sequence of the first loop\n",
+            prog);
+}
@@ -0,0 +1,138 @@
+/**
+ * checksum.c
+ * 
+ * Internet checksums (RFC 1071) for IPv4 and TCP headers (IPv4 and IPv6
+ * pseudo-headers), and incremental updates (RFC 1624) for single-field
+ * rewrites.
+ */
+
+#include "checksum.h"
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * Calculate IP header checksum
+ */
+uint16_t checksum_ip(const struct iphdr* ip) {
+    uint32_t sum = 0;
+    const uint16_t* ptr = (const uint16_t*)ip;
+    int len = ip->ihl * 4;
+    
+    while (len > 1) {
+        sum += *ptr++;
+        len -= 2;
+    }
+    
+    if (len == 1) {
+        sum += *(const uint8_t*)ptr;
+    }
+    
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    
+    return ~sum;
+}
+
+/**
+ * Calculate TCP checksum
+ */
+uint16_t checksum_tcp(const struct iphdr* ip, const struct tcphdr* tcp,
+                      const uint8_t* payload, uint32_t payload_len) {
+    uint32_t sum = 0;
+    uint32_t tcp_len = tcp->doff * 4 + payload_len;
+    
+    // Pseudo header
+    sum += (ip->saddr >> 16) & 0xFFFF;
+    sum += ip->saddr & 0xFFFF;
+    sum += (ip->daddr >> 16) & 0xFFFF;
+    sum += ip->daddr & 0xFFFF;
+    sum += htons(IPPROTO_TCP);
+    sum += htons(tcp_len);
+    
+    // TCP header
+    const uint16_t* ptr = (const uint16_t*)tcp;
+    int len = tcp->doff * 4;
+    while (len > 1) {
+        sum += *ptr++;
+        len -= 2;
+    }
+    
+    // Payload
+    ptr = (const uint16_t*)payload;
+    len = payload_len;
+    while (len > 1) {
+        sum += *ptr++;
+        len -= 2;
+    }
+    
+    if (len == 1) {
+        sum += *(const uint8_t*)ptr;
+    }
+    
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    
+    return ~sum;
+}
+
+/**
+ * Calculate TCP checksum over IPv6
+ */
+uint16_t checksum_tcp6(const struct ip6_hdr* ip6, const struct tcphdr* tcp,
+                       const uint8_t* payload, uint32_t payload_len) {
+    uint32_t sum = 0;
+    uint32_t tcp_len = tcp->doff * 4 + payload_len;
+    
+    // Pseudo header: source, destination, upper-layer length, next header
+    const uint16_t* ptr = (const uint16_t*)&ip6->ip6_src;
+    for (int i = 0; i < 16; i++) {
+        sum += ptr[i];
+    }
+    sum += htons(tcp_len >> 16);
+    sum += htons(tcp_len & 0xFFFF);
+    sum += htons(IPPROTO_TCP);
+    
+    // TCP header
+    ptr = (const uint16_t*)tcp;
+    int len = tcp->doff * 4;
+    while (len > 1) {
+        sum += *ptr++;
+        len -= 2;
+    }
+    
+    // Payload
+    ptr = (const uint16_t*)payload;
+    len = payload_len;
+    while (len > 1) {
+        sum += *ptr++;
+        len -= 2;
+    }
+    
+    if (len == 1) {
+        sum += *(const uint8_t*)ptr;
+    }
+    
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    
+    return ~sum;
+}
+
+/**
+ * Incremental update: HC' = ~(~HC + ~m + m')
+ */
+uint16_t checksum_update16(uint16_t check, uint16_t old_word, uint16_t new_word) {
+    uint32_t sum = (uint16_t)~check;
+    sum += (uint16_t)~old_word;
+    sum += new_word;
+    
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    
+    return ~sum;
+}
@@ -0,0 +1,63 @@
+/**
+ * checksum.h
+ * 
+ * Internet checksums (RFC 1071) for IPv4 and TCP headers (IPv4 and IPv6
+ * pseudo-headers), and incremental updates (RFC 1624) for single-field
+ * rewrites.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <netinet/ip6.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Calculate IPv4 header checksum
+ * @param ip IP header (check field must be zero)
+ * @return Checksum in network byte order
+ */
+uint16_t checksum_ip(const struct iphdr* ip);
+
+/**
+ * Calculate TCP checksum including the IPv4 pseudo-header
+ * @param ip IP header (addresses)
+ * @param tcp TCP header (check field must be zero)
+ * @param payload TCP payload
+ * @param payload_len Payload length
+ * @return Checksum in network byte order
+ */
+uint16_t checksum_tcp(const struct iphdr* ip, const struct tcphdr* tcp,
+                      const uint8_t* payload, uint32_t payload_len);
+
+/**
+ * Calculate TCP checksum including the IPv6 pseudo-header (RFC 8200, 8.1)
+ * @param ip6 IPv6 header (addresses; extension headers are not covered)
+ * @param tcp TCP header (check field must be zero)
+ * @param payload TCP payload
+ * @param payload_len Payload length
+ * @return Checksum in network byte order
+ */
+uint16_t checksum_tcp6(const struct ip6_hdr* ip6, const struct tcphdr* tcp,
+                       const uint8_t* payload, uint32_t payload_len);
+
+/**
+ * Update a checksum for one changed 16-bit word (RFC 1624, eqn. 3)
+ * @param check Current checksum (network byte order)
+ * @param old_word Old value of the word (network byte order)
+ * @param new_word New value of the word (network byte order)
+ * @return Updated checksum in network byte order
+ */
+uint16_t checksum_update16(uint16_t check, uint16_t old_word, uint16_t new_word);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CHECKSUM_H
@@ -0,0 +1,122 @@
+/**
+ * ctl_client.c
+ *
+ * Daemon control socket client implementation.
+ */
+
+#include "ctl_client.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+// Forward declarations
+static size_t object_end(const char* data, size_t len);
+
+/**
+ * Connect to the daemon control socket
+ */
+int ctl_client_connect(const char* path, int timeout_ms) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    
+    if (timeout_ms > 0) {
+        struct timeval tv = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_usec = (timeout_ms % 1000) * 1000
+        };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Send one command and read its reply
+ */
+int ctl_client_request(int fd, const char* cmd, char* response, size_t resp_size) {
+    if (resp_size == 0) return -1;
+    
+    size_t cmd_len = strlen(cmd);
+    size_t off = 0;
+    while (off < cmd_len) {
+        ssize_t n = send(fd, cmd + off, cmd_len - off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    
+    // The daemon sends no delimiter: read until the reply object closes
+    size_t len = 0;
+    while (len < resp_size - 1) {
+        ssize_t n = recv(fd, response + len, resp_size - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        if (n == 0) {
+            errno = ECONNRESET;
+            break;
+        }
+        len += (size_t)n;
+        
+        size_t end = object_end(response, len);
+        if (end > 0) {
+            response[end] = '\0';
+            return (int)end;
+        }
+    }
+    
+    response[len] = '\0';
+    return -1;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Length of the first complete JSON object in data (0 = incomplete)
+ */
+static size_t object_end(const char* data, size_t len) {
+    int depth = 0;
+    bool in_string = false;
+    bool escaped = false;
+    
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (in_string) {
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == '"') in_string = false;
+        } else if (c == '"') {
+            in_string = true;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && depth > 0 && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * ctl_client.h
+ *
+ * Client side of the daemon control socket.
+ * Commands are single JSON objects; every command gets one JSON object
+ * back on the same connection, so a client can keep the connection open
+ * and pay one write and one read per command. Used by netrixctl and by
+ * the JNI bridge (the socket is mode 0666, no su needed).
+ */
+
+#ifndef CTL_CLIENT_H
+#define CTL_CLIENT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Connect to the daemon control socket
+ * @param path Socket path
+ * @param timeout_ms Send/receive timeout per command (0 = none)
+ * @return Connected socket, -1 on error (errno set)
+ */
+int ctl_client_connect(const char* path, int timeout_ms);
+
+/**
+ * Send one command and read its reply
+ * @param fd Connected socket
+ * @param cmd JSON command
+ * @param response Output buffer (NUL-terminated JSON object)
+ * @param resp_size Output buffer size
+ * @return Reply length, -1 on error (the connection should be closed)
+ */
+int ctl_client_request(int fd, const char* cmd, char* response, size_t resp_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CTL_CLIENT_H
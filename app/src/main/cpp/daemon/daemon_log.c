@@ -0,0 +1,270 @@
+/**
+ * daemon_log.c
+ *
+ * Asynchronous daemon logger implementation.
+ * Fixed-size records in a record_ring; its writer thread adds timestamps
+ * and writes batches to a rotating_file (one flush per batch).
+ */
+
+#include "daemon_log.h"
+#include "record_ring.h"
+#include "rotating_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define LOG_PREFIX "[DAEMON] "
+#define LOG_MESSAGE_MAX 232            // Message bytes per record (longer lines are cut)
+#define LINE_MAX_LEN (LOG_MESSAGE_MAX + 40)
+#define WRITER_BATCH 256
+#define BATCH_BUFFER_SIZE (WRITER_BATCH * LINE_MAX_LEN)
+
+#define DEFAULT_MAX_FILE_BYTES (1024ULL * 1024)
+#define DEFAULT_RING_SLOTS 1024
+
+// One ring record
+typedef struct {
+    uint64_t ts_ns;                    // CLOCK_REALTIME
+    uint32_t len;
+    char message[LOG_MESSAGE_MAX];
+} LogRecord;
+
+// Global state
+static struct {
+    DaemonLogConfig config;
+    char path[256];
+    RecordRing ring;
+    // Writer
+    RotatingFile out;
+    char* batch;                       // Lines of the current batch, for stderr
+    size_t batch_len;
+    uint64_t dropped_reported;
+    // Counters (drops are counted in the ring)
+    atomic_uint_fast64_t lines;
+    pthread_mutex_t lock;
+} g_log = {
+    .batch = NULL,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Forward declarations
+static size_t drain_ring(void* ctx);
+static void append_line(uint64_t ts_ns, const char* message, uint32_t len);
+static void flush_batch(void);
+static uint64_t realtime_ns(void);
+static void write_stderr(const char* message, int len);
+
+/**
+ * Start logger
+ */
+int daemon_log_start(const DaemonLogConfig* config) {
+    if (config == NULL || config->path == NULL || config->path[0] == '\0') return -1;
+    if (strlen(config->path) >= sizeof(g_log.path) - 4) return -1;
+    
+    daemon_log_stop();
+    
+    pthread_mutex_lock(&g_log.lock);
+    
+    g_log.config = *config;
+    strcpy(g_log.path, config->path);
+    g_log.config.path = g_log.path;
+    if (g_log.config.max_file_bytes == 0) g_log.config.max_file_bytes = DEFAULT_MAX_FILE_BYTES;
+    if (g_log.config.ring_slots == 0) g_log.config.ring_slots = DEFAULT_RING_SLOTS;
+    
+    size_t slots = record_ring_init(&g_log.ring, g_log.config.ring_slots, sizeof(LogRecord));
+    g_log.batch = malloc(BATCH_BUFFER_SIZE);
+    if (slots == 0 || g_log.batch == NULL) {
+        record_ring_free(&g_log.ring);
+        free(g_log.batch);
+        g_log.batch = NULL;
+        pthread_mutex_unlock(&g_log.lock);
+        return -1;
+    }
+    g_log.config.ring_slots = (uint32_t)slots;
+    g_log.batch_len = 0;
+    g_log.dropped_reported = atomic_load(&g_log.ring.dropped);
+    
+    // Without a file the writer still runs and echoes to stderr
+    RotatingFileConfig out = {
+        .path = g_log.path,
+        .max_bytes = g_log.config.max_file_bytes,
+        .max_files = g_log.config.max_files,
+        .append = true,
+        .buffer_size = BATCH_BUFFER_SIZE
+    };
+    int result = rotating_file_open(&g_log.out, &out);
+    if (result < 0) g_log.config.echo_stderr = true;
+    
+    if (record_ring_start(&g_log.ring, drain_ring, NULL) < 0) {
+        rotating_file_close(&g_log.out);
+        record_ring_free(&g_log.ring);
+        free(g_log.batch);
+        g_log.batch = NULL;
+        pthread_mutex_unlock(&g_log.lock);
+        return -1;
+    }
+    
+    pthread_mutex_unlock(&g_log.lock);
+    return result;
+}
+
+/**
+ * Stop logger
+ */
+void daemon_log_stop(void) {
+    pthread_mutex_lock(&g_log.lock);
+    
+    if (!record_ring_active(&g_log.ring)) {
+        pthread_mutex_unlock(&g_log.lock);
+        return;
+    }
+    
+    // Writes out queued records before returning
+    record_ring_stop(&g_log.ring);
+    rotating_file_close(&g_log.out);
+    record_ring_free(&g_log.ring);
+    free(g_log.batch);
+    g_log.batch = NULL;
+    
+    pthread_mutex_unlock(&g_log.lock);
+}
+
+/**
+ * Queue one line; drop and count if the ring is full
+ */
+void daemon_log(const char* fmt, ...) {
+    char message[LOG_MESSAGE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    if (len < 0) return;
+    if (len >= (int)sizeof(message)) len = (int)sizeof(message) - 1;
+    
+    if (!record_ring_enter(&g_log.ring)) {
+        write_stderr(message, len);
+        return;
+    }
+    
+    size_t pos;
+    LogRecord* record = record_ring_claim(&g_log.ring, &pos);
+    if (record != NULL) {
+        record->ts_ns = realtime_ns();
+        record->len = (uint32_t)len;
+        memcpy(record->message, message, (size_t)len);
+        record_ring_publish(&g_log.ring, pos);
+    }
+    
+    record_ring_leave(&g_log.ring);
+}
+
+/**
+ * Get counters
+ */
+void daemon_log_get_stats(DaemonLogStats* stats) {
+    if (stats == NULL) return;
+    stats->lines = atomic_load(&g_log.lines);
+    stats->dropped = atomic_load(&g_log.ring.dropped);
+    stats->rotations = atomic_load(&g_log.out.rotations);
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Writer callback: one batch of lines, one flush per batch
+ */
+static size_t drain_ring(void* ctx) {
+    (void)ctx;
+    size_t count = 0;
+    const LogRecord* record;
+    
+    while (count < WRITER_BATCH && (record = record_ring_peek(&g_log.ring)) != NULL) {
+        append_line(record->ts_ns, record->message, record->len);
+        record_ring_release(&g_log.ring);
+        count++;
+    }
+    
+    // Report drops once the ring has room again
+    uint64_t dropped = atomic_load(&g_log.ring.dropped);
+    if (dropped != g_log.dropped_reported) {
+        char message[64];
+        int len = snprintf(message, sizeof(message), "Log ring full, %llu lines dropped",
+                           (unsigned long long)(dropped - g_log.dropped_reported));
+        g_log.dropped_reported = dropped;
+        append_line(realtime_ns(), message, (uint32_t)len);
+    }
+    
+    flush_batch();
+    return count;
+}
+
+/**
+ * Format "HH:MM:SS.mmm [DAEMON] message\n" into the batch buffer and the file
+ */
+static void append_line(uint64_t ts_ns, const char* message, uint32_t len) {
+    if (g_log.batch_len + LINE_MAX_LEN > BATCH_BUFFER_SIZE) flush_batch();
+    
+    time_t sec = (time_t)(ts_ns / 1000000000ULL);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    
+    char* line = g_log.batch + g_log.batch_len;
+    int n = snprintf(line, LINE_MAX_LEN, "%02d:%02d:%02d.%03u " LOG_PREFIX,
+                     tm.tm_hour, tm.tm_min, tm.tm_sec,
+                     (unsigned)(ts_ns / 1000000ULL % 1000));
+    memcpy(line + n, message, len);
+    n += (int)len;
+    line[n++] = '\n';
+    
+    if (rotating_file_write(&g_log.out, line, (size_t)n) == ROTATING_FILE_REOPEN_FAILED) {
+        // Lines go to stderr from now on; without a file nothing rotates again
+        char error[LOG_MESSAGE_MAX];
+        int len = snprintf(error, sizeof(error), "Cannot reopen %s after rotation: %s",
+                           g_log.path, strerror(errno));
+        if (len >= (int)sizeof(error)) len = (int)sizeof(error) - 1;
+        write_stderr(error, len);
+        g_log.config.echo_stderr = true;
+    }
+    
+    g_log.batch_len += (size_t)n;
+    atomic_fetch_add(&g_log.lines, 1);
+}
+
+static void flush_batch(void) {
+    if (g_log.batch_len == 0) return;
+    
+    if (g_log.config.echo_stderr) {
+        ssize_t ignored = write(STDERR_FILENO, g_log.batch, g_log.batch_len);
+        (void)ignored;
+    }
+    rotating_file_flush(&g_log.out);
+    
+    g_log.batch_len = 0;
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Synchronous fallback when the logger is not running
+ */
+static void write_stderr(const char* message, int len) {
+    char line[LINE_MAX_LEN];
+    int n = snprintf(line, sizeof(line), LOG_PREFIX "%.*s\n", len, message);
+    if (n > 0) {
+        ssize_t ignored = write(STDERR_FILENO, line, (size_t)n);
+        (void)ignored;
+    }
+}
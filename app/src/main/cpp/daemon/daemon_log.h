@@ -0,0 +1,66 @@
+/**
+ * daemon_log.h
+ *
+ * Asynchronous daemon logger.
+ * Callers format the message into a fixed-size record in a lock-free
+ * ring and return; a background thread timestamps the records, writes
+ * them to the log file in batches and rotates it at a size limit.
+ * A full ring drops the record (counted) instead of blocking the caller.
+ */
+
+#ifndef DAEMON_LOG_H
+#define DAEMON_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Logger configuration
+typedef struct {
+    const char* path;              // Log file (appended to; rotated files get .1, .2, ...)
+    uint64_t max_file_bytes;       // Rotate before a line would exceed this (default: 1 MiB)
+    uint32_t max_files;            // Rotated files kept besides the current one (0 = none)
+    uint32_t ring_slots;           // Ring capacity in records, power of two (default: 1024)
+    bool echo_stderr;              // Also write each line to stderr
+} DaemonLogConfig;
+
+// Logger counters
+typedef struct {
+    uint64_t lines;                // Lines written
+    uint64_t dropped;              // Records lost because the ring was full
+    uint64_t rotations;            // File rotations
+} DaemonLogStats;
+
+/**
+ * Open the log file and start the writer thread
+ * @param config Logger configuration (path required)
+ * @return 0 on success, -1 if the file cannot be opened (lines then go to stderr)
+ */
+int daemon_log_start(const DaemonLogConfig* config);
+
+/**
+ * Write out queued records and stop the writer thread
+ */
+void daemon_log_stop(void);
+
+/**
+ * Queue one log line (not async-signal-safe: formats with vsnprintf)
+ * Before start / after stop the line is written to stderr directly.
+ * @param fmt printf format
+ */
+void daemon_log(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Get logger counters
+ * @param stats Output counters
+ */
+void daemon_log_get_stats(DaemonLogStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DAEMON_LOG_H
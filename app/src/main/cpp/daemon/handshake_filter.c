@@ -0,0 +1,78 @@
+/**
+ * handshake_filter.c
+ *
+ * Classic BPF classifier implementation.
+ * Jumps only go forward and every path ends in a return, which is all the
+ * classic verifier (bpf_check_classic) asks for; 25 instructions is well
+ * under the 64 that xt_bpf accepts.
+ */
+
+#include "handshake_filter.h"
+
+#include <stdio.h>
+
+// Return values: non-zero = match (queue the packet)
+#define FILTER_MATCH 0xFFFF
+#define FILTER_NO_MATCH 0
+
+// HTTP method tokens (first four payload bytes, big-endian)
+#define TOKEN_GET  0x47455420      // "GET "
+#define TOKEN_POST 0x504F5354      // "POST"
+#define TOKEN_HEAD 0x48454144      // "HEAD"
+#define TOKEN_PUT  0x50555420      // "PUT "
+#define TOKEN_DELE 0x44454C45      // "DELE" (DELETE)
+#define TOKEN_OPTI 0x4F505449      // "OPTI" (OPTIONS)
+#define TOKEN_PATC 0x50415443      // "PATC" (PATCH)
+#define TOKEN_CONN 0x434F4E4E      // "CONN" (CONNECT)
+
+// Jump offsets are relative to the next instruction (index in comments)
+static const struct sock_filter g_program[] = {
+    /*  0 */ BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),            // X = IP header length
+    /*  1 */ BPF_STMT(BPF_LD | BPF_B | BPF_IND, 13),            // A = TCP flags
+    /*  2 */ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x02, 21, 0), // SYN -> 24
+    /*  3 */ BPF_STMT(BPF_LD | BPF_B | BPF_IND, 12),            // A = TCP data offset
+    /*  4 */ BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xF0),
+    /*  5 */ BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 2),             // TCP header length
+    /*  6 */ BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+    /*  7 */ BPF_STMT(BPF_MISC | BPF_TAX, 0),                    // X = payload offset
+    /*  8 */ BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),
+    /*  9 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x16, 0, 4),   // Not a handshake record -> 14
+    /* 10 */ BPF_STMT(BPF_LD | BPF_B | BPF_IND, 1),
+    /* 11 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x03, 0, 11),  // Not TLS -> 23
+    /* 12 */ BPF_STMT(BPF_LD | BPF_B | BPF_IND, 5),             // Handshake type
+    /* 13 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x01, 10, 9),  // ClientHello -> 24, else 23
+    /* 14 */ BPF_STMT(BPF_LD | BPF_W | BPF_IND, 0),
+    /* 15 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TOKEN_GET, 8, 0),
+    /* 16 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TOKEN_POST, 7, 0),
+    /* 17 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TOKEN_HEAD, 6, 0),
+    /* 18 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TOKEN_PUT, 5, 0),
+    /* 19 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TOKEN_DELE, 4, 0),
+    /* 20 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TOKEN_OPTI, 3, 0),
+    /* 21 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TOKEN_PATC, 2, 0),
+    /* 22 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TOKEN_CONN, 1, 0),
+    /* 23 */ BPF_STMT(BPF_RET | BPF_K, FILTER_NO_MATCH),
+    /* 24 */ BPF_STMT(BPF_RET | BPF_K, FILTER_MATCH),
+};
+
+#define PROGRAM_LEN (sizeof(g_program) / sizeof(g_program[0]))
+
+/**
+ * Get the classifier program
+ */
+const struct sock_filter* handshake_filter_program(uint32_t* len) {
+    if (len) *len = PROGRAM_LEN;
+    return g_program;
+}
+
+/**
+ * Format the program for iptables
+ */
+int handshake_filter_bytecode(char* out, size_t out_size) {
+    int len = snprintf(out, out_size, "%zu", PROGRAM_LEN);
+    for (size_t i = 0; i < PROGRAM_LEN && len >= 0 && (size_t)len < out_size; i++) {
+        len += snprintf(out + len, out_size - len, ",%u %u %u %u",
+                        g_program[i].code, g_program[i].jt, g_program[i].jf, g_program[i].k);
+    }
+    if (len < 0 || (size_t)len >= out_size) return -1;
+    return len;
+}
@@ -0,0 +1,43 @@
+/**
+ * handshake_filter.h
+ *
+ * Classic BPF classifier for the outbound queue rules.
+ * Port rules queue every HTTP(S) packet, bulk data included; this program
+ * (run by the xt_bpf match, "-m bpf --bytecode") accepts only packets the
+ * engine acts on: SYNs, TLS ClientHello records (16 03 xx xx xx 01) and
+ * payloads starting with an HTTP method. Everything else stays in-kernel.
+ * The program sees the packet from the IPv4 header on; out-of-range loads
+ * end it with "no match", so short packets need no length checks.
+ */
+
+#ifndef HANDSHAKE_FILTER_H
+#define HANDSHAKE_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/filter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Get the classifier program
+ * @param len Output: number of instructions
+ * @return Instructions (static, for SO_ATTACH_FILTER or tests)
+ */
+const struct sock_filter* handshake_filter_program(uint32_t* len);
+
+/**
+ * Format the program for iptables: "N,code jt jf k,code jt jf k,..."
+ * @param out Output buffer
+ * @param out_size Size of out
+ * @return String length, -1 if out is too small
+ */
+int handshake_filter_bytecode(char* out, size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HANDSHAKE_FILTER_H
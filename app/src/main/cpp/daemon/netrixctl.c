@@ -0,0 +1,102 @@
+/**
+ * netrixctl.c
+ * 
+ * Command-line client for the NFQUEUE daemon control socket.
+ * Sends each JSON command over one connection and prints each reply on
+ * its own line; without commands, reads one JSON command per stdin line.
+ * 
+ * Usage: netrixctl [-s SOCKET] [-t TIMEOUT_MS] ['{"cmd":"status"}' ...]
+ *   -s SOCKET      Control socket (default: the daemon's runtime dir)
+ *   -t TIMEOUT_MS  Per-command timeout (default: 10000)
+ * 
+ * Exit status: 0 on success, 1 if the daemon could not be reached,
+ * 2 if a reply had "status":"error".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "ctl_client.h"
+
+// Same default as nfqueue_daemon (override with -DNETRIX_RUNTIME_DIR=...)
+#ifndef NETRIX_RUNTIME_DIR
+#ifdef __ANDROID__
+#define NETRIX_RUNTIME_DIR "/data/local/tmp"
+#else
+#define NETRIX_RUNTIME_DIR "/run"
+#endif
+#endif
+
+#define SOCKET_PATH NETRIX_RUNTIME_DIR "/netrix.sock"
+#define DEFAULT_TIMEOUT_MS 10000
+#define BUFFER_SIZE 4096
+
+// Forward declarations
+static int run_command(int fd, const char* cmd);
+
+/**
+ * Main entry point
+ */
+int main(int argc, char* argv[]) {
+    const char* path = SOCKET_PATH;
+    int timeout_ms = DEFAULT_TIMEOUT_MS;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:")) != -1) {
+        switch (opt) {
+            case 's':
+                path = optarg;
+                break;
+            case 't':
+                timeout_ms = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s SOCKET] [-t TIMEOUT_MS] [JSON ...]\n", argv[0]);
+                return 1;
+        }
+    }
+    
+    int fd = ctl_client_connect(path, timeout_ms);
+    if (fd < 0) {
+        fprintf(stderr, "netrixctl: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    
+    int status = 0;
+    if (optind < argc) {
+        for (int i = optind; i < argc && status != 1; i++) {
+            int result = run_command(fd, argv[i]);
+            if (result > status) status = result;
+        }
+    } else {
+        char line[BUFFER_SIZE];
+        while (status != 1 && fgets(line, sizeof(line), stdin) != NULL) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '\0') continue;
+            int result = run_command(fd, line);
+            if (result > status) status = result;
+        }
+    }
+    
+    close(fd);
+    return status;
+}
+
+/**
+ * Send one command and print the reply
+ * @return 0 on success, 1 on connection error, 2 on an error reply
+ */
+static int run_command(int fd, const char* cmd) {
+    char response[BUFFER_SIZE];
+    if (ctl_client_request(fd, cmd, response, sizeof(response)) < 0) {
+        fprintf(stderr, "netrixctl: %s\n", strerror(errno));
+        return 1;
+    }
+    
+    printf("%s\n", response);
+    fflush(stdout);
+    return strstr(response, "\"status\":\"error\"") != NULL ? 2 : 0;
+}
@@ -1,11 +1,17 @@
 /**
  * nfqueue_daemon.c
  * 
- * Standalone NFQUEUE daemon for Android.
+ * Standalone NFQUEUE daemon for Android (and plain Linux hosts).
  * Runs as root to bypass SELinux restrictions.
  * Communicates with the app via Unix socket.
  * 
- * Usage: su -c /data/local/tmp/nfqueue_daemon
+ * Usage: su -c /data/local/tmp/nfqueue_daemon [-d] [-m unix:/path|tcp:PORT] [-u] [-t FILE]
+ *        (Linux: sudo ./nfqueue_daemon ..., runtime files in /run)
+ *   -d          Daemonize
+ *   -m SPEC     Export Prometheus metrics on a Unix socket or loopback port
+ *   -u          Include per-UID series in the metrics (readable by any app)
+ *   -t FILE     Write a pcapng decision trace from startup
+ *               (or at runtime: {"cmd":"trace","enable":true})
  */
 
 #include <stdio.h>
@@ -16,66 +22,149 @@
 #include <pthread.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
 // Include NFQUEUE handler
 #include "../nfqueue_handler.h"
 #include "../dpi_bypass.h"
+#include "../metrics_server.h"
+#include "../queue_health.h"
+#include "../decision_trace.h"
+#include "../strategy_cache.h"
+#include "../flow_table.h"
+#include "../ingress_observer.h"
+#include "../uid_stats.h"
+#include "daemon_log.h"
+#include "handshake_filter.h"
+#include "worker_sched.h"
 
-#define SOCKET_PATH "/data/local/tmp/netrix.sock"
-#define PID_FILE "/data/local/tmp/netrix.pid"
-#define LOG_FILE "/data/local/tmp/netrix.log"
+// Socket, PID and log file location (override with -DNETRIX_RUNTIME_DIR=...)
+#ifndef NETRIX_RUNTIME_DIR
+#ifdef __ANDROID__
+#define NETRIX_RUNTIME_DIR "/data/local/tmp"
+#else
+#define NETRIX_RUNTIME_DIR "/run"
+#endif
+#endif
+
+#define SOCKET_PATH NETRIX_RUNTIME_DIR "/netrix.sock"
+#define PID_FILE NETRIX_RUNTIME_DIR "/netrix.pid"
+#define LOG_FILE NETRIX_RUNTIME_DIR "/netrix.log"
+#define STRATEGY_FILE NETRIX_RUNTIME_DIR "/netrix-strategy.bin"
+#define LOG_MAX_BYTES (1024 * 1024)
+#define LOG_FILES 2
+#define TRACE_FILE NETRIX_RUNTIME_DIR "/netrix-trace.pcapng"
+#define TRACE_MAX_MB 16
+#define TRACE_FILES 3
+#define INGRESS_QUEUE_NUM 1
+#define FANOUT_QUEUE_BASE 2            // First outbound queue with --queue-cpu-fanout
+#define INGRESS_PACKETS "1:4"          // Server packets per connection sent to the observer
+#define PACKAGES_LIST "/data/system/packages.list"   // "name uid ..." per installed package
+#define MAX_TARGET_UIDS 64
+#define WORKER_FIFO_PRIORITY 10        // Default SCHED_FIFO priority of the queue workers
 #define BUFFER_SIZE 4096
 #define MAX_CLIENTS 5
 
-// Logging
-static FILE* log_file = NULL;
-
-#define LOG(fmt, ...) do { \
-    if (log_file) { \
-        fprintf(log_file, "[DAEMON] " fmt "\n", ##__VA_ARGS__); \
-        fflush(log_file); \
-    } \
-    fprintf(stderr, "[DAEMON] " fmt "\n", ##__VA_ARGS__); \
-} while(0)
+// Logging (queued; written by the daemon_log thread)
+#define LOG(fmt, ...) daemon_log(fmt, ##__VA_ARGS__)
 
 // Global state
 static volatile int running = 1;
+static volatile sig_atomic_t last_signal = 0;
 static volatile int nfqueue_active = 0;
 static int server_socket = -1;
-static pthread_t nfqueue_thread;
+static pthread_t nfqueue_threads[NFQUEUE_MAX_QUEUES];  // One worker per outbound queue
+static int nfqueue_thread_count = 0;            // Workers started
+static int nfqueue_workers_live = 0;            // Workers still in their packet loop
+static int queue_count = 1;                     // Outbound queues (> 1: --queue-cpu-fanout)
 static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t target_uids[MAX_TARGET_UIDS];   // Apps whose traffic is queued (none = all)
+static int target_uid_count = 0;
+static char classifier_match[1024];             // " -m bpf --bytecode ..." for the queue rules
+static bool classifier_installed = false;       // Queue rules use the BPF classifier
+static bool ipv6_installed = false;             // ip6tables rules feed the queue too
+static WorkerSched worker_sched;                // Placement of the queue worker threads
 
 // Forward declarations
 static void signal_handler(int sig);
 static int setup_server_socket(void);
-static void handle_client(int client_fd);
+static int handle_client(int client_fd);
 static void* nfqueue_thread_func(void* arg);
 static int parse_and_execute_command(const char* cmd, char* response, size_t resp_size);
 static void cleanup(void);
 static void write_pid_file(void);
-static int setup_iptables(void);
+static int setup_iptables(const uint32_t* uids, int uid_count, bool classifier, bool ipv6,
+                          int queues);
+static void setup_ip6tables(const uint32_t* uids, int uid_count);
 static int clear_iptables(void);
+static int mark_rule(const char* tool, const char* action, const char* redirect);
+static int queue_rules(const char* tool, const char* action, const uint32_t* uids, int uid_count,
+                       const char* match, bool bypass, const char* redirect);
+static int add_queue_rules(const char* tool, const uint32_t* uids, int uid_count, const char* match);
+static int start_workers(void);
+static void stop_workers(void);
+static void use_port_rules(void);
+static int ingress_rules(const char* action, const char* redirect);
+static void start_ingress(void);
+static void parse_worker_sched(const char* cmd);
+static void ingress_thread_start(void* user_data);
+static int start_trace(const char* path, uint32_t max_mb, uint32_t files, bool all_packets);
+static int json_get_string(const char* json, const char* key, char* out, size_t out_size);
+static int parse_targets(const char* cmd, uint32_t* uids, int max);
+static int add_target(uint32_t* uids, int count, int max, uint32_t uid);
+static int resolve_package(const char* name, uint32_t* uid);
 
 /**
  * Main entry point
  */
 int main(int argc, char* argv[]) {
+    int daemonize = 0;
+    const char* metrics_spec = NULL;
+    bool metrics_uids = false;
+    const char* trace_path = NULL;
+    
+    int opt;
+    while ((opt = getopt(argc, argv, "dm:ut:")) != -1) {
+        switch (opt) {
+            case 'd':
+                daemonize = 1;
+                break;
+            case 'm':
+                metrics_spec = optarg;
+                break;
+            case 'u':
+                metrics_uids = true;
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-d] [-m unix:/path|tcp:PORT] [-u] [-t FILE]\n", argv[0]);
+                return 1;
+        }
+    }
+    
     // Daemonize if requested
-    if (argc > 1 && strcmp(argv[1], "-d") == 0) {
+    if (daemonize) {
         if (fork() != 0) {
             exit(0);  // Parent exits
         }
         setsid();
     }
     
-    // Open log file
-    log_file = fopen(LOG_FILE, "a");
-    if (!log_file) {
-        log_file = stderr;
-    }
+    // Start logger (falls back to stderr if the file cannot be opened)
+    DaemonLogConfig log_config = {
+        .path = LOG_FILE,
+        .max_file_bytes = LOG_MAX_BYTES,
+        .max_files = LOG_FILES,
+        .echo_stderr = !daemonize
+    };
+    daemon_log_start(&log_config);
     
     LOG("Starting NFQUEUE daemon...");
     
@@ -96,54 +185,110 @@ int main(int argc, char* argv[]) {
         .desync_https = true,
         .desync_http = true,
         .mix_host_case = true,
-        .block_quic = true
+        .block_quic = true,
+        .shed_backlog = 256,
+        .shed_latency_us = 10000,
+        .packet_budget_us = 100000,
+        .auto_strategy = true,
+        .split_delay_rtt_pct = 25,
+        .split_delay_min_us = 1000,
+        .split_delay_max_us = 100000,
+        .clamp_window = 64
     };
     dpi_bypass_init(&settings);
     
+    // Per-host strategy cache (kept across restarts)
+    StrategyCacheConfig strategy_config = {
+        .path = STRATEGY_FILE,
+        .probe_interval = 32
+    };
+    if (strategy_cache_open(&strategy_config) < 0) {
+        LOG("Warning: strategy cache unavailable, using the configured method for every flow");
+    }
+    
+    // Start metrics exporter (optional)
+    if (metrics_spec != NULL) {
+        metrics_server_set_uid_series(metrics_uids);
+        if (metrics_server_start(metrics_spec) < 0) {
+            LOG("Warning: failed to start metrics server on %s", metrics_spec);
+        } else {
+            LOG("Metrics exported on %s", metrics_spec);
+        }
+    }
+    
+    // Start decision trace (optional)
+    if (trace_path != NULL) {
+        start_trace(trace_path, TRACE_MAX_MB, TRACE_FILES, false);
+    }
+    
     // Setup server socket
     server_socket = setup_server_socket();
     if (server_socket < 0) {
         LOG("Failed to setup server socket");
         cleanup();
+        daemon_log_stop();
         return 1;
     }
     
     LOG("Daemon started, listening on %s", SOCKET_PATH);
     
-    // Main loop - accept client connections
+    // Main loop - serve the control socket; clients may keep their
+    // connection open (the app does), so several are polled at once
+    struct pollfd fds[MAX_CLIENTS + 1];
+    int client_count = 0;
     while (running) {
-        struct sockaddr_un client_addr;
-        socklen_t client_len = sizeof(client_addr);
+        fds[0].fd = server_socket;
+        fds[0].events = client_count < MAX_CLIENTS ? POLLIN : 0;
         
-        int client_fd = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
-        if (client_fd < 0) {
+        if (poll(fds, (nfds_t)client_count + 1, -1) < 0) {
             if (errno == EINTR) continue;
-            if (!running) break;
-            LOG("Accept error: %s", strerror(errno));
-            continue;
+            LOG("Poll error: %s", strerror(errno));
+            break;
+        }
+        
+        for (int i = 1; i <= client_count && running; ) {
+            if (fds[i].revents != 0 && handle_client(fds[i].fd) < 0) {
+                close(fds[i].fd);
+                fds[i] = fds[client_count--];
+                LOG("Client disconnected");
+                continue;
+            }
+            i++;
         }
         
-        LOG("Client connected");
-        handle_client(client_fd);
-        close(client_fd);
-        LOG("Client disconnected");
+        if (running && (fds[0].revents & POLLIN)) {
+            int client_fd = accept(server_socket, NULL, NULL);
+            if (client_fd < 0) {
+                if (errno != EINTR) LOG("Accept error: %s", strerror(errno));
+                continue;
+            }
+            client_count++;
+            fds[client_count].fd = client_fd;
+            fds[client_count].events = POLLIN;
+            fds[client_count].revents = 0;
+            LOG("Client connected");
+        }
+    }
+    for (int i = 1; i <= client_count; i++) {
+        close(fds[i].fd);
+    }
+    
+    if (last_signal != 0) {
+        LOG("Received signal %d", (int)last_signal);
     }
     
     cleanup();
     LOG("Daemon stopped");
-    
-    if (log_file && log_file != stderr) {
-        fclose(log_file);
-    }
+    daemon_log_stop();
     
     return 0;
 }
 
 /**
- * Signal handler
+ * Signal handler (async-signal-safe only: the main loop logs the signal)
  */
 static void signal_handler(int sig) {
-    LOG("Received signal %d", sig);
+    last_signal = sig;
     running = 0;
     
     // Close server socket to unblock accept()
@@ -191,44 +336,48 @@ static int setup_server_socket(void) {
 }
 
 /**
- * Handle client connection
+ * Handle one command from a client
+ * @return 0 if the client stays connected, -1 when it is gone
  */
-static void handle_client(int client_fd) {
+static int handle_client(int client_fd) {
     char buffer[BUFFER_SIZE];
     char response[BUFFER_SIZE];
     
-    while (running) {
-        memset(buffer, 0, sizeof(buffer));
-        
-        ssize_t len = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        if (len <= 0) {
-            if (len < 0 && errno == EINTR) continue;
-            break;  // Client disconnected
-        }
-        
-        buffer[len] = '\0';
-        LOG("Received: %s", buffer);
-        
-        // Parse and execute command
-        memset(response, 0, sizeof(response));
-        parse_and_execute_command(buffer, response, sizeof(response));
-        
-        // Send response
-        if (response[0]) {
-            send(client_fd, response, strlen(response), 0);
-        }
+    ssize_t len = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+    if (len < 0 && errno == EINTR) return 0;
+    if (len <= 0) return -1;  // Client disconnected
+    
+    buffer[len] = '\0';
+    LOG("Received: %s", buffer);
+    
+    // Parse and execute command
+    memset(response, 0, sizeof(response));
+    parse_and_execute_command(buffer, response, sizeof(response));
+    
+    // Send response
+    if (response[0] && send(client_fd, response, strlen(response), MSG_NOSIGNAL) < 0) {
+        return -1;
     }
+    return 0;
 }
 
-// Simple packet counter callback for debugging
-static uint64_t g_packet_count = 0;
+/**
+ * Queue health listener - feeds kernel backlog into load shedding
+ */
+static void on_queue_health(const QueueHealthSnapshot* snapshot, void* user_data) {
+    (void)user_data;
+    dpi_bypass_report_backlog(snapshot->queue.queue_total);
+}
+
+// Simple packet counter callback for debugging (called by every queue worker)
+static atomic_uint_fast64_t g_packet_count = 0;
 
 static NfqueueVerdict debug_packet_callback(NfqueuePacket* packet, void* user_data) {
-    g_packet_count++;
+    uint64_t count = atomic_fetch_add_explicit(&g_packet_count, 1, memory_order_relaxed) + 1;
     
-    if (g_packet_count <= 5 || g_packet_count % 100 == 0) {
+    if (count <= 5 || count % 100 == 0) {
         LOG("[PACKET #%llu] dst=%d.%d.%d.%d:%d proto=%d len=%u",
-            (unsigned long long)g_packet_count,
+            (unsigned long long)count,
             (packet->dst_ip) & 0xFF,
             (packet->dst_ip >> 8) & 0xFF,
             (packet->dst_ip >> 16) & 0xFF,
@@ -239,18 +388,29 @@ static NfqueueVerdict debug_packet_callback(NfqueuePacket* packet, void* user_da
     }
     
     // Call the real bypass function
-    return dpi_bypass_process_packet(packet, user_data);
+    NfqueueVerdict verdict = dpi_bypass_process_packet(packet, user_data);
+    uid_stats_record(packet, dpi_bypass_last_reason() == DPI_REASON_BYPASSED);
+    return verdict;
 }
 
 /**
- * NFQUEUE processing thread
+ * NFQUEUE processing thread, one per outbound queue
+ * With --queue-cpu-fanout the worker of queue i runs on the CPUs that
+ * feed it, so packets are serviced on the core that enqueued them.
  */
 static void* nfqueue_thread_func(void* arg) {
-    (void)arg;
+    int index = (int)(intptr_t)arg;
     
-    LOG("=== NFQUEUE THREAD STARTED ===");
+    LOG("=== NFQUEUE THREAD %d STARTED ===", index);
+    WorkerSched sched = worker_sched;
+    char name[32] = "Queue worker";
+    if (queue_count > 1) {
+        worker_sched_fanout_cpus(index, queue_count, &sched.cpus);
+        snprintf(name, sizeof(name), "Queue %d worker", FANOUT_QUEUE_BASE + index);
+    }
+    worker_sched_apply(&sched, name);
     
-    // Initialize raw socket for packet injection
+    // Initialize raw socket for packet injection (shared, opened once)
     LOG("Initializing raw socket...");
     if (dpi_raw_socket_init() < 0) {
         LOG("!!! CRITICAL: Failed to initialize raw socket !!!");
@@ -266,10 +426,15 @@ static void* nfqueue_thread_func(void* arg) {
     LOG("Starting NFQUEUE packet loop (blocking)...");
     
     // Start processing (blocking)
-    int result = nfqueue_start();
+    int result = nfqueue_start_queue((uint16_t)index);
     
-    LOG("=== NFQUEUE THREAD STOPPED: result=%d, packets=%llu ===", 
-        result, (unsigned long long)g_packet_count);
+    LOG("=== NFQUEUE THREAD %d STOPPED: result=%d, packets=%llu ===", 
+        index, result, (unsigned long long)atomic_load(&g_packet_count));
+    
+    pthread_mutex_lock(&state_lock);
+    bool last = --nfqueue_workers_live == 0;
+    pthread_mutex_unlock(&state_lock);
+    if (!last) return NULL;
     
     // Cleanup raw socket
     dpi_raw_socket_cleanup();
@@ -297,16 +462,62 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
             return 0;
         }
         
-        // Setup iptables
-        if (setup_iptables() < 0) {
+        // Apps to queue (uids and/or packages; none = every app)
+        uint32_t uids[MAX_TARGET_UIDS];
+        int uid_count = parse_targets(cmd, uids, MAX_TARGET_UIDS);
+        if (uid_count < 0) {
+            snprintf(response, resp_size, "{\"status\":\"error\",\"message\":\"no target app resolved\"}");
+            pthread_mutex_unlock(&state_lock);
+            return -1;
+        }
+        
+        // Injection backend ("raw", "raw_per_thread", "packet_ring"), opened by the worker
+        InjectBackendType inject = INJECT_BACKEND_RAW;
+        char backend[32];
+        if (json_get_string(cmd, "inject", backend, sizeof(backend)) > 0 &&
+            inject_backend_parse(backend, &inject) < 0) {
+            snprintf(response, resp_size, "{\"status\":\"error\",\"message\":\"unknown inject backend\"}");
+            pthread_mutex_unlock(&state_lock);
+            return -1;
+        }
+        dpi_set_inject_backend(inject);
+        
+        // Setup iptables (one queue per possible CPU with "queue_cpu_fanout")
+        bool classifier = strstr(cmd, "\"bpf_classifier\":true") != NULL;
+        bool ipv6 = strstr(cmd, "\"ipv6\":false") == NULL;
+        int queues = strstr(cmd, "\"queue_cpu_fanout\":true") != NULL
+                     ? worker_sched_fanout_queues(NFQUEUE_MAX_QUEUES) : 1;
+        if (setup_iptables(uids, uid_count, classifier, ipv6, queues) < 0) {
             snprintf(response, resp_size, "{\"status\":\"error\",\"message\":\"iptables setup failed\"}");
             pthread_mutex_unlock(&state_lock);
             return -1;
         }
         
+        // Queue sizing from start settings
+        NfqueueConfig qcfg;
+        nfqueue_get_config(&qcfg);
+        char* ptr;
+        if ((ptr = strstr(cmd, "\"rcvbuf_size\":")) != NULL) {
+            qcfg.rcvbuf_size = (uint32_t)strtoul(ptr + 14, NULL, 10);
+        }
+        if ((ptr = strstr(cmd, "\"queue_maxlen\":")) != NULL) {
+            qcfg.queue_maxlen = (uint32_t)strtoul(ptr + 15, NULL, 10);
+        }
+        if (strstr(cmd, "\"fail_open\":true")) qcfg.fail_open = true;
+        if (strstr(cmd, "\"fail_open\":false")) qcfg.fail_open = false;
+        qcfg.uid_gid = true;
+        nfqueue_set_config(&qcfg);
+        
         // Initialize NFQUEUE
-        LOG("Initializing NFQUEUE (queue=0)...");
-        int nfq_result = nfqueue_init(0);
+        int nfq_result;
+        if (queue_count > 1) {
+            LOG("Initializing NFQUEUE (queues=%d-%d)...",
+                FANOUT_QUEUE_BASE, FANOUT_QUEUE_BASE + queue_count - 1);
+            nfq_result = nfqueue_init_fanout(FANOUT_QUEUE_BASE, (uint16_t)queue_count);
+        } else {
+            LOG("Initializing NFQUEUE (queue=0)...");
+            nfq_result = nfqueue_init(0);
+        }
         if (nfq_result < 0) {
             LOG("!!! NFQUEUE INIT FAILED: %s !!!", nfqueue_get_error());
             snprintf(response, resp_size, "{\"status\":\"error\",\"message\":\"%s\"}", nfqueue_get_error());
@@ -319,9 +530,10 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
         nfqueue_active = 1;
         pthread_mutex_unlock(&state_lock);
         
-        // Start NFQUEUE thread
-        if (pthread_create(&nfqueue_thread, NULL, nfqueue_thread_func, NULL) != 0) {
-            nfqueue_cleanup();
+        // Start NFQUEUE threads (placed by "cpus", "sched", "priority", "nice")
+        parse_worker_sched(cmd);
+        if (start_workers() < 0) {
+            stop_workers();
             clear_iptables();
             pthread_mutex_lock(&state_lock);
             nfqueue_active = 0;
@@ -330,9 +542,37 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
             return -1;
         }
         
-        LOG("NFQUEUE started");
-        snprintf(response, resp_size, "{\"status\":\"ok\",\"running\":true}");
+        // Watch kernel queue backlog and drops
+        QueueHealthConfig hcfg = {
+            .interval_ms = 1000,
+            .overload_backlog = 0,
+            .auto_fail_open = true,
+            .listener = on_queue_health,
+            .listener_data = NULL
+        };
+        queue_health_start(&hcfg);
+        
+        // Inbound handshake observation (optional)
+        if (!strstr(cmd, "\"ingress\":false")) {
+            start_ingress();
+        }
+        
+        // The classifier hides the packets that report handshake outcomes
+        // from the queue; without the observer only timeouts would be seen
+        if (classifier_installed && !flow_table_ingress() &&
+            dpi_bypass_get_settings()->auto_strategy) {
+            LOG("Warning: BPF classifier needs the ingress observer for handshake outcomes, "
+                "using port rules");
+            use_port_rules();
+        }
         
+        LOG("NFQUEUE started");
+        snprintf(response, resp_size,
+                 "{\"status\":\"ok\",\"running\":true,\"target_uids\":%d,\"bpf_classifier\":%s,"
+                 "\"ipv6\":%s,\"queues\":%d}",
+                 target_uid_count, classifier_installed ? "true" : "false",
+                 ipv6_installed ? "true" : "false", queue_count);
+    
     } else if (strstr(cmd, "\"cmd\":\"stop\"") || strstr(cmd, "\"cmd\": \"stop\"")) {
         // STOP command
         pthread_mutex_lock(&state_lock);
@@ -346,9 +586,9 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
         pthread_mutex_unlock(&state_lock);
         
         // Stop NFQUEUE
-        nfqueue_stop();
-        pthread_join(nfqueue_thread, NULL);
-        nfqueue_cleanup();
+        ingress_observer_stop();
+        queue_health_stop();
+        stop_workers();
         
         // Clear iptables
         clear_iptables();
@@ -359,7 +599,7 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
         
         LOG("NFQUEUE stopped");
         snprintf(response, resp_size, "{\"status\":\"ok\",\"running\":false}");
-        
+    
     } else if (strstr(cmd, "\"cmd\":\"status\"") || strstr(cmd, "\"cmd\": \"status\"")) {
         // STATUS command
         pthread_mutex_lock(&state_lock);
@@ -367,12 +607,65 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
         pthread_mutex_unlock(&state_lock);
         
         DpiBypassStats stats = dpi_bypass_get_stats();
+        QueueHealthSnapshot health;
+        queue_health_get(&health);
+        DecisionTraceStats trace;
+        decision_trace_get_stats(&trace);
+        DaemonLogStats log_stats;
+        daemon_log_get_stats(&log_stats);
+        StrategyCacheStats strategy;
+        strategy_cache_get_stats(&strategy);
+        FlowTableStats flows;
+        flow_table_get_stats(&flows);
+        IngressObserverStats ingress;
+        ingress_observer_get_stats(&ingress);
+        InjectBackendStats inject;
+        inject_backend_get_stats(&inject);
+        char worker_cpus[128];
+        worker_sched_format_cpus(&worker_sched.cpus, worker_cpus, sizeof(worker_cpus));
         snprintf(response, resp_size, 
-                "{\"status\":\"ok\",\"running\":%s,\"packets\":%llu,\"bypassed\":%llu}",
+                "{\"status\":\"ok\",\"running\":%s,\"packets\":%llu,\"bypassed\":%llu,"
+                "\"dropped\":%llu,\"inject_failed\":%llu,\"pps\":%.1f,"
+                "\"backlog\":%u,\"kernel_drops\":%llu,\"overloaded\":%s,"
+                "\"shedding\":%s,\"shed\":%llu,\"trace_active\":%s,"
+                "\"trace_records\":%llu,\"trace_dropped\":%llu,\"log_dropped\":%llu,"
+                "\"strategy_hosts\":%u,\"handshakes_ok\":%llu,\"handshakes_failed\":%llu,"
+                "\"ingress\":%s,\"srtt_us\":%u,\"answer_us\":%u,"
+                "\"fragment_delay_us\":%u,\"rtt_delays\":%llu,\"window_clamps\":%llu,"
+                "\"target_uids\":%d,\"bpf_classifier\":%s,\"worker_cpus\":\"%s\","
+                "\"worker_policy\":\"%s\",\"inject_backend\":\"%s\",\"inject_fallbacks\":%llu,"
+                "\"ipv6\":%s,\"queues\":%d}",
                 is_running ? "true" : "false",
                 (unsigned long long)stats.packets_total,
-                (unsigned long long)stats.packets_bypassed);
-        
+                (unsigned long long)stats.packets_bypassed,
+                (unsigned long long)stats.packets_dropped,
+                (unsigned long long)stats.reasons[DPI_REASON_INJECT_FAILED],
+                stats.packet_rate,
+                health.queue.queue_total,
+                (unsigned long long)health.kernel_drops,
+                health.overloaded ? "true" : "false",
+                stats.shedding ? "true" : "false",
+                (unsigned long long)stats.reasons[DPI_REASON_SHED],
+                trace.active ? "true" : "false",
+                (unsigned long long)trace.records,
+                (unsigned long long)trace.dropped,
+                (unsigned long long)log_stats.dropped,
+                strategy.entries,
+                (unsigned long long)flows.outcomes[STRATEGY_OUTCOME_SUCCESS],
+                (unsigned long long)(flows.outcomes[STRATEGY_OUTCOME_RST] +
+                                     flows.outcomes[STRATEGY_OUTCOME_TIMEOUT] +
+                                     flows.outcomes[STRATEGY_OUTCOME_RETRANSMIT]),
+                flow_table_ingress() ? "true" : "false",
+                flows.srtt_us, flows.answer_us,
+                stats.fragment_delay_us,
+                (unsigned long long)stats.rtt_delays,
+                (unsigned long long)ingress.clamped,
+                target_uid_count, classifier_installed ? "true" : "false",
+                worker_cpus, worker_sched.fifo ? "fifo" : "other",
+                inject_backend_ready() ? inject_backend_name(inject.type) : "none",
+                (unsigned long long)inject.fallbacks,
+                ipv6_installed ? "true" : "false", queue_count);
+    
     } else if (strstr(cmd, "\"cmd\":\"settings\"") || strstr(cmd, "\"cmd\": \"settings\"")) {
         // UPDATE SETTINGS command
         // Parse settings from JSON
@@ -381,10 +674,15 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
         memcpy(&settings, current, sizeof(settings));
         
         // Parse method
-        if (strstr(cmd, "\"method\":\"SPLIT\"")) settings.method = BYPASS_SPLIT;
+        if (strstr(cmd, "\"method\":\"NONE\"")) settings.method = BYPASS_NONE;
+        else if (strstr(cmd, "\"method\":\"SPLIT\"")) settings.method = BYPASS_SPLIT;
         else if (strstr(cmd, "\"method\":\"SPLIT_REVERSE\"")) settings.method = BYPASS_SPLIT_REVERSE;
         else if (strstr(cmd, "\"method\":\"DISORDER\"")) settings.method = BYPASS_DISORDER;
         else if (strstr(cmd, "\"method\":\"DISORDER_REVERSE\"")) settings.method = BYPASS_DISORDER_REVERSE;
+        else if (strstr(cmd, "\"method\":\"OOB\"")) settings.method = BYPASS_OOB;
+        else if (strstr(cmd, "\"method\":\"IPFRAG\"")) settings.method = BYPASS_IPFRAG;
+        else if (strstr(cmd, "\"method\":\"IPFRAG_REVERSE\"")) settings.method = BYPASS_IPFRAG_REVERSE;
+        else if (strstr(cmd, "\"method\":\"WINDOW_CLAMP\"")) settings.method = BYPASS_WINDOW_CLAMP;
         
         // Parse other settings (simplified)
         char* ptr;
@@ -403,21 +701,135 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
         if (strstr(cmd, "\"desync_http\":false")) settings.desync_http = false;
         if (strstr(cmd, "\"block_quic\":true")) settings.block_quic = true;
         if (strstr(cmd, "\"block_quic\":false")) settings.block_quic = false;
+        if ((ptr = strstr(cmd, "\"shed_backlog\":")) != NULL) {
+            settings.shed_backlog = (uint32_t)strtoul(ptr + 15, NULL, 10);
+        }
+        if ((ptr = strstr(cmd, "\"shed_latency_us\":")) != NULL) {
+            settings.shed_latency_us = (uint32_t)strtoul(ptr + 18, NULL, 10);
+        }
+        if ((ptr = strstr(cmd, "\"packet_budget_us\":")) != NULL) {
+            settings.packet_budget_us = (uint32_t)strtoul(ptr + 19, NULL, 10);
+        }
+        if (strstr(cmd, "\"auto_strategy\":true")) settings.auto_strategy = true;
+        if (strstr(cmd, "\"auto_strategy\":false")) settings.auto_strategy = false;
+        if ((ptr = strstr(cmd, "\"split_delay_rtt_pct\":")) != NULL) {
+            settings.split_delay_rtt_pct = (uint8_t)atoi(ptr + 22);
+        }
+        if ((ptr = strstr(cmd, "\"split_delay_min_us\":")) != NULL) {
+            settings.split_delay_min_us = (uint32_t)strtoul(ptr + 21, NULL, 10);
+        }
+        if ((ptr = strstr(cmd, "\"split_delay_max_us\":")) != NULL) {
+            settings.split_delay_max_us = (uint32_t)strtoul(ptr + 21, NULL, 10);
+        }
+        if ((ptr = strstr(cmd, "\"clamp_window\":")) != NULL) {
+            settings.clamp_window = (uint16_t)atoi(ptr + 15);
+        }
+        if (settings.method == BYPASS_WINDOW_CLAMP && !flow_table_ingress()) {
+            LOG("Warning: WINDOW_CLAMP needs the ingress observer, splitting instead");
+        }
         
         dpi_bypass_update_settings(&settings);
         LOG("Settings updated");
         snprintf(response, resp_size, "{\"status\":\"ok\"}");
+    
+    } else if (strstr(cmd, "\"cmd\":\"trace\"") || strstr(cmd, "\"cmd\": \"trace\"")) {
+        // TRACE command - start/stop the pcapng decision trace
+        if (strstr(cmd, "\"enable\":false")) {
+            decision_trace_stop();
+            LOG("Decision trace stopped");
+            snprintf(response, resp_size, "{\"status\":\"ok\",\"trace_active\":false}");
+            return 0;
+        }
         
+        char path[256] = TRACE_FILE;
+        uint32_t max_mb = TRACE_MAX_MB;
+        uint32_t files = TRACE_FILES;
+        char* ptr;
+        json_get_string(cmd, "path", path, sizeof(path));
+        if ((ptr = strstr(cmd, "\"max_mb\":")) != NULL) {
+            max_mb = (uint32_t)strtoul(ptr + 9, NULL, 10);
+        }
+        if ((ptr = strstr(cmd, "\"files\":")) != NULL) {
+            files = (uint32_t)strtoul(ptr + 8, NULL, 10);
+        }
+        
+        // Restart with the new configuration
+        decision_trace_stop();
+        if (start_trace(path, max_mb, files, strstr(cmd, "\"all\":true") != NULL) < 0) {
+            snprintf(response, resp_size,
+                    "{\"status\":\"error\",\"message\":\"failed to open trace file\"}");
+            return -1;
+        }
+        snprintf(response, resp_size, "{\"status\":\"ok\",\"trace_active\":true}");
+    
+    } else if (strstr(cmd, "\"cmd\":\"strategy\"") || strstr(cmd, "\"cmd\": \"strategy\"")) {
+        // STRATEGY command - cache counters, optional reset
+        if (strstr(cmd, "\"clear\":true")) {
+            strategy_cache_clear();
+            flow_table_clear();
+            LOG("Strategy cache cleared");
+        }
+        
+        StrategyCacheStats strategy;
+        strategy_cache_get_stats(&strategy);
+        FlowTableStats flows;
+        flow_table_get_stats(&flows);
+        snprintf(response, resp_size,
+                "{\"status\":\"ok\",\"enabled\":%s,\"hosts\":%u,\"capacity\":%u,"
+                "\"lookups\":%llu,\"known\":%llu,\"probes\":%llu,\"evictions\":%llu,"
+                "\"success\":%llu,\"rst\":%llu,\"timeout\":%llu,\"retransmit\":%llu,"
+                "\"pending_flows\":%u}",
+                strategy_cache_enabled() ? "true" : "false",
+                strategy.entries, strategy.capacity,
+                (unsigned long long)strategy.lookups,
+                (unsigned long long)strategy.known,
+                (unsigned long long)strategy.probes,
+                (unsigned long long)strategy.evictions,
+                (unsigned long long)strategy.outcomes[STRATEGY_OUTCOME_SUCCESS],
+                (unsigned long long)strategy.outcomes[STRATEGY_OUTCOME_RST],
+                (unsigned long long)strategy.outcomes[STRATEGY_OUTCOME_TIMEOUT],
+                (unsigned long long)strategy.outcomes[STRATEGY_OUTCOME_RETRANSMIT],
+                flows.active);
+    
+    } else if (strstr(cmd, "\"cmd\":\"uids\"") || strstr(cmd, "\"cmd\": \"uids\"")) {
+        // UIDS command - per-app counters (busiest first) and queued apps, optional reset
+        if (strstr(cmd, "\"clear\":true")) {
+            uid_stats_clear();
+            LOG("Per-UID counters cleared");
+        }
+        
+        UidStatsEntry entries[MAX_TARGET_UIDS];
+        uint64_t overflows = 0;
+        uint32_t count = uid_stats_snapshot(entries, MAX_TARGET_UIDS, &overflows);
+        
+        size_t len = (size_t)snprintf(response, resp_size, "{\"status\":\"ok\",\"targets\":[");
+        for (int i = 0; i < target_uid_count && len + 16 < resp_size; i++) {
+            len += (size_t)snprintf(response + len, resp_size - len, "%s%u",
+                                    i > 0 ? "," : "", target_uids[i]);
+        }
+        len += (size_t)snprintf(response + len, resp_size - len,
+                                "],\"overflows\":%llu,\"uids\":[", (unsigned long long)overflows);
+        // Stop early rather than send truncated JSON
+        for (uint32_t i = 0; i < count && len + 128 < resp_size; i++) {
+            len += (size_t)snprintf(response + len, resp_size - len,
+                                    "%s{\"uid\":%d,\"packets\":%llu,\"bytes\":%llu,\"bypassed\":%llu}",
+                                    i > 0 ? "," : "", (int)entries[i].uid,
+                                    (unsigned long long)entries[i].packets,
+                                    (unsigned long long)entries[i].bytes,
+                                    (unsigned long long)entries[i].bypassed);
+        }
+        snprintf(response + len, resp_size - len, "]}");
+    
     } else if (strstr(cmd, "\"cmd\":\"ping\"") || strstr(cmd, "\"cmd\": \"ping\"")) {
         // PING command (keepalive)
         snprintf(response, resp_size, "{\"status\":\"ok\",\"pong\":true}");
-        
+    
     } else if (strstr(cmd, "\"cmd\":\"exit\"") || strstr(cmd, "\"cmd\": \"exit\"")) {
         // EXIT command - shutdown daemon
         LOG("Exit command received");
         running = 0;
         snprintf(response, resp_size, "{\"status\":\"ok\",\"exiting\":true}");
-        
+    
     } else {
         snprintf(response, resp_size, "{\"status\":\"error\",\"message\":\"unknown command\"}");
         return -1;
@@ -431,12 +843,22 @@ static int parse_and_execute_command(const char* cmd, char* response, size_t res
 
 /**
  * Setup iptables rules
+ * @param uids Apps whose traffic is queued (owner-scoped rules)
+ * @param uid_count Number of uids, 0 to queue every app
+ * @param classifier Queue only handshake packets (xt_bpf), falling back to port rules
+ * @param ipv6 Queue IPv6 traffic too (ip6tables)
+ * @param queues Outbound queues; more than one spreads packets with
+ *               --queue-cpu-fanout, falling back to a single queue
  */
-static int setup_iptables(void) {
+static int setup_iptables(const uint32_t* uids, int uid_count, bool classifier, bool ipv6,
+                          int queues) {
     LOG("=== SETTING UP IPTABLES ===");
     
-    // Clear existing rules first
+    // Clear existing rules first (including the previous app list)
     clear_iptables();
+    memcpy(target_uids, uids, uid_count * sizeof(uids[0]));
+    target_uid_count = uid_count;
+    queue_count = queues;
     
     // Check if iptables is available
     int check = system("which iptables > /dev/null 2>&1");
@@ -447,12 +869,7 @@ static int setup_iptables(void) {
     LOG("iptables found OK");
     
     // IMPORTANT: First rule - ACCEPT packets with our mark (avoid re-capturing our own injected packets)
-    char mark_cmd[256];
-    snprintf(mark_cmd, sizeof(mark_cmd),
-             "iptables -I OUTPUT -m mark --mark 0x%X -j ACCEPT 2>&1",
-             OUR_PACKET_MARK);
-    LOG("Running: %s", mark_cmd);
-    int ret0 = system(mark_cmd);
+    int ret0 = mark_rule("iptables", "-I", "2>&1");
     LOG("Mark rule result: %d", ret0);
     if (ret0 != 0) {
         LOG("Warning: Could not add mark exception rule (may need xt_mark module)");
@@ -460,59 +877,437 @@ static int setup_iptables(void) {
     }
     
     // Add NFQUEUE rules for HTTPS and HTTP (after mark exception)
-    LOG("Adding NFQUEUE rule for port 443...");
-    int ret1 = system("iptables -A OUTPUT -p tcp --dport 443 -j NFQUEUE --queue-num 0 --queue-bypass 2>&1");
-    LOG("Port 443 rule result: %d", ret1);
-    
-    LOG("Adding NFQUEUE rule for port 80...");
-    int ret2 = system("iptables -A OUTPUT -p tcp --dport 80 -j NFQUEUE --queue-num 0 --queue-bypass 2>&1");
-    LOG("Port 80 rule result: %d", ret2);
-    
-    if (ret1 != 0 || ret2 != 0) {
-        LOG("!!! ERROR: iptables NFQUEUE rules failed: %d, %d !!!", ret1, ret2);
-        // Try without --queue-bypass
-        LOG("Trying without --queue-bypass...");
-        ret1 = system("iptables -A OUTPUT -p tcp --dport 443 -j NFQUEUE --queue-num 0 2>&1");
-        ret2 = system("iptables -A OUTPUT -p tcp --dport 80 -j NFQUEUE --queue-num 0 2>&1");
-        LOG("Retry results: %d, %d", ret1, ret2);
-        
-        if (ret1 != 0 || ret2 != 0) {
-            LOG("!!! CRITICAL: Cannot setup iptables rules !!!");
-            return -1;
+    if (uid_count > 0) {
+        LOG("Adding NFQUEUE rules for ports 443/80, %d app UIDs...", uid_count);
+    } else {
+        LOG("Adding NFQUEUE rules for ports 443/80...");
+    }
+    if (classifier) {
+        char bytecode[900];
+        if (handshake_filter_bytecode(bytecode, sizeof(bytecode)) > 0) {
+            snprintf(classifier_match, sizeof(classifier_match),
+                     " -m bpf --bytecode \"%s\"", bytecode);
+            if (add_queue_rules("iptables", uids, uid_count, classifier_match) == 0) {
+                classifier_installed = true;
+                LOG("BPF classifier installed: only SYNs, ClientHellos and HTTP requests are queued");
+            } else {
+                LOG("Warning: BPF classifier rules failed (needs xt_bpf), using port rules");
+            }
         }
     }
+    if (!classifier_installed && add_queue_rules("iptables", uids, uid_count, "") < 0) {
+        LOG("!!! CRITICAL: Cannot setup iptables rules%s !!!",
+            uid_count > 0 ? " (owner match needs xt_owner)" : "");
+        return -1;
+    }
     
     // Verify rules
     LOG("Verifying iptables rules...");
     system("iptables -L OUTPUT -n -v 2>&1 | head -10");
     
+    if (ipv6) {
+        setup_ip6tables(uids, uid_count);
+    }
+    
     LOG("=== IPTABLES SETUP COMPLETE (mark=0x%X) ===", OUR_PACKET_MARK);
     return 0;
 }
 
+/**
+ * Setup the IPv6 mark exception and queue rules
+ * Port rules only: the BPF classifier bytecode reads IPv4 headers.
+ * Failure leaves IPv6 traffic unqueued; IPv4 keeps working.
+ */
+static void setup_ip6tables(const uint32_t* uids, int uid_count) {
+    if (system("which ip6tables > /dev/null 2>&1") != 0) {
+        LOG("Warning: ip6tables not found in PATH, IPv6 traffic is not queued");
+        return;
+    }
+    
+    if (mark_rule("ip6tables", "-I", "2>&1") != 0) {
+        LOG("Warning: Could not add IPv6 mark exception rule");
+    }
+    if (add_queue_rules("ip6tables", uids, uid_count, "") < 0) {
+        LOG("Warning: ip6tables NFQUEUE rules failed, IPv6 traffic is not queued");
+        mark_rule("ip6tables", "-D", "2>/dev/null");
+        return;
+    }
+    
+    ipv6_installed = true;
+    LOG("IPv6 NFQUEUE rules added");
+}
+
 /**
  * Clear iptables rules
  */
 static int clear_iptables(void) {
     LOG("Clearing iptables...");
     
+    // Remove NFQUEUE rules (run multiple times to clear all)
+    for (int i = 0; i < 5; i++) {
+        mark_rule("iptables", "-D", "2>/dev/null");
+        queue_rules("iptables", "-D", NULL, 0, "", false, "2>/dev/null");
+        queue_rules("iptables", "-D", NULL, 0, "", true, "2>/dev/null");
+        ingress_rules("-D", "2>/dev/null");
+        mark_rule("ip6tables", "-D", "2>/dev/null");
+        queue_rules("ip6tables", "-D", NULL, 0, "", false, "2>/dev/null");
+        queue_rules("ip6tables", "-D", NULL, 0, "", true, "2>/dev/null");
+    }
+    
+    // Owner-scoped and classifier rules were added once
+    if (ipv6_installed && target_uid_count > 0) {
+        queue_rules("ip6tables", "-D", target_uids, target_uid_count, "", false, "2>/dev/null");
+        queue_rules("ip6tables", "-D", target_uids, target_uid_count, "", true, "2>/dev/null");
+    }
+    if (target_uid_count > 0 || classifier_installed) {
+        const char* match = classifier_installed ? classifier_match : "";
+        queue_rules("iptables", "-D", target_uids, target_uid_count, match, false, "2>/dev/null");
+        queue_rules("iptables", "-D", target_uids, target_uid_count, match, true, "2>/dev/null");
+        target_uid_count = 0;
+        classifier_installed = false;
+    }
+    ipv6_installed = false;
+    queue_count = 1;
+    
+    return 0;
+}
+
+/**
+ * Insert (-I) or delete (-D) the OUTPUT rule accepting our injected packets
+ * @param tool "iptables" or "ip6tables"
+ * @return system() status of the command
+ */
+static int mark_rule(const char* tool, const char* action, const char* redirect) {
     char mark_cmd[256];
     snprintf(mark_cmd, sizeof(mark_cmd),
-             "iptables -D OUTPUT -m mark --mark 0x%X -j ACCEPT 2>/dev/null",
-             OUR_PACKET_MARK);
+             "%s %s OUTPUT -m mark --mark 0x%X -j ACCEPT %s",
+             tool, action, OUR_PACKET_MARK, redirect);
+    return system(mark_cmd);
+}
+
+/**
+ * Add (-A) or delete (-D) the OUTPUT rules feeding the queue: HTTP(S)
+ * from every app, or one owner-scoped rule per port and app UID
+ * Several queues (queue_count) are fed by --queue-cpu-fanout.
+ * @param tool "iptables" or "ip6tables"
+ * @param match Extra match appended to each rule ("" = none)
+ * @return 0 if every command succeeded
+ */
+static int queue_rules(const char* tool, const char* action, const uint32_t* uids, int uid_count,
+                       const char* match, bool bypass, const char* redirect) {
+    static const int ports[] = { 443, 80 };
+    char target[64] = "--queue-num 0";
+    if (queue_count > 1) {
+        snprintf(target, sizeof(target), "--queue-balance %d:%d --queue-cpu-fanout",
+                 FANOUT_QUEUE_BASE, FANOUT_QUEUE_BASE + queue_count - 1);
+    }
+    int result = 0;
+    for (size_t i = 0; i < sizeof(ports) / sizeof(ports[0]); i++) {
+        for (int u = 0; u < (uid_count > 0 ? uid_count : 1); u++) {
+            char owner[48] = "";
+            if (uid_count > 0) {
+                snprintf(owner, sizeof(owner), " -m owner --uid-owner %u", uids[u]);
+            }
+            char rule_cmd[1280];
+            snprintf(rule_cmd, sizeof(rule_cmd),
+                     "%s %s OUTPUT -p tcp --dport %d%s%s -j NFQUEUE %s%s %s",
+                     tool, action, ports[i], owner, match, target,
+                     bypass ? " --queue-bypass" : "", redirect);
+            if (system(rule_cmd) != 0) result = -1;
+        }
+    }
+    return result;
+}
+
+/**
+ * Add the queue rules, retrying without --queue-bypass (older kernels)
+ * and then on a single queue (--queue-cpu-fanout needs Linux 3.10)
+ * A partial set is removed before retrying or failing.
+ * @return 0 on success, -1 if no variant could be added
+ */
+static int add_queue_rules(const char* tool, const uint32_t* uids, int uid_count, const char* match) {
+    if (queue_rules(tool, "-A", uids, uid_count, match, true, "2>&1") == 0) return 0;
     
-    // Remove NFQUEUE rules (run multiple times to clear all)
-    for (int i = 0; i < 5; i++) {
-        system(mark_cmd);
-        system("iptables -D OUTPUT -p tcp --dport 443 -j NFQUEUE --queue-num 0 2>/dev/null");
-        system("iptables -D OUTPUT -p tcp --dport 443 -j NFQUEUE --queue-num 0 --queue-bypass 2>/dev/null");
-        system("iptables -D OUTPUT -p tcp --dport 80 -j NFQUEUE --queue-num 0 2>/dev/null");
-        system("iptables -D OUTPUT -p tcp --dport 80 -j NFQUEUE --queue-num 0 --queue-bypass 2>/dev/null");
+    LOG("!!! ERROR: %s NFQUEUE rules failed !!!", tool);
+    // Try without --queue-bypass
+    LOG("Trying without --queue-bypass...");
+    queue_rules(tool, "-D", uids, uid_count, match, true, "2>/dev/null");
+    if (queue_rules(tool, "-A", uids, uid_count, match, false, "2>&1") == 0) return 0;
+    
+    queue_rules(tool, "-D", uids, uid_count, match, false, "2>/dev/null");
+    if (queue_count > 1) {
+        int queues = queue_count;
+        LOG("Trying without --queue-cpu-fanout...");
+        queue_count = 1;
+        if (add_queue_rules(tool, uids, uid_count, match) == 0) return 0;
+        queue_count = queues;
     }
+    return -1;
+}
+
+/**
+ * Replace the classifier rules with plain port rules
+ * The port rules go in first so traffic is never left unqueued.
+ */
+static void use_port_rules(void) {
+    if (add_queue_rules("iptables", target_uids, target_uid_count, "") < 0) {
+        LOG("Warning: port rules failed, keeping the BPF classifier");
+        return;
+    }
+    queue_rules("iptables", "-D", target_uids, target_uid_count, classifier_match, false, "2>/dev/null");
+    queue_rules("iptables", "-D", target_uids, target_uid_count, classifier_match, true, "2>/dev/null");
+    classifier_installed = false;
+}
+
+/**
+ * Add (-I) or delete (-D) the INPUT rules feeding the ingress observer:
+ * the first INGRESS_PACKETS server packets of each HTTP(S) connection
+ * @return 0 if both commands succeeded
+ */
+static int ingress_rules(const char* action, const char* redirect) {
+    static const int ports[] = { 443, 80 };
+    int result = 0;
+    for (size_t i = 0; i < sizeof(ports) / sizeof(ports[0]); i++) {
+        char rule_cmd[256];
+        snprintf(rule_cmd, sizeof(rule_cmd),
+                 "iptables %s INPUT -p tcp --sport %d -m connbytes --connbytes %s "
+                 "--connbytes-dir reply --connbytes-mode packets "
+                 "-j NFQUEUE --queue-num %d --queue-bypass %s",
+                 action, ports[i], INGRESS_PACKETS, INGRESS_QUEUE_NUM, redirect);
+        if (system(rule_cmd) != 0) result = -1;
+    }
+    return result;
+}
+
+/**
+ * Add the inbound rules and start the ingress observer
+ * Failure only disables RTT/outcome observation; the outbound queue keeps running.
+ */
+static void start_ingress(void) {
+    if (ingress_rules("-I", "2>&1") < 0) {
+        LOG("Warning: inbound observation rules failed (needs xt_connbytes), ingress observer off");
+        ingress_rules("-D", "2>/dev/null");
+        return;
+    }
+    
+    IngressObserverConfig icfg = {
+        .queue_num = INGRESS_QUEUE_NUM,
+        .thread_start = ingress_thread_start,
+        .thread_data = NULL
+    };
+    if (ingress_observer_start(&icfg) < 0) {
+        LOG("Warning: ingress observer failed to start");
+        ingress_rules("-D", "2>/dev/null");
+        return;
+    }
+    LOG("Ingress observer on queue %d (server packets %s)", INGRESS_QUEUE_NUM, INGRESS_PACKETS);
+}
+
+/**
+ * Worker placement from start settings: "cpus" ("auto" = big cores, or a
+ * list like "4-7"), "sched":"fifo" with "priority", or "nice"
+ */
+static void parse_worker_sched(const char* cmd) {
+    memset(&worker_sched, 0, sizeof(worker_sched));
+    
+    char spec[128];
+    if (json_get_string(cmd, "cpus", spec, sizeof(spec)) > 0) {
+        int count = worker_sched_parse_cpus(spec, &worker_sched.cpus);
+        if (count < 0) {
+            LOG("Warning: bad cpus \"%s\", workers not pinned", spec);
+        } else if (count == 0) {
+            LOG("Warning: no %s CPUs found, workers not pinned",
+                strcmp(spec, "auto") == 0 ? "big" : "online");
+        }
+    }
+    
+    char policy[16];
+    if (json_get_string(cmd, "sched", policy, sizeof(policy)) > 0) {
+        worker_sched.fifo = strcmp(policy, "fifo") == 0;
+    }
+    worker_sched.fifo_priority = WORKER_FIFO_PRIORITY;
+    const char* ptr;
+    if ((ptr = strstr(cmd, "\"priority\":")) != NULL) {
+        worker_sched.fifo_priority = atoi(ptr + 11);
+    }
+    if ((ptr = strstr(cmd, "\"nice\":")) != NULL) {
+        worker_sched.nice = atoi(ptr + 7);
+    }
+}
+
+/**
+ * Start one worker thread per bound queue
+ * @return 0 on success, -1 if a thread could not be created
+ */
+static int start_workers(void) {
+    int count = nfqueue_queue_count();
     
+    pthread_mutex_lock(&state_lock);
+    nfqueue_workers_live = count;
+    pthread_mutex_unlock(&state_lock);
+    
+    for (nfqueue_thread_count = 0; nfqueue_thread_count < count; nfqueue_thread_count++) {
+        if (pthread_create(&nfqueue_threads[nfqueue_thread_count], NULL, nfqueue_thread_func,
+                           (void*)(intptr_t)nfqueue_thread_count) != 0) {
+            pthread_mutex_lock(&state_lock);
+            nfqueue_workers_live -= count - nfqueue_thread_count;
+            pthread_mutex_unlock(&state_lock);
+            return -1;
+        }
+    }
     return 0;
 }
 
+/**
+ * Stop the queue workers, wait for them and release the queues
+ */
+static void stop_workers(void) {
+    nfqueue_stop();
+    for (int i = 0; i < nfqueue_thread_count; i++) {
+        pthread_join(nfqueue_threads[i], NULL);
+    }
+    nfqueue_thread_count = 0;
+    nfqueue_cleanup();
+}
+
+/**
+ * Observer thread hook: same placement as the queue worker
+ */
+static void ingress_thread_start(void* user_data) {
+    (void)user_data;
+    worker_sched_apply(&worker_sched, "Ingress observer");
+}
+
+/**
+ * Start the pcapng decision trace
+ */
+static int start_trace(const char* path, uint32_t max_mb, uint32_t files, bool all_packets) {
+    DecisionTraceConfig config = {
+        .path = path,
+        .max_file_bytes = (uint64_t)(max_mb > 0 ? max_mb : TRACE_MAX_MB) * 1024 * 1024,
+        .max_files = files,
+        .all_packets = all_packets
+    };
+    if (decision_trace_start(&config) < 0) {
+        LOG("Failed to start decision trace on %s", path);
+        return -1;
+    }
+    LOG("Decision trace: %s (%u MB, %u rotated%s)", path, max_mb, files,
+        all_packets ? ", all packets" : "");
+    return 0;
+}
+
+/**
+ * Extract a string value ("key":"value") from a command
+ * @return Value length, -1 if the key is absent or the value does not fit
+ */
+static int json_get_string(const char* json, const char* key, char* out, size_t out_size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    const char* start = strstr(json, pattern);
+    if (start == NULL) return -1;
+    start += strlen(pattern);
+    
+    const char* end = strchr(start, '"');
+    if (end == NULL || (size_t)(end - start) >= out_size) return -1;
+    
+    memcpy(out, start, end - start);
+    out[end - start] = '\0';
+    return (int)(end - start);
+}
+
+/**
+ * Collect the apps to queue from "uids":[N,...] and "packages":["name",...]
+ * Duplicates are dropped; unknown packages are logged and skipped.
+ * @return Number of UIDs (0 = none requested), -1 if apps were requested but none resolved
+ */
+static int parse_targets(const char* cmd, uint32_t* uids, int max) {
+    int count = 0;
+    bool requested = false;
+    
+    const char* p = strstr(cmd, "\"uids\":[");
+    if (p != NULL) {
+        p += 8;
+        for (;;) {
+            while (*p == ' ' || *p == ',') p++;
+            char* end;
+            unsigned long uid = strtoul(p, &end, 10);
+            if (end == p) break;
+            requested = true;
+            count = add_target(uids, count, max, (uint32_t)uid);
+            p = end;
+        }
+    }
+    
+    p = strstr(cmd, "\"packages\":[");
+    if (p != NULL) {
+        p += 12;
+        for (;;) {
+            while (*p == ' ' || *p == ',') p++;
+            if (*p != '"') break;
+            const char* end = strchr(p + 1, '"');
+            if (end == NULL) break;
+            requested = true;
+            
+            char name[128];
+            size_t len = (size_t)(end - p - 1);
+            if (len < sizeof(name)) {
+                memcpy(name, p + 1, len);
+                name[len] = '\0';
+                uint32_t uid;
+                if (resolve_package(name, &uid) == 0) {
+                    LOG("Package %s -> uid %u", name, uid);
+                    count = add_target(uids, count, max, uid);
+                } else {
+                    LOG("Warning: package %s not found in %s", name, PACKAGES_LIST);
+                }
+            }
+            p = end + 1;
+        }
+    }
+    
+    return (requested && count == 0) ? -1 : count;
+}
+
+/**
+ * Append a UID unless present or the list is full
+ * @return New count
+ */
+static int add_target(uint32_t* uids, int count, int max, uint32_t uid) {
+    for (int i = 0; i < count; i++) {
+        if (uids[i] == uid) return count;
+    }
+    if (count >= max) {
+        LOG("Warning: more than %d target apps, uid %u ignored", max, uid);
+        return count;
+    }
+    uids[count] = uid;
+    return count + 1;
+}
+
+/**
+ * Look up the UID of an installed package (primary user)
+ * @return 0 on success, -1 if unknown or the package list is unreadable
+ */
+static int resolve_package(const char* name, uint32_t* uid) {
+    FILE* f = fopen(PACKAGES_LIST, "r");
+    if (f == NULL) return -1;
+    
+    char line[512];
+    int result = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char pkg[128];
+        unsigned int value;
+        if (sscanf(line, "%127s %u", pkg, &value) == 2 && strcmp(pkg, name) == 0) {
+            *uid = value;
+            result = 0;
+            break;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
 /**
  * Write PID file
  */
@@ -534,9 +1329,9 @@ static void cleanup(void) {
     pthread_mutex_lock(&state_lock);
     if (nfqueue_active) {
         pthread_mutex_unlock(&state_lock);
-        nfqueue_stop();
-        pthread_join(nfqueue_thread, NULL);
-        nfqueue_cleanup();
+        ingress_observer_stop();
+        queue_health_stop();
+        stop_workers();
     } else {
         pthread_mutex_unlock(&state_lock);
     }
@@ -544,6 +1339,15 @@ static void cleanup(void) {
     // Clear iptables
     clear_iptables();
     
+    // Stop metrics exporter
+    metrics_server_stop();
+    
+    // Flush and close the decision trace
+    decision_trace_stop();
+    
+    // Unmap the strategy cache (contents stay in the file)
+    strategy_cache_close();
+    
     // Close server socket
     if (server_socket >= 0) {
         close(server_socket);
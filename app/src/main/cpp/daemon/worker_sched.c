@@ -0,0 +1,238 @@
+/**
+ * worker_sched.c
+ *
+ * Worker thread placement implementation.
+ */
+
+#include "worker_sched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define LOG_TAG "WorkerSched"
+#include "../netrix_log.h"
+
+#define CPU_SYSFS "/sys/devices/system/cpu"
+#define BIG_CAPACITY_PCT 75            // Capacity (% of the largest) counted as a big core
+
+// Forward declarations
+static int parse_list(const char* spec, cpu_set_t* cpus);
+static int read_list(const char* path, cpu_set_t* cpus);
+
+/**
+ * Parse a CPU list
+ */
+int worker_sched_parse_cpus(const char* spec, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    if (spec == NULL || spec[0] == '\0') return 0;
+    
+    if (strcmp(spec, "auto") == 0) {
+        return worker_sched_big_cores(cpus);
+    }
+    
+    if (parse_list(spec, cpus) < 0) return -1;
+    
+    cpu_set_t online;
+    if (read_list(CPU_SYSFS "/online", &online) > 0) {
+        CPU_AND(cpus, cpus, &online);
+    }
+    return CPU_COUNT(cpus);
+}
+
+/**
+ * Find the big cores
+ */
+int worker_sched_big_cores(cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    
+    cpu_set_t online;
+    if (read_list(CPU_SYSFS "/online", &online) <= 0) return 0;
+    
+    unsigned long capacity[CPU_SETSIZE];
+    unsigned long max_capacity = 0;
+    unsigned long min_capacity = ~0UL;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        capacity[cpu] = 0;
+        if (!CPU_ISSET(cpu, &online)) continue;
+        
+        char path[96];
+        snprintf(path, sizeof(path), CPU_SYSFS "/cpu%d/cpu_capacity", cpu);
+        FILE* f = fopen(path, "r");
+        if (f == NULL) continue;
+        if (fscanf(f, "%lu", &capacity[cpu]) != 1) capacity[cpu] = 0;
+        fclose(f);
+        
+        if (capacity[cpu] == 0) continue;
+        if (capacity[cpu] > max_capacity) max_capacity = capacity[cpu];
+        if (capacity[cpu] < min_capacity) min_capacity = capacity[cpu];
+    }
+    
+    // Symmetric CPUs (or no capacity files): nothing to prefer
+    if (max_capacity == 0 || min_capacity == max_capacity) return 0;
+    
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (capacity[cpu] * 100 >= max_capacity * BIG_CAPACITY_PCT) {
+            CPU_SET(cpu, cpus);
+        }
+    }
+    return CPU_COUNT(cpus);
+}
+
+/**
+ * Queue count for --queue-cpu-fanout
+ */
+int worker_sched_fanout_queues(int max) {
+    cpu_set_t possible;
+    int queues = 0;
+    if (read_list(CPU_SYSFS "/possible", &possible) > 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &possible)) queues = cpu + 1;
+        }
+    } else {
+        queues = (int)sysconf(_SC_NPROCESSORS_CONF);
+    }
+    
+    if (queues > max) queues = max;
+    return queues > 1 ? queues : 1;
+}
+
+/**
+ * CPUs whose packets --queue-cpu-fanout sends to one queue
+ */
+int worker_sched_fanout_cpus(int index, int queues, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    if (queues <= 0 || index < 0 || index >= queues) return 0;
+    
+    for (int cpu = index; cpu < CPU_SETSIZE; cpu += queues) {
+        CPU_SET(cpu, cpus);
+    }
+    
+    cpu_set_t online;
+    if (read_list(CPU_SYSFS "/online", &online) > 0) {
+        CPU_AND(cpus, cpus, &online);
+    }
+    return CPU_COUNT(cpus);
+}
+
+/**
+ * Apply the settings to the calling thread
+ */
+int worker_sched_apply(const WorkerSched* sched, const char* name) {
+    if (sched == NULL) return 0;
+    int result = 0;
+    
+    if (CPU_COUNT(&sched->cpus) > 0) {
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(sched->cpus), &sched->cpus);
+        if (err != 0) {
+            LOGE("%s: CPU affinity failed: %s", name, strerror(err));
+            result = -1;
+        }
+    }
+    
+    if (sched->fifo) {
+        int priority = sched->fifo_priority;
+        int min = sched_get_priority_min(SCHED_FIFO);
+        int max = sched_get_priority_max(SCHED_FIFO);
+        if (priority < min) priority = min;
+        if (priority > max) priority = max;
+        
+        struct sched_param param = { .sched_priority = priority };
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0) {
+            LOGE("%s: SCHED_FIFO failed: %s", name, strerror(err));
+            result = -1;
+        }
+    } else if (sched->nice != 0) {
+        // Linux nice values are per thread
+        if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), sched->nice) < 0) {
+            LOGE("%s: nice %d failed: %s", name, sched->nice, strerror(errno));
+            result = -1;
+        }
+    }
+    
+    char cpus[128];
+    worker_sched_format_cpus(&sched->cpus, cpus, sizeof(cpus));
+    LOGI("%s: cpus=%s, policy=%s, priority=%d, nice=%d", name, cpus[0] ? cpus : "any",
+         sched->fifo ? "fifo" : "other", sched->fifo ? sched->fifo_priority : 0,
+         sched->fifo ? 0 : sched->nice);
+    return result;
+}
+
+/**
+ * Format a CPU set as ranges
+ */
+void worker_sched_format_cpus(const cpu_set_t* cpus, char* out, size_t out_size) {
+    size_t len = 0;
+    out[0] = '\0';
+    
+    for (int cpu = 0; cpu < CPU_SETSIZE && len < out_size; cpu++) {
+        if (!CPU_ISSET(cpu, cpus)) continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus)) last++;
+        
+        int n = last > cpu
+                ? snprintf(out + len, out_size - len, "%s%d-%d", len ? "," : "", cpu, last)
+                : snprintf(out + len, out_size - len, "%s%d", len ? "," : "", cpu);
+        if (n < 0) break;
+        len += (size_t)n;
+        cpu = last;
+    }
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Parse "0-3,6" into a set
+ * @return Number of CPUs, -1 if malformed
+ */
+static int parse_list(const char* spec, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    const char* p = spec;
+    
+    while (*p != '\0' && *p != '\n') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE) return -1;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE) return -1;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET((int)cpu, cpus);
+        
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0' && *p != '\n') {
+            return -1;
+        }
+    }
+    return CPU_COUNT(cpus);
+}
+
+/**
+ * CPU list from sysfs ("online", "possible")
+ * @return Number of CPUs, -1 if unknown
+ */
+static int read_list(const char* path, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return -1;
+    
+    char line[256];
+    int count = -1;
+    if (fgets(line, sizeof(line), f) != NULL) {
+        count = parse_list(line, cpus);
+    }
+    fclose(f);
+    return count;
+}
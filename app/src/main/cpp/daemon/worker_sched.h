@@ -0,0 +1,90 @@
+/**
+ * worker_sched.h
+ *
+ * CPU placement and scheduling class of the packet worker threads.
+ * On big.LITTLE SoCs the scheduler often runs an idle-looking queue
+ * thread on a little core, and a handshake burst then waits for it to
+ * migrate or for a preempting task to yield. Workers can be pinned to
+ * chosen CPUs (or the big cores, from cpu_capacity), run SCHED_FIFO, or
+ * get a nice level. With --queue-cpu-fanout each queue's worker runs on
+ * the CPUs whose packets land in that queue, so a packet is serviced on
+ * the core that enqueued it. The effect shows in netrix_packet_lag_seconds
+ * and netrix_packet_service_seconds.
+ */
+
+#ifndef WORKER_SCHED_H
+#define WORKER_SCHED_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sched.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Worker scheduling settings
+typedef struct {
+    cpu_set_t cpus;                // CPUs to run on (empty = not pinned)
+    bool fifo;                     // SCHED_FIFO instead of SCHED_OTHER
+    int fifo_priority;             // SCHED_FIFO priority (1-99)
+    int nice;                      // Nice level under SCHED_OTHER (0 = unchanged)
+} WorkerSched;
+
+/**
+ * Parse a CPU list: "auto" (big cores), or "0-3,6" style ranges
+ * Offline CPUs are dropped.
+ * @param spec CPU list
+ * @param cpus Output set (empty if "auto" finds no big cores)
+ * @return Number of CPUs in the set, -1 if spec is malformed
+ */
+int worker_sched_parse_cpus(const char* spec, cpu_set_t* cpus);
+
+/**
+ * Find the big cores: CPUs whose cpu_capacity is at least 3/4 of the
+ * largest (prime and big clusters of a tri-cluster SoC)
+ * @param cpus Output set
+ * @return Number of big cores, 0 if capacities are missing or all equal
+ */
+int worker_sched_big_cores(cpu_set_t* cpus);
+
+/**
+ * Queue count for --queue-cpu-fanout: one per possible CPU, so each
+ * queue is fed by a single CPU unless capped
+ * @param max Most queues to use
+ * @return Queue count (1 on a single-CPU system)
+ */
+int worker_sched_fanout_queues(int max);
+
+/**
+ * CPUs whose packets --queue-cpu-fanout sends to one queue of the range
+ * (the kernel picks queue cpu % queues). Offline CPUs are dropped.
+ * @param index Queue index in the range
+ * @param queues Queues in the range
+ * @param cpus Output set
+ * @return Number of CPUs in the set
+ */
+int worker_sched_fanout_cpus(int index, int queues, cpu_set_t* cpus);
+
+/**
+ * Apply the settings to the calling thread
+ * Each failing step is logged and skipped.
+ * @param sched Settings
+ * @param name Thread name for the log
+ * @return 0 if every requested step succeeded, -1 otherwise
+ */
+int worker_sched_apply(const WorkerSched* sched, const char* name);
+
+/**
+ * Format a CPU set as ranges ("4-7"; "" when empty)
+ * @param cpus CPU set
+ * @param out Output buffer
+ * @param out_size Size of out
+ */
+void worker_sched_format_cpus(const cpu_set_t* cpus, char* out, size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WORKER_SCHED_H
@@ -0,0 +1,432 @@
+/**
+ * decision_trace.c
+ *
+ * pcapng decision trace implementation.
+ * Fixed-size records in a record_ring; its writer thread turns them into
+ * Enhanced Packet Blocks in a rotating_file.
+ */
+
+#include "decision_trace.h"
+#include "record_ring.h"
+#include "rotating_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define LOG_TAG "Trace"
+#include "netrix_log.h"
+
+#define TRACE_SNAPLEN 2048             // Bytes kept per packet
+#define TRACE_COMMENT_MAX 256
+#define TRACE_MAX_PENDING 16           // Fragments remembered per traced packet
+#define WRITER_BATCH 256
+#define FILE_BUFFER_SIZE (256 * 1024)
+
+#define DEFAULT_MAX_FILE_BYTES (16ULL * 1024 * 1024)
+#define DEFAULT_RING_SLOTS 1024
+
+// pcapng block types and options
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_LINKTYPE_RAW 101
+#define OPT_ENDOFOPT 0
+#define OPT_COMMENT 1
+#define OPT_SHB_USERAPPL 4
+#define OPT_IF_NAME 2
+#define OPT_IF_TSRESOL 9
+#define OPT_EPB_FLAGS 2
+#define EPB_FLAG_OUTBOUND 0x2
+
+// One ring record
+typedef struct {
+    uint64_t ts_ns;                    // Monotonic
+    uint32_t orig_len;
+    uint32_t cap_len;
+    uint32_t comment_len;
+    char comment[TRACE_COMMENT_MAX];
+    uint8_t data[TRACE_SNAPLEN];
+} TraceRecord;
+
+// Fragment injected while the current packet is processed
+typedef struct {
+    uint64_t ts_ns;
+    uint32_t orig_len;
+    uint32_t cap_len;
+    uint8_t data[TRACE_SNAPLEN];
+} PendingFragment;
+
+typedef struct {
+    uint32_t count;
+    uint32_t overflow;                 // Fragments beyond TRACE_MAX_PENDING
+    PendingFragment fragments[TRACE_MAX_PENDING];
+} PendingList;
+
+// Global state
+static struct {
+    DecisionTraceConfig config;
+    char path[256];
+    RecordRing ring;
+    // Writer
+    RotatingFile out;                  // Starts with SHB + IDB
+    int64_t realtime_offset_ns;        // Added to monotonic timestamps
+    // Counters (ring drops are counted in the ring)
+    atomic_uint_fast64_t records;
+    atomic_uint_fast64_t dropped;      // No file after a failed rotation
+    atomic_uint_fast64_t bytes;
+    pthread_mutex_t lock;
+} g_trace = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Per-thread fragment list (allocated on first use, freed at thread exit)
+static pthread_key_t g_pending_key;
+static pthread_once_t g_pending_once = PTHREAD_ONCE_INIT;
+static __thread PendingList* t_pending = NULL;
+
+// Forward declarations
+static size_t drain_ring(void* ctx);
+static bool ring_push(uint64_t ts_ns, const uint8_t* data, uint32_t len,
+                      const char* comment, int comment_len);
+static uint64_t write_headers(FILE* file, void* ctx);
+static void write_epb(const TraceRecord* record);
+static void put_option(uint8_t* block, uint32_t* pos, uint16_t code, const void* value, uint16_t len);
+static void make_pending_key(void);
+static uint64_t monotonic_ns(void);
+
+/**
+ * Start tracing
+ */
+int decision_trace_start(const DecisionTraceConfig* config) {
+    if (config == NULL || config->path == NULL || config->path[0] == '\0') return -1;
+    if (strlen(config->path) >= sizeof(g_trace.path) - 4) return -1;
+    
+    // Restart with the new configuration
+    decision_trace_stop();
+    
+    pthread_mutex_lock(&g_trace.lock);
+    
+    g_trace.config = *config;
+    strcpy(g_trace.path, config->path);
+    g_trace.config.path = g_trace.path;
+    if (g_trace.config.max_file_bytes == 0) g_trace.config.max_file_bytes = DEFAULT_MAX_FILE_BYTES;
+    if (g_trace.config.ring_slots == 0) g_trace.config.ring_slots = DEFAULT_RING_SLOTS;
+    
+    size_t slots = record_ring_init(&g_trace.ring, g_trace.config.ring_slots, sizeof(TraceRecord));
+    if (slots == 0) {
+        LOGE("Trace ring allocation failed (%u slots)", g_trace.config.ring_slots);
+        pthread_mutex_unlock(&g_trace.lock);
+        return -1;
+    }
+    g_trace.config.ring_slots = (uint32_t)slots;
+    
+    struct timespec rt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    g_trace.realtime_offset_ns = (int64_t)rt.tv_sec * 1000000000LL + rt.tv_nsec -
+                                 (int64_t)monotonic_ns();
+    
+    RotatingFileConfig out = {
+        .path = g_trace.path,
+        .max_bytes = g_trace.config.max_file_bytes,
+        .max_files = g_trace.config.max_files,
+        .buffer_size = FILE_BUFFER_SIZE,
+        .header = write_headers
+    };
+    if (rotating_file_open(&g_trace.out, &out) < 0) {
+        LOGE("Cannot open trace file %s: %s", g_trace.path, strerror(errno));
+        record_ring_free(&g_trace.ring);
+        pthread_mutex_unlock(&g_trace.lock);
+        return -1;
+    }
+    
+    if (record_ring_start(&g_trace.ring, drain_ring, NULL) < 0) {
+        LOGE("Trace writer thread creation failed");
+        rotating_file_close(&g_trace.out);
+        record_ring_free(&g_trace.ring);
+        pthread_mutex_unlock(&g_trace.lock);
+        return -1;
+    }
+    
+    LOGI("Decision trace started: %s (max %llu bytes + %u rotated, %zu slots)",
+         g_trace.path, (unsigned long long)g_trace.config.max_file_bytes,
+         g_trace.config.max_files, slots);
+    
+    pthread_mutex_unlock(&g_trace.lock);
+    return 0;
+}
+
+/**
+ * Stop tracing
+ */
+void decision_trace_stop(void) {
+    pthread_mutex_lock(&g_trace.lock);
+    
+    if (!record_ring_active(&g_trace.ring)) {
+        pthread_mutex_unlock(&g_trace.lock);
+        return;
+    }
+    
+    // Writes out queued records before returning
+    record_ring_stop(&g_trace.ring);
+    rotating_file_close(&g_trace.out);
+    record_ring_free(&g_trace.ring);
+    
+    LOGI("Decision trace stopped: %llu records, %llu dropped",
+         (unsigned long long)atomic_load(&g_trace.records),
+         (unsigned long long)(atomic_load(&g_trace.ring.dropped) + atomic_load(&g_trace.dropped)));
+    
+    pthread_mutex_unlock(&g_trace.lock);
+}
+
+/**
+ * Tracing enabled?
+ */
+bool decision_trace_active(void) {
+    return record_ring_active(&g_trace.ring);
+}
+
+/**
+ * Begin packet on this thread
+ */
+void decision_trace_begin(void) {
+    if (t_pending == NULL) {
+        pthread_once(&g_pending_once, make_pending_key);
+        t_pending = malloc(sizeof(PendingList));
+        if (t_pending == NULL) return;
+        pthread_setspecific(g_pending_key, t_pending);
+    }
+    t_pending->count = 0;
+    t_pending->overflow = 0;
+}
+
+/**
+ * Remember injected fragment
+ */
+void decision_trace_injected(const uint8_t* packet, uint32_t len) {
+    if (t_pending == NULL || !decision_trace_active()) return;
+    
+    if (t_pending->count >= TRACE_MAX_PENDING) {
+        t_pending->overflow++;
+        return;
+    }
+    
+    PendingFragment* frag = &t_pending->fragments[t_pending->count++];
+    frag->ts_ns = monotonic_ns();
+    frag->orig_len = len;
+    frag->cap_len = len < TRACE_SNAPLEN ? len : TRACE_SNAPLEN;
+    memcpy(frag->data, packet, frag->cap_len);
+}
+
+/**
+ * Record original packet and pending fragments
+ */
+void decision_trace_finish(const uint8_t* packet, uint32_t len,
+                           const DecisionTraceInfo* info, bool decision) {
+    if (!decision_trace_active()) return;
+    if (!decision && !g_trace.config.all_packets) return;
+    
+    if (!record_ring_enter(&g_trace.ring)) return;
+    
+    uint32_t fragments = t_pending != NULL ? t_pending->count : 0;
+    char comment[TRACE_COMMENT_MAX];
+    int n = snprintf(comment, sizeof(comment),
+                     "pkt=%llu method=%s host=%s reason=%s verdict=%s fragments=%u "
+                     "lag_us=%llu proc_us=%llu",
+                     (unsigned long long)info->packet_id, info->method,
+                     info->host[0] ? info->host : "-", info->reason,
+                     info->dropped ? "drop" : "accept", fragments,
+                     (unsigned long long)((info->start_ns - info->recv_ns) / 1000),
+                     (unsigned long long)((info->end_ns - info->start_ns) / 1000));
+    ring_push(info->recv_ns, packet, len, comment, n);
+    
+    for (uint32_t i = 0; i < fragments; i++) {
+        const PendingFragment* frag = &t_pending->fragments[i];
+        n = snprintf(comment, sizeof(comment), "pkt=%llu fragment=%u/%u t=+%lluus",
+                     (unsigned long long)info->packet_id, i + 1, fragments + t_pending->overflow,
+                     (unsigned long long)((frag->ts_ns - info->start_ns) / 1000));
+        ring_push(frag->ts_ns, frag->data, frag->orig_len, comment, n);
+    }
+    if (t_pending != NULL) t_pending->count = 0;
+    
+    record_ring_leave(&g_trace.ring);
+}
+
+/**
+ * Get counters
+ */
+void decision_trace_get_stats(DecisionTraceStats* stats) {
+    if (stats == NULL) return;
+    stats->records = atomic_load(&g_trace.records);
+    stats->dropped = atomic_load(&g_trace.ring.dropped) + atomic_load(&g_trace.dropped);
+    stats->bytes = atomic_load(&g_trace.bytes);
+    stats->rotations = atomic_load(&g_trace.out.rotations);
+    stats->active = decision_trace_active();
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Claim a slot, copy the record, publish it; drop if the ring is full
+ */
+static bool ring_push(uint64_t ts_ns, const uint8_t* data, uint32_t len,
+                      const char* comment, int comment_len) {
+    size_t pos;
+    TraceRecord* record = record_ring_claim(&g_trace.ring, &pos);
+    if (record == NULL) return false;
+    
+    record->ts_ns = ts_ns;
+    record->orig_len = len;
+    record->cap_len = len < TRACE_SNAPLEN ? len : TRACE_SNAPLEN;
+    memcpy(record->data, data, record->cap_len);
+    if (comment_len < 0) comment_len = 0;
+    if (comment_len >= TRACE_COMMENT_MAX) comment_len = TRACE_COMMENT_MAX - 1;
+    record->comment_len = (uint32_t)comment_len;
+    memcpy(record->comment, comment, record->comment_len);
+    
+    record_ring_publish(&g_trace.ring, pos);
+    return true;
+}
+
+/**
+ * Writer callback: one batch of EPBs, flushed when anything was written
+ */
+static size_t drain_ring(void* ctx) {
+    (void)ctx;
+    size_t count = 0;
+    const TraceRecord* record;
+    
+    while (count < WRITER_BATCH && (record = record_ring_peek(&g_trace.ring)) != NULL) {
+        write_epb(record);
+        record_ring_release(&g_trace.ring);
+        count++;
+    }
+    
+    if (count > 0) rotating_file_flush(&g_trace.out);
+    return count;
+}
+
+/**
+ * Section Header Block and one raw-IP Interface Description Block
+ */
+static uint64_t write_headers(FILE* file, void* ctx) {
+    (void)ctx;
+    uint8_t block[128];
+    uint32_t pos;
+    static const char app[] = "netrix decision trace";
+    static const char ifname[] = "nfqueue";
+    uint8_t tsresol = 9;                   // Nanoseconds
+    
+    // SHB: type, length, byte-order magic, version 1.0, section length -1
+    pos = 8;
+    uint32_t magic = PCAPNG_BYTE_ORDER_MAGIC;
+    uint16_t version[2] = { 1, 0 };
+    int64_t section_len = -1;
+    memcpy(block + pos, &magic, 4);
+    memcpy(block + pos + 4, version, 4);
+    memcpy(block + pos + 8, &section_len, 8);
+    pos += 16;
+    put_option(block, &pos, OPT_SHB_USERAPPL, app, sizeof(app) - 1);
+    put_option(block, &pos, OPT_ENDOFOPT, NULL, 0);
+    uint32_t type = PCAPNG_SHB, total = pos + 4;
+    memcpy(block, &type, 4);
+    memcpy(block + 4, &total, 4);
+    memcpy(block + pos, &total, 4);
+    uint64_t written = fwrite(block, 1, total, file);
+    
+    // IDB: link type, reserved, snap length
+    pos = 8;
+    uint16_t linktype[2] = { PCAPNG_LINKTYPE_RAW, 0 };
+    uint32_t snaplen = TRACE_SNAPLEN;
+    memcpy(block + pos, linktype, 4);
+    memcpy(block + pos + 4, &snaplen, 4);
+    pos += 8;
+    put_option(block, &pos, OPT_IF_NAME, ifname, sizeof(ifname) - 1);
+    put_option(block, &pos, OPT_IF_TSRESOL, &tsresol, 1);
+    put_option(block, &pos, OPT_ENDOFOPT, NULL, 0);
+    type = PCAPNG_IDB;
+    total = pos + 4;
+    memcpy(block, &type, 4);
+    memcpy(block + 4, &total, 4);
+    memcpy(block + pos, &total, 4);
+    written += fwrite(block, 1, total, file);
+    return written;
+}
+
+/**
+ * Enhanced Packet Block with comment and outbound direction flag
+ */
+static void write_epb(const TraceRecord* record) {
+    static uint8_t block[32 + TRACE_SNAPLEN + TRACE_COMMENT_MAX + 32];
+    uint32_t pos = 8;
+    
+    uint64_t ts = record->ts_ns + (uint64_t)g_trace.realtime_offset_ns;
+    uint32_t fields[5] = {
+        0,                                 // Interface ID
+        (uint32_t)(ts >> 32),
+        (uint32_t)ts,
+        record->cap_len,
+        record->orig_len
+    };
+    memcpy(block + pos, fields, sizeof(fields));
+    pos += sizeof(fields);
+    
+    memcpy(block + pos, record->data, record->cap_len);
+    pos += record->cap_len;
+    while (pos % 4) block[pos++] = 0;
+    
+    uint32_t flags = EPB_FLAG_OUTBOUND;
+    put_option(block, &pos, OPT_COMMENT, record->comment, (uint16_t)record->comment_len);
+    put_option(block, &pos, OPT_EPB_FLAGS, &flags, 4);
+    put_option(block, &pos, OPT_ENDOFOPT, NULL, 0);
+    
+    uint32_t type = PCAPNG_EPB, total = pos + 4;
+    memcpy(block, &type, 4);
+    memcpy(block + 4, &total, 4);
+    memcpy(block + pos, &total, 4);
+    
+    int result = rotating_file_write(&g_trace.out, block, total);
+    if (result < 0) {
+        // Writer stays alive but writes nothing until the next start
+        if (result == ROTATING_FILE_REOPEN_FAILED) {
+            LOGE("Cannot reopen trace file %s: %s; trace disabled until restarted",
+                 g_trace.path, strerror(errno));
+        }
+        atomic_fetch_add_explicit(&g_trace.dropped, 1, memory_order_relaxed);
+        return;
+    }
+    
+    atomic_fetch_add_explicit(&g_trace.bytes, total, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_trace.records, 1, memory_order_relaxed);
+}
+
+/**
+ * Append an option (code, length, value padded to 32 bits)
+ */
+static void put_option(uint8_t* block, uint32_t* pos, uint16_t code, const void* value, uint16_t len) {
+    memcpy(block + *pos, &code, 2);
+    memcpy(block + *pos + 2, &len, 2);
+    *pos += 4;
+    if (len > 0) {
+        memcpy(block + *pos, value, len);
+        *pos += len;
+        while (*pos % 4) block[(*pos)++] = 0;
+    }
+}
+
+static void make_pending_key(void) {
+    pthread_key_create(&g_pending_key, free);
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,103 @@
+/**
+ * decision_trace.h
+ *
+ * pcapng decision trace.
+ * Records each traced queued packet together with every fragment the
+ * engine injected for it, annotated with the decision (method, SNI/Host,
+ * reason, verdict, timings) as packet comments. Packet threads only copy
+ * into a lock-free ring; a background writer drains it to a size-capped,
+ * rotating pcapng file, so tracing never blocks the queue.
+ */
+
+#ifndef DECISION_TRACE_H
+#define DECISION_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Trace configuration
+typedef struct {
+    const char* path;              // Output file; rotated files get .1, .2, ...
+    uint64_t max_file_bytes;       // Rotate when a file would exceed this (default: 16 MiB)
+    uint32_t max_files;            // Rotated files kept besides the current one (0 = none)
+    uint32_t ring_slots;           // Ring capacity in records, power of two (default: 1024)
+    bool all_packets;              // Trace every queued packet, not only decisions
+} DecisionTraceConfig;
+
+// Decision attached to a traced packet
+typedef struct {
+    uint64_t packet_id;            // Engine packet counter
+    const char* method;            // Bypass method name
+    const char* host;              // SNI / Host ("" if none)
+    const char* reason;            // Decision reason name
+    bool dropped;                  // Original dropped (fragments sent instead)
+    uint64_t recv_ns;              // Monotonic: packet received from the queue
+    uint64_t start_ns;             // Monotonic: processing started
+    uint64_t end_ns;               // Monotonic: verdict decided
+} DecisionTraceInfo;
+
+// Trace counters
+typedef struct {
+    uint64_t records;              // Packets written to the file
+    uint64_t dropped;              // Packets lost: ring full, or no file after a failed rotation
+    uint64_t bytes;                // Bytes written (all files)
+    uint64_t rotations;            // File rotations
+    bool active;                   // Tracing enabled
+} DecisionTraceStats;
+
+/**
+ * Start tracing (opens the file, starts the writer thread)
+ * @param config Trace configuration (path required)
+ * @return 0 on success, -1 on error
+ */
+int decision_trace_start(const DecisionTraceConfig* config);
+
+/**
+ * Stop tracing, drain the ring and close the file
+ */
+void decision_trace_stop(void);
+
+/**
+ * Check if tracing is enabled (cheap, called per packet)
+ * @return true if enabled
+ */
+bool decision_trace_active(void);
+
+/**
+ * Begin tracing a packet on the calling thread (clears pending fragments)
+ */
+void decision_trace_begin(void);
+
+/**
+ * Remember an injected fragment for the packet being traced on this thread
+ * @param packet IP packet as sent
+ * @param len Packet length
+ */
+void decision_trace_injected(const uint8_t* packet, uint32_t len);
+
+/**
+ * Record the original packet and its pending fragments
+ * @param packet Original IP packet
+ * @param len Packet length
+ * @param info Decision details
+ * @param decision true if the engine took a bypass decision for the packet
+ *                 (other packets are only recorded with all_packets)
+ */
+void decision_trace_finish(const uint8_t* packet, uint32_t len,
+                           const DecisionTraceInfo* info, bool decision);
+
+/**
+ * Get trace counters
+ * @param stats Output counters
+ */
+void decision_trace_get_stats(DecisionTraceStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DECISION_TRACE_H
@@ -14,37 +14,77 @@
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
+#include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <arpa/inet.h>
 #include <linux/ip.h>
 #include <linux/tcp.h>
+#include <netinet/ip6.h>
 #include <sys/socket.h>
 
-#include <android/log.h>
+#include "checksum.h"
+#include "ipv6.h"
+#include "decision_trace.h"
+#include "strategy_cache.h"
+#include "flow_table.h"
 
 #define LOG_TAG "DpiBypass"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#include "netrix_log.h"
 
-// Maximum whitelist entries
-#define MAX_WHITELIST 256
+// Whitelist storage grows in steps of at least this many entries
+#define WHITELIST_MIN_CAPACITY 16
 #define MAX_HOSTNAME_LEN 256
 
 // Packet mark to identify our own packets (avoid re-capture)
 #define OUR_PACKET_MARK 0x10DEAD
 
+// Rate estimation: sample interval and EWMA time constant
+#define RATE_INTERVAL_NS 1000000000ULL
+#define RATE_TAU_SEC 5.0
+
+// Most packets handed to one dpi_send_raw_batch()
+#define DPI_MAX_BATCH 16
+
+// IPv4 fragment field (not in linux/ip.h)
+#define IP_MF 0x2000
+#define IP_OFFSET 0x1FFF
+
+// Lag EWMA weight (1/8 per packet, as in TCP SRTT)
+#define LAG_EWMA_SHIFT 3
+
+// Names for metrics export (order must match enums in dpi_bypass.h)
+static const char* const REASON_NAMES[DPI_REASON_COUNT] = {
+    "invalid", "not_ip", "bad_ip_header", "quic_blocked", "not_tcp",
+    "bad_tcp_header", "no_payload", "not_http_port", "https_disabled",
+    "http_disabled", "not_client_hello", "whitelisted", "no_raw_socket",
+    "method_none", "inject_failed", "bypassed", "shed", "over_budget",
+    "window_clamped"
+};
+
+static const char* const METHOD_NAMES[BYPASS_METHOD_COUNT] = {
+    "none", "split", "split_reverse", "disorder", "disorder_reverse", "oob",
+    "ipfrag", "ipfrag_reverse", "window_clamp"
+};
+
 // Global state
 static struct {
     DpiBypassSettings settings;
     DpiBypassStats stats;
     pthread_mutex_t lock;
-    char whitelist[MAX_WHITELIST][MAX_HOSTNAME_LEN];
+    char** whitelist;
     int whitelist_count;
-    // Raw socket for packet injection
-    int raw_socket;
+    int whitelist_capacity;
+    // Packet injection
+    InjectBackendType inject_backend;
     uint32_t packet_mark;
-    bool raw_socket_initialized;
+    // Optional replacement for the raw socket
+    dpi_inject_sink_t inject_sink;
+    void* inject_sink_data;
+    // Rate estimation state
+    uint64_t rate_last_ns;
+    uint64_t rate_last_packets;
+    uint64_t rate_last_bytes;
 } g_bypass = {
     .settings = {
         .method = BYPASS_SPLIT,
@@ -54,34 +94,78 @@ static struct {
         .desync_https = true,
         .desync_http = true,
         .mix_host_case = true,
-        .block_quic = true
+        .block_quic = true,
+        .shed_backlog = 256,
+        .shed_latency_us = 10000,
+        .packet_budget_us = 100000,
+        .auto_strategy = false,
+        .split_delay_rtt_pct = 0,
+        .split_delay_min_us = 0,
+        .split_delay_max_us = 0,
+        .clamp_window = 64
     },
     .stats = {0},
     .lock = PTHREAD_MUTEX_INITIALIZER,
+    .whitelist = NULL,
     .whitelist_count = 0,
-    .raw_socket = -1,
+    .whitelist_capacity = 0,
+    .inject_backend = INJECT_BACKEND_RAW,
     .packet_mark = OUR_PACKET_MARK,
-    .raw_socket_initialized = false
+    .inject_sink = NULL,
+    .inject_sink_data = NULL
 };
 
+// Decision of the last packet processed on this thread
+static __thread DpiDecisionReason t_last_reason = DPI_REASON_INVALID;
+
+// Processing start of the current packet on this thread (0 = not timed)
+static __thread uint64_t t_start_ns = 0;
+
+// Budget deadline of the current packet on this thread (0 = no budget)
+static __thread uint64_t t_deadline_ns = 0;
+
+// Packet being traced on this thread (packet is NULL when not tracing)
+static __thread struct {
+    NfqueuePacket* packet;
+    uint64_t id;
+    uint64_t recv_ns;
+    uint64_t start_ns;
+    const char* host;
+} t_trace;
+
 // Forward declarations
-static bool should_bypass(NfqueuePacket* packet, char* hostname, int hostname_len);
+static bool should_bypass(NfqueuePacket* packet, char* hostname, int hostname_len,
+                          DpiDecisionReason* reason);
 static uint8_t* apply_split(uint8_t* payload, uint32_t len, uint32_t* new_len);
 static uint8_t* apply_split_reverse(uint8_t* payload, uint32_t len, uint32_t* new_len);
 static uint8_t* apply_disorder(uint8_t* payload, uint32_t len, uint32_t* new_len);
 static uint8_t* apply_disorder_reverse(uint8_t* payload, uint32_t len, uint32_t* new_len);
 static void mix_hostname_case(uint8_t* data, uint32_t len);
-static uint16_t calculate_tcp_checksum(struct iphdr* ip, struct tcphdr* tcp, 
-                                       uint8_t* payload, uint32_t payload_len);
-static uint16_t calculate_ip_checksum(struct iphdr* ip);
+static uint32_t ip_header_len(const uint8_t* packet, uint32_t len, uint8_t* protocol);
+static uint16_t set_ip_length(uint8_t* packet, uint32_t len);
+static uint16_t update_tcp_checksum(uint8_t* packet, uint32_t len, uint32_t ip_hdr_len);
+static const char* format_ip(const uint8_t* packet, bool dst, char* buf, size_t size);
 
 // New injection-based functions
-static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse);
-static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse);
-static uint8_t* create_tcp_fragment(uint8_t* orig_packet, uint32_t orig_len,
-                                    uint8_t* tcp_data, uint32_t tcp_data_len,
-                                    uint32_t seq_offset, uint32_t* out_len);
-static void delay_ms(uint32_t ms);
+static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse,
+                                      const StrategyChoice* choice);
+static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse,
+                                         const StrategyChoice* choice);
+static int apply_oob_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip,
+                                    const StrategyChoice* choice);
+static int apply_ipfrag_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse,
+                                       const StrategyChoice* choice);
+static void delay_us(uint32_t us);
+static void step_delay_us(uint32_t us);
+static uint32_t fragment_delay_us(const NfqueuePacket* packet);
+static NfqueueVerdict finish_packet(DpiDecisionReason reason, BypassMethod method,
+                                    NfqueueVerdict verdict);
+static void trace_decision(DpiDecisionReason reason, BypassMethod method, NfqueueVerdict verdict);
+static void update_rates_locked(void);
+static bool update_load_locked(uint64_t lag_us, uint32_t recv_batch);
+static uint32_t latency_bucket(uint64_t us);
+static bool is_shed_candidate(NfqueuePacket* packet);
+static uint64_t monotonic_ns(void);
 
 /**
  * Initialize DPI bypass
@@ -94,6 +178,7 @@ void dpi_bypass_init(DpiBypassSettings* settings) {
     }
     
     memset(&g_bypass.stats, 0, sizeof(DpiBypassStats));
+    g_bypass.rate_last_ns = 0;
     
     LOGI("DPI bypass initialized: method=%d, split_size=%d, delay=%d",
          g_bypass.settings.method,
@@ -136,8 +221,8 @@ static const char* tcp_flags_str(struct tcphdr* tcp) {
     return buf;
 }
 
-// Packet counter for logging
-static uint64_t g_pkt_id = 0;
+// Packet counter for logging (shared by all queue workers)
+static atomic_uint_fast64_t g_pkt_id = 0;
 
 /**
  * Main packet processing callback
@@ -145,74 +230,117 @@ static uint64_t g_pkt_id = 0;
 NfqueueVerdict dpi_bypass_process_packet(NfqueuePacket* packet, void* user_data) {
     (void)user_data;
     
-    uint64_t pkt_id = ++g_pkt_id;
+    uint64_t pkt_id = atomic_fetch_add_explicit(&g_pkt_id, 1, memory_order_relaxed) + 1;
+    t_trace.packet = NULL;
+    t_start_ns = 0;
+    t_deadline_ns = 0;
     
     if (packet == NULL || packet->payload == NULL || packet->payload_len < 40) {
         LOGD("[PKT#%llu] SKIP: Invalid packet (null or too small)", (unsigned long long)pkt_id);
-        return NFQUEUE_ACCEPT;
+        return finish_packet(DPI_REASON_INVALID, BYPASS_NONE, NFQUEUE_ACCEPT);
+    }
+    
+    uint64_t start_ns = monotonic_ns();
+    // Lag counts from the kernel's queue time when it reports one, else from the read
+    uint64_t recv_ns = packet->queued_time_ns ? packet->queued_time_ns :
+                       packet->recv_time_ns ? packet->recv_time_ns : start_ns;
+    uint64_t lag_us = start_ns > recv_ns ? (start_ns - recv_ns) / 1000 : 0;
+    t_start_ns = start_ns;
+    
+    if (decision_trace_active()) {
+        decision_trace_begin();
+        t_trace.packet = packet;
+        t_trace.id = pkt_id;
+        t_trace.recv_ns = start_ns > recv_ns ? recv_ns : start_ns;
+        t_trace.start_ns = start_ns;
+        t_trace.host = "";
     }
     
     pthread_mutex_lock(&g_bypass.lock);
     g_bypass.stats.packets_total++;
     g_bypass.stats.bytes_total += packet->payload_len;
+    update_rates_locked();
+    g_bypass.stats.lag_hist[latency_bucket(lag_us)]++;
+    g_bypass.stats.lag_sum_us += lag_us;
+    bool shedding = update_load_locked(lag_us, packet->recv_batch);
     pthread_mutex_unlock(&g_bypass.lock);
     
-    // Parse IP header
-    struct iphdr* ip = (struct iphdr*)packet->payload;
-    if (ip->version != 4) {
-        LOGD("[PKT#%llu] SKIP: Not IPv4 (version=%d)", (unsigned long long)pkt_id, ip->version);
-        return NFQUEUE_ACCEPT;  // Only IPv4 supported
+    // Parse IP header (IPv6: up to the transport header)
+    uint8_t version = packet->payload[0] >> 4;
+    if (version != 4 && version != 6) {
+        LOGD("[PKT#%llu] SKIP: Not IP (version=%d)", (unsigned long long)pkt_id, version);
+        return finish_packet(DPI_REASON_NOT_IP, BYPASS_NONE, NFQUEUE_ACCEPT);
     }
     
-    uint32_t ip_hdr_len = ip->ihl * 4;
-    if (ip_hdr_len < 20 || packet->payload_len < ip_hdr_len) {
+    uint8_t protocol = 0;
+    uint32_t ip_hdr_len = ip_header_len(packet->payload, packet->payload_len, &protocol);
+    if (ip_hdr_len == 0) {
         LOGD("[PKT#%llu] SKIP: Invalid IP header", (unsigned long long)pkt_id);
-        return NFQUEUE_ACCEPT;
+        return finish_packet(DPI_REASON_BAD_IP_HEADER, BYPASS_NONE, NFQUEUE_ACCEPT);
+    }
+    
+    // Overloaded: accept everything that can't need bypass without logging
+    // or further parsing, so the queue drains quickly
+    if (shedding && !is_shed_candidate(packet)) {
+        return finish_packet(DPI_REASON_SHED, BYPASS_NONE, NFQUEUE_ACCEPT);
     }
     
     // Log packet info
-    LOGI("[PKT#%llu] %d.%d.%d.%d:%d -> %d.%d.%d.%d:%d proto=%d len=%u",
+    char src_str[INET6_ADDRSTRLEN], dst_str[INET6_ADDRSTRLEN];
+    LOGI("[PKT#%llu] %s:%d -> %s:%d proto=%d len=%u",
          (unsigned long long)pkt_id,
-         (ip->saddr) & 0xFF, (ip->saddr >> 8) & 0xFF,
-         (ip->saddr >> 16) & 0xFF, (ip->saddr >> 24) & 0xFF,
-         packet->src_port,
-         (ip->daddr) & 0xFF, (ip->daddr >> 8) & 0xFF,
-         (ip->daddr >> 16) & 0xFF, (ip->daddr >> 24) & 0xFF,
-         packet->dst_port,
-         ip->protocol, packet->payload_len);
+         format_ip(packet->payload, false, src_str, sizeof(src_str)), packet->src_port,
+         format_ip(packet->payload, true, dst_str, sizeof(dst_str)), packet->dst_port,
+         protocol, packet->payload_len);
     
     // Block QUIC if enabled
-    if (g_bypass.settings.block_quic && ip->protocol == IPPROTO_UDP) {
+    if (g_bypass.settings.block_quic && protocol == IPPROTO_UDP) {
         if (packet->dst_port == 443 || packet->dst_port == 80) {
             LOGI("[PKT#%llu] DROP: QUIC blocked (UDP port %d)",
                  (unsigned long long)pkt_id, packet->dst_port);
-            
-            pthread_mutex_lock(&g_bypass.lock);
-            g_bypass.stats.packets_dropped++;
-            pthread_mutex_unlock(&g_bypass.lock);
-            
-            return NFQUEUE_DROP;
+            return finish_packet(DPI_REASON_QUIC_BLOCKED, BYPASS_NONE, NFQUEUE_DROP);
         }
     }
     
     // Only process TCP
-    if (ip->protocol != IPPROTO_TCP) {
-        LOGD("[PKT#%llu] ACCEPT: Not TCP (proto=%d)", (unsigned long long)pkt_id, ip->protocol);
-        return NFQUEUE_ACCEPT;
+    if (protocol != IPPROTO_TCP) {
+        LOGD("[PKT#%llu] ACCEPT: Not TCP (proto=%d)", (unsigned long long)pkt_id, protocol);
+        return finish_packet(DPI_REASON_NOT_TCP, BYPASS_NONE, NFQUEUE_ACCEPT);
+    }
+    
+    // Parse TCP header (IP options or IPv6 extension headers may leave < 20 bytes)
+    if (packet->payload_len < ip_hdr_len + 20) {
+        LOGD("[PKT#%llu] ACCEPT: Truncated TCP header", (unsigned long long)pkt_id);
+        return finish_packet(DPI_REASON_BAD_TCP_HEADER, BYPASS_NONE, NFQUEUE_ACCEPT);
     }
     
-    // Parse TCP header
     struct tcphdr* tcp = (struct tcphdr*)(packet->payload + ip_hdr_len);
     uint32_t tcp_hdr_len = tcp->doff * 4;
     
     if (tcp_hdr_len < 20 || packet->payload_len < ip_hdr_len + tcp_hdr_len) {
         LOGD("[PKT#%llu] ACCEPT: Invalid TCP header", (unsigned long long)pkt_id);
-        return NFQUEUE_ACCEPT;
+        return finish_packet(DPI_REASON_BAD_TCP_HEADER, BYPASS_NONE, NFQUEUE_ACCEPT);
     }
     
     // Check if there's TCP payload
     uint32_t tcp_data_len = packet->payload_len - ip_hdr_len - tcp_hdr_len;
     
+    // Outcome of tracked handshakes (answer acknowledged, retransmit, reset);
+    // with inbound observation, connections are tracked from the SYN
+    StrategyChoice choice;
+    bool auto_strategy = g_bypass.settings.auto_strategy && strategy_cache_enabled();
+    bool track_flows = auto_strategy || flow_table_ingress();
+    bool pending_flow = track_flows &&
+                        flow_table_outbound(packet, ntohl(tcp->seq), ntohl(tcp->ack_seq),
+                                            ((const uint8_t*)tcp)[13], tcp_data_len, start_ns,
+                                            &choice);
+    // The ingress observer and its window clamp are IPv4-only
+    if (tcp->syn && !tcp->ack && flow_table_ingress() && version == 4) {
+        // With the cache, clamping is decided per destination
+        bool clamp_all = g_bypass.settings.method == BYPASS_WINDOW_CLAMP && !auto_strategy;
+        flow_table_syn(packet, clamp_all ? g_bypass.settings.clamp_window : 0, start_ns);
+    }
+    
     // Log TCP details
     LOGI("[PKT#%llu] TCP: port=%d flags=[%s] seq=%u ack=%u data_len=%u",
          (unsigned long long)pkt_id,
@@ -224,15 +352,18 @@ NfqueueVerdict dpi_bypass_process_packet(NfqueuePacket* packet, void* user_data)
     
     if (tcp_data_len == 0) {
         LOGD("[PKT#%llu] ACCEPT: No TCP payload (control packet)", (unsigned long long)pkt_id);
-        return NFQUEUE_ACCEPT;  // No data to process
+        return finish_packet(DPI_REASON_NO_PAYLOAD, BYPASS_NONE, NFQUEUE_ACCEPT);  // No data to process
     }
     
     // Check if we should bypass
     char hostname[MAX_HOSTNAME_LEN] = {0};
-    if (!should_bypass(packet, hostname, sizeof(hostname))) {
-        LOGI("[PKT#%llu] ACCEPT: Bypass not needed (host=%s)", 
-             (unsigned long long)pkt_id, hostname[0] ? hostname : "N/A");
-        return NFQUEUE_ACCEPT;
+    DpiDecisionReason reason = DPI_REASON_BYPASSED;
+    t_trace.host = hostname;
+    if (!should_bypass(packet, hostname, sizeof(hostname), &reason)) {
+        LOGI("[PKT#%llu] ACCEPT: Bypass not needed (host=%s, reason=%s)", 
+             (unsigned long long)pkt_id, hostname[0] ? hostname : "N/A",
+             dpi_reason_name(reason));
+        return finish_packet(reason, BYPASS_NONE, NFQUEUE_ACCEPT);
     }
     
     LOGI("[PKT#%llu] >>> BYPASS: %s -> %s (method=%d, data=%u bytes)", 
@@ -242,60 +373,254 @@ NfqueueVerdict dpi_bypass_process_packet(NfqueuePacket* packet, void* user_data)
          g_bypass.settings.method,
          tcp_data_len);
     
+    // Fail open if this packet already waited longer than the budget; the
+    // injection re-checks the deadline before every fragment delay
+    uint32_t budget_us = g_bypass.settings.packet_budget_us;
+    if (budget_us > 0) t_deadline_ns = recv_ns + (uint64_t)budget_us * 1000;
+    if (budget_us > 0 && monotonic_ns() > t_deadline_ns) {
+        LOGI("[PKT#%llu] ACCEPT: Processing budget exceeded (%u us)",
+             (unsigned long long)pkt_id, budget_us);
+        return finish_packet(DPI_REASON_OVER_BUDGET, BYPASS_NONE, NFQUEUE_ACCEPT);
+    }
+    
     // Initialize raw socket if needed
-    if (!g_bypass.raw_socket_initialized) {
+    if (!inject_backend_ready() && g_bypass.inject_sink == NULL) {
         if (dpi_raw_socket_init() < 0) {
             LOGE("Failed to initialize raw socket, falling back to ACCEPT");
-            return NFQUEUE_ACCEPT;
+            return finish_packet(DPI_REASON_NO_RAW_SOCKET, BYPASS_NONE, NFQUEUE_ACCEPT);
+        }
+    }
+    
+    // Strategy: a retransmitted request keeps its flow's strategy; new flows
+    // get the per-host choice of the cache, or the configured method
+    if (!pending_flow) {
+        choice.method = g_bypass.settings.method;
+        choice.first_packet_size = g_bypass.settings.first_packet_size;
+        choice.split_count = g_bypass.settings.split_count;
+        choice.probe = false;
+        choice.clamp_pending = false;
+        uint64_t key = 0;
+        bool clamp_ok = flow_table_ingress() && version == 4;
+        if (auto_strategy) {
+            key = strategy_cache_key(hostname, packet->dst_ip);
+            strategy_cache_select(key, &g_bypass.settings,
+                                  clamp_ok ? 0 : 1u << BYPASS_WINDOW_CLAMP, &choice);
+        }
+        
+        // The clamp acts on the SYN-ACK, too late for this flow: clamp the
+        // destination's next connections and split this request. The flow
+        // outcome is recorded against WINDOW_CLAMP, not the stand-in split
+        if (choice.method == BYPASS_WINDOW_CLAMP) {
+            if (auto_strategy && clamp_ok) {
+                flow_table_clamp_destination(packet->dst_ip, key, g_bypass.settings.clamp_window);
+            }
+            choice.clamp_pending = true;
+        }
+        choice.split_delay_us = fragment_delay_us(packet);
+        if (track_flows) {
+            flow_table_track(packet, ntohl(tcp->seq), ntohl(tcp->ack_seq), key, &choice, start_ns);
         }
     }
+    if (auto_strategy) {
+        LOGI("[PKT#%llu] Strategy: %s%s%s", (unsigned long long)pkt_id,
+             dpi_method_name(choice.method), choice.probe ? " (probe)" : "",
+             pending_flow ? " (retransmit)" : "");
+    }
     
     // Apply bypass method using raw socket injection
     int result = -1;
+    BypassMethod method = choice.clamp_pending ? BYPASS_SPLIT : choice.method;
     
-    switch (g_bypass.settings.method) {
+    switch (method) {
         case BYPASS_SPLIT:
             result = apply_split_with_injection(packet->payload, packet->payload_len, 
-                                                packet->dst_ip, false);
+                                                packet->dst_ip, false, &choice);
             break;
-            
+        
         case BYPASS_SPLIT_REVERSE:
             result = apply_split_with_injection(packet->payload, packet->payload_len, 
-                                                packet->dst_ip, true);
+                                                packet->dst_ip, true, &choice);
             break;
-            
+        
         case BYPASS_DISORDER:
             result = apply_disorder_with_injection(packet->payload, packet->payload_len, 
-                                                   packet->dst_ip, false);
+                                                   packet->dst_ip, false, &choice);
             break;
-            
+        
         case BYPASS_DISORDER_REVERSE:
             result = apply_disorder_with_injection(packet->payload, packet->payload_len, 
-                                                   packet->dst_ip, true);
+                                                   packet->dst_ip, true, &choice);
             break;
-            
+        
+        case BYPASS_OOB:
+            result = apply_oob_with_injection(packet->payload, packet->payload_len,
+                                              packet->dst_ip, &choice);
+            break;
+        
+        case BYPASS_IPFRAG:
+            result = apply_ipfrag_with_injection(packet->payload, packet->payload_len,
+                                                 packet->dst_ip, false, &choice);
+            break;
+        
+        case BYPASS_IPFRAG_REVERSE:
+            result = apply_ipfrag_with_injection(packet->payload, packet->payload_len,
+                                                 packet->dst_ip, true, &choice);
+            break;
+        
+        case BYPASS_WINDOW_CLAMP:
+            // Sent whole despite the clamped window; nothing to inject
+            return finish_packet(DPI_REASON_WINDOW_CLAMPED, BYPASS_NONE, NFQUEUE_ACCEPT);
+        
         default:
-            return NFQUEUE_ACCEPT;
+            return finish_packet(DPI_REASON_METHOD_NONE, BYPASS_NONE, NFQUEUE_ACCEPT);
     }
     
     if (result == 0) {
-        pthread_mutex_lock(&g_bypass.lock);
-        g_bypass.stats.packets_bypassed++;
-        pthread_mutex_unlock(&g_bypass.lock);
-        
         // DROP original packet - we sent our own fragments
-        return NFQUEUE_DROP;
+        return finish_packet(DPI_REASON_BYPASSED, method, NFQUEUE_DROP);
     }
     
     // Injection failed, accept original packet
     LOGD("Injection failed, accepting original packet");
-    return NFQUEUE_ACCEPT;
+    return finish_packet(DPI_REASON_INJECT_FAILED, method, NFQUEUE_ACCEPT);
+}
+
+/**
+ * Record the decision taken for a packet and pass its verdict through
+ */
+static NfqueueVerdict finish_packet(DpiDecisionReason reason, BypassMethod method,
+                                    NfqueueVerdict verdict) {
+    t_last_reason = reason;
+    uint64_t service_us = t_start_ns ? (monotonic_ns() - t_start_ns) / 1000 : 0;
+    pthread_mutex_lock(&g_bypass.lock);
+    g_bypass.stats.reasons[reason]++;
+    if (t_start_ns) {
+        g_bypass.stats.service_hist[latency_bucket(service_us)]++;
+        g_bypass.stats.service_sum_us += service_us;
+    }
+    if (reason == DPI_REASON_BYPASSED) {
+        g_bypass.stats.packets_bypassed++;
+        if (method < BYPASS_METHOD_COUNT) {
+            g_bypass.stats.method_bypassed[method]++;
+        }
+    } else if (verdict == NFQUEUE_DROP) {
+        g_bypass.stats.packets_dropped++;
+    }
+    pthread_mutex_unlock(&g_bypass.lock);
+    
+    if (t_trace.packet != NULL) {
+        trace_decision(reason, method, verdict);
+        t_trace.packet = NULL;
+    }
+    return verdict;
+}
+
+/**
+ * Hand the traced packet, its fragments and the decision to the trace ring
+ */
+static void trace_decision(DpiDecisionReason reason, BypassMethod method, NfqueueVerdict verdict) {
+    // Packets that reached a per-flow decision; the rest only with all_packets
+    bool decision = reason == DPI_REASON_QUIC_BLOCKED || reason == DPI_REASON_WHITELISTED ||
+                    reason == DPI_REASON_NO_RAW_SOCKET || reason == DPI_REASON_METHOD_NONE ||
+                    reason == DPI_REASON_INJECT_FAILED || reason == DPI_REASON_BYPASSED ||
+                    reason == DPI_REASON_OVER_BUDGET;
+    
+    DecisionTraceInfo info = {
+        .packet_id = t_trace.id,
+        .method = dpi_method_name(method),
+        .host = t_trace.host,
+        .reason = dpi_reason_name(reason),
+        .dropped = verdict == NFQUEUE_DROP,
+        .recv_ns = t_trace.recv_ns,
+        .start_ns = t_trace.start_ns,
+        .end_ns = monotonic_ns()
+    };
+    decision_trace_finish(t_trace.packet->payload, t_trace.packet->payload_len, &info, decision);
+}
+
+/**
+ * Update lag EWMA and shedding state (caller holds g_bypass.lock)
+ * Shedding starts when backlog or lag crosses its threshold and stops
+ * once both are below half of it. The backlog is the larger of the last
+ * sampled kernel backlog and the packets returned by this packet's read,
+ * so a burst is seen before the next sample.
+ * @param lag_us Time since the packet was queued (or read)
+ * @param recv_batch Packets returned by the same read
+ * @return true if load shedding is active
+ */
+static bool update_load_locked(uint64_t lag_us, uint32_t recv_batch) {
+    DpiBypassStats* st = &g_bypass.stats;
+    
+    if (lag_us > UINT32_MAX) lag_us = UINT32_MAX;
+    int64_t diff = (int64_t)lag_us - (int64_t)st->packet_lag_us;
+    st->packet_lag_us = (uint32_t)((int64_t)st->packet_lag_us + (diff >> LAG_EWMA_SHIFT));
+    
+    uint32_t backlog = st->queue_backlog > recv_batch ? st->queue_backlog : recv_batch;
+    uint32_t max_backlog = g_bypass.settings.shed_backlog;
+    uint32_t max_lag = g_bypass.settings.shed_latency_us;
+    
+    bool over = (max_backlog > 0 && backlog >= max_backlog) ||
+                (max_lag > 0 && st->packet_lag_us >= max_lag);
+    bool under = (max_backlog == 0 || backlog < max_backlog / 2) &&
+                 (max_lag == 0 || st->packet_lag_us < max_lag / 2);
+    
+    if (!st->shedding && over) {
+        st->shedding = true;
+        st->shed_events++;
+        LOGI("Load shedding ON: backlog=%u, lag=%uus", backlog, st->packet_lag_us);
+    } else if (st->shedding && under) {
+        st->shedding = false;
+        LOGI("Load shedding OFF: backlog=%u, lag=%uus", backlog, st->packet_lag_us);
+    }
+    
+    return st->shedding;
+}
+
+/**
+ * Histogram bucket of a latency sample
+ */
+static uint32_t latency_bucket(uint64_t us) {
+    uint32_t bucket = 0;
+    while (bucket < DPI_LATENCY_BUCKETS - 1 && us > DPI_LATENCY_BOUND_US(bucket)) {
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * Cheap-path check: can this packet need bypass (or a QUIC drop)?
+ */
+static bool is_shed_candidate(NfqueuePacket* packet) {
+    DpiPacketClass packet_class = dpi_classify_packet(packet->payload, packet->payload_len, NULL);
+    if (packet_class == DPI_CLASS_QUIC_INITIAL) {
+        return g_bypass.settings.block_quic;
+    }
+    return packet_class != DPI_CLASS_OTHER;
+}
+
+/**
+ * Report kernel queue backlog
+ */
+void dpi_bypass_report_backlog(uint32_t backlog) {
+    pthread_mutex_lock(&g_bypass.lock);
+    g_bypass.stats.queue_backlog = backlog;
+    pthread_mutex_unlock(&g_bypass.lock);
+}
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
 /**
  * Check if packet should be bypassed
  */
-static bool should_bypass(NfqueuePacket* packet, char* hostname, int hostname_len) {
+static bool should_bypass(NfqueuePacket* packet, char* hostname, int hostname_len,
+                          DpiDecisionReason* reason) {
     bool is_https = (packet->dst_port == 443);
     bool is_http = (packet->dst_port == 80);
     
@@ -305,20 +630,23 @@ static bool should_bypass(NfqueuePacket* packet, char* hostname, int hostname_le
     // Check port settings
     if (is_https && !g_bypass.settings.desync_https) {
         LOGD("[BYPASS-CHECK] SKIP: HTTPS desync disabled");
+        *reason = DPI_REASON_HTTPS_DISABLED;
         return false;
     }
     if (is_http && !g_bypass.settings.desync_http) {
         LOGD("[BYPASS-CHECK] SKIP: HTTP desync disabled");
+        *reason = DPI_REASON_HTTP_DISABLED;
         return false;
     }
     if (!is_https && !is_http) {
         LOGD("[BYPASS-CHECK] SKIP: Not HTTP/HTTPS port");
+        *reason = DPI_REASON_NOT_HTTP_PORT;
         return false;
     }
     
     // Get TCP data
-    struct iphdr* ip = (struct iphdr*)packet->payload;
-    uint32_t ip_hdr_len = ip->ihl * 4;
+    uint8_t protocol;
+    uint32_t ip_hdr_len = ip_header_len(packet->payload, packet->payload_len, &protocol);
     struct tcphdr* tcp = (struct tcphdr*)(packet->payload + ip_hdr_len);
     uint32_t tcp_hdr_len = tcp->doff * 4;
     
@@ -335,6 +663,7 @@ static bool should_bypass(NfqueuePacket* packet, char* hostname, int hostname_le
         
         if (!is_client_hello) {
             LOGD("[BYPASS-CHECK] SKIP: Not TLS ClientHello");
+            *reason = DPI_REASON_NOT_CLIENT_HELLO;
             return false;
         }
         
@@ -344,21 +673,12 @@ static bool should_bypass(NfqueuePacket* packet, char* hostname, int hostname_le
     } else {
         // Extract HTTP Host header
         LOGD("[BYPASS-CHECK] Searching for HTTP Host header...");
-        const char* host_start = memmem(tcp_data, tcp_data_len, "Host:", 5);
-        if (host_start == NULL) {
-            host_start = memmem(tcp_data, tcp_data_len, "host:", 5);
-        }
-        if (host_start != NULL) {
-            host_start += 5;
-            while (*host_start == ' ') host_start++;
-            const char* host_end = strchr(host_start, '\r');
-            if (host_end == NULL) host_end = strchr(host_start, '\n');
-            if (host_end != NULL) {
-                int len = host_end - host_start;
-                if (len > 0 && len < hostname_len) {
-                    strncpy(hostname, host_start, len);
-                    hostname[len] = '\0';
-                }
+        uint32_t host_len = 0;
+        uint32_t host_offset = dpi_find_http_host(tcp_data, tcp_data_len, &host_len);
+        if (host_offset != 0) {
+            if (host_len < (uint32_t)hostname_len) {
+                memcpy(hostname, tcp_data + host_offset, host_len);
+                hostname[host_len] = '\0';
             }
             LOGI("[BYPASS-CHECK] HTTP Host: '%s'", hostname);
         } else {
@@ -379,11 +699,13 @@ static bool should_bypass(NfqueuePacket* packet, char* hostname, int hostname_le
     // Check whitelist
     if (hostname[0] != '\0' && dpi_is_whitelisted(hostname)) {
         LOGI("[BYPASS-CHECK] SKIP: Whitelisted host '%s'", hostname);
+        *reason = DPI_REASON_WHITELISTED;
         return false;
     }
     
     LOGI("[BYPASS-CHECK] PROCEED: Will apply bypass for '%s'", 
          hostname[0] ? hostname : "unknown");
+    *reason = DPI_REASON_BYPASSED;
     return true;
 }
 
@@ -394,8 +716,8 @@ static uint8_t* apply_split(uint8_t* payload, uint32_t len, uint32_t* new_len) {
     // For true kernel-level fragmentation, we modify the TCP sequence
     // This implementation modifies the first packet size
     
-    struct iphdr* ip = (struct iphdr*)payload;
-    uint32_t ip_hdr_len = ip->ihl * 4;
+    uint8_t protocol;
+    uint32_t ip_hdr_len = ip_header_len(payload, len, &protocol);
     struct tcphdr* tcp = (struct tcphdr*)(payload + ip_hdr_len);
     uint32_t tcp_hdr_len = tcp->doff * 4;
     
@@ -415,18 +737,9 @@ static uint8_t* apply_split(uint8_t* payload, uint32_t len, uint32_t* new_len) {
     memcpy(new_packet, payload, ip_hdr_len + tcp_hdr_len);
     memcpy(new_packet + ip_hdr_len + tcp_hdr_len, tcp_data, split_pos);
     
-    // Update IP total length
-    struct iphdr* new_ip = (struct iphdr*)new_packet;
-    new_ip->tot_len = htons(new_packet_len);
-    new_ip->check = 0;
-    new_ip->check = calculate_ip_checksum(new_ip);
-    
-    // Update TCP checksum
-    struct tcphdr* new_tcp = (struct tcphdr*)(new_packet + ip_hdr_len);
-    new_tcp->check = 0;
-    new_tcp->check = calculate_tcp_checksum(new_ip, new_tcp,
-                                            new_packet + ip_hdr_len + tcp_hdr_len,
-                                            split_pos);
+    // Update IP length and TCP checksum
+    set_ip_length(new_packet, new_packet_len);
+    update_tcp_checksum(new_packet, new_packet_len, ip_hdr_len);
     
     *new_len = new_packet_len;
     return new_packet;
@@ -446,8 +759,8 @@ static uint8_t* apply_split_reverse(uint8_t* payload, uint32_t len, uint32_t* ne
  * Apply DISORDER - splits into multiple small fragments
  */
 static uint8_t* apply_disorder(uint8_t* payload, uint32_t len, uint32_t* new_len) {
-    struct iphdr* ip = (struct iphdr*)payload;
-    uint32_t ip_hdr_len = ip->ihl * 4;
+    uint8_t protocol;
+    uint32_t ip_hdr_len = ip_header_len(payload, len, &protocol);
     struct tcphdr* tcp = (struct tcphdr*)(payload + ip_hdr_len);
     uint32_t tcp_hdr_len = tcp->doff * 4;
     
@@ -473,16 +786,8 @@ static uint8_t* apply_disorder(uint8_t* payload, uint32_t len, uint32_t* new_len
     memcpy(new_packet + ip_hdr_len + tcp_hdr_len, tcp_data, first_chunk);
     
     // Update headers
-    struct iphdr* new_ip = (struct iphdr*)new_packet;
-    new_ip->tot_len = htons(new_packet_len);
-    new_ip->check = 0;
-    new_ip->check = calculate_ip_checksum(new_ip);
-    
-    struct tcphdr* new_tcp = (struct tcphdr*)(new_packet + ip_hdr_len);
-    new_tcp->check = 0;
-    new_tcp->check = calculate_tcp_checksum(new_ip, new_tcp,
-                                            new_packet + ip_hdr_len + tcp_hdr_len,
-                                            first_chunk);
+    set_ip_length(new_packet, new_packet_len);
+    update_tcp_checksum(new_packet, new_packet_len, ip_hdr_len);
     
     *new_len = new_packet_len;
     return new_packet;
@@ -501,37 +806,81 @@ static uint8_t* apply_disorder_reverse(uint8_t* payload, uint32_t len, uint32_t*
 // ============================================================================
 
 /**
- * Delay in milliseconds
+ * Delay in microseconds
  */
-static void delay_ms(uint32_t ms) {
-    if (ms == 0) return;
+static void delay_us(uint32_t us) {
+    if (us == 0) return;
     struct timespec ts;
-    ts.tv_sec = ms / 1000;
-    ts.tv_nsec = (ms % 1000) * 1000000;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
     nanosleep(&ts, NULL);
 }
 
+/**
+ * Delay before the next injection step, skipped once it would run past
+ * the packet budget: the original is held until the last fragment is out,
+ * so the rest of the fragments then go back to back
+ */
+static void step_delay_us(uint32_t us) {
+    if (us == 0) return;
+    if (t_deadline_ns != 0 && monotonic_ns() + (uint64_t)us * 1000 > t_deadline_ns) {
+        LOGI("Fragment delay skipped: packet budget (%u us) exhausted",
+             g_bypass.settings.packet_budget_us);
+        return;
+    }
+    delay_us(us);
+}
+
+/**
+ * Delay between the fragments of a new flow: split_delay_rtt_pct of its
+ * RTT (or of the destination's smoothed RTT) within the min/max bounds;
+ * the fixed split_delay_ms when the RTT is unknown or scaling is off
+ */
+static uint32_t fragment_delay_us(const NfqueuePacket* packet) {
+    uint32_t delay = g_bypass.settings.split_delay_ms * 1000;
+    uint32_t rtt_us = g_bypass.settings.split_delay_rtt_pct > 0 ? flow_table_rtt(packet) : 0;
+    
+    if (rtt_us > 0) {
+        uint64_t scaled = (uint64_t)rtt_us * g_bypass.settings.split_delay_rtt_pct / 100;
+        uint32_t max_us = g_bypass.settings.split_delay_max_us > 0 ?
+                          g_bypass.settings.split_delay_max_us : delay;
+        if (scaled > max_us) scaled = max_us;
+        if (scaled < g_bypass.settings.split_delay_min_us) scaled = g_bypass.settings.split_delay_min_us;
+        delay = (uint32_t)scaled;
+    }
+    
+    pthread_mutex_lock(&g_bypass.lock);
+    if (rtt_us > 0) g_bypass.stats.rtt_delays++;
+    if (g_bypass.stats.fragment_delay_us == 0) {
+        g_bypass.stats.fragment_delay_us = delay;
+    } else {
+        int64_t diff = (int64_t)delay - (int64_t)g_bypass.stats.fragment_delay_us;
+        g_bypass.stats.fragment_delay_us = (uint32_t)((int64_t)g_bypass.stats.fragment_delay_us + diff / 8);
+    }
+    pthread_mutex_unlock(&g_bypass.lock);
+    
+    LOGD("Fragment delay %u us (rtt=%u us)", delay, rtt_us);
+    return delay;
+}
+
 /**
  * Create a TCP fragment packet from original packet
- * @param orig_packet Original IP packet
- * @param orig_len Original packet length
- * @param tcp_data TCP payload data for this fragment
- * @param tcp_data_len Length of TCP payload
- * @param seq_offset Offset to add to sequence number
- * @param out_len Output: length of new packet
- * @return Allocated packet (caller must free) or NULL on error
  */
-static uint8_t* create_tcp_fragment(uint8_t* orig_packet, uint32_t orig_len,
-                                    uint8_t* tcp_data, uint32_t tcp_data_len,
-                                    uint32_t seq_offset, uint32_t* out_len) {
+uint8_t* dpi_create_tcp_fragment(const uint8_t* orig_packet, uint32_t orig_len,
+                                 const uint8_t* tcp_data, uint32_t tcp_data_len,
+                                 uint32_t seq_offset, uint32_t* out_len) {
     if (orig_packet == NULL || orig_len < 40) {
         LOGE("[FRAGMENT] ERROR: Invalid original packet");
         return NULL;
     }
     
-    struct iphdr* orig_ip = (struct iphdr*)orig_packet;
-    uint32_t ip_hdr_len = orig_ip->ihl * 4;
-    struct tcphdr* orig_tcp = (struct tcphdr*)(orig_packet + ip_hdr_len);
+    uint8_t protocol;
+    uint32_t ip_hdr_len = ip_header_len(orig_packet, orig_len, &protocol);
+    if (ip_hdr_len == 0 || protocol != IPPROTO_TCP) {
+        LOGE("[FRAGMENT] ERROR: Not a TCP packet");
+        return NULL;
+    }
+    const struct tcphdr* orig_tcp = (const struct tcphdr*)(orig_packet + ip_hdr_len);
     uint32_t tcp_hdr_len = orig_tcp->doff * 4;
     uint32_t orig_seq = ntohl(orig_tcp->seq);
     
@@ -554,22 +903,18 @@ static uint8_t* create_tcp_fragment(uint8_t* orig_packet, uint32_t orig_len,
         memcpy(new_packet + ip_hdr_len + tcp_hdr_len, tcp_data, tcp_data_len);
     }
     
-    // Update IP header
+    // Update IP header (IPv6 has no ID outside fragments)
     struct iphdr* new_ip = (struct iphdr*)new_packet;
-    new_ip->tot_len = htons(new_len);
-    new_ip->id = htons(ntohs(orig_ip->id) + (seq_offset > 0 ? 1 : 0));  // Different ID for each fragment
-    new_ip->check = 0;
-    uint16_t ip_checksum = calculate_ip_checksum(new_ip);
-    new_ip->check = ip_checksum;
+    if (new_ip->version == 4) {
+        const struct iphdr* orig_ip = (const struct iphdr*)orig_packet;
+        new_ip->id = htons(ntohs(orig_ip->id) + (seq_offset > 0 ? 1 : 0));  // Different ID for each fragment
+    }
+    uint16_t ip_checksum = set_ip_length(new_packet, new_len);
     
     // Update TCP header - adjust sequence number
     struct tcphdr* new_tcp = (struct tcphdr*)(new_packet + ip_hdr_len);
     new_tcp->seq = htonl(orig_seq + seq_offset);
-    new_tcp->check = 0;
-    uint16_t tcp_checksum = calculate_tcp_checksum(new_ip, new_tcp,
-                                            new_packet + ip_hdr_len + tcp_hdr_len,
-                                            tcp_data_len);
-    new_tcp->check = tcp_checksum;
+    uint16_t tcp_checksum = update_tcp_checksum(new_packet, new_len, ip_hdr_len);
     
     LOGI("[FRAGMENT] Created: data_len=%u, seq=%u->%u (offset=%u), total_len=%u, ip_csum=0x%04X, tcp_csum=0x%04X",
          tcp_data_len, orig_seq, orig_seq + seq_offset, seq_offset, new_len, ip_checksum, tcp_checksum);
@@ -585,9 +930,11 @@ static uint8_t* create_tcp_fragment(uint8_t* orig_packet, uint32_t orig_len,
  * @param len Packet length
  * @param dst_ip Destination IP (network byte order)
  * @param reverse If true, send second fragment first
+ * @param choice Strategy parameters (split position)
  * @return 0 on success, -1 on error
  */
-static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse) {
+static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse,
+                                      const StrategyChoice* choice) {
     LOGI("[SPLIT] === Starting SPLIT injection ===");
     
     if (payload == NULL || len < 40) {
@@ -595,8 +942,8 @@ static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t d
         return -1;
     }
     
-    struct iphdr* ip = (struct iphdr*)payload;
-    uint32_t ip_hdr_len = ip->ihl * 4;
+    uint8_t protocol;
+    uint32_t ip_hdr_len = ip_header_len(payload, len, &protocol);
     struct tcphdr* tcp = (struct tcphdr*)(payload + ip_hdr_len);
     uint32_t tcp_hdr_len = tcp->doff * 4;
     
@@ -612,20 +959,20 @@ static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t d
     }
     
     // Calculate split position
-    uint16_t split_pos = g_bypass.settings.first_packet_size;
+    uint16_t split_pos = choice->first_packet_size;
     if (split_pos >= tcp_data_len) {
         split_pos = tcp_data_len > 1 ? (tcp_data_len / 2) : 1;
     }
     if (split_pos < 1) split_pos = 1;
     
-    LOGI("[SPLIT] Split position: %u bytes (frag1=%u, frag2=%u), delay=%ums, reverse=%d", 
+    LOGI("[SPLIT] Split position: %u bytes (frag1=%u, frag2=%u), delay=%uus, reverse=%d", 
          split_pos, split_pos, tcp_data_len - split_pos, 
-         g_bypass.settings.split_delay_ms, reverse);
+         choice->split_delay_us, reverse);
     
     // Create first fragment (bytes 0 to split_pos-1)
     LOGI("[SPLIT] Creating fragment 1 (bytes 0-%u)...", split_pos - 1);
     uint32_t frag1_len = 0;
-    uint8_t* frag1 = create_tcp_fragment(payload, len, tcp_data, split_pos, 0, &frag1_len);
+    uint8_t* frag1 = dpi_create_tcp_fragment(payload, len, tcp_data, split_pos, 0, &frag1_len);
     if (frag1 == NULL) {
         LOGE("[SPLIT] ERROR: Failed to create fragment 1");
         return -1;
@@ -634,10 +981,10 @@ static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t d
     // Create second fragment (bytes split_pos to end)
     LOGI("[SPLIT] Creating fragment 2 (bytes %u-%u)...", split_pos, tcp_data_len - 1);
     uint32_t frag2_len = 0;
-    uint8_t* frag2 = create_tcp_fragment(payload, len, 
-                                         tcp_data + split_pos, 
-                                         tcp_data_len - split_pos, 
-                                         split_pos, &frag2_len);
+    uint8_t* frag2 = dpi_create_tcp_fragment(payload, len, 
+                                             tcp_data + split_pos, 
+                                             tcp_data_len - split_pos, 
+                                             split_pos, &frag2_len);
     if (frag2 == NULL) {
         LOGE("[SPLIT] ERROR: Failed to create fragment 2");
         free(frag1);
@@ -646,16 +993,9 @@ static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t d
     
     // Apply host case mixing if enabled (to second fragment which has more data)
     if (g_bypass.settings.mix_host_case) {
-        struct iphdr* f2_ip = (struct iphdr*)frag2;
-        uint32_t f2_ip_len = f2_ip->ihl * 4;
-        struct tcphdr* f2_tcp = (struct tcphdr*)(frag2 + f2_ip_len);
-        uint32_t f2_tcp_len = f2_tcp->doff * 4;
-        mix_hostname_case(frag2 + f2_ip_len + f2_tcp_len, frag2_len - f2_ip_len - f2_tcp_len);
+        mix_hostname_case(frag2 + ip_hdr_len + tcp_hdr_len, frag2_len - ip_hdr_len - tcp_hdr_len);
         // Recalculate TCP checksum after mixing
-        f2_tcp->check = 0;
-        f2_tcp->check = calculate_tcp_checksum(f2_ip, f2_tcp,
-                                               frag2 + f2_ip_len + f2_tcp_len,
-                                               frag2_len - f2_ip_len - f2_tcp_len);
+        update_tcp_checksum(frag2, frag2_len, ip_hdr_len);
         LOGD("[SPLIT] Applied host case mixing to fragment 2");
     }
     
@@ -674,8 +1014,8 @@ static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t d
         }
         
         if (result == 0) {
-            LOGD("[SPLIT] Delaying %u ms...", g_bypass.settings.split_delay_ms);
-            delay_ms(g_bypass.settings.split_delay_ms);
+            LOGD("[SPLIT] Delaying %u us...", choice->split_delay_us);
+            step_delay_us(choice->split_delay_us);
             
             LOGI("[SPLIT] Sending fragment 1...");
             send1_result = dpi_send_raw_packet(frag1, frag1_len, dst_ip);
@@ -698,8 +1038,8 @@ static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t d
         }
         
         if (result == 0) {
-            LOGD("[SPLIT] Delaying %u ms...", g_bypass.settings.split_delay_ms);
-            delay_ms(g_bypass.settings.split_delay_ms);
+            LOGD("[SPLIT] Delaying %u us...", choice->split_delay_us);
+            step_delay_us(choice->split_delay_us);
             
             LOGI("[SPLIT] Sending fragment 2...");
             send2_result = dpi_send_raw_packet(frag2, frag2_len, dst_ip);
@@ -731,9 +1071,11 @@ static int apply_split_with_injection(uint8_t* payload, uint32_t len, uint32_t d
  * @param len Packet length
  * @param dst_ip Destination IP (network byte order)
  * @param reverse If true, send fragments in reverse order
+ * @param choice Strategy parameters (fragment count)
  * @return 0 on success, -1 on error
  */
-static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse) {
+static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse,
+                                         const StrategyChoice* choice) {
     LOGI("[DISORDER] === Starting DISORDER injection ===");
     
     if (payload == NULL || len < 40) {
@@ -741,8 +1083,8 @@ static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_
         return -1;
     }
     
-    struct iphdr* ip = (struct iphdr*)payload;
-    uint32_t ip_hdr_len = ip->ihl * 4;
+    uint8_t protocol;
+    uint32_t ip_hdr_len = ip_header_len(payload, len, &protocol);
     struct tcphdr* tcp = (struct tcphdr*)(payload + ip_hdr_len);
     uint32_t tcp_hdr_len = tcp->doff * 4;
     
@@ -758,15 +1100,15 @@ static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_
     }
     
     // Calculate number of fragments and chunk size
-    uint8_t count = g_bypass.settings.split_count;
+    uint8_t count = choice->split_count;
     if (count < 2) count = 2;
     if (count > 10) count = 10;  // Limit to prevent too many fragments
     
     uint32_t chunk_size = tcp_data_len / count;
     if (chunk_size < 1) chunk_size = 1;
     
-    LOGI("[DISORDER] Plan: %u fragments, chunk_size=%u, delay=%ums, reverse=%d", 
-         count, chunk_size, g_bypass.settings.split_delay_ms, reverse);
+    LOGI("[DISORDER] Plan: %u fragments, chunk_size=%u, delay=%uus, reverse=%d", 
+         count, chunk_size, choice->split_delay_us, reverse);
     
     // Create all fragments
     uint8_t* fragments[10] = {0};
@@ -783,9 +1125,9 @@ static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_
         LOGI("[DISORDER] Creating fragment %d (bytes %u-%u, size=%u)...", 
              i, offset, offset + this_chunk - 1, this_chunk);
         
-        fragments[i] = create_tcp_fragment(payload, len,
-                                           tcp_data + offset, this_chunk,
-                                           offset, &frag_lens[i]);
+        fragments[i] = dpi_create_tcp_fragment(payload, len,
+                                               tcp_data + offset, this_chunk,
+                                               offset, &frag_lens[i]);
         if (fragments[i] == NULL) {
             LOGE("[DISORDER] ERROR: Failed to create fragment %d", i);
             // Cleanup
@@ -803,16 +1145,9 @@ static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_
     
     // Apply host case mixing to first fragment (contains Host header start)
     if (g_bypass.settings.mix_host_case && actual_count > 0) {
-        struct iphdr* f_ip = (struct iphdr*)fragments[0];
-        uint32_t f_ip_len = f_ip->ihl * 4;
-        struct tcphdr* f_tcp = (struct tcphdr*)(fragments[0] + f_ip_len);
-        uint32_t f_tcp_len = f_tcp->doff * 4;
-        mix_hostname_case(fragments[0] + f_ip_len + f_tcp_len, 
-                         frag_lens[0] - f_ip_len - f_tcp_len);
-        f_tcp->check = 0;
-        f_tcp->check = calculate_tcp_checksum(f_ip, f_tcp,
-                                              fragments[0] + f_ip_len + f_tcp_len,
-                                              frag_lens[0] - f_ip_len - f_tcp_len);
+        mix_hostname_case(fragments[0] + ip_hdr_len + tcp_hdr_len, 
+                         frag_lens[0] - ip_hdr_len - tcp_hdr_len);
+        update_tcp_checksum(fragments[0], frag_lens[0], ip_hdr_len);
         LOGD("[DISORDER] Applied host case mixing to fragment 0");
     }
     
@@ -833,7 +1168,7 @@ static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_
                 LOGI("[DISORDER] Fragment %d sent OK", i);
             }
             if (i > 0 && result == 0) {
-                delay_ms(g_bypass.settings.split_delay_ms);
+                step_delay_us(choice->split_delay_us);
             }
         }
     } else {
@@ -849,7 +1184,7 @@ static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_
                 LOGI("[DISORDER] Fragment %d sent OK", i);
             }
             if (i < actual_count - 1 && result == 0) {
-                delay_ms(g_bypass.settings.split_delay_ms);
+                step_delay_us(choice->split_delay_us);
             }
         }
     }
@@ -870,6 +1205,275 @@ static int apply_disorder_with_injection(uint8_t* payload, uint32_t len, uint32_
     return result;
 }
 
+/**
+ * Apply OOB: the request split in two with a 1-byte urgent segment between
+ * them, all sent back to back without a delay.
+ * The urgent segment re-covers the last byte of fragment 1 with a
+ * different byte, URG set and the urgent pointer on that byte. A receiver
+ * that already has fragment 1 drops it as a duplicate before looking at
+ * the urgent pointer, so no sequence space is consumed and the stream is
+ * unchanged; middleboxes that splice segments in arrival order or take
+ * urgent data in-band see a corrupted request.
+ */
+static int apply_oob_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip,
+                                    const StrategyChoice* choice) {
+    if (payload == NULL || len < 40) {
+        LOGE("[OOB] ERROR: Invalid payload");
+        return -1;
+    }
+    
+    uint8_t protocol;
+    uint32_t ip_hdr_len = ip_header_len(payload, len, &protocol);
+    struct tcphdr* tcp = (struct tcphdr*)(payload + ip_hdr_len);
+    uint32_t tcp_hdr_len = tcp->doff * 4;
+    
+    uint8_t* tcp_data = payload + ip_hdr_len + tcp_hdr_len;
+    uint32_t tcp_data_len = len - ip_hdr_len - tcp_hdr_len;
+    
+    if (tcp_data_len < 2) {
+        LOGD("[OOB] SKIP: TCP data too short (%u bytes)", tcp_data_len);
+        return -1;
+    }
+    
+    uint16_t split_pos = choice->first_packet_size;
+    if (split_pos >= tcp_data_len) {
+        split_pos = tcp_data_len / 2;
+    }
+    if (split_pos < 1) split_pos = 1;
+    
+    uint8_t* frags[3] = {0};
+    uint32_t frag_lens[3] = {0};
+    uint8_t urgent_byte = tcp_data[split_pos - 1] ^ 0xFF;
+    
+    frags[0] = dpi_create_tcp_fragment(payload, len, tcp_data, split_pos, 0, &frag_lens[0]);
+    frags[1] = dpi_create_tcp_fragment(payload, len, &urgent_byte, 1, split_pos - 1, &frag_lens[1]);
+    frags[2] = dpi_create_tcp_fragment(payload, len, tcp_data + split_pos,
+                                       tcp_data_len - split_pos, split_pos, &frag_lens[2]);
+    
+    int result = -1;
+    if (frags[0] != NULL && frags[1] != NULL && frags[2] != NULL) {
+        // Urgent segment: URG + pointer just past its byte (BSD semantics, RFC 6093)
+        struct tcphdr* u_tcp = (struct tcphdr*)(frags[1] + ip_hdr_len);
+        u_tcp->urg = 1;
+        u_tcp->urg_ptr = htons(1);
+        update_tcp_checksum(frags[1], frag_lens[1], ip_hdr_len);
+        
+        if (g_bypass.settings.mix_host_case) {
+            mix_hostname_case(frags[2] + ip_hdr_len + tcp_hdr_len, frag_lens[2] - ip_hdr_len - tcp_hdr_len);
+            update_tcp_checksum(frags[2], frag_lens[2], ip_hdr_len);
+        }
+        
+        result = dpi_send_raw_batch(frags, frag_lens, 3, dst_ip);
+    }
+    
+    for (int i = 0; i < 3; i++) {
+        free(frags[i]);
+    }
+    
+    if (result == 0) {
+        LOGI("[OOB] Sent %u + urgent + %u bytes", split_pos, tcp_data_len - split_pos);
+    } else {
+        LOGE("[OOB] === OOB injection FAILED ===");
+    }
+    return result;
+}
+
+/**
+ * Apply IPFRAG: the datagram split into two IP fragments at an 8-byte
+ * boundary inside the SNI / Host value (or after the split size when no
+ * hostname is found), both sent back to back without a delay.
+ * The TCP segment is not touched: the receiver's reassembly restores the
+ * original datagram, so only the two IPv4 header checksums are computed.
+ * IPv6 fragments get a Fragment header after the fixed header; packets
+ * with extension headers are not fragmented.
+ * DPI that reassembles TCP streams but not IP fragments never sees the
+ * whole hostname.
+ */
+static int apply_ipfrag_with_injection(uint8_t* payload, uint32_t len, uint32_t dst_ip, bool reverse,
+                                       const StrategyChoice* choice) {
+    if (payload == NULL || len < 40) {
+        LOGE("[IPFRAG] ERROR: Invalid payload");
+        return -1;
+    }
+    
+    const struct iphdr* ip = (const struct iphdr*)payload;
+    bool ipv6 = ip->version == 6;
+    uint8_t protocol;
+    uint32_t ip_hdr_len = ip_header_len(payload, len, &protocol);
+    const struct tcphdr* tcp = (const struct tcphdr*)(payload + ip_hdr_len);
+    uint32_t tcp_hdr_len = tcp->doff * 4;
+    uint32_t l4_len = len - ip_hdr_len;
+    
+    if (ipv6 && ip_hdr_len != IPV6_HEADER_LEN) {
+        // The Fragment header would have to follow the unfragmentable part
+        LOGD("[IPFRAG] SKIP: IPv6 extension headers present");
+        return -1;
+    }
+    if (!ipv6 && (ntohs(ip->frag_off) & (IP_MF | IP_OFFSET))) {
+        LOGD("[IPFRAG] SKIP: Packet is already a fragment");
+        return -1;
+    }
+    
+    // Cut in the middle of the hostname; offsets count from the TCP header
+    DpiPacketInfo info;
+    dpi_classify_packet(payload, len, &info);
+    uint32_t cut;
+    if (info.host_offset > 0) {
+        cut = info.host_offset - ip_hdr_len + info.host_len / 2;
+    } else {
+        cut = tcp_hdr_len + choice->first_packet_size;
+    }
+    cut &= ~7U;
+    
+    // The first fragment keeps the whole TCP header (RFC 1858)
+    uint32_t min_cut = (tcp_hdr_len + 7) & ~7U;
+    if (cut < min_cut) cut = min_cut;
+    if (cut >= l4_len) {
+        LOGD("[IPFRAG] SKIP: Datagram too short to fragment (%u bytes)", l4_len);
+        return -1;
+    }
+    
+    // Both fragments need the same nonzero ID; the kernel would pick a
+    // different one for each if it were left 0 (IPv6 has no ID to reuse)
+    uint32_t flow_id = ntohl(tcp->seq) ^ ntohs(tcp->source);
+    uint16_t id = ip->id;
+    if (id == 0) {
+        id = htons((uint16_t)flow_id != 0 ? (uint16_t)flow_id : 1);
+    }
+    uint32_t id6 = htonl(flow_id != 0 ? flow_id : 1);
+    
+    uint32_t hdr_len = ip_hdr_len + (ipv6 ? sizeof(struct ip6_frag) : 0);
+    uint8_t* frags[2] = {0};
+    uint32_t frag_lens[2] = { hdr_len + cut, hdr_len + l4_len - cut };
+    uint32_t frag_offsets[2] = { 0, cut };
+    
+    frags[0] = (uint8_t*)malloc(frag_lens[0]);
+    frags[1] = (uint8_t*)malloc(frag_lens[1]);
+    if (frags[0] == NULL || frags[1] == NULL) {
+        LOGE("[IPFRAG] ERROR: malloc failed");
+        free(frags[0]);
+        free(frags[1]);
+        return -1;
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        memcpy(frags[i], payload, ip_hdr_len);
+        memcpy(frags[i] + hdr_len, payload + ip_hdr_len + frag_offsets[i], frag_lens[i] - hdr_len);
+        
+        if (ipv6) {
+            struct ip6_hdr* f_ip6 = (struct ip6_hdr*)frags[i];
+            struct ip6_frag* f_frag = (struct ip6_frag*)(frags[i] + ip_hdr_len);
+            f_ip6->ip6_plen = htons(frag_lens[i] - IPV6_HEADER_LEN);
+            f_ip6->ip6_nxt = IPPROTO_FRAGMENT;
+            f_frag->ip6f_nxt = protocol;
+            f_frag->ip6f_reserved = 0;
+            f_frag->ip6f_offlg = htons(frag_offsets[i]) | (i == 0 ? IP6F_MORE_FRAG : 0);
+            f_frag->ip6f_ident = id6;
+            continue;
+        }
+        
+        struct iphdr* f_ip = (struct iphdr*)frags[i];
+        f_ip->tot_len = htons(frag_lens[i]);
+        f_ip->id = id;
+        f_ip->frag_off = htons((i == 0 ? IP_MF : 0) | (frag_offsets[i] >> 3));
+        f_ip->check = 0;
+        f_ip->check = checksum_ip(f_ip);
+    }
+    
+    if (reverse) {
+        uint8_t* tmp = frags[0];
+        frags[0] = frags[1];
+        frags[1] = tmp;
+        uint32_t tmp_len = frag_lens[0];
+        frag_lens[0] = frag_lens[1];
+        frag_lens[1] = tmp_len;
+    }
+    int result = dpi_send_raw_batch(frags, frag_lens, 2, dst_ip);
+    
+    for (int i = 0; i < 2; i++) {
+        free(frags[i]);
+    }
+    
+    if (result == 0) {
+        LOGI("[IPFRAG] Sent fragments at offset 0 and %u%s", cut, reverse ? " (reversed)" : "");
+    } else {
+        LOGE("[IPFRAG] === IPFRAG injection FAILED ===");
+    }
+    return result;
+}
+
+/**
+ * Length of the IP header and the transport protocol
+ * IPv6 extension headers count as part of the header. An IPv6 packet that
+ * carries a Fragment header reports IPPROTO_FRAGMENT: segments rebuilt
+ * from it could not keep that header.
+ * @return Header length, 0 if the header is invalid or truncated
+ */
+static uint32_t ip_header_len(const uint8_t* packet, uint32_t len, uint8_t* protocol) {
+    if (len >= IPV6_HEADER_LEN && (packet[0] >> 4) == 6) {
+        bool fragment = false;
+        int offset = ipv6_transport_offset(packet, len, protocol, &fragment);
+        if (offset < 0) return 0;
+        if (fragment) *protocol = IPPROTO_FRAGMENT;
+        return (uint32_t)offset;
+    }
+    
+    if (len < 20 || (packet[0] >> 4) != 4) return 0;
+    
+    uint32_t ip_hdr_len = (packet[0] & 0x0F) * 4;
+    if (ip_hdr_len < 20 || ip_hdr_len > len) return 0;
+    
+    *protocol = packet[9];
+    return ip_hdr_len;
+}
+
+/**
+ * Set the length field of a rebuilt packet (IPv4: and the header checksum)
+ * @return IPv4 header checksum, 0 for IPv6
+ */
+static uint16_t set_ip_length(uint8_t* packet, uint32_t len) {
+    if ((packet[0] >> 4) == 6) {
+        struct ip6_hdr* ip6 = (struct ip6_hdr*)packet;
+        ip6->ip6_plen = htons(len - IPV6_HEADER_LEN);
+        return 0;
+    }
+    
+    struct iphdr* ip = (struct iphdr*)packet;
+    ip->tot_len = htons(len);
+    ip->check = 0;
+    ip->check = checksum_ip(ip);
+    return ip->check;
+}
+
+/**
+ * Recompute the TCP checksum of a rebuilt packet
+ * @return New checksum
+ */
+static uint16_t update_tcp_checksum(uint8_t* packet, uint32_t len, uint32_t ip_hdr_len) {
+    struct tcphdr* tcp = (struct tcphdr*)(packet + ip_hdr_len);
+    uint32_t tcp_hdr_len = tcp->doff * 4;
+    const uint8_t* data = packet + ip_hdr_len + tcp_hdr_len;
+    uint32_t data_len = len - ip_hdr_len - tcp_hdr_len;
+    
+    tcp->check = 0;
+    if ((packet[0] >> 4) == 6) {
+        tcp->check = checksum_tcp6((const struct ip6_hdr*)packet, tcp, data, data_len);
+    } else {
+        tcp->check = checksum_tcp((const struct iphdr*)packet, tcp, data, data_len);
+    }
+    return tcp->check;
+}
+
+/**
+ * Format the source or destination address of a packet for logs
+ */
+static const char* format_ip(const uint8_t* packet, bool dst, char* buf, size_t size) {
+    if ((packet[0] >> 4) == 6) {
+        return inet_ntop(AF_INET6, packet + (dst ? 24 : 8), buf, size);
+    }
+    return inet_ntop(AF_INET, packet + (dst ? 16 : 12), buf, size);
+}
+
 /**
  * Mix case of hostname in HTTP Host header
  */
@@ -905,11 +1509,43 @@ bool dpi_is_tls_client_hello(const uint8_t* data, uint32_t len) {
     return data[0] == 0x16 && data[5] == 0x01;
 }
 
+/**
+ * Check if HTTP request line
+ */
+bool dpi_is_http_request(const uint8_t* data, uint32_t len) {
+    static const char* const methods[] = {
+        "GET ", "POST ", "HEAD ", "PUT ", "DELETE ", "OPTIONS ", "PATCH ", "CONNECT "
+    };
+    
+    if (data == NULL || len < 4) return false;
+    
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        size_t mlen = strlen(methods[i]);
+        if (len >= mlen && memcmp(data, methods[i], mlen) == 0) return true;
+    }
+    return false;
+}
+
 /**
  * Extract SNI from TLS ClientHello
  */
 int dpi_extract_sni(const uint8_t* data, uint32_t len, char* sni_buf, uint32_t sni_buf_len) {
-    if (data == NULL || len < 43 || sni_buf == NULL) return 0;
+    if (sni_buf == NULL) return 0;
+    
+    uint32_t name_len = 0;
+    uint32_t offset = dpi_find_sni(data, len, &name_len);
+    if (offset == 0 || name_len >= sni_buf_len) return 0;
+    
+    memcpy(sni_buf, data + offset, name_len);
+    sni_buf[name_len] = '\0';
+    return (int)name_len;
+}
+
+/**
+ * Locate SNI in TLS ClientHello
+ */
+uint32_t dpi_find_sni(const uint8_t* data, uint32_t len, uint32_t* name_len_out) {
+    if (data == NULL || len < 43) return 0;
     
     uint32_t offset = 43;
     
@@ -948,10 +1584,9 @@ int dpi_extract_sni(const uint8_t* data, uint32_t len, char* sni_buf, uint32_t s
             
             if (name_type == 0 && name_len > 0) {
                 uint32_t hostname_offset = sni_start + 5;
-                if (hostname_offset + name_len <= len && name_len < sni_buf_len) {
-                    memcpy(sni_buf, data + hostname_offset, name_len);
-                    sni_buf[name_len] = '\0';
-                    return name_len;
+                if (hostname_offset + name_len <= len) {
+                    if (name_len_out != NULL) *name_len_out = name_len;
+                    return hostname_offset;
                 }
             }
         }
@@ -962,6 +1597,92 @@ int dpi_extract_sni(const uint8_t* data, uint32_t len, char* sni_buf, uint32_t s
     return 0;
 }
 
+/**
+ * Locate Host header value
+ */
+uint32_t dpi_find_http_host(const uint8_t* data, uint32_t len, uint32_t* host_len) {
+    if (data == NULL) return 0;
+    
+    // Header names start right after a line break; stop at the blank line
+    for (uint32_t i = 1; i + 5 <= len; i++) {
+        if (data[i - 1] != '\n') continue;
+        if (data[i] == '\r' || data[i] == '\n') break;
+        if (strncasecmp((const char*)data + i, "host:", 5) != 0) continue;
+        
+        uint32_t start = i + 5;
+        while (start < len && (data[start] == ' ' || data[start] == '\t')) start++;
+        
+        uint32_t end = start;
+        while (end < len && data[end] != '\r' && data[end] != '\n') end++;
+        if (end == start) return 0;
+        
+        if (host_len != NULL) *host_len = end - start;
+        return start;
+    }
+    
+    return 0;
+}
+
+/**
+ * Classify packet for the prefilter
+ */
+DpiPacketClass dpi_classify_packet(const uint8_t* packet, uint32_t len, DpiPacketInfo* info) {
+    DpiPacketInfo tmp;
+    if (info == NULL) info = &tmp;
+    memset(info, 0, sizeof(*info));
+    
+    if (packet == NULL) return DPI_CLASS_OTHER;
+    
+    uint8_t protocol = 0;
+    uint32_t ip_hdr_len = ip_header_len(packet, len, &protocol);
+    if (ip_hdr_len == 0 || len < ip_hdr_len + 8) return DPI_CLASS_OTHER;
+    
+    // Later IP fragments carry no transport header (IPv6: protocol is
+    // IPPROTO_FRAGMENT)
+    if ((packet[0] >> 4) == 4 && (((packet[6] << 8) | packet[7]) & 0x1FFF) != 0) return DPI_CLASS_OTHER;
+    
+    const uint8_t* l4 = packet + ip_hdr_len;
+    uint16_t dst_port = (l4[2] << 8) | l4[3];
+    if (dst_port != 443 && dst_port != 80) return DPI_CLASS_OTHER;
+    info->l4_offset = ip_hdr_len;
+    
+    if (protocol == IPPROTO_UDP) {
+        // Long header, fixed bit set, packet type Initial (0)
+        info->data_offset = ip_hdr_len + 8;
+        info->data_len = len - info->data_offset;
+        if (info->data_len > 0 && (packet[info->data_offset] & 0xF0) == 0xC0) {
+            info->packet_class = DPI_CLASS_QUIC_INITIAL;
+        }
+        return info->packet_class;
+    }
+    
+    if (protocol != IPPROTO_TCP || len < ip_hdr_len + 20) return DPI_CLASS_OTHER;
+    
+    uint32_t tcp_hdr_len = (l4[12] >> 4) * 4;
+    if (tcp_hdr_len < 20 || len <= ip_hdr_len + tcp_hdr_len) return DPI_CLASS_OTHER;
+    
+    info->data_offset = ip_hdr_len + tcp_hdr_len;
+    info->data_len = len - info->data_offset;
+    const uint8_t* data = packet + info->data_offset;
+    uint32_t host_offset = 0;
+    
+    if (dst_port == 443 && dpi_is_tls_client_hello(data, info->data_len)) {
+        info->packet_class = DPI_CLASS_TLS_CLIENT_HELLO;
+        host_offset = dpi_find_sni(data, info->data_len, &info->host_len);
+    } else if (dst_port == 80 && dpi_is_http_request(data, info->data_len)) {
+        info->packet_class = DPI_CLASS_HTTP_REQUEST;
+        host_offset = dpi_find_http_host(data, info->data_len, &info->host_len);
+    }
+    
+    if (host_offset != 0) {
+        info->host_offset = info->data_offset + host_offset;
+    } else {
+        info->host_len = 0;
+    }
+    
+    return info->packet_class;
+}
+
 /**
  * Check whitelist
  */
@@ -987,13 +1708,26 @@ bool dpi_is_whitelisted(const char* hostname) {
 void dpi_whitelist_add(const char* hostname) {
     if (hostname == NULL || hostname[0] == '\0') return;
     
+    char* entry = strndup(hostname, MAX_HOSTNAME_LEN - 1);
+    if (entry == NULL) return;
+    
     pthread_mutex_lock(&g_bypass.lock);
     
-    if (g_bypass.whitelist_count < MAX_WHITELIST) {
-        strncpy(g_bypass.whitelist[g_bypass.whitelist_count], hostname, MAX_HOSTNAME_LEN - 1);
-        g_bypass.whitelist[g_bypass.whitelist_count][MAX_HOSTNAME_LEN - 1] = '\0';
-        g_bypass.whitelist_count++;
+    if (g_bypass.whitelist_count == g_bypass.whitelist_capacity) {
+        int capacity = g_bypass.whitelist_capacity * 2;
+        if (capacity < WHITELIST_MIN_CAPACITY) capacity = WHITELIST_MIN_CAPACITY;
+        
+        char** grown = realloc(g_bypass.whitelist, capacity * sizeof(char*));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&g_bypass.lock);
+            LOGE("Whitelist: out of memory at %d entries", g_bypass.whitelist_count);
+            free(entry);
+            return;
+        }
+        g_bypass.whitelist = grown;
+        g_bypass.whitelist_capacity = capacity;
     }
+    g_bypass.whitelist[g_bypass.whitelist_count++] = entry;
     
     pthread_mutex_unlock(&g_bypass.lock);
 }
@@ -1003,6 +1737,9 @@ void dpi_whitelist_add(const char* hostname) {
  */
 void dpi_whitelist_clear(void) {
     pthread_mutex_lock(&g_bypass.lock);
+    for (int i = 0; i < g_bypass.whitelist_count; i++) {
+        free(g_bypass.whitelist[i]);
+    }
     g_bypass.whitelist_count = 0;
     pthread_mutex_unlock(&g_bypass.lock);
 }
@@ -1012,6 +1749,7 @@ void dpi_whitelist_clear(void) {
  */
 DpiBypassStats dpi_bypass_get_stats(void) {
     pthread_mutex_lock(&g_bypass.lock);
+    update_rates_locked();
     DpiBypassStats stats = g_bypass.stats;
     pthread_mutex_unlock(&g_bypass.lock);
     return stats;
@@ -1023,78 +1761,58 @@ DpiBypassStats dpi_bypass_get_stats(void) {
 void dpi_bypass_reset_stats(void) {
     pthread_mutex_lock(&g_bypass.lock);
     memset(&g_bypass.stats, 0, sizeof(DpiBypassStats));
+    g_bypass.rate_last_ns = 0;
+    g_bypass.rate_last_packets = 0;
+    g_bypass.rate_last_bytes = 0;
     pthread_mutex_unlock(&g_bypass.lock);
 }
 
-// ============================================================================
-// Checksum calculations
-// ============================================================================
-
 /**
- * Calculate IP header checksum
+ * Update EWMA packet/byte rates (caller holds g_bypass.lock)
+ * Folds in one sample per RATE_INTERVAL_NS; idle periods decay the rate.
  */
-static uint16_t calculate_ip_checksum(struct iphdr* ip) {
-    uint32_t sum = 0;
-    uint16_t* ptr = (uint16_t*)ip;
-    int len = ip->ihl * 4;
-    
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
+static void update_rates_locked(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    
+    if (g_bypass.rate_last_ns == 0) {
+        g_bypass.rate_last_ns = now;
+        g_bypass.rate_last_packets = g_bypass.stats.packets_total;
+        g_bypass.rate_last_bytes = g_bypass.stats.bytes_total;
+        return;
     }
     
-    if (len == 1) {
-        sum += *(uint8_t*)ptr;
-    }
+    uint64_t elapsed = now - g_bypass.rate_last_ns;
+    if (elapsed < RATE_INTERVAL_NS) return;
     
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
+    double dt = (double)elapsed / 1e9;
+    double weight = exp(-dt / RATE_TAU_SEC);
+    double pps = (double)(g_bypass.stats.packets_total - g_bypass.rate_last_packets) / dt;
+    double bps = (double)(g_bypass.stats.bytes_total - g_bypass.rate_last_bytes) / dt;
+    
+    g_bypass.stats.packet_rate = g_bypass.stats.packet_rate * weight + pps * (1.0 - weight);
+    g_bypass.stats.byte_rate = g_bypass.stats.byte_rate * weight + bps * (1.0 - weight);
     
-    return ~sum;
+    g_bypass.rate_last_ns = now;
+    g_bypass.rate_last_packets = g_bypass.stats.packets_total;
+    g_bypass.rate_last_bytes = g_bypass.stats.bytes_total;
 }
 
 /**
- * Calculate TCP checksum
+ * Get decision reason name
  */
-static uint16_t calculate_tcp_checksum(struct iphdr* ip, struct tcphdr* tcp,
-                                       uint8_t* payload, uint32_t payload_len) {
-    uint32_t sum = 0;
-    uint32_t tcp_len = tcp->doff * 4 + payload_len;
-    
-    // Pseudo header
-    sum += (ip->saddr >> 16) & 0xFFFF;
-    sum += ip->saddr & 0xFFFF;
-    sum += (ip->daddr >> 16) & 0xFFFF;
-    sum += ip->daddr & 0xFFFF;
-    sum += htons(IPPROTO_TCP);
-    sum += htons(tcp_len);
-    
-    // TCP header
-    uint16_t* ptr = (uint16_t*)tcp;
-    int len = tcp->doff * 4;
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
-    }
-    
-    // Payload
-    ptr = (uint16_t*)payload;
-    len = payload_len;
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
-    }
-    
-    if (len == 1) {
-        sum += *(uint8_t*)ptr;
-    }
-    
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-    
-    return ~sum;
+const char* dpi_reason_name(DpiDecisionReason reason) {
+    if ((unsigned)reason >= DPI_REASON_COUNT) return "unknown";
+    return REASON_NAMES[reason];
+}
+
+/**
+ * Get bypass method name
+ */
+const char* dpi_method_name(BypassMethod method) {
+    if ((unsigned)method >= BYPASS_METHOD_COUNT) return "unknown";
+    return METHOD_NAMES[method];
 }
 
 // ============================================================================
@@ -1106,48 +1824,15 @@ static uint16_t calculate_tcp_checksum(struct iphdr* ip, struct tcphdr* tcp,
  */
 int dpi_raw_socket_init(void) {
     pthread_mutex_lock(&g_bypass.lock);
+    InjectBackendType type = g_bypass.inject_backend;
+    uint32_t mark = g_bypass.packet_mark;
+    pthread_mutex_unlock(&g_bypass.lock);
     
-    LOGI("=== RAW SOCKET INIT ===");
-    
-    if (g_bypass.raw_socket_initialized) {
-        LOGI("Raw socket already initialized");
-        pthread_mutex_unlock(&g_bypass.lock);
-        return 0;  // Already initialized
-    }
-    
-    // Create raw socket with IP_HDRINCL (we provide IP header)
-    LOGI("Creating raw socket (SOCK_RAW, IPPROTO_RAW)...");
-    g_bypass.raw_socket = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
-    if (g_bypass.raw_socket < 0) {
-        LOGE("!!! FAILED to create raw socket: %s (errno=%d)", strerror(errno), errno);
-        pthread_mutex_unlock(&g_bypass.lock);
-        return -1;
-    }
-    LOGI("Raw socket created: fd=%d", g_bypass.raw_socket);
-    
-    // Set IP_HDRINCL option (we include IP header in packet)
-    int one = 1;
-    if (setsockopt(g_bypass.raw_socket, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one)) < 0) {
-        LOGE("!!! FAILED to set IP_HDRINCL: %s", strerror(errno));
-        close(g_bypass.raw_socket);
-        g_bypass.raw_socket = -1;
-        pthread_mutex_unlock(&g_bypass.lock);
+    LOGI("=== RAW SOCKET INIT (%s) ===", inject_backend_name(type));
+    if (inject_backend_init(type, mark) < 0) {
+        LOGE("!!! FAILED to open injection backend !!!");
         return -1;
     }
-    LOGI("IP_HDRINCL set OK");
-    
-    // Set socket mark (so iptables can identify our packets)
-    if (setsockopt(g_bypass.raw_socket, SOL_SOCKET, SO_MARK, &g_bypass.packet_mark, sizeof(g_bypass.packet_mark)) < 0) {
-        LOGI("Warning: Failed to set SO_MARK: %s (may cause packet loops)", strerror(errno));
-        // Not fatal, continue without mark
-    } else {
-        LOGI("SO_MARK set to 0x%X", g_bypass.packet_mark);
-    }
-    
-    g_bypass.raw_socket_initialized = true;
-    LOGI("=== RAW SOCKET READY: fd=%d ===", g_bypass.raw_socket);
-    
-    pthread_mutex_unlock(&g_bypass.lock);
     return 0;
 }
 
@@ -1155,59 +1840,50 @@ int dpi_raw_socket_init(void) {
  * Close raw socket
  */
 void dpi_raw_socket_cleanup(void) {
-    pthread_mutex_lock(&g_bypass.lock);
-    
-    if (g_bypass.raw_socket >= 0) {
-        close(g_bypass.raw_socket);
-        g_bypass.raw_socket = -1;
-    }
-    g_bypass.raw_socket_initialized = false;
-    
+    inject_backend_cleanup();
     LOGI("Raw socket cleaned up");
-    pthread_mutex_unlock(&g_bypass.lock);
 }
 
 /**
  * Send raw packet
  */
 int dpi_send_raw_packet(const uint8_t* packet, uint32_t len, uint32_t dst_ip) {
-    if (!g_bypass.raw_socket_initialized || g_bypass.raw_socket < 0) {
-        LOGE("!!! Raw socket not initialized, cannot send packet !!!");
-        return -1;
-    }
-    
-    if (packet == NULL || len < 20) {
-        LOGE("Invalid packet: ptr=%p, len=%u", packet, len);
-        return -1;
-    }
-    
-    struct sockaddr_in dst_addr;
-    memset(&dst_addr, 0, sizeof(dst_addr));
-    dst_addr.sin_family = AF_INET;
-    dst_addr.sin_addr.s_addr = dst_ip;
-    
-    LOGD("Sending raw packet: len=%u, dst=%d.%d.%d.%d",
-         len,
-         (dst_ip) & 0xFF,
-         (dst_ip >> 8) & 0xFF,
-         (dst_ip >> 16) & 0xFF,
-         (dst_ip >> 24) & 0xFF);
-    
-    ssize_t sent = sendto(g_bypass.raw_socket, packet, len, 0,
-                          (struct sockaddr*)&dst_addr, sizeof(dst_addr));
-    
-    if (sent < 0) {
-        LOGE("!!! sendto FAILED: %s (errno=%d) !!!", strerror(errno), errno);
-        return -1;
+    uint8_t* packets[1] = { (uint8_t*)packet };
+    return dpi_send_raw_batch(packets, &len, 1, dst_ip);
+}
+
+/**
+ * Send packets back to back
+ */
+int dpi_send_raw_batch(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip) {
+    if (count > DPI_MAX_BATCH) return -1;
+    if (count == 0) return 0;
+    
+    int sent = 0;
+    if (g_bypass.inject_sink != NULL) {
+        while ((uint32_t)sent < count && packets[sent] != NULL && lens[sent] >= 20 &&
+               g_bypass.inject_sink(packets[sent], lens[sent], dst_ip, g_bypass.inject_sink_data) >= 0) {
+            sent++;
+        }
+    } else {
+        char dst_str[INET6_ADDRSTRLEN];
+        LOGD("Sending %u raw packet(s): dst=%s",
+             count, format_ip(packets[0], true, dst_str, sizeof(dst_str)));
+        sent = inject_backend_send(packets, lens, count, dst_ip);
+        if (sent < 0) return -1;
     }
     
-    if ((uint32_t)sent != len) {
-        LOGD("Partial send: %zd/%u", sent, len);
-    } else {
-        LOGD("Sent OK: %zd bytes", sent);
+    uint64_t bytes = 0;
+    for (int i = 0; i < sent; i++) {
+        bytes += lens[i];
+        if (t_trace.packet != NULL) decision_trace_injected(packets[i], lens[i]);
     }
+    pthread_mutex_lock(&g_bypass.lock);
+    g_bypass.stats.fragments_injected += (uint64_t)sent;
+    g_bypass.stats.bytes_injected += bytes;
+    pthread_mutex_unlock(&g_bypass.lock);
     
-    return 0;
+    return (uint32_t)sent == count ? 0 : -1;
 }
 
 /**
@@ -1216,12 +1892,35 @@ int dpi_send_raw_packet(const uint8_t* packet, uint32_t len, uint32_t dst_ip) {
 void dpi_set_packet_mark(uint32_t mark) {
     pthread_mutex_lock(&g_bypass.lock);
     g_bypass.packet_mark = mark;
+    pthread_mutex_unlock(&g_bypass.lock);
     
     // Update socket option if already initialized
-    if (g_bypass.raw_socket >= 0) {
-        setsockopt(g_bypass.raw_socket, SOL_SOCKET, SO_MARK, &mark, sizeof(mark));
-    }
-    
+    inject_backend_set_mark(mark);
+}
+
+/**
+ * Set injection backend
+ */
+void dpi_set_inject_backend(InjectBackendType type) {
+    pthread_mutex_lock(&g_bypass.lock);
+    g_bypass.inject_backend = type;
     pthread_mutex_unlock(&g_bypass.lock);
 }
 
+/**
+ * Set injection sink
+ */
+void dpi_set_inject_sink(dpi_inject_sink_t sink, void* user_data) {
+    pthread_mutex_lock(&g_bypass.lock);
+    g_bypass.inject_sink = sink;
+    g_bypass.inject_sink_data = user_data;
+    pthread_mutex_unlock(&g_bypass.lock);
+}
+
+/**
+ * Last decision on this thread
+ */
+DpiDecisionReason dpi_bypass_last_reason(void) {
+    return t_last_reason;
+}
+
@@ -2,7 +2,8 @@
  * dpi_bypass.h
  * 
  * Native DPI bypass implementation for kernel-level packet manipulation.
- * Supports: SPLIT, SPLIT_REVERSE, DISORDER, DISORDER_REVERSE
+ * Supports: SPLIT, SPLIT_REVERSE, DISORDER, DISORDER_REVERSE, OOB,
+ * IPFRAG, IPFRAG_REVERSE, WINDOW_CLAMP
  */
 
 #ifndef DPI_BYPASS_H
@@ -11,6 +12,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "nfqueue_handler.h"
+#include "inject_backend.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,9 +24,61 @@ typedef enum {
     BYPASS_SPLIT = 1,
     BYPASS_SPLIT_REVERSE = 2,
     BYPASS_DISORDER = 3,
-    BYPASS_DISORDER_REVERSE = 4
+    BYPASS_DISORDER_REVERSE = 4,
+    BYPASS_OOB = 5,                // Urgent byte at the split point, no delay
+    BYPASS_IPFRAG = 6,             // IP fragments split inside the SNI, no delay
+    BYPASS_IPFRAG_REVERSE = 7,     // IPFRAG, last fragment first
+    BYPASS_WINDOW_CLAMP = 8,       // Tiny SYN-ACK window, the client segments the request
+    BYPASS_METHOD_COUNT
 } BypassMethod;
 
+// Decision reasons - one per branch of the packet path
+typedef enum {
+    DPI_REASON_INVALID = 0,         // Null or truncated packet
+    DPI_REASON_NOT_IP,              // IP version neither 4 nor 6
+    DPI_REASON_BAD_IP_HEADER,       // Invalid IHL / length
+    DPI_REASON_QUIC_BLOCKED,        // UDP 443/80 dropped (block_quic)
+    DPI_REASON_NOT_TCP,             // Other protocol, accepted
+    DPI_REASON_BAD_TCP_HEADER,      // Invalid data offset / length
+    DPI_REASON_NO_PAYLOAD,          // Control packet (SYN, ACK, FIN...)
+    DPI_REASON_NOT_HTTP_PORT,       // Not port 443 or 80
+    DPI_REASON_HTTPS_DISABLED,      // desync_https off
+    DPI_REASON_HTTP_DISABLED,       // desync_http off
+    DPI_REASON_NOT_CLIENT_HELLO,    // HTTPS data that is not a ClientHello
+    DPI_REASON_WHITELISTED,         // Host matched whitelist
+    DPI_REASON_NO_RAW_SOCKET,       // Raw socket could not be opened
+    DPI_REASON_METHOD_NONE,         // Bypass method disabled
+    DPI_REASON_INJECT_FAILED,       // Fragment creation or send failed
+    DPI_REASON_BYPASSED,            // Fragments injected, original dropped
+    DPI_REASON_SHED,                // Accepted on the cheap path while overloaded
+    DPI_REASON_OVER_BUDGET,         // Processing budget exceeded, failed open
+    DPI_REASON_WINDOW_CLAMPED,      // Request of a window-clamped flow, accepted
+    DPI_REASON_COUNT
+} DpiDecisionReason;
+
+// Packet classes recognised by the prefilter
+typedef enum {
+    DPI_CLASS_OTHER = 0,            // Can never need bypass
+    DPI_CLASS_TLS_CLIENT_HELLO,     // First segment of a TLS ClientHello (TCP 443)
+    DPI_CLASS_HTTP_REQUEST,         // Start of an HTTP request (TCP 80)
+    DPI_CLASS_QUIC_INITIAL          // QUIC long-header Initial (UDP 443/80)
+} DpiPacketClass;
+
+// Prefilter result; offsets are from the start of the IP packet
+typedef struct {
+    DpiPacketClass packet_class;
+    uint32_t l4_offset;            // TCP/UDP header
+    uint32_t data_offset;          // Application data
+    uint32_t data_len;             // Application data length
+    uint32_t host_offset;          // SNI / Host value (0 = not found)
+    uint32_t host_len;             // SNI / Host value length
+} DpiPacketInfo;
+
+// Injection sink: receives packets instead of the raw socket when set
+// Return: 0 on success, -1 on error
+typedef int (*dpi_inject_sink_t)(const uint8_t* packet, uint32_t len,
+                                 uint32_t dst_ip, void* user_data);
+
 // DPI bypass settings
 typedef struct {
     BypassMethod method;           // Bypass method to use
@@ -35,14 +89,43 @@ typedef struct {
     bool desync_http;              // Apply to HTTP (port 80)
     bool mix_host_case;            // Mix case of Host header
     bool block_quic;               // Block QUIC (UDP 443)
+    uint32_t shed_backlog;         // Queue backlog (sampled, or packets in one read) that enables load shedding (0 = off)
+    uint32_t shed_latency_us;      // Average packet lag that enables load shedding (0 = off)
+    uint32_t packet_budget_us;     // Max lag before a packet fails open; fragment delays past it are skipped (0 = off)
+    bool auto_strategy;            // Per-host method from the strategy cache (if open)
+    uint8_t split_delay_rtt_pct;   // Fragment delay as % of the flow's RTT (0 = split_delay_ms)
+    uint32_t split_delay_min_us;   // Lower bound of the RTT-derived delay
+    uint32_t split_delay_max_us;   // Upper bound of the RTT-derived delay (0 = split_delay_ms)
+    uint16_t clamp_window;         // SYN-ACK window of WINDOW_CLAMP flows (default: 64, < 48 stalls the client)
 } DpiBypassSettings;
 
+// Latency histograms: bucket i counts samples <= DPI_LATENCY_BOUND_US(i)
+// (8 us .. 8 ms), the last bucket everything slower
+#define DPI_LATENCY_BUCKETS 12
+#define DPI_LATENCY_BOUND_US(i) (8ULL << (i))
+
 // Statistics
 typedef struct {
     uint64_t packets_total;
     uint64_t packets_bypassed;
     uint64_t packets_dropped;
     uint64_t bytes_total;
+    uint64_t reasons[DPI_REASON_COUNT];            // Packets per decision reason
+    uint64_t method_bypassed[BYPASS_METHOD_COUNT]; // Bypassed packets per method
+    uint64_t fragments_injected;                   // Packets sent via raw socket
+    uint64_t bytes_injected;                       // Bytes sent via raw socket
+    double packet_rate;                            // EWMA packets/sec
+    double byte_rate;                              // EWMA bytes/sec
+    uint64_t shed_events;                          // Transitions into load shedding
+    uint32_t packet_lag_us;                        // EWMA recv-to-processing lag
+    uint64_t lag_hist[DPI_LATENCY_BUCKETS];        // Recv-to-processing lag per bucket
+    uint64_t lag_sum_us;                           // Sum of lag samples
+    uint64_t service_hist[DPI_LATENCY_BUCKETS];    // Processing-to-verdict time per bucket
+    uint64_t service_sum_us;                       // Sum of processing times (incl. fragment delays)
+    uint64_t rtt_delays;                           // Flows with an RTT-derived fragment delay
+    uint32_t fragment_delay_us;                    // EWMA delay between fragments
+    uint32_t queue_backlog;                        // Last reported kernel backlog
+    bool shedding;                                 // Load shedding active
 } DpiBypassStats;
 
 /**
@@ -73,6 +156,30 @@ DpiBypassSettings* dpi_bypass_get_settings(void);
  */
 NfqueueVerdict dpi_bypass_process_packet(NfqueuePacket* packet, void* user_data);
 
+/**
+ * Report current kernel queue backlog (drives load shedding)
+ * @param backlog Packets waiting in the kernel queue
+ */
+void dpi_bypass_report_backlog(uint32_t backlog);
+
+/**
+ * Classify a raw IPv4 or IPv6 packet without touching bypass state.
+ * Cheap enough to run on every queued packet.
+ * @param packet Raw IP packet
+ * @param len Packet length
+ * @param info Output: offsets of transport header, data and hostname (may be NULL)
+ * @return Packet class
+ */
+DpiPacketClass dpi_classify_packet(const uint8_t* packet, uint32_t len, DpiPacketInfo* info);
+
+/**
+ * Check if payload starts with an HTTP request method
+ * @param data TCP payload
+ * @param len Payload length
+ * @return true if HTTP request line
+ */
+bool dpi_is_http_request(const uint8_t* data, uint32_t len);
+
 /**
  * Check if packet is TLS ClientHello
  * @param data TCP payload
@@ -92,6 +199,38 @@ bool dpi_is_tls_client_hello(const uint8_t* data, uint32_t len);
 int dpi_extract_sni(const uint8_t* data, uint32_t len, 
                     char* sni_buf, uint32_t sni_buf_len);
 
+/**
+ * Locate SNI hostname in TLS ClientHello without copying
+ * @param data TCP payload
+ * @param len Payload length
+ * @param name_len Output: hostname length
+ * @return Hostname offset in data, 0 if not found
+ */
+uint32_t dpi_find_sni(const uint8_t* data, uint32_t len, uint32_t* name_len);
+
+/**
+ * Locate Host header value in an HTTP request without copying
+ * @param data TCP payload
+ * @param len Payload length
+ * @param host_len Output: value length
+ * @return Value offset in data, 0 if not found
+ */
+uint32_t dpi_find_http_host(const uint8_t* data, uint32_t len, uint32_t* host_len);
+
+/**
+ * Create a TCP segment carrying part of the original packet's payload
+ * @param orig_packet Original IP packet (headers are copied from it)
+ * @param orig_len Original packet length
+ * @param tcp_data TCP payload for this fragment
+ * @param tcp_data_len Length of TCP payload
+ * @param seq_offset Offset added to the original sequence number
+ * @param out_len Output: length of new packet
+ * @return Allocated packet (caller must free) or NULL on error
+ */
+uint8_t* dpi_create_tcp_fragment(const uint8_t* orig_packet, uint32_t orig_len,
+                                 const uint8_t* tcp_data, uint32_t tcp_data_len,
+                                 uint32_t seq_offset, uint32_t* out_len);
+
 /**
  * Check if host is whitelisted
  * @param hostname Hostname to check
@@ -121,8 +260,23 @@ DpiBypassStats dpi_bypass_get_stats(void);
  */
 void dpi_bypass_reset_stats(void);
 
+/**
+ * Get short name of a decision reason (for logs and metrics)
+ * @param reason Decision reason
+ * @return Static string, "unknown" if out of range
+ */
+const char* dpi_reason_name(DpiDecisionReason reason);
+
+/**
+ * Get short name of a bypass method (for logs and metrics)
+ * @param method Bypass method
+ * @return Static string, "unknown" if out of range
+ */
+const char* dpi_method_name(BypassMethod method);
+
 /**
  * Initialize raw socket for packet injection
+ * Opens the backend chosen with dpi_set_inject_backend (default: shared raw socket).
  * Must be called before processing packets
  * @return 0 on success, -1 on error
  */
@@ -137,17 +291,47 @@ void dpi_raw_socket_cleanup(void);
  * Send raw packet
  * @param packet IP packet data
  * @param len Packet length
- * @param dst_ip Destination IP (network byte order)
+ * @param dst_ip Destination IP (network byte order; IPv6 packets carry their own)
  * @return 0 on success, -1 on error
  */
 int dpi_send_raw_packet(const uint8_t* packet, uint32_t len, uint32_t dst_ip);
 
+/**
+ * Send several raw packets back to back (one sendmmsg, or one ring kick)
+ * @param packets IP packets
+ * @param lens Packet lengths
+ * @param count Number of packets
+ * @param dst_ip Destination IP (network byte order; IPv6 packets carry their own)
+ * @return 0 if all packets were sent, -1 on error
+ */
+int dpi_send_raw_batch(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip);
+
 /**
  * Set packet mark (to avoid re-capturing our own packets)
  * @param mark Mark value
  */
 void dpi_set_packet_mark(uint32_t mark);
 
+/**
+ * Choose the injection backend (takes effect at the next dpi_raw_socket_init)
+ * @param type Backend type
+ */
+void dpi_set_inject_backend(InjectBackendType type);
+
+/**
+ * Redirect injected packets to a sink instead of the raw socket
+ * (used by benchmarks and replay tools)
+ * @param sink Sink function, NULL to restore the raw socket
+ * @param user_data User data passed to sink
+ */
+void dpi_set_inject_sink(dpi_inject_sink_t sink, void* user_data);
+
+/**
+ * Get decision reason of the last packet processed on the calling thread
+ * @return Decision reason
+ */
+DpiDecisionReason dpi_bypass_last_reason(void);
+
 #ifdef __cplusplus
 }
 #endif
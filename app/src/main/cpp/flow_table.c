@@ -0,0 +1,469 @@
+/**
+ * flow_table.c
+ *
+ * Handshake flow tracking implementation.
+ * Fixed table of FLOW_SLOTS entries; a flow lives in one of FLOW_WINDOW
+ * slots after its 4-tuple hash. Flows leave the table as soon as their
+ * outcome is known, so the table only holds handshakes in progress.
+ * Flows tracked from the SYN whose first request is not handled by the
+ * engine are dropped silently at their second data packet or timeout.
+ * Window-clamped flows are the exception: the client segments their
+ * request itself, so their first data packet starts the request.
+ * Per-destination state (smoothed RTT, window clamp) lives in a small
+ * direct-mapped table next to the flows.
+ */
+
+#include "flow_table.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#define LOG_TAG "FlowTable"
+#include "netrix_log.h"
+
+#define FLOW_SLOTS 4096                // Power of two
+#define FLOW_WINDOW 8
+#define FLOW_TIMEOUT_NS (10ULL * 1000000000ULL)
+#define SWEEP_INTERVAL_NS 1000000000ULL
+#define RETRANSMIT_LIMIT 2             // Request retransmissions that count as failure
+#define DEST_SLOTS 1024                // Per-destination state, direct-mapped
+
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_RST 0x04
+#define TCP_FLAG_ACK 0x10
+
+// Flow progress
+typedef enum {
+    FLOW_SYN_SENT = 0,                 // SYN seen, waiting for the SYN-ACK
+    FLOW_OPEN,                         // Connected, request not handled yet
+    FLOW_REQUEST                       // Request handled, waiting for the outcome
+} FlowState;
+
+// One handshake in progress (dst_ip 0 = free slot)
+typedef struct {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t state;                     // FlowState
+    uint8_t retransmits;
+    bool syn_retransmitted;            // RTT ambiguous (Karn)
+    bool data_seen;                    // Outbound data seen before the request was tracked
+    uint32_t seq;                      // Sequence number of the request
+    uint32_t ack;                      // Server sequence acknowledged by the request
+    uint32_t rtt_us;                   // SYN -> SYN-ACK (0 = not measured)
+    uint16_t clamp_window;             // Window advertised in the SYN-ACK (0 = not clamped)
+    uint64_t key;                      // Strategy cache key (0 = not reported)
+    uint64_t syn_ns;                   // SYN seen
+    uint64_t start_ns;                 // Request (or SYN) seen, for the timeout
+    StrategyChoice choice;
+} FlowEntry;
+
+// State of one destination (dst_ip 0 = free slot)
+typedef struct {
+    uint32_t dst_ip;
+    uint32_t srtt_us;                  // Smoothed SYN -> SYN-ACK RTT (0 = none)
+    uint16_t clamp_window;             // Window for new connections (0 = not clamped)
+    uint64_t clamp_key;                // Strategy cache key of clamped flows
+} DestEntry;
+
+// Global state
+static struct {
+    FlowEntry flows[FLOW_SLOTS];
+    DestEntry dests[DEST_SLOTS];
+    FlowTableStats stats;
+    uint64_t last_sweep_ns;
+    volatile bool ingress;
+    pthread_mutex_t lock;
+} g_flows = {
+    .last_sweep_ns = 0,
+    .ingress = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Forward declarations
+static FlowEntry* find_flow(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port);
+static FlowEntry* alloc_flow(const NfqueuePacket* packet);
+static void finish_flow(FlowEntry* flow, StrategyOutcome outcome);
+static void free_flow(FlowEntry* flow);
+static DestEntry* find_dest(uint32_t dst_ip);
+static DestEntry* claim_dest(uint32_t dst_ip);
+static uint32_t ewma_us(uint32_t average, uint64_t sample_ns);
+static void sweep_locked(uint64_t now_ns);
+static uint32_t flow_hash(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port);
+
+/**
+ * Track from the SYN
+ */
+void flow_table_syn(const NfqueuePacket* packet, uint16_t clamp_window, uint64_t now_ns) {
+    pthread_mutex_lock(&g_flows.lock);
+    
+    FlowEntry* flow = find_flow(packet->src_ip, packet->dst_ip, packet->src_port, packet->dst_port);
+    if (flow != NULL && flow->state == FLOW_SYN_SENT) {
+        flow->syn_retransmitted = true;
+        pthread_mutex_unlock(&g_flows.lock);
+        return;
+    }
+    
+    // A SYN on a tuple still in the table is a new connection
+    if (flow != NULL) free_flow(flow);
+    
+    flow = alloc_flow(packet);
+    if (flow != NULL) {
+        flow->state = FLOW_SYN_SENT;
+        flow->syn_ns = now_ns;
+        flow->start_ns = now_ns;
+        flow->clamp_window = clamp_window;
+        
+        // A clamped destination reports its flows to the host that chose the clamp
+        const DestEntry* dest = find_dest(packet->dst_ip);
+        if (dest != NULL && dest->clamp_window != 0) {
+            if (flow->clamp_window == 0) flow->clamp_window = dest->clamp_window;
+            flow->key = dest->clamp_key;
+        }
+    }
+    
+    pthread_mutex_unlock(&g_flows.lock);
+}
+
+/**
+ * Start tracking
+ */
+void flow_table_track(const NfqueuePacket* packet, uint32_t seq, uint32_t ack,
+                      uint64_t key, const StrategyChoice* choice, uint64_t now_ns) {
+    pthread_mutex_lock(&g_flows.lock);
+    
+    // Keep the RTT of a flow tracked from its SYN
+    FlowEntry* flow = find_flow(packet->src_ip, packet->dst_ip, packet->src_port, packet->dst_port);
+    if (flow == NULL) {
+        flow = alloc_flow(packet);
+    }
+    
+    if (flow == NULL) {
+        pthread_mutex_unlock(&g_flows.lock);
+        return;
+    }
+    
+    flow->state = FLOW_REQUEST;
+    flow->retransmits = 0;
+    flow->seq = seq;
+    flow->ack = ack;
+    flow->key = key;
+    flow->start_ns = now_ns;
+    flow->choice = *choice;
+    g_flows.stats.tracked++;
+    
+    pthread_mutex_unlock(&g_flows.lock);
+}
+
+/**
+ * Observe outbound packet
+ */
+bool flow_table_outbound(const NfqueuePacket* packet, uint32_t seq, uint32_t ack,
+                         uint8_t tcp_flags, uint32_t data_len, uint64_t now_ns,
+                         StrategyChoice* choice) {
+    pthread_mutex_lock(&g_flows.lock);
+    
+    if (g_flows.stats.active > 0 && now_ns - g_flows.last_sweep_ns >= SWEEP_INTERVAL_NS) {
+        sweep_locked(now_ns);
+    }
+    
+    FlowEntry* flow = NULL;
+    if (g_flows.stats.active > 0) {
+        flow = find_flow(packet->src_ip, packet->dst_ip, packet->src_port, packet->dst_port);
+    }
+    if (flow == NULL) {
+        pthread_mutex_unlock(&g_flows.lock);
+        return false;
+    }
+    
+    if (flow->state == FLOW_OPEN && flow->clamp_window != 0 && data_len > 0 &&
+        !(tcp_flags & (TCP_FLAG_RST | TCP_FLAG_FIN))) {
+        // Clamped flow: the client segmented the request, this is its start
+        flow->state = FLOW_REQUEST;
+        flow->retransmits = 0;
+        flow->seq = seq;
+        flow->ack = ack;
+        flow->start_ns = now_ns;
+        memset(&flow->choice, 0, sizeof(flow->choice));
+        flow->choice.method = BYPASS_WINDOW_CLAMP;
+        flow->choice.first_packet_size = flow->clamp_window;
+        g_flows.stats.tracked++;
+        if (choice != NULL) *choice = flow->choice;
+        pthread_mutex_unlock(&g_flows.lock);
+        return true;
+    } else if (flow->state != FLOW_REQUEST) {
+        // Tracked from the SYN: the request is either tracked right after
+        // this call or not handled by the engine at all
+        if ((tcp_flags & (TCP_FLAG_RST | TCP_FLAG_FIN)) || (data_len > 0 && flow->data_seen)) {
+            free_flow(flow);
+        } else if (data_len > 0) {
+            flow->data_seen = true;
+        }
+    } else if (tcp_flags & TCP_FLAG_RST) {
+        finish_flow(flow, STRATEGY_OUTCOME_RST);
+    } else if ((int32_t)(ack - flow->ack) > 0) {
+        // Client acknowledges server data: the request got an answer
+        finish_flow(flow, STRATEGY_OUTCOME_SUCCESS);
+    } else if (tcp_flags & TCP_FLAG_FIN) {
+        // Client gave up before any answer
+        finish_flow(flow, STRATEGY_OUTCOME_TIMEOUT);
+    } else if (data_len > 0 && seq == flow->seq && ++flow->retransmits >= RETRANSMIT_LIMIT) {
+        finish_flow(flow, STRATEGY_OUTCOME_RETRANSMIT);
+    } else {
+        if (choice != NULL) *choice = flow->choice;
+        pthread_mutex_unlock(&g_flows.lock);
+        return true;
+    }
+    
+    pthread_mutex_unlock(&g_flows.lock);
+    return false;
+}
+
+/**
+ * Observe inbound packet
+ */
+bool flow_table_inbound(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
+                        uint32_t ack, uint8_t tcp_flags, uint32_t data_len, uint64_t now_ns,
+                        uint16_t* window) {
+    *window = 0;
+    pthread_mutex_lock(&g_flows.lock);
+    
+    // Inbound tuple is the reverse of the tracked outbound one
+    FlowEntry* flow = NULL;
+    if (g_flows.stats.active > 0) {
+        flow = find_flow(dst_ip, src_ip, dst_port, src_port);
+    }
+    if (flow == NULL) {
+        pthread_mutex_unlock(&g_flows.lock);
+        return false;
+    }
+    
+    g_flows.stats.inbound++;
+    
+    if (tcp_flags & TCP_FLAG_RST) {
+        if (flow->state == FLOW_REQUEST) {
+            finish_flow(flow, STRATEGY_OUTCOME_RST);
+        } else {
+            free_flow(flow);
+        }
+    } else if ((tcp_flags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) == (TCP_FLAG_SYN | TCP_FLAG_ACK)) {
+        // Retransmitted SYN-ACKs are clamped too
+        if (flow->clamp_window != 0 && flow->state != FLOW_REQUEST) {
+            *window = flow->clamp_window;
+        }
+        if (flow->state == FLOW_SYN_SENT) {
+            flow->state = FLOW_OPEN;
+            if (!flow->syn_retransmitted) {
+                uint64_t rtt_ns = now_ns - flow->syn_ns;
+                flow->rtt_us = (uint32_t)(rtt_ns / 1000);
+                if (flow->rtt_us == 0) flow->rtt_us = 1;
+                g_flows.stats.last_rtt_us = flow->rtt_us;
+                g_flows.stats.srtt_us = ewma_us(g_flows.stats.srtt_us, rtt_ns);
+                g_flows.stats.rtt_samples++;
+                
+                DestEntry* dest = claim_dest(flow->dst_ip);
+                dest->srtt_us = ewma_us(dest->srtt_us, rtt_ns);
+            }
+        }
+    } else if (data_len > 0 && flow->state == FLOW_REQUEST && (int32_t)(ack - flow->seq) > 0) {
+        // Server data acknowledging the request: it was answered
+        g_flows.stats.answer_us = ewma_us(g_flows.stats.answer_us, now_ns - flow->start_ns);
+        g_flows.stats.answer_samples++;
+        finish_flow(flow, STRATEGY_OUTCOME_SUCCESS);
+    }
+    
+    pthread_mutex_unlock(&g_flows.lock);
+    return true;
+}
+
+/**
+ * RTT for a request
+ */
+uint32_t flow_table_rtt(const NfqueuePacket* packet) {
+    pthread_mutex_lock(&g_flows.lock);
+    
+    uint32_t rtt_us = 0;
+    FlowEntry* flow = find_flow(packet->src_ip, packet->dst_ip, packet->src_port, packet->dst_port);
+    if (flow != NULL) {
+        rtt_us = flow->rtt_us;
+    }
+    if (rtt_us == 0) {
+        const DestEntry* dest = find_dest(packet->dst_ip);
+        if (dest != NULL) rtt_us = dest->srtt_us;
+    }
+    
+    pthread_mutex_unlock(&g_flows.lock);
+    return rtt_us;
+}
+
+/**
+ * Mark a destination for window clamping
+ */
+void flow_table_clamp_destination(uint32_t dst_ip, uint64_t key, uint16_t window) {
+    pthread_mutex_lock(&g_flows.lock);
+    DestEntry* dest = claim_dest(dst_ip);
+    dest->clamp_window = window;
+    dest->clamp_key = key;
+    pthread_mutex_unlock(&g_flows.lock);
+}
+
+/**
+ * Enable SYN tracking
+ */
+void flow_table_set_ingress(bool enabled) {
+    g_flows.ingress = enabled;
+}
+
+/**
+ * Check SYN tracking
+ */
+bool flow_table_ingress(void) {
+    return g_flows.ingress;
+}
+
+/**
+ * Forget all flows
+ */
+void flow_table_clear(void) {
+    pthread_mutex_lock(&g_flows.lock);
+    memset(g_flows.flows, 0, sizeof(g_flows.flows));
+    memset(g_flows.dests, 0, sizeof(g_flows.dests));
+    g_flows.stats.active = 0;
+    pthread_mutex_unlock(&g_flows.lock);
+}
+
+/**
+ * Get counters
+ */
+void flow_table_get_stats(FlowTableStats* stats) {
+    if (stats == NULL) return;
+    pthread_mutex_lock(&g_flows.lock);
+    *stats = g_flows.stats;
+    pthread_mutex_unlock(&g_flows.lock);
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+static FlowEntry* find_flow(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port) {
+    uint32_t start = flow_hash(src_ip, dst_ip, src_port, dst_port);
+    for (uint32_t i = 0; i < FLOW_WINDOW; i++) {
+        FlowEntry* flow = &g_flows.flows[(start + i) & (FLOW_SLOTS - 1)];
+        if (flow->dst_ip == dst_ip && flow->src_ip == src_ip &&
+            flow->dst_port == dst_port && flow->src_port == src_port) {
+            return flow;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Take a free slot for the packet's tuple (caller holds g_flows.lock)
+ * @return Zeroed entry with the tuple set, NULL if the window is full
+ */
+static FlowEntry* alloc_flow(const NfqueuePacket* packet) {
+    uint32_t start = flow_hash(packet->src_ip, packet->dst_ip, packet->src_port, packet->dst_port);
+    for (uint32_t i = 0; i < FLOW_WINDOW; i++) {
+        FlowEntry* flow = &g_flows.flows[(start + i) & (FLOW_SLOTS - 1)];
+        if (flow->dst_ip == 0) {
+            memset(flow, 0, sizeof(*flow));
+            flow->src_ip = packet->src_ip;
+            flow->dst_ip = packet->dst_ip;
+            flow->src_port = packet->src_port;
+            flow->dst_port = packet->dst_port;
+            g_flows.stats.active++;
+            return flow;
+        }
+    }
+    g_flows.stats.overflows++;
+    return NULL;
+}
+
+/**
+ * Report the outcome and free the slot (caller holds g_flows.lock)
+ */
+static void finish_flow(FlowEntry* flow, StrategyOutcome outcome) {
+    LOGD("Flow :%u -> :%u %s (method=%s, retransmits=%u, rtt=%uus)",
+         flow->src_port, flow->dst_port, strategy_outcome_name(outcome),
+         dpi_method_name(flow->choice.method), flow->retransmits, flow->rtt_us);
+    g_flows.stats.outcomes[outcome]++;
+    if (flow->key != 0) {
+        strategy_cache_report(flow->key, &flow->choice, outcome);
+    }
+    
+    // A failed clamp stops clamping the destination; its host picks again
+    if (flow->choice.method == BYPASS_WINDOW_CLAMP && !flow->choice.clamp_pending &&
+        outcome != STRATEGY_OUTCOME_SUCCESS) {
+        DestEntry* dest = find_dest(flow->dst_ip);
+        if (dest != NULL) dest->clamp_window = 0;
+    }
+    free_flow(flow);
+}
+
+/**
+ * Free the slot without an outcome (caller holds g_flows.lock)
+ */
+static void free_flow(FlowEntry* flow) {
+    flow->dst_ip = 0;
+    g_flows.stats.active--;
+}
+
+/**
+ * Expire flows that never got an answer
+ */
+static void sweep_locked(uint64_t now_ns) {
+    g_flows.last_sweep_ns = now_ns;
+    for (uint32_t i = 0; i < FLOW_SLOTS; i++) {
+        FlowEntry* flow = &g_flows.flows[i];
+        if (flow->dst_ip == 0 || now_ns - flow->start_ns < FLOW_TIMEOUT_NS) continue;
+        if (flow->state == FLOW_REQUEST) {
+            finish_flow(flow, STRATEGY_OUTCOME_TIMEOUT);
+        } else {
+            free_flow(flow);
+        }
+    }
+}
+
+/**
+ * State of a destination (caller holds g_flows.lock)
+ * @return Entry, NULL if the destination has none
+ */
+static DestEntry* find_dest(uint32_t dst_ip) {
+    DestEntry* dest = &g_flows.dests[flow_hash(dst_ip, 0, 0, 0) & (DEST_SLOTS - 1)];
+    return dest->dst_ip == dst_ip ? dest : NULL;
+}
+
+/**
+ * State of a destination, created if needed (caller holds g_flows.lock)
+ * A colliding destination takes the slot over.
+ */
+static DestEntry* claim_dest(uint32_t dst_ip) {
+    DestEntry* dest = &g_flows.dests[flow_hash(dst_ip, 0, 0, 0) & (DEST_SLOTS - 1)];
+    if (dest->dst_ip != dst_ip) {
+        memset(dest, 0, sizeof(*dest));
+        dest->dst_ip = dst_ip;
+    }
+    return dest;
+}
+
+/**
+ * 1/8 EWMA of a latency in microseconds (first sample taken as is)
+ */
+static uint32_t ewma_us(uint32_t average, uint64_t sample_ns) {
+    int64_t sample = (int64_t)(sample_ns / 1000);
+    if (average == 0) return (uint32_t)(sample > 0 ? sample : 1);
+    return (uint32_t)((int64_t)average + (sample - (int64_t)average) / 8);
+}
+
+static uint32_t flow_hash(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port) {
+    uint32_t h = src_ip * 0x9E3779B1U;
+    h ^= dst_ip;
+    h = h * 0x85EBCA6BU ^ (((uint32_t)src_port << 16) | dst_port);
+    h ^= h >> 15;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 13;
+    return h;
+}
@@ -0,0 +1,150 @@
+/**
+ * flow_table.h
+ *
+ * Handshake flow tracking.
+ * Remembers the flows whose ClientHello / HTTP request the engine handled
+ * and watches their later outbound packets for the handshake outcome:
+ * an ACK beyond the server's first sequence number means the server
+ * answered; a repeated request, a reset or silence means it did not.
+ * With the ingress observer running, flows are tracked from their SYN and
+ * the server's SYN-ACK, first data segment and resets are matched too,
+ * which yields the connection RTT and the request-to-answer latency.
+ * Flows using BYPASS_WINDOW_CLAMP are chosen at the SYN; the observer
+ * clamps their SYN-ACK window and their first data segment starts the
+ * request. Outcomes are reported to the strategy cache.
+ */
+
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nfqueue_handler.h"
+#include "strategy_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Flow table counters
+typedef struct {
+    uint32_t active;               // Flows waiting for an outcome
+    uint64_t tracked;              // Flows added
+    uint64_t overflows;            // Flows not tracked because the table was full
+    uint64_t inbound;              // Inbound packets matched to a tracked flow
+    uint64_t outcomes[STRATEGY_OUTCOME_COUNT];  // Outcomes of tracked requests
+    uint64_t rtt_samples;          // SYN -> SYN-ACK round trips measured
+    uint32_t srtt_us;              // Smoothed SYN -> SYN-ACK RTT (EWMA, 1/8)
+    uint32_t last_rtt_us;          // Most recent RTT sample
+    uint64_t answer_samples;       // Request -> first server data latencies measured
+    uint32_t answer_us;            // Smoothed request -> first server data latency
+} FlowTableStats;
+
+/**
+ * Track a connection from its SYN (for RTT measurement and window clamping)
+ * A retransmitted SYN makes the RTT ambiguous; the flow then gets no sample.
+ * @param packet Outbound SYN
+ * @param clamp_window SYN-ACK window to advertise to the client (0 = clamp
+ *                     only if the destination was marked with
+ *                     flow_table_clamp_destination)
+ * @param now_ns Monotonic time
+ */
+void flow_table_syn(const NfqueuePacket* packet, uint16_t clamp_window, uint64_t now_ns);
+
+/**
+ * Start tracking a handshake
+ * @param packet Outbound packet carrying the first request data
+ * @param seq TCP sequence number of the request (host byte order)
+ * @param ack TCP acknowledgment number of the request (host byte order)
+ * @param key Strategy cache key of the destination (0 = not reported to the cache)
+ * @param choice Strategy applied to the flow
+ * @param now_ns Monotonic time
+ */
+void flow_table_track(const NfqueuePacket* packet, uint32_t seq, uint32_t ack,
+                      uint64_t key, const StrategyChoice* choice, uint64_t now_ns);
+
+/**
+ * Observe an outbound TCP packet of a possibly tracked flow
+ * Reports the outcome once it is known and forgets the flow; also expires
+ * flows that got no answer within the timeout.
+ * @param packet Outbound packet
+ * @param seq TCP sequence number (host byte order)
+ * @param ack TCP acknowledgment number (host byte order)
+ * @param tcp_flags TCP flags byte
+ * @param data_len TCP payload length
+ * @param now_ns Monotonic time
+ * @param choice Output: strategy of the flow if it is still pending (may be NULL)
+ * @return true if the flow is tracked and still pending (e.g. a retransmitted request)
+ */
+bool flow_table_outbound(const NfqueuePacket* packet, uint32_t seq, uint32_t ack,
+                         uint8_t tcp_flags, uint32_t data_len, uint64_t now_ns,
+                         StrategyChoice* choice);
+
+/**
+ * Observe an inbound TCP packet (addresses as seen on the wire)
+ * A SYN-ACK yields the RTT sample of a flow tracked from its SYN; the
+ * first server data after the request reports success, a reset reports
+ * failure (or just forgets a flow that sent no request yet). The SYN-ACK
+ * of a window-clamped flow gets the window to advertise instead of the
+ * server's; the server's next segment restores the real one.
+ * @param src_ip Server address (network byte order)
+ * @param dst_ip Local address (network byte order)
+ * @param src_port Server port
+ * @param dst_port Local port
+ * @param ack TCP acknowledgment number (host byte order)
+ * @param tcp_flags TCP flags byte
+ * @param data_len TCP payload length
+ * @param now_ns Monotonic time
+ * @param window Output: window to advertise instead of the server's (0 = unchanged)
+ * @return true if the packet belongs to a tracked flow
+ */
+bool flow_table_inbound(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
+                        uint32_t ack, uint8_t tcp_flags, uint32_t data_len, uint64_t now_ns,
+                        uint16_t* window);
+
+/**
+ * RTT to use for a new request
+ * @param packet Outbound request
+ * @return The flow's SYN -> SYN-ACK time, else the destination's smoothed
+ *         RTT from earlier flows, in microseconds (0 = unknown)
+ */
+uint32_t flow_table_rtt(const NfqueuePacket* packet);
+
+/**
+ * Clamp the window of later connections to a destination
+ * Used when the strategy of a host turns out to be BYPASS_WINDOW_CLAMP
+ * after its handshake; the mark is dropped when a clamped flow fails.
+ * @param dst_ip Destination address (network byte order)
+ * @param key Strategy cache key the outcomes of clamped flows go to
+ * @param window SYN-ACK window to advertise
+ */
+void flow_table_clamp_destination(uint32_t dst_ip, uint64_t key, uint16_t window);
+
+/**
+ * Enable tracking from the SYN (set while inbound packets are observed)
+ * @param enabled true to track SYNs
+ */
+void flow_table_set_ingress(bool enabled);
+
+/**
+ * Check if inbound packets are being observed
+ * @return true if flows are tracked from their SYN
+ */
+bool flow_table_ingress(void);
+
+/**
+ * Forget all flows (outcomes are not reported), destination RTTs and clamps
+ */
+void flow_table_clear(void);
+
+/**
+ * Get flow table counters
+ * @param stats Output counters
+ */
+void flow_table_get_stats(FlowTableStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLOW_TABLE_H
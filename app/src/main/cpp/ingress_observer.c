@@ -0,0 +1,475 @@
+/**
+ * ingress_observer.c
+ *
+ * Inbound handshake observation implementation.
+ * Own netlink socket and thread, independent of the outbound queue: one
+ * recvfrom returns a batch of packets, each is parsed and matched, and
+ * all ACCEPT verdicts go back in a single sendto. Only headers are
+ * copied to userspace, which is the whole packet for a SYN-ACK: a
+ * clamped one is rewritten in place and returned with its verdict.
+ */
+
+#include "ingress_observer.h"
+#include "flow_table.h"
+#include "checksum.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>     // before linux/ headers: glibc and uapi both define in.h types
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_queue.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+
+#define LOG_TAG "IngressObserver"
+#include "netrix_log.h"
+
+#define DEFAULT_QUEUE_NUM 1
+#define DEFAULT_RCVBUF_SIZE (256 * 1024)
+#define DEFAULT_QUEUE_MAXLEN 256
+#define RECV_BUFFER_SIZE 65536
+#define RECV_WAKEUP_MS 200
+#define COPY_RANGE 128                 // Largest IPv4 + TCP header
+#define MAX_BATCH 64
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+#ifndef NETLINK_NO_ENOBUFS
+#define NETLINK_NO_ENOBUFS 5
+#endif
+
+#define NFA_ALIGN_SIZE(len) (((len) + NFA_ALIGNTO - 1) & ~(NFA_ALIGNTO - 1))
+
+// One verdict message: nlmsghdr + nfgenmsg + NFQA_VERDICT_HDR
+#define VERDICT_MSG_SIZE (NLMSG_ALIGN(sizeof(struct nlmsghdr)) + \
+                          NLMSG_ALIGN(sizeof(struct nfgenmsg)) + \
+                          NFA_ALIGN_SIZE(sizeof(struct nlattr) + sizeof(struct nfqnl_msg_verdict_hdr)))
+
+// Verdict with a rewritten packet: + NFQA_PAYLOAD
+#define MAX_VERDICT_MSG_SIZE (VERDICT_MSG_SIZE + NFA_ALIGN_SIZE(sizeof(struct nlattr) + COPY_RANGE))
+
+// Global state
+static struct {
+    int nl_socket;
+    pthread_t thread;
+    volatile bool running;
+    IngressObserverConfig config;
+    IngressObserverStats stats;
+    pthread_mutex_t lock;
+    uint8_t recv_buffer[RECV_BUFFER_SIZE];
+    uint8_t verdict_buffer[MAX_BATCH * MAX_VERDICT_MSG_SIZE];
+} g_ingress = {
+    .nl_socket = -1,
+    .running = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Forward declarations
+static void* observer_thread(void* arg);
+static int send_config(uint16_t queue_num, uint16_t type, const void* data, uint16_t len);
+static void set_fail_open(uint16_t queue_num);
+static uint32_t observe_packet(struct nlmsghdr* nlh, uint64_t now_ns,
+                               const uint8_t** payload, uint32_t* payload_len);
+static size_t fill_accept(uint8_t* buf, uint32_t packet_id, const uint8_t* payload, uint32_t payload_len);
+static void send_verdicts(size_t len);
+
+/**
+ * Start observer
+ */
+int ingress_observer_start(const IngressObserverConfig* config) {
+    pthread_mutex_lock(&g_ingress.lock);
+    
+    if (g_ingress.nl_socket >= 0) {
+        pthread_mutex_unlock(&g_ingress.lock);
+        return 0;
+    }
+    
+    IngressObserverConfig cfg = {
+        .queue_num = DEFAULT_QUEUE_NUM,
+        .rcvbuf_size = DEFAULT_RCVBUF_SIZE,
+        .queue_maxlen = DEFAULT_QUEUE_MAXLEN
+    };
+    if (config != NULL) {
+        cfg.queue_num = config->queue_num;
+        if (config->rcvbuf_size > 0) cfg.rcvbuf_size = config->rcvbuf_size;
+        if (config->queue_maxlen > 0) cfg.queue_maxlen = config->queue_maxlen;
+        cfg.thread_start = config->thread_start;
+        cfg.thread_data = config->thread_data;
+    }
+    
+    int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_NETFILTER);
+    if (fd < 0) {
+        LOGE("Failed to create netlink socket: %s", strerror(errno));
+        pthread_mutex_unlock(&g_ingress.lock);
+        return -1;
+    }
+    
+    int rcvbuf = (int)cfg.rcvbuf_size;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    struct timeval tv = { .tv_sec = 0, .tv_usec = RECV_WAKEUP_MS * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &one, sizeof(one));
+    
+    // Port id 0: the outbound queue socket already owns getpid()
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOGE("Failed to bind netlink socket: %s", strerror(errno));
+        close(fd);
+        pthread_mutex_unlock(&g_ingress.lock);
+        return -1;
+    }
+    g_ingress.nl_socket = fd;
+    
+    // No PF_UNBIND here: on old kernels it would detach the outbound queue too
+    struct nfqnl_msg_config_cmd cmd = { .command = NFQNL_CFG_CMD_PF_BIND, .pf = htons(PF_INET) };
+    send_config(0, NFQA_CFG_CMD, &cmd, sizeof(cmd));
+    
+    cmd.command = NFQNL_CFG_CMD_BIND;
+    cmd.pf = 0;
+    struct nfqnl_msg_config_params params = { .copy_range = htonl(COPY_RANGE),
+                                              .copy_mode = NFQNL_COPY_PACKET };
+    uint32_t maxlen = htonl(cfg.queue_maxlen);
+    if (send_config(cfg.queue_num, NFQA_CFG_CMD, &cmd, sizeof(cmd)) < 0 ||
+        send_config(cfg.queue_num, NFQA_CFG_PARAMS, &params, sizeof(params)) < 0 ||
+        send_config(cfg.queue_num, NFQA_CFG_QUEUE_MAXLEN, &maxlen, sizeof(maxlen)) < 0) {
+        LOGE("Failed to bind inbound queue %u", cfg.queue_num);
+        close(fd);
+        g_ingress.nl_socket = -1;
+        pthread_mutex_unlock(&g_ingress.lock);
+        return -1;
+    }
+    
+    // Overflow accepts instead of dropping
+    set_fail_open(cfg.queue_num);
+    
+    memset(&g_ingress.stats, 0, sizeof(g_ingress.stats));
+    g_ingress.stats.queue_num = cfg.queue_num;
+    g_ingress.config = cfg;
+    g_ingress.running = true;
+    
+    if (pthread_create(&g_ingress.thread, NULL, observer_thread, NULL) != 0) {
+        LOGE("Failed to create observer thread");
+        g_ingress.running = false;
+        cmd.command = NFQNL_CFG_CMD_UNBIND;
+        send_config(cfg.queue_num, NFQA_CFG_CMD, &cmd, sizeof(cmd));
+        close(fd);
+        g_ingress.nl_socket = -1;
+        pthread_mutex_unlock(&g_ingress.lock);
+        return -1;
+    }
+    
+    g_ingress.stats.active = true;
+    flow_table_set_ingress(true);
+    LOGI("Ingress observer started: queue=%u, rcvbuf=%d, maxlen=%u",
+         cfg.queue_num, rcvbuf, cfg.queue_maxlen);
+    pthread_mutex_unlock(&g_ingress.lock);
+    return 0;
+}
+
+/**
+ * Stop observer
+ */
+void ingress_observer_stop(void) {
+    pthread_mutex_lock(&g_ingress.lock);
+    
+    if (g_ingress.nl_socket < 0) {
+        pthread_mutex_unlock(&g_ingress.lock);
+        return;
+    }
+    
+    flow_table_set_ingress(false);
+    g_ingress.running = false;
+    pthread_join(g_ingress.thread, NULL);
+    
+    struct nfqnl_msg_config_cmd cmd = { .command = NFQNL_CFG_CMD_UNBIND };
+    send_config(g_ingress.config.queue_num, NFQA_CFG_CMD, &cmd, sizeof(cmd));
+    close(g_ingress.nl_socket);
+    g_ingress.nl_socket = -1;
+    g_ingress.stats.active = false;
+    
+    LOGI("Ingress observer stopped (%llu packets, %llu matched)",
+         (unsigned long long)g_ingress.stats.packets,
+         (unsigned long long)g_ingress.stats.matched);
+    pthread_mutex_unlock(&g_ingress.lock);
+}
+
+/**
+ * Get counters
+ */
+void ingress_observer_get_stats(IngressObserverStats* stats) {
+    if (stats == NULL) return;
+    // Counters are written by the observer thread only; torn reads are harmless
+    *stats = g_ingress.stats;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+static void* observer_thread(void* arg) {
+    (void)arg;
+    
+    if (g_ingress.config.thread_start != NULL) {
+        g_ingress.config.thread_start(g_ingress.config.thread_data);
+    }
+    
+    while (g_ingress.running) {
+        ssize_t len = recv(g_ingress.nl_socket, g_ingress.recv_buffer, RECV_BUFFER_SIZE, 0);
+        if (len < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            g_ingress.stats.recv_errors++;
+            continue;
+        }
+        
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t now_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+        
+        size_t verdict_len = 0;
+        struct nlmsghdr* nlh = (struct nlmsghdr*)g_ingress.recv_buffer;
+        while (NLMSG_OK(nlh, len)) {
+            if ((nlh->nlmsg_type >> 8) == NFNL_SUBSYS_QUEUE &&
+                (nlh->nlmsg_type & 0xFF) == NFQNL_MSG_PACKET) {
+                const uint8_t* payload = NULL;
+                uint32_t payload_len = 0;
+                uint32_t packet_id = observe_packet(nlh, now_ns, &payload, &payload_len);
+                if (packet_id != 0) {
+                    verdict_len += fill_accept(g_ingress.verdict_buffer + verdict_len, packet_id,
+                                               payload, payload_len);
+                    if (verdict_len + MAX_VERDICT_MSG_SIZE > sizeof(g_ingress.verdict_buffer)) {
+                        send_verdicts(verdict_len);
+                        verdict_len = 0;
+                    }
+                }
+            }
+            nlh = NLMSG_NEXT(nlh, len);
+        }
+        
+        if (verdict_len > 0) {
+            send_verdicts(verdict_len);
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * Send one queue config attribute
+ */
+static int send_config(uint16_t queue_num, uint16_t type, const void* data, uint16_t len) {
+    struct {
+        struct nlmsghdr nlh;
+        struct nfgenmsg nfg;
+        struct nlattr attr;
+        uint8_t data[32];
+    } req;
+    
+    memset(&req, 0, sizeof(req));
+    
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.nfg) + sizeof(req.attr) + NFA_ALIGN_SIZE(len));
+    req.nlh.nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_CONFIG;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    
+    req.nfg.nfgen_family = AF_UNSPEC;
+    req.nfg.version = NFNETLINK_V0;
+    req.nfg.res_id = htons(queue_num);
+    
+    req.attr.nla_len = sizeof(req.attr) + len;
+    req.attr.nla_type = type;
+    memcpy(req.data, data, len);
+    
+    struct sockaddr_nl peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.nl_family = AF_NETLINK;
+    
+    if (sendto(g_ingress.nl_socket, &req, req.nlh.nlmsg_len, 0,
+               (struct sockaddr*)&peer, sizeof(peer)) < 0) {
+        LOGE("sendto queue config failed: %s", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Set NFQA_CFG_F_FAIL_OPEN (flags and mask must arrive in one message)
+ */
+static void set_fail_open(uint16_t queue_num) {
+    struct {
+        struct nlmsghdr nlh;
+        struct nfgenmsg nfg;
+        struct {
+            struct nlattr attr;
+            uint32_t value;
+        } attrs[2];
+    } req;
+    
+    memset(&req, 0, sizeof(req));
+    
+    req.nlh.nlmsg_len = sizeof(req);
+    req.nlh.nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_CONFIG;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    
+    req.nfg.nfgen_family = AF_UNSPEC;
+    req.nfg.version = NFNETLINK_V0;
+    req.nfg.res_id = htons(queue_num);
+    
+    req.attrs[0].attr.nla_len = sizeof(req.attrs[0]);
+    req.attrs[0].attr.nla_type = NFQA_CFG_FLAGS;
+    req.attrs[0].value = htonl(NFQA_CFG_F_FAIL_OPEN);
+    req.attrs[1].attr.nla_len = sizeof(req.attrs[1]);
+    req.attrs[1].attr.nla_type = NFQA_CFG_MASK;
+    req.attrs[1].value = htonl(NFQA_CFG_F_FAIL_OPEN);
+    
+    struct sockaddr_nl peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.nl_family = AF_NETLINK;
+    
+    if (sendto(g_ingress.nl_socket, &req, sizeof(req), 0,
+               (struct sockaddr*)&peer, sizeof(peer)) < 0) {
+        LOGE("sendto fail-open failed: %s", strerror(errno));
+    }
+}
+
+/**
+ * Match one queued packet against the flow table
+ * @param payload Output: rewritten packet to return with the verdict (NULL = unchanged)
+ * @param payload_len Output: rewritten packet length
+ * @return Packet id to accept, 0 if the message carried none
+ */
+static uint32_t observe_packet(struct nlmsghdr* nlh, uint64_t now_ns,
+                               const uint8_t** payload, uint32_t* payload_len) {
+    struct nfgenmsg* nfg = (struct nfgenmsg*)NLMSG_DATA(nlh);
+    struct nlattr* attr = (struct nlattr*)((uint8_t*)nfg + NLMSG_ALIGN(sizeof(*nfg)));
+    int attr_len = nlh->nlmsg_len - NLMSG_HDRLEN - NLMSG_ALIGN(sizeof(*nfg));
+    uint32_t packet_id = 0;
+    uint8_t* data = NULL;
+    int data_len = 0;
+    
+    while (attr_len > 0 && attr->nla_len >= sizeof(*attr)) {
+        int type = attr->nla_type & NLA_TYPE_MASK;
+        if (type == NFQA_PACKET_HDR) {
+            struct nfqnl_msg_packet_hdr* ph = (struct nfqnl_msg_packet_hdr*)(attr + 1);
+            packet_id = ntohl(ph->packet_id);
+        } else if (type == NFQA_PAYLOAD) {
+            data = (uint8_t*)(attr + 1);
+            data_len = attr->nla_len - sizeof(*attr);
+        }
+        
+        int padded_len = NFA_ALIGN_SIZE(attr->nla_len);
+        attr = (struct nlattr*)((uint8_t*)attr + padded_len);
+        attr_len -= padded_len;
+    }
+    
+    if (packet_id == 0) return 0;
+    g_ingress.stats.packets++;
+    
+    // IPv4 + TCP headers (payload is cut at COPY_RANGE, the length comes from the IP header)
+    if (data == NULL || data_len < 20 || (data[0] >> 4) != 4 || data[9] != IPPROTO_TCP) {
+        return packet_id;
+    }
+    uint32_t ip_hdr_len = (data[0] & 0x0F) * 4;
+    if ((uint32_t)data_len < ip_hdr_len + 20) return packet_id;
+    uint8_t* tcp = data + ip_hdr_len;
+    uint32_t tcp_hdr_len = (tcp[12] >> 4) * 4;
+    uint32_t total_len = ntohs(*(const uint16_t*)(data + 2));
+    uint32_t tcp_data_len = total_len > ip_hdr_len + tcp_hdr_len ?
+                            total_len - ip_hdr_len - tcp_hdr_len : 0;
+    
+    uint32_t src_ip, dst_ip, ack;
+    uint16_t src_port, dst_port;
+    memcpy(&src_ip, data + 12, 4);
+    memcpy(&dst_ip, data + 16, 4);
+    memcpy(&src_port, tcp, 2);
+    memcpy(&dst_port, tcp + 2, 2);
+    memcpy(&ack, tcp + 8, 4);
+    
+    uint16_t window = 0;
+    if (flow_table_inbound(src_ip, dst_ip, ntohs(src_port), ntohs(dst_port),
+                           ntohl(ack), tcp[13], tcp_data_len, now_ns, &window)) {
+        g_ingress.stats.matched++;
+    }
+    
+    // Clamp the window; the verdict must carry the whole packet, or the
+    // kernel would cut it to the returned length
+    if (window != 0 && (uint32_t)data_len >= total_len && total_len >= ip_hdr_len + tcp_hdr_len) {
+        uint16_t old_window, check;
+        uint16_t new_window = htons(window);
+        memcpy(&old_window, tcp + 14, 2);
+        memcpy(&check, tcp + 16, 2);
+        if (ntohs(old_window) > window) {
+            check = checksum_update16(check, old_window, new_window);
+            memcpy(tcp + 14, &new_window, 2);
+            memcpy(tcp + 16, &check, 2);
+            *payload = data;
+            *payload_len = total_len;
+            g_ingress.stats.clamped++;
+        }
+    }
+    
+    return packet_id;
+}
+
+/**
+ * Build an ACCEPT verdict at buf, with a replacement packet if given
+ * @return Message length
+ */
+static size_t fill_accept(uint8_t* buf, uint32_t packet_id, const uint8_t* payload, uint32_t payload_len) {
+    size_t msg_len = VERDICT_MSG_SIZE;
+    if (payload != NULL) msg_len += NFA_ALIGN_SIZE(sizeof(struct nlattr) + payload_len);
+    memset(buf, 0, msg_len);
+    
+    struct nlmsghdr* nlh = (struct nlmsghdr*)buf;
+    nlh->nlmsg_len = msg_len;
+    nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_VERDICT;
+    nlh->nlmsg_flags = NLM_F_REQUEST;
+    
+    struct nfgenmsg* nfg = (struct nfgenmsg*)NLMSG_DATA(nlh);
+    nfg->nfgen_family = AF_UNSPEC;
+    nfg->version = NFNETLINK_V0;
+    nfg->res_id = htons(g_ingress.config.queue_num);
+    
+    struct nlattr* attr = (struct nlattr*)((uint8_t*)nfg + NLMSG_ALIGN(sizeof(*nfg)));
+    attr->nla_len = sizeof(*attr) + sizeof(struct nfqnl_msg_verdict_hdr);
+    attr->nla_type = NFQA_VERDICT_HDR;
+    
+    struct nfqnl_msg_verdict_hdr* vh = (struct nfqnl_msg_verdict_hdr*)(attr + 1);
+    vh->verdict = htonl(NF_ACCEPT);
+    vh->id = htonl(packet_id);
+    
+    if (payload != NULL) {
+        attr = (struct nlattr*)(buf + VERDICT_MSG_SIZE);
+        attr->nla_len = sizeof(*attr) + payload_len;
+        attr->nla_type = NFQA_PAYLOAD;
+        memcpy(attr + 1, payload, payload_len);
+    }
+    
+    return msg_len;
+}
+
+/**
+ * Send the collected verdicts in one message batch
+ */
+static void send_verdicts(size_t len) {
+    struct sockaddr_nl peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.nl_family = AF_NETLINK;
+    
+    if (sendto(g_ingress.nl_socket, g_ingress.verdict_buffer, len, 0,
+               (struct sockaddr*)&peer, sizeof(peer)) < 0) {
+        LOGE("sendto verdicts failed: %s", strerror(errno));
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * ingress_observer.h
+ *
+ * Inbound handshake observation.
+ * Reads a second NFQUEUE fed from INPUT by a connbytes-limited rule (the
+ * first few server packets of each connection: SYN-ACK, first data,
+ * early resets) and matches them against the flow table, which turns
+ * them into per-flow RTT, request-to-answer latency and outcomes.
+ * Every packet is accepted, unchanged except for the SYN-ACKs of
+ * window-clamped flows, which go back with the clamped window. The queue
+ * is fail-open and the rule uses --queue-bypass, so a stalled or missing
+ * observer never holds inbound traffic.
+ */
+
+#ifndef INGRESS_OBSERVER_H
+#define INGRESS_OBSERVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Observer configuration
+typedef struct {
+    uint16_t queue_num;            // Inbound queue number (default: 1)
+    uint32_t rcvbuf_size;          // Netlink receive buffer (default: 256 KiB)
+    uint32_t queue_maxlen;         // Kernel queue length (default: 256)
+    void (*thread_start)(void* user_data);  // Called on the observer thread first (optional)
+    void* thread_data;             // User data for thread_start
+} IngressObserverConfig;
+
+// Observer counters (since start)
+typedef struct {
+    bool active;                   // Observer thread running
+    uint16_t queue_num;            // Bound queue
+    uint64_t packets;              // Inbound packets read
+    uint64_t matched;              // Packets of tracked flows
+    uint64_t clamped;              // SYN-ACKs sent back with a clamped window
+    uint64_t recv_errors;          // recvfrom failures (including ENOBUFS)
+} IngressObserverStats;
+
+/**
+ * Bind the inbound queue and start the observer thread
+ * Enables SYN tracking in the flow table while running.
+ * @param config Observer configuration, NULL for defaults
+ * @return 0 on success, -1 on error
+ */
+int ingress_observer_start(const IngressObserverConfig* config);
+
+/**
+ * Stop the observer thread and unbind the queue
+ */
+void ingress_observer_stop(void);
+
+/**
+ * Get observer counters
+ * @param stats Output counters
+ */
+void ingress_observer_get_stats(IngressObserverStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INGRESS_OBSERVER_H
@@ -0,0 +1,819 @@
+/**
+ * inject_backend.c
+ *
+ * Packet injection backends implementation.
+ * Every backend keeps the shared raw socket open: it is the raw backend
+ * itself, the per-thread backend's overflow path and the ring's fallback
+ * for destinations whose next hop is not known yet. IPv6 packets always
+ * take a second shared raw socket, opened next to it.
+ */
+
+#include <net/if.h>         // before linux/ headers: glibc and uapi both define if.h types
+#include <netinet/in.h>
+
+#include "inject_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/ip.h>
+
+#include "checksum.h"
+
+#define LOG_TAG "InjectBackend"
+#include "netrix_log.h"
+
+// Packets per sendmmsg on the raw sockets
+#define RAW_MAX_BATCH 16
+
+// Per-thread raw sockets tracked for cleanup (more threads share the raw socket)
+#define MAX_THREAD_SOCKETS 32
+
+// TX ring geometry: 32 frames of 2 KiB per 64 KiB block, 4 blocks
+#define RING_BLOCK_SIZE (64 * 1024)
+#define RING_BLOCK_COUNT 4
+#define RING_FRAME_SIZE 2048
+#define RING_FRAME_COUNT (RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_COUNT)
+#define RING_DATA_OFFSET TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+#define RING_FLUSH_TIMEOUT_MS 100
+
+// Next-hop cache (direct mapped, power of two)
+#define ROUTE_SLOTS 64
+#define ROUTE_TTL_NS (5ULL * 1000000000ULL)
+#define ROUTE_MISS_TTL_NS (1ULL * 1000000000ULL)
+
+#ifndef ARPHRD_RAWIP
+#define ARPHRD_RAWIP 519
+#endif
+#ifndef PACKET_QDISC_BYPASS
+#define PACKET_QDISC_BYPASS 20
+#endif
+
+// Egress of one destination
+typedef struct {
+    uint32_t dst_ip;               // Destination (network byte order, 0 = empty)
+    int ifindex;                   // Egress interface (0 = not resolved, use the raw socket)
+    uint8_t halen;                 // Link-layer address length (0 = no header: rmnet, tun, ppp)
+    uint8_t addr[8];               // Next-hop link-layer address
+    uint64_t expires_ns;           // Monotonic time the entry goes stale
+} RouteEntry;
+
+// Backend operations
+typedef struct {
+    int (*init)(void);
+    int (*send_batch)(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip);
+    int (*flush)(void);
+    void (*cleanup)(void);
+} BackendOps;
+
+// Global state
+static struct {
+    InjectBackendType type;
+    bool initialized;
+    uint32_t mark;
+    int raw_fd;                    // Shared raw socket
+    int raw6_fd;                   // Shared IPv6 raw socket (-1 = IPv6 unavailable)
+    int thread_fds[MAX_THREAD_SOCKETS];
+    int thread_fd_count;
+    uint32_t generation;           // Bumped on cleanup; stale per-thread sockets reopen
+    int ring_fd;
+    uint8_t* ring;
+    uint32_t ring_head;            // Next frame to fill
+    uint32_t rt_seq;
+    int rt_fd;                     // NETLINK_ROUTE socket for next-hop lookups
+    RouteEntry routes[ROUTE_SLOTS];
+    InjectBackendStats stats;
+    pthread_mutex_t lock;          // init/cleanup, per-thread registry, ring
+    pthread_mutex_t stats_lock;
+} g_inject = {
+    .type = INJECT_BACKEND_RAW,
+    .initialized = false,
+    .raw_fd = -1,
+    .raw6_fd = -1,
+    .thread_fd_count = 0,
+    .generation = 0,
+    .ring_fd = -1,
+    .ring = NULL,
+    .rt_fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .stats_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Per-thread raw socket (valid while t_generation matches)
+static __thread int t_raw_fd = -1;
+static __thread uint32_t t_generation = 0;
+
+static const char* const BACKEND_NAMES[INJECT_BACKEND_COUNT] = {
+    "raw", "raw_per_thread", "packet_ring"
+};
+
+// Forward declarations
+static int raw_init(void);
+static int raw_send_batch(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip);
+static int raw_flush(void);
+static void raw_cleanup(void);
+static int thread_send_batch(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip);
+static void thread_cleanup(void);
+static int ring_init(void);
+static int ring_send_batch(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip);
+static int ring_flush(void);
+static void ring_cleanup(void);
+static int open_raw_socket(uint32_t mark);
+static int open_raw6_socket(uint32_t mark);
+static int raw_send(int fd, uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip);
+static const RouteEntry* ring_route(uint32_t dst_ip);
+static int lookup_route(uint32_t dst_ip, int* ifindex, uint32_t* next_hop);
+static int link_type(int ifindex, char* name, size_t name_size);
+static int lookup_neighbor(uint32_t ip, const char* dev, uint8_t* addr);
+static void count_sent(uint32_t packets, uint64_t bytes, uint32_t syscalls);
+static uint64_t monotonic_ns(void);
+
+static const BackendOps BACKENDS[INJECT_BACKEND_COUNT] = {
+    [INJECT_BACKEND_RAW] = { raw_init, raw_send_batch, raw_flush, raw_cleanup },
+    [INJECT_BACKEND_RAW_PER_THREAD] = { raw_init, thread_send_batch, raw_flush, thread_cleanup },
+    [INJECT_BACKEND_PACKET_RING] = { ring_init, ring_send_batch, ring_flush, ring_cleanup },
+};
+
+/**
+ * Open the backend
+ */
+int inject_backend_init(InjectBackendType type, uint32_t mark) {
+    if (type >= INJECT_BACKEND_COUNT) return -1;
+    pthread_mutex_lock(&g_inject.lock);
+    
+    if (g_inject.initialized) {
+        pthread_mutex_unlock(&g_inject.lock);
+        return 0;
+    }
+    
+    g_inject.mark = mark;
+    g_inject.raw_fd = open_raw_socket(mark);
+    if (g_inject.raw_fd < 0) {
+        pthread_mutex_unlock(&g_inject.lock);
+        return -1;
+    }
+    
+    g_inject.raw6_fd = open_raw6_socket(mark);
+    
+    if (BACKENDS[type].init() < 0) {
+        LOGE("%s backend unavailable, using the raw socket", BACKEND_NAMES[type]);
+        type = INJECT_BACKEND_RAW;
+    }
+    
+    pthread_mutex_lock(&g_inject.stats_lock);
+    memset(&g_inject.stats, 0, sizeof(g_inject.stats));
+    g_inject.stats.type = type;
+    pthread_mutex_unlock(&g_inject.stats_lock);
+    
+    g_inject.type = type;
+    g_inject.initialized = true;
+    LOGI("Injection backend: %s (raw fd=%d, mark=0x%X)", BACKEND_NAMES[type], g_inject.raw_fd, mark);
+    pthread_mutex_unlock(&g_inject.lock);
+    return 0;
+}
+
+/**
+ * Send packets to one destination
+ */
+int inject_backend_send(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip) {
+    if (!g_inject.initialized) {
+        LOGE("!!! Injection backend not initialized, cannot send packet !!!");
+        return -1;
+    }
+    if (count == 0) return 0;
+    
+    // IPv6 skips the backend: the ring resolves IPv4 next hops only
+    if ((packets[0][0] >> 4) == 6) {
+        return raw_send(g_inject.raw6_fd, packets, lens, count, dst_ip);
+    }
+    return BACKENDS[g_inject.type].send_batch(packets, lens, count, dst_ip);
+}
+
+/**
+ * Wait until queued packets have left
+ */
+int inject_backend_flush(void) {
+    if (!g_inject.initialized) return -1;
+    return BACKENDS[g_inject.type].flush();
+}
+
+/**
+ * Flush and close the backend
+ */
+void inject_backend_cleanup(void) {
+    pthread_mutex_lock(&g_inject.lock);
+    
+    if (g_inject.initialized) {
+        BACKENDS[g_inject.type].flush();
+        BACKENDS[g_inject.type].cleanup();
+        g_inject.initialized = false;
+    }
+    if (g_inject.raw_fd >= 0) {
+        close(g_inject.raw_fd);
+        g_inject.raw_fd = -1;
+    }
+    if (g_inject.raw6_fd >= 0) {
+        close(g_inject.raw6_fd);
+        g_inject.raw6_fd = -1;
+    }
+    
+    LOGI("Injection backend closed");
+    pthread_mutex_unlock(&g_inject.lock);
+}
+
+/**
+ * Check if a backend is open
+ */
+bool inject_backend_ready(void) {
+    return g_inject.initialized;
+}
+
+/**
+ * Change SO_MARK of the open sockets
+ */
+void inject_backend_set_mark(uint32_t mark) {
+    pthread_mutex_lock(&g_inject.lock);
+    g_inject.mark = mark;
+    if (g_inject.raw_fd >= 0) {
+        setsockopt(g_inject.raw_fd, SOL_SOCKET, SO_MARK, &mark, sizeof(mark));
+    }
+    if (g_inject.raw6_fd >= 0) {
+        setsockopt(g_inject.raw6_fd, SOL_SOCKET, SO_MARK, &mark, sizeof(mark));
+    }
+    for (int i = 0; i < g_inject.thread_fd_count; i++) {
+        setsockopt(g_inject.thread_fds[i], SOL_SOCKET, SO_MARK, &mark, sizeof(mark));
+    }
+    if (g_inject.ring_fd >= 0) {
+        setsockopt(g_inject.ring_fd, SOL_SOCKET, SO_MARK, &mark, sizeof(mark));
+    }
+    // Ring next hops were routed with the old mark
+    memset(g_inject.routes, 0, sizeof(g_inject.routes));
+    pthread_mutex_unlock(&g_inject.lock);
+}
+
+/**
+ * Get backend counters
+ */
+void inject_backend_get_stats(InjectBackendStats* stats) {
+    if (stats == NULL) return;
+    pthread_mutex_lock(&g_inject.stats_lock);
+    *stats = g_inject.stats;
+    pthread_mutex_unlock(&g_inject.stats_lock);
+}
+
+/**
+ * Short name of a backend type
+ */
+const char* inject_backend_name(InjectBackendType type) {
+    if (type >= INJECT_BACKEND_COUNT) return "unknown";
+    return BACKEND_NAMES[type];
+}
+
+/**
+ * Look up a backend type by name
+ */
+int inject_backend_parse(const char* name, InjectBackendType* type) {
+    for (int i = 0; i < INJECT_BACKEND_COUNT; i++) {
+        if (strcmp(name, BACKEND_NAMES[i]) == 0) {
+            *type = (InjectBackendType)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Shared raw socket: nothing beyond the socket opened by inject_backend_init
+ */
+static int raw_init(void) {
+    return 0;
+}
+
+static int raw_send_batch(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip) {
+    return raw_send(g_inject.raw_fd, packets, lens, count, dst_ip);
+}
+
+/**
+ * Raw sockets hand packets to the IP layer synchronously
+ */
+static int raw_flush(void) {
+    return 0;
+}
+
+static void raw_cleanup(void) {
+}
+
+/**
+ * Send on the calling thread's own raw socket (opened on first use)
+ */
+static int thread_send_batch(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip) {
+    if (t_raw_fd < 0 || t_generation != g_inject.generation) {
+        t_raw_fd = -1;
+        pthread_mutex_lock(&g_inject.lock);
+        if (g_inject.thread_fd_count < MAX_THREAD_SOCKETS) {
+            int fd = open_raw_socket(g_inject.mark);
+            if (fd >= 0) {
+                g_inject.thread_fds[g_inject.thread_fd_count++] = fd;
+                t_raw_fd = fd;
+                t_generation = g_inject.generation;
+            }
+        }
+        pthread_mutex_unlock(&g_inject.lock);
+    }
+    
+    return raw_send(t_raw_fd >= 0 ? t_raw_fd : g_inject.raw_fd, packets, lens, count, dst_ip);
+}
+
+/**
+ * Close every per-thread socket; threads reopen on their next send
+ */
+static void thread_cleanup(void) {
+    for (int i = 0; i < g_inject.thread_fd_count; i++) {
+        close(g_inject.thread_fds[i]);
+    }
+    g_inject.thread_fd_count = 0;
+    g_inject.generation++;
+}
+
+/**
+ * Map a TPACKET_V3 TX ring on a send-only packet socket (needs Linux 4.11+)
+ */
+static int ring_init(void) {
+    int fd = socket(AF_PACKET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        LOGE("Failed to create packet socket: %s", strerror(errno));
+        return -1;
+    }
+    
+    int version = TPACKET_V3;
+    int one = 1;
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RING_BLOCK_SIZE;
+    req.tp_block_nr = RING_BLOCK_COUNT;
+    req.tp_frame_size = RING_FRAME_SIZE;
+    req.tp_frame_nr = RING_FRAME_COUNT;
+    
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+        setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        LOGE("Failed to set up TPACKET_V3 TX ring: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    
+    // Straight to the driver; malformed frames are skipped instead of stalling the ring
+    if (setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) < 0) {
+        LOGI("Warning: PACKET_QDISC_BYPASS unavailable: %s", strerror(errno));
+    }
+    setsockopt(fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_MARK, &g_inject.mark, sizeof(g_inject.mark));
+    
+    void* ring = mmap(NULL, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT,
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        LOGE("Failed to map TX ring: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    
+    int rt_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (rt_fd < 0) {
+        LOGE("Failed to create route socket: %s", strerror(errno));
+        munmap(ring, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT);
+        close(fd);
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+    setsockopt(rt_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    
+    g_inject.ring_fd = fd;
+    g_inject.ring = (uint8_t*)ring;
+    g_inject.ring_head = 0;
+    g_inject.rt_fd = rt_fd;
+    memset(g_inject.routes, 0, sizeof(g_inject.routes));
+    LOGI("TX ring: %d frames of %d bytes", RING_FRAME_COUNT, RING_FRAME_SIZE);
+    return 0;
+}
+
+/**
+ * Copy the burst into ring frames and kick them with one send()
+ * Packets the ring cannot take (unknown next hop, no free frame, too
+ * large) follow through the raw socket, after the ring packets.
+ */
+static int ring_send_batch(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip) {
+    pthread_mutex_lock(&g_inject.lock);
+    
+    const RouteEntry* route = ring_route(dst_ip);
+    uint32_t queued = 0;
+    uint64_t bytes = 0;
+    uint32_t first_frame = g_inject.ring_head;
+    
+    while (route != NULL && queued < count) {
+        if (lens[queued] < sizeof(struct iphdr) ||
+            lens[queued] > RING_FRAME_SIZE - RING_DATA_OFFSET) {
+            break;
+        }
+        
+        struct tpacket3_hdr* hdr =
+            (struct tpacket3_hdr*)(g_inject.ring + (size_t)g_inject.ring_head * RING_FRAME_SIZE);
+        if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            pthread_mutex_lock(&g_inject.stats_lock);
+            g_inject.stats.ring_full++;
+            pthread_mutex_unlock(&g_inject.stats_lock);
+            break;
+        }
+        
+        // The raw socket would fill in the IP checksum; here the driver sends it as is
+        uint8_t* data = (uint8_t*)hdr + RING_DATA_OFFSET;
+        memcpy(data, packets[queued], lens[queued]);
+        struct iphdr* ip = (struct iphdr*)data;
+        ip->check = 0;
+        ip->check = checksum_ip(ip);
+        
+        hdr->tp_len = lens[queued];
+        hdr->tp_next_offset = 0;
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        
+        bytes += lens[queued];
+        queued++;
+        g_inject.ring_head = (g_inject.ring_head + 1) % RING_FRAME_COUNT;
+    }
+    
+    if (queued > 0) {
+        struct sockaddr_ll sll;
+        memset(&sll, 0, sizeof(sll));
+        sll.sll_family = AF_PACKET;
+        sll.sll_protocol = htons(ETH_P_IP);
+        sll.sll_ifindex = route->ifindex;
+        sll.sll_halen = route->halen;
+        memcpy(sll.sll_addr, route->addr, route->halen);
+        
+        if (sendto(g_inject.ring_fd, NULL, 0, MSG_DONTWAIT, (struct sockaddr*)&sll, sizeof(sll)) < 0) {
+            LOGE("!!! TX ring send FAILED: %s (errno=%d) !!!", strerror(errno), errno);
+            // Withdraw frames the kernel did not take so they are not sent later;
+            // it takes frames in order, so the rest go out through the raw socket
+            uint32_t taken = queued;
+            for (uint32_t i = 0; i < queued; i++) {
+                struct tpacket3_hdr* hdr = (struct tpacket3_hdr*)
+                    (g_inject.ring + (size_t)((first_frame + i) % RING_FRAME_COUNT) * RING_FRAME_SIZE);
+                uint32_t expected = TP_STATUS_SEND_REQUEST;
+                if (__atomic_compare_exchange_n(&hdr->tp_status, &expected, TP_STATUS_AVAILABLE, false,
+                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) && taken == queued) {
+                    taken = i;
+                }
+            }
+            
+            // Keep our head in step with the kernel's, which stopped at the first withdrawn frame
+            g_inject.ring_head = (first_frame + taken) % RING_FRAME_COUNT;
+            for (uint32_t i = taken; i < queued; i++) {
+                bytes -= lens[i];
+            }
+            queued = taken;
+        }
+        count_sent(queued, bytes, 1);
+    }
+    pthread_mutex_unlock(&g_inject.lock);
+    
+    if (queued == count) return (int)count;
+    
+    pthread_mutex_lock(&g_inject.stats_lock);
+    g_inject.stats.fallbacks += count - queued;
+    pthread_mutex_unlock(&g_inject.stats_lock);
+    
+    int sent = raw_send(g_inject.raw_fd, packets + queued, lens + queued, count - queued, dst_ip);
+    return (int)queued + (sent > 0 ? sent : 0);
+}
+
+/**
+ * Wait until every frame is back with the user (bounded)
+ */
+static int ring_flush(void) {
+    if (g_inject.ring == NULL) return 0;
+    
+    for (int waited_ms = 0; waited_ms <= RING_FLUSH_TIMEOUT_MS; waited_ms++) {
+        bool busy = false;
+        for (uint32_t i = 0; i < RING_FRAME_COUNT && !busy; i++) {
+            struct tpacket3_hdr* hdr =
+                (struct tpacket3_hdr*)(g_inject.ring + (size_t)i * RING_FRAME_SIZE);
+            uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+            busy = status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT;
+        }
+        if (!busy) return 0;
+        
+        struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000 };
+        nanosleep(&ts, NULL);
+    }
+    LOGE("TX ring flush timed out");
+    return -1;
+}
+
+static void ring_cleanup(void) {
+    if (g_inject.ring != NULL) {
+        munmap(g_inject.ring, (size_t)RING_BLOCK_SIZE * RING_BLOCK_COUNT);
+        g_inject.ring = NULL;
+    }
+    if (g_inject.ring_fd >= 0) {
+        close(g_inject.ring_fd);
+        g_inject.ring_fd = -1;
+    }
+    if (g_inject.rt_fd >= 0) {
+        close(g_inject.rt_fd);
+        g_inject.rt_fd = -1;
+    }
+}
+
+/**
+ * Open a raw socket for injection (IP_HDRINCL, mark, no output defrag)
+ * @return Socket, -1 on error
+ */
+static int open_raw_socket(uint32_t mark) {
+    int fd = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+    if (fd < 0) {
+        LOGE("!!! FAILED to create raw socket: %s (errno=%d)", strerror(errno), errno);
+        return -1;
+    }
+    
+    // We provide the IP header
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_IP, IP_HDRINCL, &one, sizeof(one)) < 0) {
+        LOGE("!!! FAILED to set IP_HDRINCL: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    
+    // Set socket mark (so iptables can identify our packets)
+    if (setsockopt(fd, SOL_SOCKET, SO_MARK, &mark, sizeof(mark)) < 0) {
+        LOGI("Warning: Failed to set SO_MARK: %s (may cause packet loops)", strerror(errno));
+    }
+    
+    // Keep conntrack from reassembling our IP fragments on output
+    if (setsockopt(fd, IPPROTO_IP, IP_NODEFRAG, &one, sizeof(one)) < 0) {
+        LOGI("Warning: Failed to set IP_NODEFRAG: %s", strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * Open an IPv6 raw socket; IPPROTO_RAW implies that we provide the header
+ * @return Socket, -1 if IPv6 is not available
+ */
+static int open_raw6_socket(uint32_t mark) {
+    int fd = socket(AF_INET6, SOCK_RAW, IPPROTO_RAW);
+    if (fd < 0) {
+        LOGI("Warning: No IPv6 raw socket: %s (IPv6 packets will not be injected)", strerror(errno));
+        return -1;
+    }
+    
+    if (setsockopt(fd, SOL_SOCKET, SO_MARK, &mark, sizeof(mark)) < 0) {
+        LOGI("Warning: Failed to set SO_MARK on the IPv6 socket: %s", strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * Send on a raw socket: one sendto, or sendmmsg for a burst
+ * sendmmsg stops at the first failing packet; the rest go one by one.
+ * @return Number of leading packets sent
+ */
+static int raw_send(int fd, uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip) {
+    if (fd < 0) {
+        LOGE("!!! Raw socket not initialized, cannot send packet !!!");
+        return -1;
+    }
+    
+    // IPv6 packets carry the destination; the port stays 0 (IPPROTO_RAW)
+    union {
+        struct sockaddr_in v4;
+        struct sockaddr_in6 v6;
+    } dst_addr;
+    socklen_t dst_len;
+    memset(&dst_addr, 0, sizeof(dst_addr));
+    if ((packets[0][0] >> 4) == 6) {
+        dst_addr.v6.sin6_family = AF_INET6;
+        memcpy(&dst_addr.v6.sin6_addr, packets[0] + 24, sizeof(dst_addr.v6.sin6_addr));
+        dst_len = sizeof(dst_addr.v6);
+    } else {
+        dst_addr.v4.sin_family = AF_INET;
+        dst_addr.v4.sin_addr.s_addr = dst_ip;
+        dst_len = sizeof(dst_addr.v4);
+    }
+    
+    uint32_t done = 0;
+    if (count > 1) {
+        struct iovec iov[RAW_MAX_BATCH];
+        struct mmsghdr msgs[RAW_MAX_BATCH];
+        uint32_t burst = count < RAW_MAX_BATCH ? count : RAW_MAX_BATCH;
+        memset(msgs, 0, sizeof(msgs));
+        for (uint32_t i = 0; i < burst; i++) {
+            iov[i].iov_base = packets[i];
+            iov[i].iov_len = lens[i];
+            msgs[i].msg_hdr.msg_name = &dst_addr;
+            msgs[i].msg_hdr.msg_namelen = dst_len;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        
+        int sent = sendmmsg(fd, msgs, burst, 0);
+        uint64_t bytes = 0;
+        for (int i = 0; i < sent; i++) bytes += msgs[i].msg_len;
+        done = sent > 0 ? (uint32_t)sent : 0;
+        count_sent(done, bytes, 1);
+    }
+    
+    for (; done < count; done++) {
+        if (packets[done] == NULL || lens[done] < sizeof(struct iphdr)) {
+            LOGE("Invalid packet: ptr=%p, len=%u", packets[done], lens[done]);
+            break;
+        }
+        ssize_t sent = sendto(fd, packets[done], lens[done], 0,
+                              (struct sockaddr*)&dst_addr, dst_len);
+        if (sent < 0) {
+            LOGE("!!! sendto FAILED: %s (errno=%d) !!!", strerror(errno), errno);
+            count_sent(0, 0, 1);
+            break;
+        }
+        count_sent(1, (uint64_t)sent, 1);
+    }
+    
+    if (done < count) {
+        pthread_mutex_lock(&g_inject.stats_lock);
+        g_inject.stats.errors += count - done;
+        pthread_mutex_unlock(&g_inject.stats_lock);
+    }
+    return (int)done;
+}
+
+/**
+ * Cached egress of a destination (caller holds g_inject.lock)
+ * @return Entry with a resolved next hop, NULL to use the raw socket
+ */
+static const RouteEntry* ring_route(uint32_t dst_ip) {
+    uint32_t slot = (ntohl(dst_ip) * 2654435761U) >> 26;   // 64 slots
+    RouteEntry* entry = &g_inject.routes[slot & (ROUTE_SLOTS - 1)];
+    uint64_t now = monotonic_ns();
+    
+    if (entry->dst_ip == dst_ip && now < entry->expires_ns) {
+        return entry->ifindex > 0 ? entry : NULL;
+    }
+    
+    memset(entry, 0, sizeof(*entry));
+    entry->dst_ip = dst_ip;
+    entry->expires_ns = now + ROUTE_MISS_TTL_NS;
+    
+    int ifindex;
+    uint32_t next_hop;
+    char dev[IF_NAMESIZE];
+    if (lookup_route(dst_ip, &ifindex, &next_hop) < 0) return NULL;
+    
+    int type = link_type(ifindex, dev, sizeof(dev));
+    if (type == ARPHRD_ETHER) {
+        if (lookup_neighbor(next_hop, dev, entry->addr) < 0) return NULL;
+        entry->halen = ETH_ALEN;
+    } else if (type != ARPHRD_NONE && type != ARPHRD_RAWIP && type != ARPHRD_PPP) {
+        return NULL;
+    }
+    
+    entry->ifindex = ifindex;
+    entry->expires_ns = now + ROUTE_TTL_NS;
+    return entry;
+}
+
+/**
+ * Route a destination the way the raw socket would (RTM_GETROUTE with the mark)
+ * @param next_hop Output: gateway, or dst_ip when on-link
+ * @return 0 for a unicast route, -1 otherwise
+ */
+static int lookup_route(uint32_t dst_ip, int* ifindex, uint32_t* next_hop) {
+    struct {
+        struct nlmsghdr nlh;
+        struct rtmsg rtm;
+        uint8_t attrs[2 * RTA_SPACE(sizeof(uint32_t))];
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    req.nlh.nlmsg_type = RTM_GETROUTE;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST;
+    req.nlh.nlmsg_seq = ++g_inject.rt_seq;
+    req.rtm.rtm_family = AF_INET;
+    req.rtm.rtm_dst_len = 32;
+    
+    uint32_t values[2] = { dst_ip, g_inject.mark };
+    uint16_t types[2] = { RTA_DST, RTA_MARK };
+    for (int i = 0; i < 2; i++) {
+        struct rtattr* rta = (struct rtattr*)((uint8_t*)&req + NLMSG_ALIGN(req.nlh.nlmsg_len));
+        rta->rta_type = types[i];
+        rta->rta_len = RTA_LENGTH(sizeof(uint32_t));
+        memcpy(RTA_DATA(rta), &values[i], sizeof(uint32_t));
+        req.nlh.nlmsg_len = NLMSG_ALIGN(req.nlh.nlmsg_len) + RTA_SPACE(sizeof(uint32_t));
+    }
+    
+    if (send(g_inject.rt_fd, &req, req.nlh.nlmsg_len, 0) < 0) return -1;
+    
+    uint8_t buf[1024];
+    ssize_t len = recv(g_inject.rt_fd, buf, sizeof(buf), 0);
+    if (len < 0) return -1;
+    
+    struct nlmsghdr* nlh = (struct nlmsghdr*)buf;
+    if (!NLMSG_OK(nlh, (uint32_t)len) || nlh->nlmsg_type != RTM_NEWROUTE ||
+        nlh->nlmsg_seq != g_inject.rt_seq) {
+        return -1;
+    }
+    
+    struct rtmsg* rtm = (struct rtmsg*)NLMSG_DATA(nlh);
+    if (rtm->rtm_type != RTN_UNICAST) return -1;
+    
+    *ifindex = 0;
+    *next_hop = dst_ip;
+    int attr_len = (int)RTM_PAYLOAD(nlh);
+    for (struct rtattr* rta = RTM_RTA(rtm); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+        if (rta->rta_type == RTA_OIF) {
+            memcpy(ifindex, RTA_DATA(rta), sizeof(int));
+        } else if (rta->rta_type == RTA_GATEWAY) {
+            memcpy(next_hop, RTA_DATA(rta), sizeof(uint32_t));
+        }
+    }
+    return *ifindex > 0 ? 0 : -1;
+}
+
+/**
+ * Link-layer type of an interface (ARPHRD_*), from sysfs
+ * @param name Output: interface name
+ * @return Type, -1 if unknown
+ */
+static int link_type(int ifindex, char* name, size_t name_size) {
+    char ifname[IF_NAMESIZE];
+    if (if_indextoname((unsigned int)ifindex, ifname) == NULL) return -1;
+    snprintf(name, name_size, "%s", ifname);
+    
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/type", ifname);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return -1;
+    int type = -1;
+    if (fscanf(f, "%d", &type) != 1) type = -1;
+    fclose(f);
+    return type;
+}
+
+/**
+ * Complete ARP entry of a next hop on an interface
+ * @return 0 on success, -1 if not resolved
+ */
+static int lookup_neighbor(uint32_t ip, const char* dev, uint8_t* addr) {
+    FILE* f = fopen("/proc/net/arp", "r");
+    if (f == NULL) return -1;
+    
+    char want[INET_ADDRSTRLEN];
+    const uint8_t* b = (const uint8_t*)&ip;
+    snprintf(want, sizeof(want), "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+    
+    char line[256];
+    int result = -1;
+    while (result < 0 && fgets(line, sizeof(line), f) != NULL) {
+        char ip_str[64], mac[32], device[32];
+        unsigned int hw_type, flags;
+        unsigned int m[ETH_ALEN];
+        if (sscanf(line, "%63s 0x%x 0x%x %31s %*s %31s", ip_str, &hw_type, &flags, mac, device) != 5 ||
+            strcmp(ip_str, want) != 0 || strcmp(device, dev) != 0 || !(flags & ATF_COM)) {
+            continue;
+        }
+        if (sscanf(mac, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) == ETH_ALEN) {
+            for (int i = 0; i < ETH_ALEN; i++) addr[i] = (uint8_t)m[i];
+            result = 0;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+/**
+ * Add to the send counters
+ */
+static void count_sent(uint32_t packets, uint64_t bytes, uint32_t syscalls) {
+    pthread_mutex_lock(&g_inject.stats_lock);
+    g_inject.stats.packets += packets;
+    g_inject.stats.bytes += bytes;
+    g_inject.stats.syscalls += syscalls;
+    pthread_mutex_unlock(&g_inject.stats_lock);
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,114 @@
+/**
+ * inject_backend.h
+ *
+ * Packet injection backends.
+ * Fragments built by the bypass engine leave through one of:
+ *  - a shared SOCK_RAW/IPPROTO_RAW socket (full IP output path, default);
+ *  - one raw socket per injecting thread (no shared socket lock);
+ *  - an AF_PACKET TPACKET_V3 mmap TX ring with PACKET_QDISC_BYPASS on the
+ *    egress interface: a burst is copied into ring frames and handed to
+ *    the driver with one send(), skipping routing, netfilter and qdiscs.
+ * The ring resolves the egress interface and next hop per destination
+ * (routed with the injection mark, like the raw socket) and falls back to
+ * the raw socket when the next hop is not resolved yet. Ring packets skip
+ * POSTROUTING, so they get no SNAT: only use it where local traffic
+ * leaves unNATed. IPv6 packets always leave through a shared IPv6 raw
+ * socket, whatever the backend.
+ */
+
+#ifndef INJECT_BACKEND_H
+#define INJECT_BACKEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Backend types
+typedef enum {
+    INJECT_BACKEND_RAW = 0,            // Shared raw socket
+    INJECT_BACKEND_RAW_PER_THREAD,     // Raw socket per injecting thread
+    INJECT_BACKEND_PACKET_RING,        // AF_PACKET TPACKET_V3 TX ring, qdisc bypass
+    INJECT_BACKEND_COUNT
+} InjectBackendType;
+
+// Backend counters (since init)
+typedef struct {
+    InjectBackendType type;        // Active backend
+    uint64_t packets;              // Packets handed to the kernel
+    uint64_t bytes;                // Bytes handed to the kernel
+    uint64_t syscalls;             // sendto/sendmmsg/send calls
+    uint64_t errors;               // Packets that could not be sent
+    uint64_t fallbacks;            // Ring packets sent through the raw socket instead
+    uint64_t ring_full;            // Ring packets that found no free frame
+} InjectBackendStats;
+
+/**
+ * Open the backend (a failing ring init falls back to the shared raw socket)
+ * @param type Backend type
+ * @param mark SO_MARK for injected packets (keeps them out of the queue)
+ * @return 0 on success, -1 on error
+ */
+int inject_backend_init(InjectBackendType type, uint32_t mark);
+
+/**
+ * Send packets to one destination, in order
+ * @param packets IP packets (all of one version)
+ * @param lens Packet lengths
+ * @param count Number of packets
+ * @param dst_ip Destination IP (network byte order; unused for IPv6)
+ * @return Number of leading packets sent (count on success), -1 if not initialized
+ */
+int inject_backend_send(uint8_t* const* packets, const uint32_t* lens, uint32_t count, uint32_t dst_ip);
+
+/**
+ * Wait until queued packets have left (ring: frames back to the user)
+ * @return 0 on success, -1 on error
+ */
+int inject_backend_flush(void);
+
+/**
+ * Flush and close the backend
+ */
+void inject_backend_cleanup(void);
+
+/**
+ * Check if a backend is open
+ * @return true after a successful inject_backend_init
+ */
+bool inject_backend_ready(void);
+
+/**
+ * Change SO_MARK of the open sockets
+ * @param mark Mark value
+ */
+void inject_backend_set_mark(uint32_t mark);
+
+/**
+ * Get backend counters
+ * @param stats Output counters
+ */
+void inject_backend_get_stats(InjectBackendStats* stats);
+
+/**
+ * Get short name of a backend type ("raw", "raw_per_thread", "packet_ring")
+ * @param type Backend type
+ * @return Static string, "unknown" if out of range
+ */
+const char* inject_backend_name(InjectBackendType type);
+
+/**
+ * Look up a backend type by name
+ * @param name Backend name
+ * @param type Output type
+ * @return 0 on success, -1 if unknown
+ */
+int inject_backend_parse(const char* name, InjectBackendType* type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INJECT_BACKEND_H
@@ -0,0 +1,86 @@
+/**
+ * ipv6.c
+ *
+ * IPv6 header helpers.
+ */
+
+#include "ipv6.h"
+
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/ip6.h>
+
+/**
+ * Walk the extension header chain
+ */
+int ipv6_transport_offset(const uint8_t* packet, uint32_t len, uint8_t* protocol, bool* fragment) {
+    if (len < IPV6_HEADER_LEN || (packet[0] >> 4) != 6) {
+        return -1;
+    }
+    
+    uint8_t next = packet[6];
+    uint32_t offset = IPV6_HEADER_LEN;
+    
+    if (fragment) {
+        *fragment = false;
+    }
+    
+    for (;;) {
+        switch (next) {
+            case IPPROTO_HOPOPTS:
+            case IPPROTO_ROUTING:
+            case IPPROTO_DSTOPTS:
+                if (offset + 8 > len) {
+                    return -1;
+                }
+                next = packet[offset];
+                offset += (packet[offset + 1] + 1) * 8;
+                break;
+            
+            case IPPROTO_AH:
+                if (offset + 8 > len) {
+                    return -1;
+                }
+                next = packet[offset];
+                offset += (packet[offset + 1] + 2) * 4;
+                break;
+            
+            case IPPROTO_FRAGMENT: {
+                if (offset + sizeof(struct ip6_frag) > len) {
+                    return -1;
+                }
+                const struct ip6_frag* frag = (const struct ip6_frag*)(packet + offset);
+                if (fragment) {
+                    *fragment = true;
+                }
+                if (frag->ip6f_offlg & IP6F_OFF_MASK) {
+                    // Not the first fragment: no transport header here
+                    *protocol = IPPROTO_FRAGMENT;
+                    return (int)offset;
+                }
+                next = frag->ip6f_nxt;
+                offset += sizeof(struct ip6_frag);
+                break;
+            }
+            
+            default:
+                // Transport header, ESP, No Next Header or unknown
+                if (offset > len) {
+                    return -1;
+                }
+                *protocol = next;
+                return (int)offset;
+        }
+    }
+}
+
+/**
+ * Fold an address into 32 bits
+ */
+uint32_t ipv6_addr_fold(const uint8_t* addr) {
+    uint32_t words[4];
+    memcpy(words, addr, sizeof(words));
+    
+    uint32_t folded = words[0] ^ words[1] ^ words[2] ^ words[3];
+    return folded ? folded : 1;
+}
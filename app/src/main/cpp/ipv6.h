@@ -0,0 +1,48 @@
+/**
+ * ipv6.h
+ *
+ * IPv6 header helpers.
+ * Walks the extension header chain (RFC 8200, 4) to the transport header
+ * so that queued IPv6 packets can be classified like IPv4 ones, and folds
+ * 128-bit addresses into the 32-bit keys used by the per-destination
+ * tables.
+ */
+
+#ifndef IPV6_H
+#define IPV6_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fixed IPv6 header length
+#define IPV6_HEADER_LEN 40
+
+/**
+ * Find the transport header of an IPv6 packet
+ * Skips Hop-by-Hop, Routing, Fragment, Destination Options and AH headers.
+ * The walk stops at ESP, No Next Header, an unknown header and at a
+ * non-first fragment, whose protocol is reported as IPPROTO_FRAGMENT.
+ * @param packet IPv6 packet
+ * @param len Packet length
+ * @param protocol Output: next header value of the transport header
+ * @param fragment Output: true if a Fragment header was crossed (may be NULL)
+ * @return Offset of the transport header, -1 if the chain is truncated
+ */
+int ipv6_transport_offset(const uint8_t* packet, uint32_t len, uint8_t* protocol, bool* fragment);
+
+/**
+ * Fold an IPv6 address into 32 bits
+ * @param addr 16-byte address
+ * @return XOR of the address words (never 0, which marks free table slots)
+ */
+uint32_t ipv6_addr_fold(const uint8_t* addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IPV6_H
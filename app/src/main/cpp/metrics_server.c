@@ -0,0 +1,546 @@
+/**
+ * metrics_server.c
+ *
+ * Prometheus text-format exporter.
+ * One background thread accepts scrapes on a Unix or loopback TCP socket
+ * and answers every request with a snapshot of the bypass statistics.
+ */
+
+#include "metrics_server.h"
+#include "dpi_bypass.h"
+#include "queue_health.h"
+#include "decision_trace.h"
+#include "strategy_cache.h"
+#include "flow_table.h"
+#include "ingress_observer.h"
+#include "uid_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOG_TAG "Metrics"
+#include "netrix_log.h"
+
+#define REQUEST_BUFFER_SIZE 2048
+#define INITIAL_RENDER_SIZE 8192
+#define CLIENT_TIMEOUT_SEC 1
+#define METRICS_MAX_UIDS 64           // Busiest UIDs exported per scrape
+
+// Global state
+static struct {
+    int listen_fd;
+    volatile bool running;
+    pthread_t thread;
+    char unix_path[108];
+    volatile bool uid_series;      // Export netrix_uid_* (opt-in)
+    pthread_mutex_t lock;
+} g_metrics = {
+    .listen_fd = -1,
+    .running = false,
+    .unix_path = "",
+    .uid_series = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Growable text buffer used while rendering
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} MetricsBuf;
+
+// Forward declarations
+static void* metrics_thread_func(void* arg);
+static void serve_client(int client_fd);
+static void buf_appendf(MetricsBuf* buf, const char* fmt, ...);
+static void render_counter(MetricsBuf* buf, const char* name, const char* help, uint64_t value);
+static void render_gauge(MetricsBuf* buf, const char* name, const char* help, double value);
+static void render_uid_series(MetricsBuf* buf);
+static void render_latency(MetricsBuf* buf, const char* name, const char* help,
+                           const uint64_t* hist, uint64_t sum_us);
+
+/**
+ * Start metrics server
+ */
+int metrics_server_start(const char* spec) {
+    if (spec == NULL || spec[0] == '\0') return -1;
+    
+    pthread_mutex_lock(&g_metrics.lock);
+    
+    if (g_metrics.running) {
+        pthread_mutex_unlock(&g_metrics.lock);
+        return 0;
+    }
+    
+    int fd = -1;
+    
+    if (strncmp(spec, "unix:", 5) == 0) {
+        const char* path = spec + 5;
+        if (path[0] == '\0' || strlen(path) >= sizeof(g_metrics.unix_path)) {
+            LOGE("Invalid metrics socket path: %s", path);
+            pthread_mutex_unlock(&g_metrics.lock);
+            return -1;
+        }
+        
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            LOGE("Failed to create metrics socket: %s", strerror(errno));
+            pthread_mutex_unlock(&g_metrics.lock);
+            return -1;
+        }
+        
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        
+        unlink(path);
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            LOGE("Failed to bind metrics socket %s: %s", path, strerror(errno));
+            close(fd);
+            pthread_mutex_unlock(&g_metrics.lock);
+            return -1;
+        }
+        chmod(path, 0666);
+        strncpy(g_metrics.unix_path, path, sizeof(g_metrics.unix_path) - 1);
+    } else {
+        const char* port_str = (strncmp(spec, "tcp:", 4) == 0) ? spec + 4 : spec;
+        int port = atoi(port_str);
+        if (port <= 0 || port > 65535) {
+            LOGE("Invalid metrics port: %s", port_str);
+            pthread_mutex_unlock(&g_metrics.lock);
+            return -1;
+        }
+        
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            LOGE("Failed to create metrics socket: %s", strerror(errno));
+            pthread_mutex_unlock(&g_metrics.lock);
+            return -1;
+        }
+        
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        
+        // Loopback only - metrics are never exposed on external interfaces
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            LOGE("Failed to bind metrics port %d: %s", port, strerror(errno));
+            close(fd);
+            pthread_mutex_unlock(&g_metrics.lock);
+            return -1;
+        }
+    }
+    
+    if (listen(fd, 4) < 0) {
+        LOGE("Failed to listen on metrics socket: %s", strerror(errno));
+        close(fd);
+        pthread_mutex_unlock(&g_metrics.lock);
+        return -1;
+    }
+    
+    g_metrics.listen_fd = fd;
+    g_metrics.running = true;
+    
+    if (pthread_create(&g_metrics.thread, NULL, metrics_thread_func, NULL) != 0) {
+        LOGE("Failed to create metrics thread");
+        close(fd);
+        g_metrics.listen_fd = -1;
+        g_metrics.running = false;
+        pthread_mutex_unlock(&g_metrics.lock);
+        return -1;
+    }
+    
+    LOGI("Metrics server listening on %s", spec);
+    pthread_mutex_unlock(&g_metrics.lock);
+    return 0;
+}
+
+/**
+ * Stop metrics server
+ */
+void metrics_server_stop(void) {
+    pthread_mutex_lock(&g_metrics.lock);
+    
+    if (!g_metrics.running) {
+        pthread_mutex_unlock(&g_metrics.lock);
+        return;
+    }
+    
+    g_metrics.running = false;
+    
+    // Unblock accept()
+    shutdown(g_metrics.listen_fd, SHUT_RDWR);
+    pthread_join(g_metrics.thread, NULL);
+    
+    close(g_metrics.listen_fd);
+    g_metrics.listen_fd = -1;
+    
+    if (g_metrics.unix_path[0] != '\0') {
+        unlink(g_metrics.unix_path);
+        g_metrics.unix_path[0] = '\0';
+    }
+    
+    LOGI("Metrics server stopped");
+    pthread_mutex_unlock(&g_metrics.lock);
+}
+
+/**
+ * Check if running
+ */
+bool metrics_server_is_running(void) {
+    return g_metrics.running;
+}
+
+/**
+ * Enable per-UID series
+ */
+void metrics_server_set_uid_series(bool enable) {
+    g_metrics.uid_series = enable;
+}
+
+/**
+ * Render metrics text
+ */
+char* metrics_render(size_t* out_len) {
+    MetricsBuf buf = {
+        .data = (char*)malloc(INITIAL_RENDER_SIZE),
+        .len = 0,
+        .cap = INITIAL_RENDER_SIZE,
+        .failed = false
+    };
+    if (buf.data == NULL) return NULL;
+    buf.data[0] = '\0';
+    
+    DpiBypassStats stats = dpi_bypass_get_stats();
+    
+    render_counter(&buf, "netrix_packets_total",
+                   "Packets seen by the bypass engine", stats.packets_total);
+    render_counter(&buf, "netrix_bytes_total",
+                   "Bytes seen by the bypass engine", stats.bytes_total);
+    render_counter(&buf, "netrix_packets_bypassed_total",
+                   "Packets replaced by injected fragments", stats.packets_bypassed);
+    render_counter(&buf, "netrix_packets_dropped_total",
+                   "Packets dropped without injection", stats.packets_dropped);
+    
+    buf_appendf(&buf, "# HELP netrix_decisions_total Packets by decision reason\n");
+    buf_appendf(&buf, "# TYPE netrix_decisions_total counter\n");
+    for (int i = 0; i < DPI_REASON_COUNT; i++) {
+        buf_appendf(&buf, "netrix_decisions_total{reason=\"%s\"} %llu\n",
+                    dpi_reason_name((DpiDecisionReason)i),
+                    (unsigned long long)stats.reasons[i]);
+    }
+    
+    buf_appendf(&buf, "# HELP netrix_bypass_method_total Bypassed packets by method\n");
+    buf_appendf(&buf, "# TYPE netrix_bypass_method_total counter\n");
+    for (int i = 0; i < BYPASS_METHOD_COUNT; i++) {
+        buf_appendf(&buf, "netrix_bypass_method_total{method=\"%s\"} %llu\n",
+                    dpi_method_name((BypassMethod)i),
+                    (unsigned long long)stats.method_bypassed[i]);
+    }
+    
+    render_counter(&buf, "netrix_injected_fragments_total",
+                   "Packets injected through the raw socket", stats.fragments_injected);
+    render_counter(&buf, "netrix_injected_bytes_total",
+                   "Bytes injected through the raw socket", stats.bytes_injected);
+    
+    InjectBackendStats inject;
+    inject_backend_get_stats(&inject);
+    
+    render_counter(&buf, "netrix_inject_syscalls_total",
+                   "Send system calls of the injection backend", inject.syscalls);
+    render_counter(&buf, "netrix_inject_errors_total",
+                   "Packets the injection backend failed to send", inject.errors);
+    render_counter(&buf, "netrix_inject_fallbacks_total",
+                   "TX ring packets sent through the raw socket instead", inject.fallbacks);
+    render_counter(&buf, "netrix_inject_ring_full_total",
+                   "TX ring sends that found no free frame", inject.ring_full);
+    render_gauge(&buf, "netrix_packet_rate",
+                 "EWMA packets per second", stats.packet_rate);
+    render_gauge(&buf, "netrix_byte_rate",
+                 "EWMA bytes per second", stats.byte_rate);
+    render_gauge(&buf, "netrix_shedding",
+                 "1 if load shedding is active", stats.shedding ? 1 : 0);
+    render_counter(&buf, "netrix_shed_events_total",
+                   "Transitions into load shedding", stats.shed_events);
+    render_gauge(&buf, "netrix_packet_lag_microseconds",
+                 "EWMA time between netlink read and processing", stats.packet_lag_us);
+    render_latency(&buf, "netrix_packet_lag_seconds",
+                   "Time between netlink read and processing", stats.lag_hist, stats.lag_sum_us);
+    render_latency(&buf, "netrix_packet_service_seconds",
+                   "Time from processing start to verdict (fragment delays included)",
+                   stats.service_hist, stats.service_sum_us);
+    render_gauge(&buf, "netrix_fragment_delay_microseconds",
+                 "EWMA delay between injected fragments", stats.fragment_delay_us);
+    render_counter(&buf, "netrix_rtt_delays_total",
+                   "Flows whose fragment delay was derived from their RTT", stats.rtt_delays);
+    
+    QueueHealthSnapshot health;
+    queue_health_get(&health);
+    
+    render_gauge(&buf, "netrix_queue_backlog",
+                 "Packets waiting in the kernel queue", health.queue.queue_total);
+    render_gauge(&buf, "netrix_queue_backlog_peak",
+                 "Highest kernel queue backlog seen", health.backlog_peak);
+    render_counter(&buf, "netrix_queue_kernel_dropped_total",
+                   "Packets dropped by the kernel (queue full or socket overrun)",
+                   health.kernel_drops);
+    render_gauge(&buf, "netrix_queue_queue_dropped",
+                 "Kernel queue_dropped counter for the bound queue", health.queue.queue_dropped);
+    render_gauge(&buf, "netrix_queue_user_dropped",
+                 "Kernel user_dropped counter for the bound queue", health.queue.user_dropped);
+    render_counter(&buf, "netrix_queue_rcvbuf_overruns_total",
+                   "Packets dropped because the netlink receive buffer was full",
+                   health.rcvbuf_overruns);
+    render_counter(&buf, "netrix_queue_overload_events_total",
+                   "Transitions into queue overload", health.overload_events);
+    render_gauge(&buf, "netrix_queue_overloaded",
+                 "1 if the last health sample detected overload", health.overloaded ? 1 : 0);
+    render_gauge(&buf, "netrix_queue_fail_open",
+                 "1 if the kernel queue is in fail-open mode", health.queue.fail_open ? 1 : 0);
+    
+    StrategyCacheStats strategy;
+    strategy_cache_get_stats(&strategy);
+    
+    render_gauge(&buf, "netrix_strategy_hosts",
+                 "Hosts in the strategy cache", strategy.entries);
+    render_counter(&buf, "netrix_strategy_lookups_total",
+                   "Strategy selections for new flows", strategy.lookups);
+    render_counter(&buf, "netrix_strategy_known_total",
+                   "Selections that used a known-working method", strategy.known);
+    render_counter(&buf, "netrix_strategy_probes_total",
+                   "Selections that probed a cheaper method", strategy.probes);
+    
+    FlowTableStats flows;
+    flow_table_get_stats(&flows);
+    IngressObserverStats ingress;
+    ingress_observer_get_stats(&ingress);
+    
+    buf_appendf(&buf, "# HELP netrix_handshake_outcomes_total Handshake outcomes of tracked flows\n");
+    buf_appendf(&buf, "# TYPE netrix_handshake_outcomes_total counter\n");
+    for (int i = 0; i < STRATEGY_OUTCOME_COUNT; i++) {
+        buf_appendf(&buf, "netrix_handshake_outcomes_total{outcome=\"%s\"} %llu\n",
+                    strategy_outcome_name((StrategyOutcome)i),
+                    (unsigned long long)flows.outcomes[i]);
+    }
+    render_gauge(&buf, "netrix_flows_pending",
+                 "Tracked flows waiting for an outcome", flows.active);
+    render_gauge(&buf, "netrix_ingress_active",
+                 "1 if inbound packets are observed", ingress.active ? 1 : 0);
+    render_counter(&buf, "netrix_ingress_packets_total",
+                   "Inbound packets read from the observation queue", ingress.packets);
+    render_counter(&buf, "netrix_ingress_matched_total",
+                   "Inbound packets matched to a tracked flow", ingress.matched);
+    render_counter(&buf, "netrix_window_clamps_total",
+                   "SYN-ACKs returned with a clamped window", ingress.clamped);
+    render_counter(&buf, "netrix_rtt_samples_total",
+                   "SYN to SYN-ACK round trips measured", flows.rtt_samples);
+    render_gauge(&buf, "netrix_rtt_microseconds",
+                 "Smoothed SYN to SYN-ACK round trip", flows.srtt_us);
+    render_counter(&buf, "netrix_answer_samples_total",
+                   "Request to first server data latencies measured", flows.answer_samples);
+    render_gauge(&buf, "netrix_answer_latency_microseconds",
+                 "Smoothed request to first server data latency", flows.answer_us);
+    
+    // Per-app traffic is visible to every local app reading the listener
+    if (g_metrics.uid_series) {
+        render_uid_series(&buf);
+    }
+    
+    DecisionTraceStats trace;
+    decision_trace_get_stats(&trace);
+    
+    render_gauge(&buf, "netrix_trace_active",
+                 "1 if the pcapng decision trace is enabled", trace.active ? 1 : 0);
+    render_counter(&buf, "netrix_trace_records_total",
+                   "Packets written to the decision trace", trace.records);
+    render_counter(&buf, "netrix_trace_dropped_total",
+                   "Packets lost because the trace ring was full", trace.dropped);
+    render_counter(&buf, "netrix_trace_bytes_total",
+                   "Bytes written to decision trace files", trace.bytes);
+    
+    if (buf.failed) {
+        free(buf.data);
+        return NULL;
+    }
+    
+    if (out_len) *out_len = buf.len;
+    return buf.data;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Accept loop
+ */
+static void* metrics_thread_func(void* arg) {
+    (void)arg;
+    
+    while (g_metrics.running) {
+        int client_fd = accept(g_metrics.listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EINTR) continue;
+            if (!g_metrics.running) break;
+            LOGE("Metrics accept error: %s", strerror(errno));
+            continue;
+        }
+        
+        serve_client(client_fd);
+        close(client_fd);
+    }
+    
+    return NULL;
+}
+
+/**
+ * Answer one scrape request
+ */
+static void serve_client(int client_fd) {
+    struct timeval tv = { .tv_sec = CLIENT_TIMEOUT_SEC, .tv_usec = 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    
+    // Read request headers (content is ignored, every path serves metrics)
+    char request[REQUEST_BUFFER_SIZE];
+    size_t req_len = 0;
+    while (req_len < sizeof(request) - 1) {
+        ssize_t n = recv(client_fd, request + req_len, sizeof(request) - 1 - req_len, 0);
+        if (n <= 0) break;
+        req_len += (size_t)n;
+        request[req_len] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+    }
+    
+    size_t body_len = 0;
+    char* body = metrics_render(&body_len);
+    if (body == NULL) {
+        const char* err = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+        send(client_fd, err, strlen(err), MSG_NOSIGNAL);
+        return;
+    }
+    
+    char header[256];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.0 200 OK\r\n"
+                              "Content-Type: text/plain; version=0.0.4\r\n"
+                              "Content-Length: %zu\r\n"
+                              "Connection: close\r\n\r\n",
+                              body_len);
+    
+    if (send(client_fd, header, (size_t)header_len, MSG_NOSIGNAL) == header_len) {
+        size_t sent = 0;
+        while (sent < body_len) {
+            ssize_t n = send(client_fd, body + sent, body_len - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += (size_t)n;
+        }
+    }
+    
+    free(body);
+}
+
+/**
+ * Append formatted text, growing the buffer as needed
+ */
+static void buf_appendf(MetricsBuf* buf, const char* fmt, ...) {
+    if (buf->failed) return;
+    
+    for (;;) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+        va_end(args);
+        
+        if (n < 0) {
+            buf->failed = true;
+            return;
+        }
+        if ((size_t)n < buf->cap - buf->len) {
+            buf->len += (size_t)n;
+            return;
+        }
+        
+        size_t new_cap = buf->cap * 2;
+        while (new_cap - buf->len <= (size_t)n) new_cap *= 2;
+        char* grown = (char*)realloc(buf->data, new_cap);
+        if (grown == NULL) {
+            buf->failed = true;
+            return;
+        }
+        buf->data = grown;
+        buf->cap = new_cap;
+    }
+}
+
+static void render_counter(MetricsBuf* buf, const char* name, const char* help, uint64_t value) {
+    buf_appendf(buf, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                name, help, name, name, (unsigned long long)value);
+}
+
+static void render_gauge(MetricsBuf* buf, const char* name, const char* help, double value) {
+    buf_appendf(buf, "# HELP %s %s\n# TYPE %s gauge\n%s %.3f\n",
+                name, help, name, name, value);
+}
+
+/**
+ * Render a DPI_LATENCY_BUCKETS histogram as cumulative Prometheus buckets
+ */
+static void render_latency(MetricsBuf* buf, const char* name, const char* help,
+                           const uint64_t* hist, uint64_t sum_us) {
+    buf_appendf(buf, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    uint64_t count = 0;
+    for (int i = 0; i < DPI_LATENCY_BUCKETS; i++) {
+        count += hist[i];
+        if (i < DPI_LATENCY_BUCKETS - 1) {
+            buf_appendf(buf, "%s_bucket{le=\"%g\"} %llu\n", name,
+                        DPI_LATENCY_BOUND_US(i) / 1e6, (unsigned long long)count);
+        } else {
+            buf_appendf(buf, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)count);
+        }
+    }
+    buf_appendf(buf, "%s_sum %.6f\n%s_count %llu\n", name, sum_us / 1e6,
+                name, (unsigned long long)count);
+}
+
+/**
+ * Per-UID packet and bypass counters
+ */
+static void render_uid_series(MetricsBuf* buf) {
+    UidStatsEntry uids[METRICS_MAX_UIDS];
+    uint64_t uid_overflows = 0;
+    uint32_t uid_count = uid_stats_snapshot(uids, METRICS_MAX_UIDS, &uid_overflows);
+    
+    buf_appendf(buf, "# HELP netrix_uid_packets_total Queued packets by socket owner UID (-1 = unknown)\n");
+    buf_appendf(buf, "# TYPE netrix_uid_packets_total counter\n");
+    for (uint32_t i = 0; i < uid_count; i++) {
+        buf_appendf(buf, "netrix_uid_packets_total{uid=\"%d\"} %llu\n",
+                    (int)uids[i].uid, (unsigned long long)uids[i].packets);
+    }
+    buf_appendf(buf, "# HELP netrix_uid_bypassed_total Desynced packets by socket owner UID\n");
+    buf_appendf(buf, "# TYPE netrix_uid_bypassed_total counter\n");
+    for (uint32_t i = 0; i < uid_count; i++) {
+        buf_appendf(buf, "netrix_uid_bypassed_total{uid=\"%d\"} %llu\n",
+                    (int)uids[i].uid, (unsigned long long)uids[i].bypassed);
+    }
+    render_counter(buf, "netrix_uid_overflows_total",
+                   "Packets not counted per UID because the table was full", uid_overflows);
+}
@@ -0,0 +1,57 @@
+/**
+ * metrics_server.h
+ *
+ * Prometheus text-format exporter for DPI bypass statistics.
+ * Serves metrics over HTTP on a local Unix socket or a loopback TCP port,
+ * so lab devices can be scraped (e.g. through `adb forward`).
+ */
+
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Start metrics server in a background thread
+ * @param spec Listen address: "unix:/path/to/sock", "tcp:PORT" or "PORT".
+ *             TCP listeners are always bound to 127.0.0.1.
+ * @return 0 on success, -1 on error
+ */
+int metrics_server_start(const char* spec);
+
+/**
+ * Stop metrics server and join its thread
+ */
+void metrics_server_stop(void);
+
+/**
+ * Include per-UID series (netrix_uid_*) in the output
+ * Off by default: any local app can read the listener, and the series
+ * show which apps generate traffic.
+ * @param enable true to export them
+ */
+void metrics_server_set_uid_series(bool enable);
+
+/**
+ * Check if metrics server is running
+ * @return true if running
+ */
+bool metrics_server_is_running(void);
+
+/**
+ * Render all metrics in Prometheus text exposition format
+ * @param out_len Output: length of rendered text (may be NULL)
+ * @return Allocated NUL-terminated text (caller must free) or NULL on error
+ */
+char* metrics_render(size_t* out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_SERVER_H
@@ -0,0 +1,52 @@
+/**
+ * netrix_log.c
+ * 
+ * stderr logging backend (see netrix_log.h).
+ */
+
+#include "netrix_log.h"
+
+#include <stdarg.h>
+#include <time.h>
+
+static volatile NetrixLogLevel g_min_level = NETRIX_LOG_LEVEL_INFO;
+
+/**
+ * Set minimum level
+ */
+void netrix_log_set_level(NetrixLogLevel level) {
+    g_min_level = level;
+}
+
+/**
+ * Write log line: "HH:MM:SS.mmm I/Tag: message"
+ */
+void netrix_log_write(NetrixLogLevel level, const char* tag, const char* fmt, ...) {
+    static const char level_chars[] = "???DIWE";
+    
+    if (level < g_min_level) return;
+    
+    struct timespec ts;
+    struct tm tm;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    localtime_r(&ts.tv_sec, &tm);
+    
+    // One buffered write per line so concurrent threads don't interleave
+    char line[1024];
+    int len = snprintf(line, sizeof(line), "%02d:%02d:%02d.%03ld %c/%s: ",
+                       tm.tm_hour, tm.tm_min, tm.tm_sec, ts.tv_nsec / 1000000,
+                       level_chars[level <= NETRIX_LOG_LEVEL_ERROR ? level : 0], tag);
+    
+    va_list args;
+    va_start(args, fmt);
+    if (len >= 0 && len < (int)sizeof(line)) {
+        len += vsnprintf(line + len, sizeof(line) - len, fmt, args);
+    }
+    va_end(args);
+    
+    if (len < 0) return;
+    if (len > (int)sizeof(line) - 2) len = (int)sizeof(line) - 2;
+    line[len++] = '\n';
+    
+    fwrite(line, 1, len, stderr);
+}
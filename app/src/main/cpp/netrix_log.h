@@ -0,0 +1,83 @@
+/**
+ * netrix_log.h
+ * 
+ * Logging backend for the native core. Each source file defines LOG_TAG
+ * and includes this header to get LOGD/LOGI/LOGW/LOGE.
+ * 
+ * The backend is chosen at compile time:
+ *   NETRIX_LOG_ANDROID - logcat via __android_log_print (default on Android)
+ *   NETRIX_LOG_STDERR  - "I/Tag: message" lines on stderr (default elsewhere)
+ *   NETRIX_LOG_NULL    - compiled out, arguments are type-checked but never evaluated
+ */
+
+#ifndef NETRIX_LOG_H
+#define NETRIX_LOG_H
+
+#include <stdio.h>
+
+#ifndef LOG_TAG
+#define LOG_TAG "netrix"
+#endif
+
+#if !defined(NETRIX_LOG_ANDROID) && !defined(NETRIX_LOG_STDERR) && !defined(NETRIX_LOG_NULL)
+#ifdef __ANDROID__
+#define NETRIX_LOG_ANDROID
+#else
+#define NETRIX_LOG_STDERR
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Log levels (values match android_LogPriority)
+typedef enum {
+    NETRIX_LOG_LEVEL_DEBUG = 3,
+    NETRIX_LOG_LEVEL_INFO = 4,
+    NETRIX_LOG_LEVEL_WARN = 5,
+    NETRIX_LOG_LEVEL_ERROR = 6
+} NetrixLogLevel;
+
+/**
+ * Set minimum level written by the stderr backend (default: INFO)
+ * @param level Minimum level
+ */
+void netrix_log_set_level(NetrixLogLevel level);
+
+/**
+ * Write one log line to stderr (stderr backend)
+ * @param level Log level
+ * @param tag Module tag
+ * @param fmt printf format
+ */
+void netrix_log_write(NetrixLogLevel level, const char* tag, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(NETRIX_LOG_ANDROID)
+
+#include <android/log.h>
+#define NETRIX_LOG_PRINT(level, ...) __android_log_print((int)(level), LOG_TAG, __VA_ARGS__)
+
+#elif defined(NETRIX_LOG_STDERR)
+
+#define NETRIX_LOG_PRINT(level, ...) netrix_log_write((level), LOG_TAG, __VA_ARGS__)
+
+#else
+
+#define NETRIX_LOG_PRINT(level, ...) do { \
+    if (0) netrix_log_write((level), LOG_TAG, __VA_ARGS__); \
+} while (0)
+
+#endif
+
+#define LOGD(...) NETRIX_LOG_PRINT(NETRIX_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOGI(...) NETRIX_LOG_PRINT(NETRIX_LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOGW(...) NETRIX_LOG_PRINT(NETRIX_LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOGE(...) NETRIX_LOG_PRINT(NETRIX_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif // NETRIX_LOG_H
@@ -9,144 +9,308 @@
  */
 
 #include "nfqueue_handler.h"
+#include "ipv6.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <endian.h>
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>     // before linux/ headers: glibc and uapi both define in.h types
 #include <linux/netlink.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter/nfnetlink.h>
 #include <linux/netfilter/nfnetlink_queue.h>
 #include <arpa/inet.h>
 #include <pthread.h>
-
-#include <android/log.h>
+#include <time.h>
 
 #define LOG_TAG "NfqueueHandler"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#include "netrix_log.h"
 
 // Buffer sizes
 #define RECV_BUFFER_SIZE 65536
 #define SEND_BUFFER_SIZE 4096
 
+// recvfrom timeout: how often an idle queue checks for nfqueue_stop()
+#define RECV_WAKEUP_MS 200
+
+// How long a config request waits for the kernel's ACK
+#define CONFIG_ACK_TIMEOUT_MS 1000
+
+// Kernel timestamps further back than this are treated as bogus
+#define QUEUED_TIME_MAX_NS (10ULL * 1000000000ULL)
+
+// One verdict message: nlmsghdr + nfgenmsg + NFQA_VERDICT_HDR
+#define VERDICT_MSG_SIZE (NLMSG_ALIGN(sizeof(struct nlmsghdr)) + \
+                          NLMSG_ALIGN(sizeof(struct nfgenmsg)) + \
+                          NFA_ALIGN_SIZE(sizeof(struct nlattr) + sizeof(struct nfqnl_msg_verdict_hdr)))
+
+// Queue defaults
+#define DEFAULT_RCVBUF_SIZE (1024 * 1024)
+#define DEFAULT_QUEUE_MAXLEN 1024
+#define PROC_NFQUEUE_PATH "/proc/net/netfilter/nfnetlink_queue"
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+#ifndef NETLINK_NO_ENOBUFS
+#define NETLINK_NO_ENOBUFS 5
+#endif
+
 // Netlink message alignment
 #define NLMSG_ALIGN_SIZE(len) (((len) + NLMSG_ALIGNTO - 1) & ~(NLMSG_ALIGNTO - 1))
 #define NFA_ALIGN_SIZE(len) (((len) + NFA_ALIGNTO - 1) & ~(NFA_ALIGNTO - 1))
 #define NFA_ALIGNTO 4
 
-// Global state
-static struct {
+// Config request waiting for its ACK (lives on the sender's stack)
+typedef struct AckWaiter {
+    uint32_t seq;
+    bool done;
+    int error;                     // Negative errno from NLMSG_ERROR, 0 = ACK
+    struct AckWaiter* next;
+} AckWaiter;
+
+// One bound queue and the netlink socket it is read from
+typedef struct {
     int nl_socket;
     uint16_t queue_num;
+    volatile bool looping;         // nfqueue_start_queue() owns the socket
+    volatile uint64_t recv_enobufs;
+    volatile uint64_t recv_errors;
+    pthread_mutex_t ack_read_lock; // One reader of ack_buffer at a time
+    uint8_t recv_buffer[RECV_BUFFER_SIZE];
+    uint8_t ack_buffer[RECV_BUFFER_SIZE];
+    uint8_t send_buffer[SEND_BUFFER_SIZE];
+    NfqueuePacket batch[NFQUEUE_MAX_BATCH];
+    NfqueueVerdict batch_verdicts[NFQUEUE_MAX_BATCH];
+    uint8_t batch_send_buffer[NFQUEUE_MAX_BATCH * VERDICT_MSG_SIZE];
+} NfqueueQueue;
+
+// First queue; static so nfqueue_get_recv_buffer() works before init
+static NfqueueQueue g_first_queue = {
+    .nl_socket = -1,
+    .queue_num = 0,
+    .looping = false,
+    .ack_read_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Global state
+static struct {
+    NfqueueQueue* queues[NFQUEUE_MAX_QUEUES];  // [0] = g_first_queue, the rest allocated
+    uint16_t queue_count;          // Bound queues (0 = not initialized)
     volatile bool running;
     nfqueue_callback_t callback;
     void* user_data;
+    nfqueue_batch_callback_t batch_callback;
+    void* batch_user_data;
     char error_msg[256];
     pthread_mutex_t lock;
-    uint8_t recv_buffer[RECV_BUFFER_SIZE];
-    uint8_t send_buffer[SEND_BUFFER_SIZE];
+    NfqueueConfig config;
+    volatile bool fail_open;
+    pthread_mutex_t ack_lock;      // Guards config_seq and ack_waiters
+    pthread_cond_t ack_cond;       // CLOCK_MONOTONIC, see init_ack_cond()
+    uint32_t config_seq;           // Sequence of the last config request
+    AckWaiter* ack_waiters;        // Requests still waiting for their ACK
 } g_nfq = {
-    .nl_socket = -1,
-    .queue_num = 0,
+    .queues = { NULL },
+    .queue_count = 0,
     .running = false,
     .callback = NULL,
     .user_data = NULL,
+    .batch_callback = NULL,
+    .batch_user_data = NULL,
     .error_msg = "",
-    .lock = PTHREAD_MUTEX_INITIALIZER
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .config = {
+        .rcvbuf_size = DEFAULT_RCVBUF_SIZE,
+        .queue_maxlen = DEFAULT_QUEUE_MAXLEN,
+        .fail_open = true,
+        .uid_gid = false
+    },
+    .fail_open = false,
+    .ack_lock = PTHREAD_MUTEX_INITIALIZER,
+    .ack_cond = PTHREAD_COND_INITIALIZER,
+    .config_seq = 0,
+    .ack_waiters = NULL
 };
 
+// Queue serviced by the calling thread (NULL outside nfqueue_start_queue)
+static __thread NfqueueQueue* t_queue = NULL;
+
 // Forward declarations
-static int send_config_cmd(uint8_t cmd, uint16_t queue_num, uint16_t pf);
-static int set_queue_mode(uint16_t queue_num, uint8_t mode, uint32_t range);
+static int open_queue(NfqueueQueue* q, uint16_t queue_num, bool first);
+static void close_queues(void);
+static int send_config_cmd(NfqueueQueue* q, uint8_t cmd, uint16_t queue_num, uint16_t pf);
+static int set_queue_mode(NfqueueQueue* q, uint8_t mode, uint32_t range);
+static int set_queue_u32_attrs(NfqueueQueue* q, uint16_t type1, uint32_t value1,
+                               uint16_t type2, uint32_t value2, int count);
+static int send_config_request(NfqueueQueue* q, struct nlmsghdr* nlh, const char* what);
+static void init_ack_cond(void);
+static int read_config_ack(NfqueueQueue* q, AckWaiter* waiter, const struct timespec* deadline);
+static void handle_config_ack(struct nlmsghdr* nlh);
 static int parse_packet(struct nlmsghdr* nlh, NfqueuePacket* pkt);
-static int send_verdict(uint32_t packet_id, uint32_t verdict, uint8_t* payload, uint32_t len);
+static int send_verdict(NfqueueQueue* q, uint32_t packet_id, uint32_t verdict,
+                        uint8_t* payload, uint32_t len);
+static void fill_verdict_msg(NfqueueQueue* q, uint8_t* buf, uint32_t packet_id, uint32_t verdict);
+static void flush_batch(NfqueueQueue* q, uint32_t count);
 
 /**
  * Initialize NFQUEUE handler
  */
 int nfqueue_init(uint16_t queue_num) {
+    return nfqueue_init_fanout(queue_num, 1);
+}
+
+/**
+ * Initialize NFQUEUE handler on a range of queues
+ */
+int nfqueue_init_fanout(uint16_t first_queue, uint16_t count) {
     pthread_mutex_lock(&g_nfq.lock);
     
-    if (g_nfq.nl_socket >= 0) {
+    if (g_nfq.queue_count > 0) {
         snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg), "Already initialized");
         pthread_mutex_unlock(&g_nfq.lock);
         return -1;
     }
     
-    g_nfq.queue_num = queue_num;
-    
-    // Create netlink socket
-    g_nfq.nl_socket = socket(AF_NETLINK, SOCK_RAW, NETLINK_NETFILTER);
-    if (g_nfq.nl_socket < 0) {
-        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg), 
-                 "Failed to create netlink socket: %s", strerror(errno));
+    if (count == 0 || count > NFQUEUE_MAX_QUEUES || first_queue + count - 1 > 0xFFFF) {
+        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
+                 "Invalid queue range %u+%u", first_queue, count);
         pthread_mutex_unlock(&g_nfq.lock);
         return -1;
     }
     
-    // Set socket buffer sizes
-    int bufsize = RECV_BUFFER_SIZE;
-    setsockopt(g_nfq.nl_socket, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
-    setsockopt(g_nfq.nl_socket, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    g_nfq.fail_open = g_nfq.config.fail_open;
+    for (uint16_t i = 0; i < count; i++) {
+        NfqueueQueue* q = &g_first_queue;
+        if (i > 0) {
+            q = calloc(1, sizeof(*q));
+            if (q == NULL) {
+                snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg), "Out of memory");
+                close_queues();
+                pthread_mutex_unlock(&g_nfq.lock);
+                return -1;
+            }
+            q->nl_socket = -1;
+            pthread_mutex_init(&q->ack_read_lock, NULL);
+        }
+        g_nfq.queues[i] = q;
+        g_nfq.queue_count = i + 1;
+        
+        if (open_queue(q, (uint16_t)(first_queue + i), i == 0) < 0) {
+            close_queues();
+            pthread_mutex_unlock(&g_nfq.lock);
+            return -1;
+        }
+    }
     
-    // Bind to netlink
-    struct sockaddr_nl addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.nl_family = AF_NETLINK;
-    addr.nl_pid = getpid();
-    addr.nl_groups = 0;
+    char queues[16];
+    snprintf(queues, sizeof(queues), count > 1 ? "%u-%u" : "%u",
+             first_queue, first_queue + count - 1);
+    LOGI("NFQUEUE initialized: queue=%s, rcvbuf=%u, maxlen=%u, fail_open=%d, uid_gid=%d",
+         queues, g_nfq.config.rcvbuf_size, g_nfq.config.queue_maxlen,
+         g_nfq.fail_open, g_nfq.config.uid_gid);
+    pthread_mutex_unlock(&g_nfq.lock);
+    return 0;
+}
+
+/**
+ * Number of bound queues
+ */
+uint16_t nfqueue_queue_count(void) {
+    return g_nfq.queue_count;
+}
+
+/**
+ * Set queue configuration
+ */
+void nfqueue_set_config(const NfqueueConfig* config) {
+    pthread_mutex_lock(&g_nfq.lock);
+    if (config != NULL) {
+        g_nfq.config = *config;
+    } else {
+        g_nfq.config.rcvbuf_size = DEFAULT_RCVBUF_SIZE;
+        g_nfq.config.queue_maxlen = DEFAULT_QUEUE_MAXLEN;
+        g_nfq.config.fail_open = true;
+        g_nfq.config.uid_gid = false;
+    }
+    pthread_mutex_unlock(&g_nfq.lock);
+}
+
+/**
+ * Get queue configuration
+ */
+void nfqueue_get_config(NfqueueConfig* config) {
+    if (config == NULL) return;
+    pthread_mutex_lock(&g_nfq.lock);
+    *config = g_nfq.config;
+    pthread_mutex_unlock(&g_nfq.lock);
+}
+
+/**
+ * Toggle fail-open on the running queue
+ */
+int nfqueue_set_fail_open(bool enable) {
+    if (g_nfq.queue_count == 0) return -1;
     
-    if (bind(g_nfq.nl_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
-                 "Failed to bind netlink socket: %s", strerror(errno));
-        close(g_nfq.nl_socket);
-        g_nfq.nl_socket = -1;
-        pthread_mutex_unlock(&g_nfq.lock);
-        return -1;
+    int result = 0;
+    for (uint16_t i = 0; i < g_nfq.queue_count; i++) {
+        if (set_queue_u32_attrs(g_nfq.queues[i],
+                                NFQA_CFG_FLAGS, enable ? NFQA_CFG_F_FAIL_OPEN : 0,
+                                NFQA_CFG_MASK, NFQA_CFG_F_FAIL_OPEN, 2) < 0) {
+            result = -1;
+        }
     }
+    if (result < 0) return -1;
     
-    // Unbind from PF_INET (if bound)
-    send_config_cmd(NFQNL_CFG_CMD_PF_UNBIND, 0, PF_INET);
+    g_nfq.fail_open = enable;
+    LOGI("NFQUEUE fail-open %s", enable ? "enabled" : "disabled");
+    return 0;
+}
+
+/**
+ * Sample kernel queue counters
+ */
+int nfqueue_get_queue_stats(NfqueueQueueStats* stats) {
+    if (stats == NULL) return -1;
     
-    // Bind to PF_INET
-    if (send_config_cmd(NFQNL_CFG_CMD_PF_BIND, 0, PF_INET) < 0) {
-        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
-                 "Failed to bind to PF_INET");
-        close(g_nfq.nl_socket);
-        g_nfq.nl_socket = -1;
-        pthread_mutex_unlock(&g_nfq.lock);
-        return -1;
-    }
+    memset(stats, 0, sizeof(*stats));
+    stats->fail_open = g_nfq.fail_open;
     
-    // Bind to queue
-    if (send_config_cmd(NFQNL_CFG_CMD_BIND, queue_num, 0) < 0) {
-        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
-                 "Failed to bind to queue %d", queue_num);
-        close(g_nfq.nl_socket);
-        g_nfq.nl_socket = -1;
-        pthread_mutex_unlock(&g_nfq.lock);
-        return -1;
+    uint16_t count = g_nfq.queue_count;
+    if (count == 0) return -1;
+    uint16_t first = g_nfq.queues[0]->queue_num;
+    for (uint16_t i = 0; i < count; i++) {
+        stats->recv_enobufs += g_nfq.queues[i]->recv_enobufs;
+        stats->recv_errors += g_nfq.queues[i]->recv_errors;
     }
     
-    // Set copy mode (copy entire packet)
-    if (set_queue_mode(queue_num, NFQNL_COPY_PACKET, 0xFFFF) < 0) {
-        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
-                 "Failed to set queue mode");
-        send_config_cmd(NFQNL_CFG_CMD_UNBIND, queue_num, 0);
-        close(g_nfq.nl_socket);
-        g_nfq.nl_socket = -1;
-        pthread_mutex_unlock(&g_nfq.lock);
-        return -1;
+    FILE* f = fopen(PROC_NFQUEUE_PATH, "r");
+    if (f == NULL) return -1;
+    
+    // Format: queue peer_portid queue_total copy_mode copy_range
+    //         queue_dropped user_dropped id_sequence 1
+    int found = -1;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned int queue, portid, total, mode, range, qdrop, udrop, seq;
+        if (sscanf(line, "%u %u %u %u %u %u %u %u",
+                   &queue, &portid, &total, &mode, &range, &qdrop, &udrop, &seq) == 8 &&
+            queue >= first && queue < (unsigned int)first + count) {
+            stats->queue_total += total;
+            stats->queue_dropped += qdrop;
+            stats->user_dropped += udrop;
+            if (queue == first) stats->id_sequence = seq;
+            found = 0;
+        }
     }
     
-    LOGI("NFQUEUE initialized: queue=%d", queue_num);
-    pthread_mutex_unlock(&g_nfq.lock);
-    return 0;
+    fclose(f);
+    return found;
 }
 
 /**
@@ -159,23 +323,44 @@ void nfqueue_set_callback(nfqueue_callback_t callback, void* user_data) {
     pthread_mutex_unlock(&g_nfq.lock);
 }
 
+/**
+ * Set batch callback
+ */
+void nfqueue_set_batch_callback(nfqueue_batch_callback_t callback, void* user_data) {
+    pthread_mutex_lock(&g_nfq.lock);
+    g_nfq.batch_callback = callback;
+    g_nfq.batch_user_data = user_data;
+    pthread_mutex_unlock(&g_nfq.lock);
+}
+
 /**
  * Start processing packets
  */
 int nfqueue_start(void) {
-    if (g_nfq.nl_socket < 0) {
-        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg), "Not initialized");
+    return nfqueue_start_queue(0);
+}
+
+/**
+ * Process packets of one bound queue
+ */
+int nfqueue_start_queue(uint16_t index) {
+    if (index >= g_nfq.queue_count) {
+        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
+                 g_nfq.queue_count == 0 ? "Not initialized" : "No such queue");
         return -1;
     }
     
+    NfqueueQueue* q = g_nfq.queues[index];
+    t_queue = q;
     g_nfq.running = true;
-    LOGI("NFQUEUE started");
+    q->looping = true;
+    LOGI("NFQUEUE started (queue %u)", q->queue_num);
     
     struct sockaddr_nl peer;
     socklen_t peer_len = sizeof(peer);
     
     while (g_nfq.running) {
-        ssize_t len = recvfrom(g_nfq.nl_socket, g_nfq.recv_buffer, 
+        ssize_t len = recvfrom(q->nl_socket, q->recv_buffer, 
                                RECV_BUFFER_SIZE, 0,
                                (struct sockaddr*)&peer, &peer_len);
         
@@ -184,26 +369,67 @@ int nfqueue_start(void) {
                 continue;
             }
             if (!g_nfq.running) break;
+            if (errno == ENOBUFS) {
+                // Receive buffer overrun: packets were lost, keep going
+                q->recv_enobufs++;
+                continue;
+            }
+            q->recv_errors++;
             LOGE("recvfrom error: %s", strerror(errno));
             continue;
         }
         
         if (len == 0) continue;
         
+        // One timestamp per read: packets later in the batch accumulate lag
+        struct timespec ts, rt;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        clock_gettime(CLOCK_REALTIME, &rt);
+        uint64_t recv_time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+        uint64_t realtime_ns = (uint64_t)rt.tv_sec * 1000000000ULL + (uint64_t)rt.tv_nsec;
+        
+        // Packets this read returned: the part of the kernel backlog the
+        // reader sees without waiting for the next queue_health sample
+        uint32_t recv_batch = 0;
+        struct nlmsghdr* nlh = (struct nlmsghdr*)q->recv_buffer;
+        for (ssize_t left = len; NLMSG_OK(nlh, left); nlh = NLMSG_NEXT(nlh, left)) {
+            if ((nlh->nlmsg_type & 0xFF) == NFNL_SUBSYS_QUEUE) recv_batch++;
+        }
+        
         // Process netlink messages
-        struct nlmsghdr* nlh = (struct nlmsghdr*)g_nfq.recv_buffer;
+        nlh = (struct nlmsghdr*)q->recv_buffer;
+        bool batch_mode = (g_nfq.batch_callback != NULL);
+        uint32_t batch_count = 0;
         
         while (NLMSG_OK(nlh, len)) {
             if (nlh->nlmsg_type == NLMSG_ERROR) {
-                struct nlmsgerr* err = (struct nlmsgerr*)NLMSG_DATA(nlh);
-                if (err->error != 0) {
-                    LOGE("Netlink error: %d", err->error);
-                }
+                handle_config_ack(nlh);
             } else if ((nlh->nlmsg_type & 0xFF) == NFNL_SUBSYS_QUEUE) {
                 NfqueuePacket pkt;
                 memset(&pkt, 0, sizeof(pkt));
+                pkt.recv_time_ns = recv_time_ns;
+                pkt.recv_batch = recv_batch;
+                int parsed = parse_packet(nlh, &pkt);
                 
-                if (parse_packet(nlh, &pkt) == 0) {
+                // parse_packet leaves the kernel's wall-clock stamp; move it
+                // to the monotonic clock and drop implausible values
+                if (pkt.queued_time_ns != 0) {
+                    uint64_t waited_ns = realtime_ns - pkt.queued_time_ns;
+                    bool plausible = pkt.queued_time_ns <= realtime_ns &&
+                                     waited_ns <= QUEUED_TIME_MAX_NS && waited_ns < recv_time_ns;
+                    pkt.queued_time_ns = plausible ? recv_time_ns - waited_ns : 0;
+                }
+                
+                if (batch_mode) {
+                    // Payloads point into recv_buffer, valid until the next recvfrom
+                    if (parsed == 0) {
+                        q->batch[batch_count++] = pkt;
+                        if (batch_count == NFQUEUE_MAX_BATCH) {
+                            flush_batch(q, batch_count);
+                            batch_count = 0;
+                        }
+                    }
+                } else if (parsed == 0) {
                     NfqueueVerdict verdict = NFQUEUE_ACCEPT;
                     
                     if (g_nfq.callback) {
@@ -211,16 +437,21 @@ int nfqueue_start(void) {
                     }
                     
                     if (verdict != NFQUEUE_STOLEN) {
-                        send_verdict(pkt.packet_id, verdict, NULL, 0);
+                        send_verdict(q, pkt.packet_id, verdict, NULL, 0);
                     }
                 }
             }
             
             nlh = NLMSG_NEXT(nlh, len);
         }
+        
+        if (batch_count > 0) {
+            flush_batch(q, batch_count);
+        }
     }
     
-    LOGI("NFQUEUE stopped");
+    q->looping = false;
+    LOGI("NFQUEUE stopped (queue %u)", q->queue_num);
     return 0;
 }
 
@@ -231,8 +462,10 @@ void nfqueue_stop(void) {
     g_nfq.running = false;
     
     // Wake up blocked recvfrom by sending empty message to self
-    if (g_nfq.nl_socket >= 0) {
-        shutdown(g_nfq.nl_socket, SHUT_RDWR);
+    for (uint16_t i = 0; i < g_nfq.queue_count; i++) {
+        if (g_nfq.queues[i]->nl_socket >= 0) {
+            shutdown(g_nfq.queues[i]->nl_socket, SHUT_RDWR);
+        }
     }
 }
 
@@ -243,15 +476,12 @@ void nfqueue_cleanup(void) {
     pthread_mutex_lock(&g_nfq.lock);
     
     nfqueue_stop();
-    
-    if (g_nfq.nl_socket >= 0) {
-        send_config_cmd(NFQNL_CFG_CMD_UNBIND, g_nfq.queue_num, 0);
-        close(g_nfq.nl_socket);
-        g_nfq.nl_socket = -1;
-    }
+    close_queues();
     
     g_nfq.callback = NULL;
     g_nfq.user_data = NULL;
+    g_nfq.batch_callback = NULL;
+    g_nfq.batch_user_data = NULL;
     
     LOGI("NFQUEUE cleaned up");
     pthread_mutex_unlock(&g_nfq.lock);
@@ -269,7 +499,9 @@ bool nfqueue_is_running(void) {
  */
 int nfqueue_set_verdict_manual(uint32_t packet_id, NfqueueVerdict verdict,
                                uint8_t* modified_payload, uint32_t modified_len) {
-    return send_verdict(packet_id, verdict, modified_payload, modified_len);
+    NfqueueQueue* q = t_queue != NULL ? t_queue : g_nfq.queues[0];
+    if (q == NULL) return -1;
+    return send_verdict(q, packet_id, verdict, modified_payload, modified_len);
 }
 
 /**
@@ -279,14 +511,162 @@ const char* nfqueue_get_error(void) {
     return g_nfq.error_msg;
 }
 
+/**
+ * Get receive buffer
+ */
+uint8_t* nfqueue_get_recv_buffer(size_t* size) {
+    if (size != NULL) *size = RECV_BUFFER_SIZE;
+    return g_first_queue.recv_buffer;
+}
+
 // ============================================================================
 // Internal functions
 // ============================================================================
 
+/**
+ * Open a netlink socket and bind it to one queue (called with g_nfq.lock
+ * held). The first queue also binds the protocol families. On failure the
+ * socket is closed and error_msg is set
+ */
+static int open_queue(NfqueueQueue* q, uint16_t queue_num, bool first) {
+    q->queue_num = queue_num;
+    
+    // Create netlink socket
+    q->nl_socket = socket(AF_NETLINK, SOCK_RAW, NETLINK_NETFILTER);
+    if (q->nl_socket < 0) {
+        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg), 
+                 "Failed to create netlink socket: %s", strerror(errno));
+        return -1;
+    }
+    
+    // Set socket buffer sizes (SO_RCVBUFFORCE ignores rmem_max, needs CAP_NET_ADMIN)
+    int bufsize = RECV_BUFFER_SIZE;
+    int rcvbuf = g_nfq.config.rcvbuf_size > 0 ? (int)g_nfq.config.rcvbuf_size : RECV_BUFFER_SIZE;
+    if (setsockopt(q->nl_socket, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        setsockopt(q->nl_socket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    setsockopt(q->nl_socket, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    
+    // shutdown() does not wake a netlink recvfrom, so poll the running flag
+    // on an idle queue or nfqueue_stop() would wait for the next packet
+    struct timeval tv = { .tv_sec = 0, .tv_usec = RECV_WAKEUP_MS * 1000 };
+    setsockopt(q->nl_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    
+    // Don't report receive buffer overruns as ENOBUFS errors; overruns show
+    // up as user_dropped in /proc and the queue keeps running
+    int one = 1;
+    if (setsockopt(q->nl_socket, SOL_NETLINK, NETLINK_NO_ENOBUFS, &one, sizeof(one)) < 0) {
+        LOGD("NETLINK_NO_ENOBUFS not supported: %s", strerror(errno));
+    }
+    q->recv_enobufs = 0;
+    q->recv_errors = 0;
+    
+    // Bind to netlink (further queues get a kernel-assigned port id)
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_pid = first ? (uint32_t)getpid() : 0;
+    addr.nl_groups = 0;
+    
+    if (bind(q->nl_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
+                 "Failed to bind netlink socket: %s", strerror(errno));
+        close(q->nl_socket);
+        q->nl_socket = -1;
+        return -1;
+    }
+    
+    if (first) {
+        // Unbind from PF_INET (if bound)
+        send_config_cmd(q, NFQNL_CFG_CMD_PF_UNBIND, 0, PF_INET);
+        
+        // Bind to PF_INET
+        if (send_config_cmd(q, NFQNL_CFG_CMD_PF_BIND, 0, PF_INET) < 0) {
+            snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
+                     "Failed to bind to PF_INET");
+            close(q->nl_socket);
+            q->nl_socket = -1;
+            return -1;
+        }
+        
+        // Same for PF_INET6; without it only IPv4 rules can feed the queue
+        send_config_cmd(q, NFQNL_CFG_CMD_PF_UNBIND, 0, PF_INET6);
+        if (send_config_cmd(q, NFQNL_CFG_CMD_PF_BIND, 0, PF_INET6) < 0) {
+            LOGW("Failed to bind to PF_INET6, IPv6 packets will not be queued");
+        }
+    }
+    
+    // Bind to queue
+    if (send_config_cmd(q, NFQNL_CFG_CMD_BIND, queue_num, 0) < 0) {
+        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
+                 "Failed to bind to queue %d", queue_num);
+        close(q->nl_socket);
+        q->nl_socket = -1;
+        return -1;
+    }
+    
+    // Set copy mode (copy entire packet)
+    if (set_queue_mode(q, NFQNL_COPY_PACKET, 0xFFFF) < 0) {
+        snprintf(g_nfq.error_msg, sizeof(g_nfq.error_msg),
+                 "Failed to set queue mode");
+        send_config_cmd(q, NFQNL_CFG_CMD_UNBIND, queue_num, 0);
+        close(q->nl_socket);
+        q->nl_socket = -1;
+        return -1;
+    }
+    
+    // Queue length (not fatal: older kernels may reject it)
+    if (g_nfq.config.queue_maxlen > 0) {
+        if (set_queue_u32_attrs(q, NFQA_CFG_QUEUE_MAXLEN, g_nfq.config.queue_maxlen,
+                                0, 0, 1) < 0) {
+            LOGE("Failed to set queue maxlen %u", g_nfq.config.queue_maxlen);
+        }
+    }
+    
+    // Fail-open: accept instead of drop when the queue overflows
+    if (g_nfq.config.fail_open) {
+        if (set_queue_u32_attrs(q, NFQA_CFG_FLAGS, NFQA_CFG_F_FAIL_OPEN,
+                                NFQA_CFG_MASK, NFQA_CFG_F_FAIL_OPEN, 2) < 0) {
+            g_nfq.fail_open = false;
+        }
+    }
+    
+    // Socket owner UID/GID (3.15+; older kernels reject the flag and send no UID)
+    if (g_nfq.config.uid_gid) {
+        if (set_queue_u32_attrs(q, NFQA_CFG_FLAGS, NFQA_CFG_F_UID_GID,
+                                NFQA_CFG_MASK, NFQA_CFG_F_UID_GID, 2) < 0) {
+            LOGE("Failed to request socket owner UID/GID");
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * Unbind and close every queue, freeing all but the first (called with
+ * g_nfq.lock held)
+ */
+static void close_queues(void) {
+    for (uint16_t i = 0; i < g_nfq.queue_count; i++) {
+        NfqueueQueue* q = g_nfq.queues[i];
+        if (q->nl_socket >= 0) {
+            send_config_cmd(q, NFQNL_CFG_CMD_UNBIND, q->queue_num, 0);
+            close(q->nl_socket);
+            q->nl_socket = -1;
+        }
+        if (q != &g_first_queue) {
+            pthread_mutex_destroy(&q->ack_read_lock);
+            free(q);
+        }
+        g_nfq.queues[i] = NULL;
+    }
+    g_nfq.queue_count = 0;
+}
+
 /**
  * Send config command
  */
-static int send_config_cmd(uint8_t cmd, uint16_t queue_num, uint16_t pf) {
+static int send_config_cmd(NfqueueQueue* q, uint8_t cmd, uint16_t queue_num, uint16_t pf) {
     struct {
         struct nlmsghdr nlh;
         struct nfgenmsg nfg;
@@ -299,7 +679,6 @@ static int send_config_cmd(uint8_t cmd, uint16_t queue_num, uint16_t pf) {
     req.nlh.nlmsg_len = sizeof(req);
     req.nlh.nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_CONFIG;
     req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-    req.nlh.nlmsg_seq = 0;
     req.nlh.nlmsg_pid = getpid();
     
     req.nfg.nfgen_family = AF_UNSPEC;
@@ -312,23 +691,13 @@ static int send_config_cmd(uint8_t cmd, uint16_t queue_num, uint16_t pf) {
     req.cfg_cmd.command = cmd;
     req.cfg_cmd.pf = htons(pf);
     
-    struct sockaddr_nl peer;
-    memset(&peer, 0, sizeof(peer));
-    peer.nl_family = AF_NETLINK;
-    
-    if (sendto(g_nfq.nl_socket, &req, sizeof(req), 0,
-               (struct sockaddr*)&peer, sizeof(peer)) < 0) {
-        LOGE("sendto config cmd failed: %s", strerror(errno));
-        return -1;
-    }
-    
-    return 0;
+    return send_config_request(q, &req.nlh, "config cmd");
 }
 
 /**
  * Set queue mode
  */
-static int set_queue_mode(uint16_t queue_num, uint8_t mode, uint32_t range) {
+static int set_queue_mode(NfqueueQueue* q, uint8_t mode, uint32_t range) {
     struct {
         struct nlmsghdr nlh;
         struct nfgenmsg nfg;
@@ -341,12 +710,11 @@ static int set_queue_mode(uint16_t queue_num, uint8_t mode, uint32_t range) {
     req.nlh.nlmsg_len = sizeof(req);
     req.nlh.nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_CONFIG;
     req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-    req.nlh.nlmsg_seq = 0;
     req.nlh.nlmsg_pid = getpid();
     
     req.nfg.nfgen_family = AF_UNSPEC;
     req.nfg.version = NFNETLINK_V0;
-    req.nfg.res_id = htons(queue_num);
+    req.nfg.res_id = htons(q->queue_num);
     
     req.attr.nla_len = sizeof(req.attr) + sizeof(req.params);
     req.attr.nla_type = NFQA_CFG_PARAMS;
@@ -354,17 +722,207 @@ static int set_queue_mode(uint16_t queue_num, uint8_t mode, uint32_t range) {
     req.params.copy_mode = mode;
     req.params.copy_range = htonl(range);
     
+    return send_config_request(q, &req.nlh, "queue mode");
+}
+
+/**
+ * Send one or two u32 config attributes (big-endian payload)
+ */
+static int set_queue_u32_attrs(NfqueueQueue* q, uint16_t type1, uint32_t value1,
+                               uint16_t type2, uint32_t value2, int count) {
+    struct {
+        struct nlmsghdr nlh;
+        struct nfgenmsg nfg;
+        struct {
+            struct nlattr attr;
+            uint32_t value;
+        } attrs[2];
+    } req;
+    
+    memset(&req, 0, sizeof(req));
+    
+    req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.nfg) + count * sizeof(req.attrs[0]));
+    req.nlh.nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_CONFIG;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    req.nlh.nlmsg_pid = getpid();
+    
+    req.nfg.nfgen_family = AF_UNSPEC;
+    req.nfg.version = NFNETLINK_V0;
+    req.nfg.res_id = htons(q->queue_num);
+    
+    req.attrs[0].attr.nla_len = sizeof(req.attrs[0]);
+    req.attrs[0].attr.nla_type = type1;
+    req.attrs[0].value = htonl(value1);
+    
+    if (count > 1) {
+        req.attrs[1].attr.nla_len = sizeof(req.attrs[1]);
+        req.attrs[1].attr.nla_type = type2;
+        req.attrs[1].value = htonl(value2);
+    }
+    
+    return send_config_request(q, &req.nlh, "queue config");
+}
+
+/**
+ * Send a config request on a queue's socket and wait for its ACK. While
+ * the queue's packet loop runs, it owns the socket and hands the ACK over;
+ * otherwise it is read here. Returns 0 only if the kernel accepted the
+ * request
+ */
+static int send_config_request(NfqueueQueue* q, struct nlmsghdr* nlh, const char* what) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, init_ack_cond);
+    
+    AckWaiter waiter;
+    memset(&waiter, 0, sizeof(waiter));
+    
+    pthread_mutex_lock(&g_nfq.ack_lock);
+    if (++g_nfq.config_seq == 0) g_nfq.config_seq = 1;  // 0 = verdicts
+    waiter.seq = g_nfq.config_seq;
+    waiter.next = g_nfq.ack_waiters;
+    g_nfq.ack_waiters = &waiter;
+    pthread_mutex_unlock(&g_nfq.ack_lock);
+    nlh->nlmsg_seq = waiter.seq;
+    
     struct sockaddr_nl peer;
     memset(&peer, 0, sizeof(peer));
     peer.nl_family = AF_NETLINK;
     
-    if (sendto(g_nfq.nl_socket, &req, sizeof(req), 0,
+    int error = 0;
+    if (sendto(q->nl_socket, nlh, nlh->nlmsg_len, 0,
                (struct sockaddr*)&peer, sizeof(peer)) < 0) {
-        LOGE("sendto queue mode failed: %s", strerror(errno));
-        return -1;
+        error = -errno;
+        LOGE("sendto %s failed: %s", what, strerror(errno));
+    } else {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += CONFIG_ACK_TIMEOUT_MS / 1000;
+        deadline.tv_nsec += (long)(CONFIG_ACK_TIMEOUT_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        
+        if (q->looping) {
+            pthread_mutex_lock(&g_nfq.ack_lock);
+            while (!waiter.done && q->looping && g_nfq.running) {
+                if (pthread_cond_timedwait(&g_nfq.ack_cond, &g_nfq.ack_lock, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+            error = waiter.done ? waiter.error : -ETIMEDOUT;
+            pthread_mutex_unlock(&g_nfq.ack_lock);
+        } else {
+            error = read_config_ack(q, &waiter, &deadline);
+        }
+        
+        if (error != 0) {
+            LOGE("%s rejected: %s", what, strerror(-error));
+        }
     }
     
-    return 0;
+    pthread_mutex_lock(&g_nfq.ack_lock);
+    for (AckWaiter** link = &g_nfq.ack_waiters; *link != NULL; link = &(*link)->next) {
+        if (*link == &waiter) {
+            *link = waiter.next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_nfq.ack_lock);
+    
+    return error == 0 ? 0 : -1;
+}
+
+/**
+ * ACK deadlines are CLOCK_MONOTONIC so wall clock changes don't move them
+ */
+static void init_ack_cond(void) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_destroy(&g_nfq.ack_cond);
+    pthread_cond_init(&g_nfq.ack_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Read the socket until the waiter's ACK arrives or the deadline passes
+ * (packet loop not running). ACKs for other requests are handed to their
+ * senders; packets queued in the meantime are accepted so they don't sit
+ * in the queue
+ */
+static int read_config_ack(NfqueueQueue* q, AckWaiter* waiter, const struct timespec* deadline) {
+    for (;;) {
+        pthread_mutex_lock(&g_nfq.ack_lock);
+        bool done = waiter->done;
+        pthread_mutex_unlock(&g_nfq.ack_lock);
+        if (done) return waiter->error;
+        
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline->tv_sec ||
+            (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec)) {
+            return -ETIMEDOUT;
+        }
+        
+        // Another sender may be reading; it delivers our ACK if it sees it
+        pthread_mutex_lock(&q->ack_read_lock);
+        ssize_t len = recv(q->nl_socket, q->ack_buffer, RECV_BUFFER_SIZE, 0);
+        
+        if (len < 0) {
+            int err = errno;
+            pthread_mutex_unlock(&q->ack_read_lock);
+            if (err == EINTR || err == EAGAIN || err == ENOBUFS) continue;
+            return -err;
+        }
+        if (len == 0) {
+            pthread_mutex_unlock(&q->ack_read_lock);
+            return -EPIPE;
+        }
+        
+        struct nlmsghdr* nlh = (struct nlmsghdr*)q->ack_buffer;
+        while (NLMSG_OK(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                handle_config_ack(nlh);
+            } else if ((nlh->nlmsg_type & 0xFF) == NFNL_SUBSYS_QUEUE) {
+                NfqueuePacket pkt;
+                memset(&pkt, 0, sizeof(pkt));
+                if (parse_packet(nlh, &pkt) == 0) {
+                    send_verdict(q, pkt.packet_id, NFQUEUE_ACCEPT, NULL, 0);
+                }
+            }
+            
+            nlh = NLMSG_NEXT(nlh, len);
+        }
+        pthread_mutex_unlock(&q->ack_read_lock);
+    }
+}
+
+/**
+ * NLMSG_ERROR from the socket: hand a config ACK to the sender waiting for
+ * its sequence number, log anything else (e.g. a verdict for an expired
+ * packet)
+ */
+static void handle_config_ack(struct nlmsghdr* nlh) {
+    struct nlmsgerr* err = (struct nlmsgerr*)NLMSG_DATA(nlh);
+    bool matched = false;
+    
+    pthread_mutex_lock(&g_nfq.ack_lock);
+    for (AckWaiter* waiter = g_nfq.ack_waiters; waiter != NULL && nlh->nlmsg_seq != 0;
+         waiter = waiter->next) {
+        if (waiter->seq == nlh->nlmsg_seq) {
+            waiter->error = err->error;
+            waiter->done = true;
+            matched = true;
+            pthread_cond_broadcast(&g_nfq.ack_cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_nfq.ack_lock);
+    
+    if (!matched && err->error != 0) {
+        LOGE("Netlink error: %d", err->error);
+    }
 }
 
 /**
@@ -389,12 +947,35 @@ static int parse_packet(struct nlmsghdr* nlh, NfqueuePacket* pkt) {
             case NFQA_MARK:
                 pkt->mark = ntohl(*(uint32_t*)data);
                 break;
+            case NFQA_TIMESTAMP:
+                // Only for PREROUTING/INPUT/FORWARD packets with an skb stamp
+                if (len >= (int)sizeof(struct nfqnl_msg_packet_timestamp)) {
+                    struct nfqnl_msg_packet_timestamp* pts = (struct nfqnl_msg_packet_timestamp*)data;
+                    pkt->queued_time_ns = be64toh(pts->sec) * 1000000000ULL +
+                                          be64toh(pts->usec) * 1000ULL;
+                }
+                break;
+            case NFQA_UID:
+                if (len >= 4) {
+                    pkt->uid = ntohl(*(uint32_t*)data);
+                    pkt->has_uid = true;
+                }
+                break;
             case NFQA_PAYLOAD:
                 pkt->payload = data;
                 pkt->payload_len = len;
                 
                 // Parse IP header
-                if (len >= 20) {
+                if (len >= IPV6_HEADER_LEN && (data[0] >> 4) == 6) {
+                    int offset = ipv6_transport_offset(data, len, &pkt->protocol, NULL);
+                    pkt->src_ip = ipv6_addr_fold(data + 8);
+                    pkt->dst_ip = ipv6_addr_fold(data + 24);
+                    
+                    if (offset >= 0 && offset + 4 <= len) {
+                        pkt->src_port = ntohs(*(uint16_t*)(data + offset));
+                        pkt->dst_port = ntohs(*(uint16_t*)(data + offset + 2));
+                    }
+                } else if (len >= 20) {
                     uint8_t ihl = (data[0] & 0x0F) * 4;
                     pkt->protocol = data[9];
                     pkt->src_ip = *(uint32_t*)(data + 12);
@@ -417,10 +998,68 @@ static int parse_packet(struct nlmsghdr* nlh, NfqueuePacket* pkt) {
     return (pkt->packet_id != 0) ? 0 : -1;
 }
 
+/**
+ * Hand a batch to the batch callback and send all verdicts in one message
+ */
+static void flush_batch(NfqueueQueue* q, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        q->batch_verdicts[i] = NFQUEUE_ACCEPT;
+    }
+    
+    g_nfq.batch_callback(q->batch, q->batch_verdicts, count, g_nfq.batch_user_data);
+    
+    // Concatenated verdict messages; nfnetlink processes them in order
+    size_t msg_len = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (q->batch_verdicts[i] == NFQUEUE_STOLEN) continue;
+        fill_verdict_msg(q, q->batch_send_buffer + msg_len,
+                         q->batch[i].packet_id, q->batch_verdicts[i]);
+        msg_len += VERDICT_MSG_SIZE;
+    }
+    
+    if (msg_len == 0) return;
+    
+    struct sockaddr_nl peer;
+    memset(&peer, 0, sizeof(peer));
+    peer.nl_family = AF_NETLINK;
+    
+    if (sendto(q->nl_socket, q->batch_send_buffer, msg_len, 0,
+               (struct sockaddr*)&peer, sizeof(peer)) < 0) {
+        LOGE("sendto batch verdict failed: %s", strerror(errno));
+    }
+}
+
+/**
+ * Build a single verdict message (no payload) at buf
+ */
+static void fill_verdict_msg(NfqueueQueue* q, uint8_t* buf, uint32_t packet_id, uint32_t verdict) {
+    memset(buf, 0, VERDICT_MSG_SIZE);
+    
+    struct nlmsghdr* nlh = (struct nlmsghdr*)buf;
+    nlh->nlmsg_len = VERDICT_MSG_SIZE;
+    nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_VERDICT;
+    nlh->nlmsg_flags = NLM_F_REQUEST;
+    nlh->nlmsg_seq = 0;
+    nlh->nlmsg_pid = getpid();
+    
+    struct nfgenmsg* nfg = (struct nfgenmsg*)NLMSG_DATA(nlh);
+    nfg->nfgen_family = AF_UNSPEC;
+    nfg->version = NFNETLINK_V0;
+    nfg->res_id = htons(q->queue_num);
+    
+    struct nlattr* attr = (struct nlattr*)((uint8_t*)nfg + NLMSG_ALIGN(sizeof(*nfg)));
+    attr->nla_len = sizeof(*attr) + sizeof(struct nfqnl_msg_verdict_hdr);
+    attr->nla_type = NFQA_VERDICT_HDR;
+    
+    struct nfqnl_msg_verdict_hdr* vh = (struct nfqnl_msg_verdict_hdr*)((uint8_t*)attr + sizeof(*attr));
+    vh->verdict = htonl(verdict);
+    vh->id = htonl(packet_id);
+}
+
 /**
  * Send verdict
  */
-static int send_verdict(uint32_t packet_id, uint32_t verdict, 
+static int send_verdict(NfqueueQueue* q, uint32_t packet_id, uint32_t verdict, 
                         uint8_t* payload, uint32_t payload_len) {
     // Calculate message size
     size_t msg_len = NLMSG_ALIGN(sizeof(struct nlmsghdr)) +
@@ -436,9 +1075,9 @@ static int send_verdict(uint32_t packet_id, uint32_t verdict,
         return -1;
     }
     
-    memset(g_nfq.send_buffer, 0, msg_len);
+    memset(q->send_buffer, 0, msg_len);
     
-    struct nlmsghdr* nlh = (struct nlmsghdr*)g_nfq.send_buffer;
+    struct nlmsghdr* nlh = (struct nlmsghdr*)q->send_buffer;
     nlh->nlmsg_len = msg_len;
     nlh->nlmsg_type = (NFNL_SUBSYS_QUEUE << 8) | NFQNL_MSG_VERDICT;
     nlh->nlmsg_flags = NLM_F_REQUEST;
@@ -448,7 +1087,7 @@ static int send_verdict(uint32_t packet_id, uint32_t verdict,
     struct nfgenmsg* nfg = (struct nfgenmsg*)NLMSG_DATA(nlh);
     nfg->nfgen_family = AF_UNSPEC;
     nfg->version = NFNETLINK_V0;
-    nfg->res_id = htons(g_nfq.queue_num);
+    nfg->res_id = htons(q->queue_num);
     
     // Verdict attribute
     struct nlattr* attr = (struct nlattr*)((uint8_t*)nfg + NLMSG_ALIGN(sizeof(*nfg)));
@@ -471,7 +1110,7 @@ static int send_verdict(uint32_t packet_id, uint32_t verdict,
     memset(&peer, 0, sizeof(peer));
     peer.nl_family = AF_NETLINK;
     
-    if (sendto(g_nfq.nl_socket, g_nfq.send_buffer, msg_len, 0,
+    if (sendto(q->nl_socket, q->send_buffer, msg_len, 0,
                (struct sockaddr*)&peer, sizeof(peer)) < 0) {
         LOGE("sendto verdict failed: %s", strerror(errno));
         return -1;
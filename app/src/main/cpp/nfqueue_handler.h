@@ -10,6 +10,7 @@
 #ifndef NFQUEUE_HANDLER_H
 #define NFQUEUE_HANDLER_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -31,17 +32,53 @@ typedef struct {
     uint32_t mark;             // Packet mark
     uint8_t* payload;          // Packet payload (IP header + data)
     uint32_t payload_len;      // Payload length
-    uint8_t protocol;          // IP protocol (6=TCP, 17=UDP)
-    uint32_t src_ip;           // Source IP (network byte order)
-    uint32_t dst_ip;           // Destination IP (network byte order)
+    uint8_t protocol;          // IP protocol (6=TCP, 17=UDP; IPv6: after extension headers)
+    uint32_t src_ip;           // Source IP (network byte order; IPv6: ipv6_addr_fold)
+    uint32_t dst_ip;           // Destination IP (network byte order; IPv6: ipv6_addr_fold)
     uint16_t src_port;         // Source port (host byte order)
     uint16_t dst_port;         // Destination port (host byte order)
+    uint64_t recv_time_ns;     // CLOCK_MONOTONIC time the packet was read (0 = unknown)
+    uint64_t queued_time_ns;   // CLOCK_MONOTONIC time the kernel queued it (NFQA_TIMESTAMP; 0 = not reported)
+    uint32_t recv_batch;       // Packets returned by the same read (backlog seen by the reader)
+    bool has_uid;              // uid is valid (NFQA_UID reported for a local socket)
+    uint32_t uid;              // UID owning the sending socket
 } NfqueuePacket;
 
+// Queue configuration (applied by nfqueue_init)
+typedef struct {
+    uint32_t rcvbuf_size;      // Netlink receive buffer (SO_RCVBUFFORCE), bytes
+    uint32_t queue_maxlen;     // Kernel queue length (NFQA_CFG_QUEUE_MAXLEN), 0 = kernel default
+    bool fail_open;            // Accept packets when the queue is full (NFQA_CFG_F_FAIL_OPEN)
+    bool uid_gid;              // Report the socket owner of each packet (NFQA_CFG_F_UID_GID)
+} NfqueueConfig;
+
+// Kernel queue counters (from /proc/net/netfilter/nfnetlink_queue, summed
+// over the bound queues)
+typedef struct {
+    uint32_t queue_total;      // Packets currently waiting for a verdict
+    uint32_t queue_dropped;    // Dropped because queue_maxlen was reached
+    uint32_t user_dropped;     // Dropped because the netlink socket buffer was full
+    uint32_t id_sequence;      // Last packet ID assigned by the kernel (first queue)
+    uint64_t recv_enobufs;     // ENOBUFS seen by recvfrom (receive buffer overruns)
+    uint64_t recv_errors;      // Other recvfrom errors
+    bool fail_open;            // Fail-open flag as acknowledged by the kernel
+} NfqueueQueueStats;
+
 // Callback type for packet handling
 // Return: verdict (ACCEPT, DROP, etc.)
 typedef NfqueueVerdict (*nfqueue_callback_t)(NfqueuePacket* packet, void* user_data);
 
+// Max packets handed to a batch callback at once
+#define NFQUEUE_MAX_BATCH 256
+
+// Max queues bound by nfqueue_init_fanout
+#define NFQUEUE_MAX_QUEUES 16
+
+// Callback type for batched packet handling
+// Fills verdicts[i] for packets[i]; all verdicts are sent in one netlink message
+typedef void (*nfqueue_batch_callback_t)(NfqueuePacket* packets, NfqueueVerdict* verdicts,
+                                         uint32_t count, void* user_data);
+
 /**
  * Initialize NFQUEUE handler
  * @param queue_num Queue number (0-65535)
@@ -49,6 +86,48 @@ typedef NfqueueVerdict (*nfqueue_callback_t)(NfqueuePacket* packet, void* user_d
  */
 int nfqueue_init(uint16_t queue_num);
 
+/**
+ * Initialize NFQUEUE handler on queues first_queue..first_queue+count-1,
+ * each on its own netlink socket so it can be serviced by its own thread
+ * (iptables --queue-balance, optionally with --queue-cpu-fanout)
+ * @param first_queue First queue number
+ * @param count Number of queues (1-NFQUEUE_MAX_QUEUES)
+ * @return 0 on success, negative on error (no queue stays bound)
+ */
+int nfqueue_init_fanout(uint16_t first_queue, uint16_t count);
+
+/**
+ * Number of queues bound by the last init
+ * @return Queue count, 0 if not initialized
+ */
+uint16_t nfqueue_queue_count(void);
+
+/**
+ * Set queue configuration (takes effect on next nfqueue_init)
+ * @param config Queue configuration, NULL to restore defaults
+ */
+void nfqueue_set_config(const NfqueueConfig* config);
+
+/**
+ * Get current queue configuration
+ * @param config Output configuration
+ */
+void nfqueue_get_config(NfqueueConfig* config);
+
+/**
+ * Toggle fail-open on the running queues
+ * @param enable true to accept packets when the queue is full
+ * @return 0 once the kernel acknowledged the change
+ */
+int nfqueue_set_fail_open(bool enable);
+
+/**
+ * Sample kernel queue counters for the bound queues
+ * @param stats Output counters
+ * @return 0 on success, -1 if the queue is not listed in /proc
+ */
+int nfqueue_get_queue_stats(NfqueueQueueStats* stats);
+
 /**
  * Set packet callback function
  * @param callback Function to call for each packet
@@ -57,13 +136,29 @@ int nfqueue_init(uint16_t queue_num);
 void nfqueue_set_callback(nfqueue_callback_t callback, void* user_data);
 
 /**
- * Start processing packets (blocking call)
+ * Set batch callback function. When set it replaces the per-packet
+ * callback: every recvfrom drain is delivered as one batch.
+ * @param callback Function to call for each batch (NULL = per-packet mode)
+ * @param user_data User data passed to callback
+ */
+void nfqueue_set_batch_callback(nfqueue_batch_callback_t callback, void* user_data);
+
+/**
+ * Start processing packets of the first queue (blocking call)
  * @return 0 on clean exit, negative on error
  */
 int nfqueue_start(void);
 
 /**
- * Stop processing packets
+ * Process packets of one bound queue (blocking call). Run one thread per
+ * queue; callbacks may then be called from several threads at once.
+ * @param index Queue index (0 to nfqueue_queue_count() - 1)
+ * @return 0 on clean exit, negative on error
+ */
+int nfqueue_start_queue(uint16_t index);
+
+/**
+ * Stop processing packets on every queue
  */
 void nfqueue_stop(void);
 
@@ -80,7 +175,8 @@ bool nfqueue_is_running(void);
 
 /**
  * Manually set verdict for a packet
- * Used when callback returns STOLEN
+ * Used when callback returns STOLEN. Goes to the queue serviced by the
+ * calling thread, or the first queue from any other thread.
  * @param packet_id Packet ID
  * @param verdict Verdict to set
  * @param modified_payload Modified payload (NULL to use original)
@@ -100,6 +196,15 @@ int nfqueue_set_verdict_manual(
  */
 const char* nfqueue_get_error(void);
 
+/**
+ * Get the netlink receive buffer that packet payloads point into.
+ * The buffer lives as long as the library; payloads are only valid
+ * for the duration of the packet callback.
+ * @param size Output: buffer capacity in bytes (may be NULL)
+ * @return Buffer base address
+ */
+uint8_t* nfqueue_get_recv_buffer(size_t* size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,27 +5,104 @@
  */
 
 #include <jni.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
 #include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "nfqueue_handler.h"
-
-#include <android/log.h>
+#include "dpi_bypass.h"
+#include "daemon/ctl_client.h"
 
 #define LOG_TAG "NfqueueJNI"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#include "netrix_log.h"
 
 // Global JVM reference
 static JavaVM* g_jvm = NULL;
 
-// Callback class and method
-static jclass g_callback_class = NULL;
-static jmethodID g_callback_method = NULL;
-static jobject g_callback_object = NULL;
+// Kotlin callback flavours
+typedef enum {
+    CALLBACK_ARRAY = 0,        // onPacket: payload copied into a ByteArray
+    CALLBACK_DIRECT,           // onPacketDirect: payload in a shared direct ByteBuffer
+    CALLBACK_BATCH             // onPackets: one upcall per drained batch
+} CallbackMode;
+
+// Batch descriptor layout (ints per packet), mirrored in NfqueueBridge
+enum {
+    DESC_ID = 0,
+    DESC_PROTOCOL,
+    DESC_SRC_IP,
+    DESC_DST_IP,
+    DESC_SRC_PORT,
+    DESC_DST_PORT,
+    DESC_OFFSET,               // Packet offset in the packet buffer
+    DESC_LENGTH,
+    DESC_CLASS,                // DpiPacketClass
+    DESC_DATA_OFFSET,          // Relative to packet start
+    DESC_HOST_OFFSET,          // Relative to packet start, 0 = none
+    DESC_HOST_LENGTH,
+    DESC_VERDICT,              // Written back by Kotlin, preset to ACCEPT
+    DESC_INTS
+};
+
+// Published callback. Readers never lock: they bump g_inflight, load the
+// pointer and use it; writers swap the pointer and wait for g_inflight to
+// drain before releasing the old struct.
+typedef struct JniCallback {
+    jobject object;            // Global ref to callback object
+    jclass clazz;              // Global ref to its class (keeps method IDs valid)
+    jmethodID method;          // onPacket, onPacketDirect or onPackets (see signatures below)
+    jobject buffer;            // Global ref to direct ByteBuffer over the recv buffer
+    const uint8_t* buffer_base;
+    size_t buffer_size;
+    jobject descriptors;       // Global ref to direct ByteBuffer over desc (batch mode)
+    int32_t* desc;             // NFQUEUE_MAX_BATCH * DESC_INTS descriptor ints
+    CallbackMode mode;
+    struct JniCallback* next_retired; // Next struct on the retired list
+} JniCallback;
+
+static _Atomic(JniCallback*) g_callback = NULL;
+static atomic_int g_inflight = 0;
+
+// Structs retired from inside an upcall, newest first; freed once
+// g_inflight drops to zero (upcall exit, next swap or unload)
+static _Atomic(JniCallback*) g_retired = NULL;
+static pthread_mutex_t g_publish_lock = PTHREAD_MUTEX_INITIALIZER;
 
-// Mutex for callback
-static pthread_mutex_t g_callback_lock = PTHREAD_MUTEX_INITIALIZER;
+// Set while this thread is inside a Kotlin upcall
+static __thread bool t_in_upcall = false;
+
+// Prefilter: ACCEPT non-handshake packets natively instead of upcalling
+static atomic_bool g_prefilter = true;
+static atomic_uint_fast64_t g_packets_seen = 0;
+static atomic_uint_fast64_t g_packets_upcalled = 0;
+
+// Persistent connection to the root daemon's control socket
+#define CTL_TIMEOUT_MS 10000
+#define CTL_BUFFER_SIZE 4096
+static int g_ctl_fd = -1;
+static char g_ctl_path[108];
+static pthread_mutex_t g_ctl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define ONPACKET_SIG        "(IIIIII[BIIIILjava/lang/String;)I"
+#define ONPACKET_DIRECT_SIG "(IIIIIILjava/nio/ByteBuffer;IIIIIILjava/lang/String;)I"
+#define ONPACKETS_SIG       "(Ljava/nio/ByteBuffer;Ljava/nio/ByteBuffer;I)V"
+
+// Forward declarations
+static JNIEnv* get_env(void);
+static void free_callback(JNIEnv* env, JniCallback* cb);
+static void publish_callback(JNIEnv* env, JniCallback* cb);
+static void reap_retired(JNIEnv* env);
+static jstring new_hostname_string(JNIEnv* env, const uint8_t* data, uint32_t len);
+static NfqueueVerdict upcall_packet(JNIEnv* env, JniCallback* cb, NfqueuePacket* packet,
+                                    DpiPacketClass packet_class, DpiPacketInfo* info);
+static void upcall_batch(JNIEnv* env, JniCallback* cb, NfqueuePacket* packets,
+                         NfqueueVerdict* verdicts, DpiPacketClass* classes,
+                         DpiPacketInfo* infos, uint32_t* indices, uint32_t count);
 
 /**
  * Called when library is loaded
@@ -44,26 +121,11 @@ JNIEXPORT void JNICALL JNI_OnUnload(JavaVM* vm, void* reserved) {
     (void)vm;
     (void)reserved;
     
-    pthread_mutex_lock(&g_callback_lock);
-    
-    if (g_callback_object != NULL) {
-        JNIEnv* env;
-        if ((*g_jvm)->GetEnv(g_jvm, (void**)&env, JNI_VERSION_1_6) == JNI_OK) {
-            (*env)->DeleteGlobalRef(env, g_callback_object);
-        }
-        g_callback_object = NULL;
-    }
-    
-    if (g_callback_class != NULL) {
-        JNIEnv* env;
-        if ((*g_jvm)->GetEnv(g_jvm, (void**)&env, JNI_VERSION_1_6) == JNI_OK) {
-            (*env)->DeleteGlobalRef(env, g_callback_class);
-        }
-        g_callback_class = NULL;
+    JNIEnv* env = NULL;
+    if ((*g_jvm)->GetEnv(g_jvm, (void**)&env, JNI_VERSION_1_6) == JNI_OK) {
+        publish_callback(env, NULL);
     }
     
-    pthread_mutex_unlock(&g_callback_lock);
-    
     LOGI("NFQUEUE JNI unloaded");
 }
 
@@ -86,45 +148,257 @@ static JNIEnv* get_env(void) {
 }
 
 /**
- * Native packet callback - calls Kotlin callback
+ * Release global refs held by a callback struct
  */
-static NfqueueVerdict native_callback(NfqueuePacket* packet, void* user_data) {
+static void free_callback(JNIEnv* env, JniCallback* cb) {
+    if (cb == NULL) return;
+    if (cb->buffer != NULL) (*env)->DeleteGlobalRef(env, cb->buffer);
+    if (cb->descriptors != NULL) (*env)->DeleteGlobalRef(env, cb->descriptors);
+    free(cb->desc);
+    if (cb->object != NULL) (*env)->DeleteGlobalRef(env, cb->object);
+    if (cb->clazz != NULL) (*env)->DeleteGlobalRef(env, cb->clazz);
+    free(cb);
+}
+
+/**
+ * Free every retired struct if no upcall is running. Caller holds
+ * g_publish_lock; a reader that bumps g_inflight after the check can
+ * only load the published pointer, never a retired one
+ */
+static void reap_retired(JNIEnv* env) {
+    if (atomic_load(&g_inflight) != 0) return;
+    
+    JniCallback* cb = atomic_exchange(&g_retired, NULL);
+    while (cb != NULL) {
+        JniCallback* next = cb->next_retired;
+        free_callback(env, cb);
+        cb = next;
+    }
+}
+
+/**
+ * Swap in a new callback (NULL clears) and release the old one once
+ * no upcall is using it
+ */
+static void publish_callback(JNIEnv* env, JniCallback* cb) {
+    pthread_mutex_lock(&g_publish_lock);
+    
+    JniCallback* old = atomic_exchange(&g_callback, cb);
+    
+    if (old != NULL) {
+        if (t_in_upcall) {
+            // Replaced from inside the callback: our own upcall still holds it
+            old->next_retired = atomic_load(&g_retired);
+            atomic_store(&g_retired, old);
+        } else {
+            while (atomic_load(&g_inflight) != 0) {
+                sched_yield();
+            }
+            free_callback(env, old);
+        }
+    }
+    
+    reap_retired(env);
+    
+    pthread_mutex_unlock(&g_publish_lock);
+}
+
+/**
+ * Build a Java string from a wire hostname (non-printable bytes replaced)
+ */
+static jstring new_hostname_string(JNIEnv* env, const uint8_t* data, uint32_t len) {
+    char buf[256];
+    if (data == NULL || len == 0) return NULL;
+    if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+    
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = (data[i] >= 0x20 && data[i] < 0x7F) ? (char)data[i] : '?';
+    }
+    buf[len] = '\0';
+    
+    return (*env)->NewStringUTF(env, buf);
+}
+
+/**
+ * Packet offset inside the shared recv buffer (0/0 if outside)
+ */
+static void buffer_span(JniCallback* cb, NfqueuePacket* packet, jint* offset, jint* length) {
+    *offset = 0;
+    *length = 0;
+    if (packet->payload != NULL &&
+        packet->payload >= cb->buffer_base &&
+        packet->payload + packet->payload_len <= cb->buffer_base + cb->buffer_size) {
+        *offset = (jint)(packet->payload - cb->buffer_base);
+        *length = (jint)packet->payload_len;
+    }
+}
+
+/**
+ * Native batch callback - classifies natively, upcalls handshake candidates
+ * (once per batch in batch mode, once per candidate otherwise)
+ */
+static void native_batch_callback(NfqueuePacket* packets, NfqueueVerdict* verdicts,
+                                  uint32_t count, void* user_data) {
     (void)user_data;
     
-    pthread_mutex_lock(&g_callback_lock);
+    DpiPacketClass classes[NFQUEUE_MAX_BATCH];
+    DpiPacketInfo infos[NFQUEUE_MAX_BATCH];
+    uint32_t indices[NFQUEUE_MAX_BATCH];
+    uint32_t candidates = 0;
+    bool prefilter = atomic_load_explicit(&g_prefilter, memory_order_relaxed);
+    
+    atomic_fetch_add_explicit(&g_packets_seen, count, memory_order_relaxed);
     
-    if (g_callback_object == NULL || g_callback_method == NULL) {
-        pthread_mutex_unlock(&g_callback_lock);
-        return NFQUEUE_ACCEPT;
+    for (uint32_t i = 0; i < count; i++) {
+        classes[i] = dpi_classify_packet(packets[i].payload, packets[i].payload_len, &infos[i]);
+        if (classes[i] == DPI_CLASS_OTHER && prefilter) {
+            verdicts[i] = NFQUEUE_ACCEPT;
+        } else {
+            indices[candidates++] = i;
+        }
     }
     
-    JNIEnv* env = get_env();
-    if (env == NULL) {
-        pthread_mutex_unlock(&g_callback_lock);
-        return NFQUEUE_ACCEPT;
+    if (candidates == 0) return;
+    
+    atomic_fetch_add(&g_inflight, 1);
+    JniCallback* cb = atomic_load(&g_callback);
+    JNIEnv* env = (cb != NULL) ? get_env() : NULL;
+    
+    if (cb == NULL || env == NULL) {
+        atomic_fetch_sub(&g_inflight, 1);
+        return;
     }
     
-    // Create byte array for payload
-    jbyteArray payload_array = NULL;
-    if (packet->payload != NULL && packet->payload_len > 0) {
-        payload_array = (*env)->NewByteArray(env, packet->payload_len);
-        if (payload_array != NULL) {
-            (*env)->SetByteArrayRegion(env, payload_array, 0, 
-                                       packet->payload_len, (jbyte*)packet->payload);
+    t_in_upcall = true;
+    atomic_fetch_add_explicit(&g_packets_upcalled, candidates, memory_order_relaxed);
+    
+    if (cb->mode == CALLBACK_BATCH) {
+        upcall_batch(env, cb, packets, verdicts, classes, infos, indices, candidates);
+    } else {
+        for (uint32_t n = 0; n < candidates; n++) {
+            uint32_t i = indices[n];
+            verdicts[i] = upcall_packet(env, cb, &packets[i], classes[i], &infos[i]);
         }
     }
     
-    // Call Kotlin callback
-    // Signature: onPacket(packetId: Int, protocol: Int, srcIp: Int, dstIp: Int,
-    //                     srcPort: Int, dstPort: Int, payload: ByteArray?): Int
-    jint verdict = (*env)->CallIntMethod(env, g_callback_object, g_callback_method,
-                                         (jint)packet->packet_id,
-                                         (jint)packet->protocol,
-                                         (jint)packet->src_ip,
-                                         (jint)packet->dst_ip,
-                                         (jint)packet->src_port,
-                                         (jint)packet->dst_port,
-                                         payload_array);
+    t_in_upcall = false;
+    
+    if (atomic_fetch_sub(&g_inflight, 1) == 1 && atomic_load(&g_retired) != NULL) {
+        pthread_mutex_lock(&g_publish_lock);
+        reap_retired(env);
+        pthread_mutex_unlock(&g_publish_lock);
+    }
+}
+
+/**
+ * Deliver a whole batch with a single onPackets upcall
+ */
+static void upcall_batch(JNIEnv* env, JniCallback* cb, NfqueuePacket* packets,
+                         NfqueueVerdict* verdicts, DpiPacketClass* classes,
+                         DpiPacketInfo* infos, uint32_t* indices, uint32_t count) {
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t i = indices[n];
+        int32_t* d = cb->desc + n * DESC_INTS;
+        jint offset, length;
+        buffer_span(cb, &packets[i], &offset, &length);
+        
+        d[DESC_ID] = (int32_t)packets[i].packet_id;
+        d[DESC_PROTOCOL] = packets[i].protocol;
+        d[DESC_SRC_IP] = (int32_t)packets[i].src_ip;
+        d[DESC_DST_IP] = (int32_t)packets[i].dst_ip;
+        d[DESC_SRC_PORT] = packets[i].src_port;
+        d[DESC_DST_PORT] = packets[i].dst_port;
+        d[DESC_OFFSET] = offset;
+        d[DESC_LENGTH] = length;
+        d[DESC_CLASS] = classes[i];
+        d[DESC_DATA_OFFSET] = (int32_t)infos[i].data_offset;
+        d[DESC_HOST_OFFSET] = (int32_t)infos[i].host_offset;
+        d[DESC_HOST_LENGTH] = (int32_t)infos[i].host_len;
+        d[DESC_VERDICT] = NFQUEUE_ACCEPT;
+    }
+    
+    // Signature: onPackets(packets: ByteBuffer, descriptors: ByteBuffer, count: Int)
+    (*env)->CallVoidMethod(env, cb->object, cb->method,
+                           cb->buffer, cb->descriptors, (jint)count);
+    
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionDescribe(env);
+        (*env)->ExceptionClear(env);
+        return;  // verdicts stay ACCEPT
+    }
+    
+    for (uint32_t n = 0; n < count; n++) {
+        verdicts[indices[n]] = (NfqueueVerdict)cb->desc[n * DESC_INTS + DESC_VERDICT];
+    }
+}
+
+/**
+ * Deliver one packet with onPacket / onPacketDirect
+ */
+static NfqueueVerdict upcall_packet(JNIEnv* env, JniCallback* cb, NfqueuePacket* packet,
+                                    DpiPacketClass packet_class, DpiPacketInfo* info) {
+    jstring hostname = NULL;
+    if (info->host_len > 0) {
+        hostname = new_hostname_string(env, packet->payload + info->host_offset, info->host_len);
+    }
+    
+    jint verdict;
+    
+    if (cb->mode == CALLBACK_DIRECT) {
+        // Payload already sits in the recv buffer wrapped by cb->buffer
+        jint offset, length;
+        buffer_span(cb, packet, &offset, &length);
+        
+        // Signature: onPacketDirect(packetId, protocol, srcIp, dstIp, srcPort, dstPort,
+        //                           buffer: ByteBuffer, offset: Int, length: Int,
+        //                           packetClass: Int, dataOffset: Int, hostOffset: Int,
+        //                           hostLength: Int, hostname: String?): Int
+        verdict = (*env)->CallIntMethod(env, cb->object, cb->method,
+                                        (jint)packet->packet_id,
+                                        (jint)packet->protocol,
+                                        (jint)packet->src_ip,
+                                        (jint)packet->dst_ip,
+                                        (jint)packet->src_port,
+                                        (jint)packet->dst_port,
+                                        cb->buffer, offset, length,
+                                        (jint)packet_class,
+                                        (jint)info->data_offset,
+                                        (jint)info->host_offset,
+                                        (jint)info->host_len,
+                                        hostname);
+    } else {
+        // Create byte array for payload
+        jbyteArray payload_array = NULL;
+        if (packet->payload != NULL && packet->payload_len > 0) {
+            payload_array = (*env)->NewByteArray(env, packet->payload_len);
+            if (payload_array != NULL) {
+                (*env)->SetByteArrayRegion(env, payload_array, 0, 
+                                           packet->payload_len, (jbyte*)packet->payload);
+            }
+        }
+        
+        // Signature: onPacket(packetId: Int, protocol: Int, srcIp: Int, dstIp: Int,
+        //                     srcPort: Int, dstPort: Int, payload: ByteArray?,
+        //                     packetClass: Int, dataOffset: Int, hostOffset: Int,
+        //                     hostLength: Int, hostname: String?): Int
+        verdict = (*env)->CallIntMethod(env, cb->object, cb->method,
+                                        (jint)packet->packet_id,
+                                        (jint)packet->protocol,
+                                        (jint)packet->src_ip,
+                                        (jint)packet->dst_ip,
+                                        (jint)packet->src_port,
+                                        (jint)packet->dst_port,
+                                        payload_array,
+                                        (jint)packet_class,
+                                        (jint)info->data_offset,
+                                        (jint)info->host_offset,
+                                        (jint)info->host_len,
+                                        hostname);
+        
+        if (payload_array != NULL) {
+            (*env)->DeleteLocalRef(env, payload_array);
+        }
+    }
     
     // Check for exception
     if ((*env)->ExceptionCheck(env)) {
@@ -133,13 +407,10 @@ static NfqueueVerdict native_callback(NfqueuePacket* packet, void* user_data) {
         verdict = NFQUEUE_ACCEPT;
     }
     
-    // Clean up local ref
-    if (payload_array != NULL) {
-        (*env)->DeleteLocalRef(env, payload_array);
+    if (hostname != NULL) {
+        (*env)->DeleteLocalRef(env, hostname);
     }
     
-    pthread_mutex_unlock(&g_callback_lock);
-    
     return (NfqueueVerdict)verdict;
 }
 
@@ -164,35 +435,26 @@ Java_com_enki_netrix_native_NfqueueBridge_nativeInit(
         return JNI_FALSE;
     }
     
-    nfqueue_set_callback(native_callback, NULL);
+    nfqueue_set_batch_callback(native_batch_callback, NULL);
     
     return JNI_TRUE;
 }
 
 /**
- * Set packet callback
+ * Set packet callback.
+ * Callbacks implementing onPackets get one upcall per batch, onPacketDirect
+ * the zero-copy per-packet path; otherwise onPacket is used.
  */
 JNIEXPORT jboolean JNICALL
 Java_com_enki_netrix_native_NfqueueBridge_nativeSetCallback(
     JNIEnv* env, jclass clazz, jobject callback) {
     
-    (void)clazz;
+    static const char* const mode_names[] = { "array", "direct", "batch" };
     
-    pthread_mutex_lock(&g_callback_lock);
-    
-    // Clean up old callback
-    if (g_callback_object != NULL) {
-        (*env)->DeleteGlobalRef(env, g_callback_object);
-        g_callback_object = NULL;
-    }
-    if (g_callback_class != NULL) {
-        (*env)->DeleteGlobalRef(env, g_callback_class);
-        g_callback_class = NULL;
-    }
-    g_callback_method = NULL;
+    (void)clazz;
     
     if (callback == NULL) {
-        pthread_mutex_unlock(&g_callback_lock);
+        publish_callback(env, NULL);
         return JNI_TRUE;
     }
     
@@ -200,31 +462,203 @@ Java_com_enki_netrix_native_NfqueueBridge_nativeSetCallback(
     jclass callback_class = (*env)->GetObjectClass(env, callback);
     if (callback_class == NULL) {
         LOGE("Failed to get callback class");
-        pthread_mutex_unlock(&g_callback_lock);
         return JNI_FALSE;
     }
     
-    // Method signature: (IIIIII[B)I
-    jmethodID method = (*env)->GetMethodID(env, callback_class, "onPacket",
-                                           "(IIIIII[B)I");
-    if (method == NULL) {
+    JniCallback* cb = calloc(1, sizeof(JniCallback));
+    if (cb == NULL) {
+        LOGE("Failed to allocate callback");
+        return JNI_FALSE;
+    }
+    
+    cb->mode = CALLBACK_BATCH;
+    cb->method = (*env)->GetMethodID(env, callback_class, "onPackets", ONPACKETS_SIG);
+    if (cb->method == NULL) {
+        (*env)->ExceptionClear(env);
+        cb->mode = CALLBACK_DIRECT;
+        cb->method = (*env)->GetMethodID(env, callback_class, "onPacketDirect",
+                                         ONPACKET_DIRECT_SIG);
+    }
+    if (cb->method == NULL) {
+        (*env)->ExceptionClear(env);
+        cb->mode = CALLBACK_ARRAY;
+        cb->method = (*env)->GetMethodID(env, callback_class, "onPacket",
+                                         ONPACKET_SIG);
+    }
+    
+    if (cb->method == NULL) {
         LOGE("Failed to get onPacket method");
         (*env)->ExceptionClear(env);
-        pthread_mutex_unlock(&g_callback_lock);
+        free(cb);
         return JNI_FALSE;
     }
     
+    if (cb->mode != CALLBACK_ARRAY) {
+        // Wrap the netlink recv buffer once; reused for every packet
+        uint8_t* base = nfqueue_get_recv_buffer(&cb->buffer_size);
+        jobject buffer = (*env)->NewDirectByteBuffer(env, base, (jlong)cb->buffer_size);
+        if (buffer == NULL) {
+            LOGE("Failed to create direct ByteBuffer");
+            (*env)->ExceptionClear(env);
+            free(cb);
+            return JNI_FALSE;
+        }
+        cb->buffer = (*env)->NewGlobalRef(env, buffer);
+        cb->buffer_base = base;
+        (*env)->DeleteLocalRef(env, buffer);
+    }
+    
+    if (cb->mode == CALLBACK_BATCH) {
+        // Descriptor table shared with Kotlin; verdicts are written back into it
+        size_t desc_size = NFQUEUE_MAX_BATCH * DESC_INTS * sizeof(int32_t);
+        cb->desc = calloc(1, desc_size);
+        jobject descriptors = cb->desc != NULL ?
+            (*env)->NewDirectByteBuffer(env, cb->desc, (jlong)desc_size) : NULL;
+        if (descriptors == NULL) {
+            LOGE("Failed to create descriptor buffer");
+            (*env)->ExceptionClear(env);
+            free_callback(env, cb);
+            return JNI_FALSE;
+        }
+        cb->descriptors = (*env)->NewGlobalRef(env, descriptors);
+        (*env)->DeleteLocalRef(env, descriptors);
+    }
+    
     // Create global refs
-    g_callback_class = (*env)->NewGlobalRef(env, callback_class);
-    g_callback_object = (*env)->NewGlobalRef(env, callback);
-    g_callback_method = method;
+    cb->clazz = (*env)->NewGlobalRef(env, callback_class);
+    cb->object = (*env)->NewGlobalRef(env, callback);
     
-    LOGI("Callback set successfully");
-    pthread_mutex_unlock(&g_callback_lock);
+    CallbackMode mode = cb->mode;
+    publish_callback(env, cb);
     
+    LOGI("Callback set successfully (%s)", mode_names[mode]);
     return JNI_TRUE;
 }
 
+/**
+ * Enable or disable the native prefilter
+ */
+JNIEXPORT void JNICALL
+Java_com_enki_netrix_native_NfqueueBridge_nativeSetPrefilter(
+    JNIEnv* env, jclass clazz, jboolean enabled) {
+    
+    (void)env;
+    (void)clazz;
+    
+    atomic_store(&g_prefilter, enabled == JNI_TRUE);
+    LOGI("Native prefilter %s", enabled ? "enabled" : "disabled");
+}
+
+/**
+ * Get prefilter counters: [packets seen, packets upcalled]
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_enki_netrix_native_NfqueueBridge_nativeGetPrefilterStats(
+    JNIEnv* env, jclass clazz) {
+    
+    (void)clazz;
+    
+    jlong values[2] = {
+        (jlong)atomic_load(&g_packets_seen),
+        (jlong)atomic_load(&g_packets_upcalled)
+    };
+    
+    jlongArray result = (*env)->NewLongArray(env, 2);
+    if (result != NULL) {
+        (*env)->SetLongArrayRegion(env, result, 0, 2, values);
+    }
+    return result;
+}
+
+/**
+ * Send a command to the root daemon and return its reply
+ * The connection stays open between calls; a connection the daemon closed
+ * (restart, exit) is reopened once. Returns null only when the socket could
+ * not be connected; a command that was sent but got no reply throws
+ * IOException, since the daemon may already have run it.
+ */
+JNIEXPORT jstring JNICALL
+Java_com_enki_netrix_native_NfqueueBridge_nativeDaemonCommand(
+    JNIEnv* env, jclass clazz, jstring socket_path, jstring command) {
+    
+    (void)clazz;
+    
+    const char* path = (*env)->GetStringUTFChars(env, socket_path, NULL);
+    const char* cmd = (*env)->GetStringUTFChars(env, command, NULL);
+    if (path == NULL || cmd == NULL) {
+        if (path != NULL) (*env)->ReleaseStringUTFChars(env, socket_path, path);
+        if (cmd != NULL) (*env)->ReleaseStringUTFChars(env, command, cmd);
+        return NULL;
+    }
+    
+    char response[CTL_BUFFER_SIZE];
+    int len = -1;
+    int request_err = 0;
+    pthread_mutex_lock(&g_ctl_lock);
+    
+    if (g_ctl_fd >= 0 && strcmp(g_ctl_path, path) != 0) {
+        close(g_ctl_fd);
+        g_ctl_fd = -1;
+    }
+    for (int attempt = 0; attempt < 2 && len < 0; attempt++) {
+        bool reused = g_ctl_fd >= 0;
+        if (!reused) {
+            g_ctl_fd = ctl_client_connect(path, CTL_TIMEOUT_MS);
+            if (g_ctl_fd < 0) {
+                LOGE("Daemon socket %s: %s", path, strerror(errno));
+                break;
+            }
+            snprintf(g_ctl_path, sizeof(g_ctl_path), "%s", path);
+        }
+        
+        len = ctl_client_request(g_ctl_fd, cmd, response, sizeof(response));
+        if (len < 0) {
+            int err = errno;
+            close(g_ctl_fd);
+            g_ctl_fd = -1;
+            // Only a stale connection is retried: a timeout may have run the command
+            if (!reused || (err != ECONNRESET && err != EPIPE)) {
+                LOGE("Daemon command failed: %s", strerror(err));
+                request_err = err;
+                break;
+            }
+        }
+    }
+    
+    pthread_mutex_unlock(&g_ctl_lock);
+    (*env)->ReleaseStringUTFChars(env, socket_path, path);
+    (*env)->ReleaseStringUTFChars(env, command, cmd);
+    
+    if (request_err != 0) {
+        jclass io_exception = (*env)->FindClass(env, "java/io/IOException");
+        if (io_exception != NULL) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Daemon command failed: %s", strerror(request_err));
+            (*env)->ThrowNew(env, io_exception, msg);
+        }
+        return NULL;
+    }
+    return len < 0 ? NULL : (*env)->NewStringUTF(env, response);
+}
+
+/**
+ * Close the daemon connection
+ */
+JNIEXPORT void JNICALL
+Java_com_enki_netrix_native_NfqueueBridge_nativeDaemonDisconnect(
+    JNIEnv* env, jclass clazz) {
+    
+    (void)env;
+    (void)clazz;
+    
+    pthread_mutex_lock(&g_ctl_lock);
+    if (g_ctl_fd >= 0) {
+        close(g_ctl_fd);
+        g_ctl_fd = -1;
+    }
+    pthread_mutex_unlock(&g_ctl_lock);
+}
+
 /**
  * Start NFQUEUE processing
  */
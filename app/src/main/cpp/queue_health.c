@@ -0,0 +1,216 @@
+/**
+ * queue_health.c
+ * 
+ * Kernel queue health monitor implementation.
+ */
+
+#include "queue_health.h"
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define LOG_TAG "QueueHealth"
+#include "netrix_log.h"
+
+#define DEFAULT_INTERVAL_MS 1000
+
+// Global state
+static struct {
+    QueueHealthConfig config;
+    QueueHealthSnapshot snapshot;
+    NfqueueQueueStats prev;        // Previous raw sample (for deltas)
+    bool have_prev;
+    volatile bool running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} g_health = {
+    .have_prev = false,
+    .running = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER
+};
+
+// Forward declarations
+static void* health_thread_func(void* arg);
+static void take_sample(void);
+
+/**
+ * Start monitor
+ */
+int queue_health_start(const QueueHealthConfig* config) {
+    pthread_mutex_lock(&g_health.lock);
+    
+    if (g_health.running) {
+        pthread_mutex_unlock(&g_health.lock);
+        return 0;
+    }
+    
+    memset(&g_health.config, 0, sizeof(g_health.config));
+    g_health.config.interval_ms = DEFAULT_INTERVAL_MS;
+    g_health.config.auto_fail_open = true;
+    if (config != NULL) {
+        g_health.config = *config;
+        if (g_health.config.interval_ms == 0) {
+            g_health.config.interval_ms = DEFAULT_INTERVAL_MS;
+        }
+    }
+    
+    if (g_health.config.overload_backlog == 0) {
+        NfqueueConfig qcfg;
+        nfqueue_get_config(&qcfg);
+        uint32_t maxlen = qcfg.queue_maxlen > 0 ? qcfg.queue_maxlen : 1024;
+        g_health.config.overload_backlog = maxlen * 3 / 4;
+    }
+    
+    memset(&g_health.snapshot, 0, sizeof(g_health.snapshot));
+    g_health.have_prev = false;
+    g_health.running = true;
+    
+    if (pthread_create(&g_health.thread, NULL, health_thread_func, NULL) != 0) {
+        LOGE("Failed to create health thread");
+        g_health.running = false;
+        pthread_mutex_unlock(&g_health.lock);
+        return -1;
+    }
+    
+    LOGI("Queue health monitor started: interval=%ums, overload_backlog=%u, auto_fail_open=%d",
+         g_health.config.interval_ms, g_health.config.overload_backlog,
+         g_health.config.auto_fail_open);
+    pthread_mutex_unlock(&g_health.lock);
+    return 0;
+}
+
+/**
+ * Stop monitor
+ */
+void queue_health_stop(void) {
+    pthread_mutex_lock(&g_health.lock);
+    if (!g_health.running) {
+        pthread_mutex_unlock(&g_health.lock);
+        return;
+    }
+    g_health.running = false;
+    pthread_cond_signal(&g_health.wake);
+    pthread_mutex_unlock(&g_health.lock);
+    
+    pthread_join(g_health.thread, NULL);
+    LOGI("Queue health monitor stopped");
+}
+
+/**
+ * Get latest sample
+ */
+void queue_health_get(QueueHealthSnapshot* snapshot) {
+    if (snapshot == NULL) return;
+    pthread_mutex_lock(&g_health.lock);
+    *snapshot = g_health.snapshot;
+    pthread_mutex_unlock(&g_health.lock);
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Sampling loop
+ */
+static void* health_thread_func(void* arg) {
+    (void)arg;
+    
+    pthread_mutex_lock(&g_health.lock);
+    while (g_health.running) {
+        pthread_mutex_unlock(&g_health.lock);
+        take_sample();
+        pthread_mutex_lock(&g_health.lock);
+        
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += g_health.config.interval_ms / 1000;
+        deadline.tv_nsec += (long)(g_health.config.interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        
+        while (g_health.running) {
+            if (pthread_cond_timedwait(&g_health.wake, &g_health.lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_health.lock);
+    
+    return NULL;
+}
+
+/**
+ * Take one sample and update overload state
+ */
+static void take_sample(void) {
+    NfqueueQueueStats cur;
+    if (nfqueue_get_queue_stats(&cur) < 0) {
+        return;  // Queue not bound (yet)
+    }
+    
+    bool enable_fail_open = false;
+    
+    pthread_mutex_lock(&g_health.lock);
+    
+    QueueHealthSnapshot* snap = &g_health.snapshot;
+    uint64_t new_drops = 0;
+    uint64_t new_overruns = 0;
+    
+    if (g_health.have_prev) {
+        // Kernel counters are u32 and reset on rebind; treat decreases as a restart
+        if (cur.queue_dropped >= g_health.prev.queue_dropped) {
+            new_drops += cur.queue_dropped - g_health.prev.queue_dropped;
+        }
+        // Receive buffer overruns: NETLINK_NO_ENOBUFS keeps them out of
+        // recvfrom, the kernel counts them as user_dropped
+        if (cur.user_dropped >= g_health.prev.user_dropped) {
+            new_overruns = cur.user_dropped - g_health.prev.user_dropped;
+        }
+        new_drops += new_overruns;
+    }
+    
+    bool overloaded = cur.queue_total >= g_health.config.overload_backlog ||
+                      new_drops > 0 || new_overruns > 0;
+    
+    if (overloaded && !snap->overloaded) {
+        snap->overload_events++;
+        LOGI("Queue overload: backlog=%u, new_drops=%llu, overruns=%llu",
+             cur.queue_total, (unsigned long long)new_drops,
+             (unsigned long long)new_overruns);
+        enable_fail_open = g_health.config.auto_fail_open && !cur.fail_open;
+    }
+    
+    snap->queue = cur;
+    snap->kernel_drops += new_drops;
+    snap->rcvbuf_overruns += new_overruns;
+    snap->overloaded = overloaded;
+    snap->samples++;
+    if (cur.queue_total > snap->backlog_peak) {
+        snap->backlog_peak = cur.queue_total;
+    }
+    
+    g_health.prev = cur;
+    g_health.have_prev = true;
+    
+    QueueHealthSnapshot copy = *snap;
+    queue_health_listener_t listener = g_health.config.listener;
+    void* listener_data = g_health.config.listener_data;
+    
+    pthread_mutex_unlock(&g_health.lock);
+    
+    if (listener != NULL) {
+        listener(&copy, listener_data);
+    }
+    
+    // Degrade to pass-through rather than letting the queue stall
+    if (enable_fail_open) {
+        nfqueue_set_fail_open(true);
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * queue_health.h
+ * 
+ * Kernel queue health monitoring.
+ * Periodically samples /proc/net/netfilter/nfnetlink_queue for the bound
+ * queue, tracks backlog and drops, and flags overload so the queue can
+ * degrade to pass-through (fail-open) instead of stalling traffic.
+ */
+
+#ifndef QUEUE_HEALTH_H
+#define QUEUE_HEALTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nfqueue_handler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Latest health sample
+typedef struct {
+    NfqueueQueueStats queue;       // Raw kernel/socket counters
+    uint32_t backlog_peak;         // Highest backlog seen since start
+    uint64_t kernel_drops;         // queue_dropped + user_dropped since start
+    uint64_t rcvbuf_overruns;      // user_dropped since start (socket buffer full)
+    uint64_t overload_events;      // Transitions into overload
+    uint64_t samples;              // Number of successful samples
+    bool overloaded;               // Overload detected in the last sample
+} QueueHealthSnapshot;
+
+// Called after every successful sample (from the monitor thread)
+typedef void (*queue_health_listener_t)(const QueueHealthSnapshot* snapshot, void* user_data);
+
+// Monitor configuration
+typedef struct {
+    uint32_t interval_ms;          // Sampling period (default: 1000)
+    uint32_t overload_backlog;     // Backlog treated as overload (0 = 3/4 of queue_maxlen)
+    bool auto_fail_open;           // Enable fail-open when overload is detected
+    queue_health_listener_t listener;  // Optional sample listener
+    void* listener_data;           // User data for listener
+} QueueHealthConfig;
+
+/**
+ * Start health monitor thread
+ * @param config Monitor configuration, NULL for defaults
+ * @return 0 on success, -1 on error
+ */
+int queue_health_start(const QueueHealthConfig* config);
+
+/**
+ * Stop health monitor thread
+ */
+void queue_health_stop(void);
+
+/**
+ * Get latest health sample
+ * @param snapshot Output sample (zeroed if monitor never ran)
+ */
+void queue_health_get(QueueHealthSnapshot* snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QUEUE_HEALTH_H
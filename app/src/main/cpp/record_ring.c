@@ -0,0 +1,186 @@
+/**
+ * record_ring.c
+ *
+ * MPSC record ring implementation.
+ * Per-slot sequence numbers (Vyukov bounded queue): a slot is free for
+ * position p when seq == p, published when seq == p + 1.
+ */
+
+#include "record_ring.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#define WRITER_IDLE_MS 10
+
+// Record starts after the sequence number, aligned for any type
+#define SLOT_ALIGN _Alignof(max_align_t)
+#define RECORD_OFFSET ((sizeof(atomic_size_t) + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN)
+
+// Forward declarations
+static void* writer_thread_func(void* arg);
+static atomic_size_t* slot_seq(RecordRing* ring, size_t pos);
+
+/**
+ * Allocate slots
+ */
+size_t record_ring_init(RecordRing* ring, size_t slots, size_t record_size) {
+    // Round ring size up to a power of two
+    size_t capacity = 2;
+    while (capacity < slots) capacity <<= 1;
+    
+    ring->stride = (RECORD_OFFSET + record_size + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+    ring->slots = malloc(capacity * ring->stride);
+    if (ring->slots == NULL) return 0;
+    
+    ring->mask = capacity - 1;
+    for (size_t i = 0; i < capacity; i++) atomic_init(slot_seq(ring, i), i);
+    atomic_store(&ring->enqueue_pos, 0);
+    ring->dequeue_pos = 0;
+    return capacity;
+}
+
+/**
+ * Free slots
+ */
+void record_ring_free(RecordRing* ring) {
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/**
+ * Start writer and accept producers
+ */
+int record_ring_start(RecordRing* ring, RecordRingDrain drain, void* ctx) {
+    ring->drain = drain;
+    ring->ctx = ctx;
+    
+    atomic_store(&ring->writer_running, true);
+    if (pthread_create(&ring->writer, NULL, writer_thread_func, ring) != 0) {
+        atomic_store(&ring->writer_running, false);
+        return -1;
+    }
+    
+    atomic_store(&ring->active, true);
+    return 0;
+}
+
+/**
+ * Stop producers, drain and join writer
+ */
+void record_ring_stop(RecordRing* ring) {
+    // No new producers; wait for those already pushing
+    atomic_store(&ring->active, false);
+    while (atomic_load(&ring->inflight) != 0) {
+        struct timespec ts = { 0, 100000 };
+        nanosleep(&ts, NULL);
+    }
+    
+    // Writer drains what is left before exiting
+    atomic_store(&ring->writer_running, false);
+    pthread_join(ring->writer, NULL);
+}
+
+/**
+ * Accepting producers?
+ */
+bool record_ring_active(RecordRing* ring) {
+    return atomic_load_explicit(&ring->active, memory_order_relaxed);
+}
+
+/**
+ * Enter as producer
+ */
+bool record_ring_enter(RecordRing* ring) {
+    atomic_fetch_add(&ring->inflight, 1);
+    if (!atomic_load(&ring->active)) {
+        atomic_fetch_sub(&ring->inflight, 1);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Leave as producer
+ */
+void record_ring_leave(RecordRing* ring) {
+    atomic_fetch_sub(&ring->inflight, 1);
+}
+
+/**
+ * Claim a slot; drop if the ring is full
+ */
+void* record_ring_claim(RecordRing* ring, size_t* pos_out) {
+    size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    
+    for (;;) {
+        size_t seq = atomic_load_explicit(slot_seq(ring, pos), memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    
+    *pos_out = pos;
+    return (uint8_t*)slot_seq(ring, pos) + RECORD_OFFSET;
+}
+
+/**
+ * Publish a claimed slot
+ */
+void record_ring_publish(RecordRing* ring, size_t pos) {
+    atomic_store_explicit(slot_seq(ring, pos), pos + 1, memory_order_release);
+}
+
+/**
+ * Next published record
+ */
+const void* record_ring_peek(RecordRing* ring) {
+    atomic_size_t* seq = slot_seq(ring, ring->dequeue_pos);
+    if (atomic_load_explicit(seq, memory_order_acquire) != ring->dequeue_pos + 1) return NULL;
+    return (uint8_t*)seq + RECORD_OFFSET;
+}
+
+/**
+ * Free the peeked slot for the next lap
+ */
+void record_ring_release(RecordRing* ring) {
+    atomic_store_explicit(slot_seq(ring, ring->dequeue_pos), ring->dequeue_pos + ring->mask + 1,
+                          memory_order_release);
+    ring->dequeue_pos++;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * Writer: drain until empty, idle briefly, final drain after stop
+ */
+static void* writer_thread_func(void* arg) {
+    RecordRing* ring = arg;
+    
+    for (;;) {
+        if (ring->drain(ring->ctx) > 0) continue;
+        if (!atomic_load(&ring->writer_running)) break;
+        
+        struct timespec ts = { 0, WRITER_IDLE_MS * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+    
+    while (ring->drain(ring->ctx) > 0) {}
+    return NULL;
+}
+
+static atomic_size_t* slot_seq(RecordRing* ring, size_t pos) {
+    return (atomic_size_t*)(ring->slots + (pos & ring->mask) * ring->stride);
+}
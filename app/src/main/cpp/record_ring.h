@@ -0,0 +1,130 @@
+/**
+ * record_ring.h
+ *
+ * Bounded MPSC ring of fixed-size records with a background writer.
+ * Producers claim a slot, fill it and publish it without locks; a full
+ * ring drops the record (counted) instead of blocking. One writer thread
+ * drains the ring through a callback. Shared by the decision trace and
+ * the daemon logger.
+ */
+
+#ifndef RECORD_RING_H
+#define RECORD_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Writer callback: consume published records (record_ring_peek/release)
+ * @param ctx Context passed to record_ring_start
+ * @return Number of records consumed (0 = ring empty, writer idles)
+ */
+typedef size_t (*RecordRingDrain)(void* ctx);
+
+// Ring state; zero-initialize, counters survive restarts
+typedef struct {
+    uint8_t* slots;                // Slot = sequence number + record
+    size_t stride;                 // Bytes per slot
+    size_t mask;
+    atomic_size_t enqueue_pos;
+    size_t dequeue_pos;            // Writer only
+    atomic_bool active;
+    atomic_int inflight;           // Producers inside the ring
+    // Writer
+    pthread_t writer;
+    atomic_bool writer_running;
+    RecordRingDrain drain;
+    void* ctx;
+    atomic_uint_fast64_t dropped;  // Records lost because the ring was full
+} RecordRing;
+
+/**
+ * Allocate the slots
+ * @param ring Ring
+ * @param slots Capacity in records, rounded up to a power of two
+ * @param record_size Bytes per record
+ * @return Capacity on success, 0 if the allocation failed
+ */
+size_t record_ring_init(RecordRing* ring, size_t slots, size_t record_size);
+
+/**
+ * Free the slots (after record_ring_stop)
+ * @param ring Ring
+ */
+void record_ring_free(RecordRing* ring);
+
+/**
+ * Start the writer thread and accept producers
+ * @param ring Initialized ring
+ * @param drain Writer callback
+ * @param ctx Callback context
+ * @return 0 on success, -1 if the thread cannot be created
+ */
+int record_ring_start(RecordRing* ring, RecordRingDrain drain, void* ctx);
+
+/**
+ * Refuse new producers, wait for those inside, then let the writer drain
+ * what is left and join it
+ * @param ring Running ring
+ */
+void record_ring_stop(RecordRing* ring);
+
+/**
+ * Accepting producers?
+ * @param ring Ring
+ */
+bool record_ring_active(RecordRing* ring);
+
+/**
+ * Enter as a producer; every true return needs record_ring_leave
+ * @param ring Ring
+ * @return false if the ring is stopped
+ */
+bool record_ring_enter(RecordRing* ring);
+
+/**
+ * Leave as a producer
+ * @param ring Ring
+ */
+void record_ring_leave(RecordRing* ring);
+
+/**
+ * Claim the next slot (producer, between enter and leave)
+ * @param ring Ring
+ * @param pos Output position for record_ring_publish
+ * @return Record to fill, or NULL if the ring is full (counted as dropped)
+ */
+void* record_ring_claim(RecordRing* ring, size_t* pos);
+
+/**
+ * Publish a claimed record to the writer
+ * @param ring Ring
+ * @param pos Position from record_ring_claim
+ */
+void record_ring_publish(RecordRing* ring, size_t pos);
+
+/**
+ * Next published record (writer only)
+ * @param ring Ring
+ * @return Record, or NULL if none is ready
+ */
+const void* record_ring_peek(RecordRing* ring);
+
+/**
+ * Return the record from record_ring_peek to the producers (writer only)
+ * @param ring Ring
+ */
+void record_ring_release(RecordRing* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RECORD_RING_H
@@ -0,0 +1,122 @@
+/**
+ * rotating_file.c
+ *
+ * Rotating output file implementation.
+ */
+
+#include "rotating_file.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Forward declarations
+static int reopen(RotatingFile* rf);
+static int rotate(RotatingFile* rf);
+
+/**
+ * Open current file
+ */
+int rotating_file_open(RotatingFile* rf, const RotatingFileConfig* config) {
+    if (strlen(config->path) >= sizeof(rf->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    
+    rotating_file_close(rf);
+    rf->config = *config;
+    strcpy(rf->path, config->path);
+    rf->config.path = rf->path;
+    return reopen(rf);
+}
+
+/**
+ * Write record, rotating first if needed
+ */
+int rotating_file_write(RotatingFile* rf, const void* data, size_t len) {
+    if (rf->file == NULL) return -1;
+    
+    if (rf->bytes + len > rf->config.max_bytes && rf->bytes > rf->header_bytes) {
+        if (rotate(rf) < 0) return ROTATING_FILE_REOPEN_FAILED;
+    }
+    
+    size_t written = fwrite(data, 1, len, rf->file);
+    rf->bytes += written;
+    return 0;
+}
+
+/**
+ * Flush buffers
+ */
+void rotating_file_flush(RotatingFile* rf) {
+    if (rf->file != NULL) fflush(rf->file);
+}
+
+/**
+ * Close file
+ */
+void rotating_file_close(RotatingFile* rf) {
+    if (rf->file != NULL) fclose(rf->file);
+    rf->file = NULL;
+    free(rf->buffer);
+    rf->buffer = NULL;
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+static int reopen(RotatingFile* rf) {
+    rf->file = fopen(rf->path, rf->config.append ? "ae" : "we");
+    if (rf->file == NULL) return -1;
+    
+    if (rf->config.buffer_size == 0) {
+        setvbuf(rf->file, NULL, _IONBF, 0);
+    } else {
+        if (rf->buffer == NULL) rf->buffer = malloc(rf->config.buffer_size);
+        if (rf->buffer != NULL) setvbuf(rf->file, rf->buffer, _IOFBF, rf->config.buffer_size);
+    }
+    
+    struct stat st;
+    rf->bytes = rf->config.append && fstat(fileno(rf->file), &st) == 0 ? (uint64_t)st.st_size : 0;
+    rf->header_bytes = 0;
+    if (rf->config.header != NULL && rf->bytes == 0) {
+        rf->header_bytes = rf->config.header(rf->file, rf->config.header_ctx);
+        rf->bytes = rf->header_bytes;
+    }
+    return 0;
+}
+
+/**
+ * path -> path.1 -> ... -> path.<max_files>; the oldest is overwritten
+ * If the new file cannot be opened, nothing is written (or rotated) until
+ * the next rotating_file_open.
+ */
+static int rotate(RotatingFile* rf) {
+    char from[sizeof(rf->path) + 12], to[sizeof(rf->path) + 12];
+    
+    fclose(rf->file);
+    rf->file = NULL;
+    
+    for (uint32_t i = rf->config.max_files; i > 1; i--) {
+        snprintf(from, sizeof(from), "%s.%u", rf->path, i - 1);
+        snprintf(to, sizeof(to), "%s.%u", rf->path, i);
+        rename(from, to);
+    }
+    if (rf->config.max_files > 0) {
+        snprintf(to, sizeof(to), "%s.1", rf->path);
+        rename(rf->path, to);
+    } else {
+        unlink(rf->path);
+    }
+    
+    atomic_fetch_add(&rf->rotations, 1);
+    if (reopen(rf) < 0) {
+        rf->bytes = 0;
+        rf->header_bytes = 0;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * rotating_file.h
+ *
+ * Size-capped output file with numbered history (path.1, path.2, ...).
+ * Used from a single writer thread; shared by the decision trace and the
+ * daemon logger. If the file cannot be reopened after a rotation, writes
+ * are refused until the next open instead of rotating again.
+ */
+
+#ifndef ROTATING_FILE_H
+#define ROTATING_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// rotating_file_write result when the reopen after a rotation failed
+#define ROTATING_FILE_REOPEN_FAILED -2
+
+/**
+ * Header writer, called at the start of every new file
+ * @param file Open file
+ * @param ctx Context from the configuration
+ * @return Bytes written
+ */
+typedef uint64_t (*RotatingFileHeader)(FILE* file, void* ctx);
+
+// File configuration
+typedef struct {
+    const char* path;              // Current file; rotated files get .1, .2, ...
+    uint64_t max_bytes;            // Rotate before a write that would exceed this
+    uint32_t max_files;            // Rotated files kept besides the current one (0 = none)
+    bool append;                   // Keep an existing file (else truncate)
+    size_t buffer_size;            // stdio buffer (0 = unbuffered)
+    RotatingFileHeader header;     // Optional
+    void* header_ctx;
+} RotatingFileConfig;
+
+// File state; zero-initialize, rotations survive reopening
+typedef struct {
+    RotatingFileConfig config;
+    char path[256];
+    FILE* file;                    // NULL when closed or lost
+    char* buffer;
+    uint64_t bytes;                // Size of the current file
+    uint64_t header_bytes;
+    atomic_uint_fast64_t rotations;
+} RotatingFile;
+
+/**
+ * Open (or create) the current file
+ * @param rf File state
+ * @param config Configuration (path is copied)
+ * @return 0 on success, -1 with errno set
+ */
+int rotating_file_open(RotatingFile* rf, const RotatingFileConfig* config);
+
+/**
+ * Write one record, rotating first if it would exceed the cap
+ * A file always takes at least one record, however small the cap.
+ * @param rf File state
+ * @param data Record
+ * @param len Record length
+ * @return 0 if written, -1 if there is no file, ROTATING_FILE_REOPEN_FAILED
+ *         if this call rotated and could not reopen (errno set)
+ */
+int rotating_file_write(RotatingFile* rf, const void* data, size_t len);
+
+/**
+ * Flush stdio buffers to the file
+ * @param rf File state
+ */
+void rotating_file_flush(RotatingFile* rf);
+
+/**
+ * Close the file and free its buffer
+ * @param rf File state
+ */
+void rotating_file_close(RotatingFile* rf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ROTATING_FILE_H
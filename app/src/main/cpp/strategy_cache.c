@@ -0,0 +1,478 @@
+/**
+ * strategy_cache.c
+ *
+ * Per-host strategy cache implementation.
+ * Open-addressed table of fixed-size entries; a host lives in one of
+ * PROBE_WINDOW slots after its hash, and the least recently used entry
+ * of the window is replaced when all are taken. The table is the file
+ * mapping itself, so no explicit save is needed.
+ */
+
+#include "strategy_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LOG_TAG "Strategy"
+#include "netrix_log.h"
+
+#define CACHE_MAGIC 0x4353584EU        // "NXSC"
+#define CACHE_VERSION 1
+#define PROBE_WINDOW 16
+#define DEFAULT_CAPACITY 4096
+#define DEFAULT_PROBE_INTERVAL 32
+#define DEFAULT_RETRY_AFTER_SEC 3600
+#define DEMOTE_FAILURES 2              // Consecutive failures that demote a proven method
+
+// Per-method history of one host
+typedef struct {
+    uint16_t successes;                // Saturating
+    uint8_t fail_streak;               // Consecutive failures (saturating)
+    uint8_t split_count;               // Parameters of the last success
+    uint16_t first_packet_size;
+    uint16_t reserved;
+    uint32_t last_fail;                // Unix time of the last failure
+} MethodRecord;
+
+// One host (key 0 = free slot)
+typedef struct {
+    uint64_t key;
+    uint32_t last_used;                // Unix time of the last selection
+    uint16_t flows;                    // Flows since the last probe
+    uint16_t reserved;
+    MethodRecord methods[BYPASS_METHOD_COUNT];
+} CacheEntry;
+
+// File header (entries follow)
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t capacity;
+    uint32_t method_count;
+} CacheHeader;
+
+static const char* const OUTCOME_NAMES[STRATEGY_OUTCOME_COUNT] = {
+    "success", "rst", "timeout", "retransmit"
+};
+
+// Relative cost of a method for the flow (added latency, extra packets).
+// Enum order is not cost order: new methods are appended to the enum
+static const uint8_t METHOD_COST[BYPASS_METHOD_COUNT] = {
+    [BYPASS_NONE] = 0,
+    [BYPASS_OOB] = 1,                  // One extra segment, no delay
+    [BYPASS_IPFRAG] = 2,               // Two fragments, no delay
+    [BYPASS_IPFRAG_REVERSE] = 2,
+    [BYPASS_SPLIT] = 3,                // split_delay between segments
+    [BYPASS_SPLIT_REVERSE] = 3,
+    [BYPASS_DISORDER] = 4,             // split_count segments, delayed
+    [BYPASS_DISORDER_REVERSE] = 4,
+    [BYPASS_WINDOW_CLAMP] = 5,         // Client segments at a few bytes per RTT
+};
+
+// Global state
+static struct {
+    StrategyCacheConfig config;
+    void* map;
+    size_t map_size;
+    CacheEntry* entries;
+    uint32_t mask;
+    uint32_t count;
+    StrategyCacheStats stats;
+    BypassMethod by_cost[BYPASS_METHOD_COUNT];  // Cheapest first
+    pthread_mutex_t lock;
+} g_cache = {
+    .map = NULL,
+    .entries = NULL,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Forward declarations
+static CacheEntry* find_entry(uint64_t key);
+static CacheEntry* insert_entry(uint64_t key, uint32_t now);
+static bool method_working(const MethodRecord* record);
+static bool method_usable(const MethodRecord* record, uint32_t now);
+static void default_choice(const DpiBypassSettings* defaults, StrategyChoice* choice);
+static void sort_by_cost(void);
+
+/**
+ * Open cache
+ */
+int strategy_cache_open(const StrategyCacheConfig* config) {
+    strategy_cache_close();
+    
+    pthread_mutex_lock(&g_cache.lock);
+    
+    memset(&g_cache.config, 0, sizeof(g_cache.config));
+    g_cache.config.probe_interval = DEFAULT_PROBE_INTERVAL;
+    if (config != NULL) g_cache.config = *config;
+    g_cache.config.path = NULL;
+    if (g_cache.config.retry_after_sec == 0) g_cache.config.retry_after_sec = DEFAULT_RETRY_AFTER_SEC;
+    
+    // Round capacity up to a power of two
+    uint32_t capacity = PROBE_WINDOW;
+    uint32_t wanted = g_cache.config.capacity ? g_cache.config.capacity : DEFAULT_CAPACITY;
+    while (capacity < wanted) capacity <<= 1;
+    g_cache.config.capacity = capacity;
+    
+    size_t size = sizeof(CacheHeader) + (size_t)capacity * sizeof(CacheEntry);
+    const char* path = config != NULL ? config->path : NULL;
+    bool reuse = false;
+    void* map;
+    
+    if (path != NULL) {
+        int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            LOGE("Cannot open strategy cache %s: %s", path, strerror(errno));
+            pthread_mutex_unlock(&g_cache.lock);
+            return -1;
+        }
+        
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+            CacheHeader header;
+            reuse = pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                    header.magic == CACHE_MAGIC && header.version == CACHE_VERSION &&
+                    header.entry_size == sizeof(CacheEntry) && header.capacity == capacity &&
+                    header.method_count == BYPASS_METHOD_COUNT;
+        }
+        if (!reuse && (ftruncate(fd, 0) < 0 || ftruncate(fd, (off_t)size) < 0)) {
+            LOGE("Cannot size strategy cache %s: %s", path, strerror(errno));
+            close(fd);
+            pthread_mutex_unlock(&g_cache.lock);
+            return -1;
+        }
+        
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    } else {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    
+    if (map == MAP_FAILED) {
+        LOGE("Strategy cache mmap failed: %s", strerror(errno));
+        pthread_mutex_unlock(&g_cache.lock);
+        return -1;
+    }
+    
+    CacheHeader* header = (CacheHeader*)map;
+    if (!reuse) {
+        memset(map, 0, size);
+        header->magic = CACHE_MAGIC;
+        header->version = CACHE_VERSION;
+        header->entry_size = sizeof(CacheEntry);
+        header->capacity = capacity;
+        header->method_count = BYPASS_METHOD_COUNT;
+    }
+    
+    g_cache.map = map;
+    g_cache.map_size = size;
+    g_cache.entries = (CacheEntry*)((uint8_t*)map + sizeof(CacheHeader));
+    g_cache.mask = capacity - 1;
+    memset(&g_cache.stats, 0, sizeof(g_cache.stats));
+    sort_by_cost();
+    
+    g_cache.count = 0;
+    for (uint32_t i = 0; i < capacity; i++) {
+        if (g_cache.entries[i].key != 0) g_cache.count++;
+    }
+    
+    LOGI("Strategy cache %s: %u/%u hosts (%s)", path ? path : "(memory)",
+         g_cache.count, capacity, reuse ? "loaded" : "new");
+    
+    pthread_mutex_unlock(&g_cache.lock);
+    return 0;
+}
+
+/**
+ * Close cache
+ */
+void strategy_cache_close(void) {
+    pthread_mutex_lock(&g_cache.lock);
+    if (g_cache.map != NULL) {
+        msync(g_cache.map, g_cache.map_size, MS_ASYNC);
+        munmap(g_cache.map, g_cache.map_size);
+        g_cache.map = NULL;
+        g_cache.entries = NULL;
+    }
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+/**
+ * Cache open?
+ */
+bool strategy_cache_enabled(void) {
+    return g_cache.entries != NULL;
+}
+
+/**
+ * FNV-1a over the lowercased host, or over the address
+ */
+uint64_t strategy_cache_key(const char* host, uint32_t dst_ip) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    
+    if (host != NULL && host[0] != '\0') {
+        for (const char* p = host; *p; p++) {
+            char c = *p;
+            if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+            hash = (hash ^ (uint8_t)c) * 0x100000001b3ULL;
+        }
+    } else {
+        hash = (hash ^ 0xFF) * 0x100000001b3ULL;  // 0xFF never occurs in a hostname
+        for (int i = 0; i < 4; i++) {
+            hash = (hash ^ ((dst_ip >> (i * 8)) & 0xFF)) * 0x100000001b3ULL;
+        }
+    }
+    
+    return hash != 0 ? hash : 1;
+}
+
+/**
+ * Choose strategy
+ */
+void strategy_cache_select(uint64_t key, const DpiBypassSettings* defaults, uint32_t unavailable,
+                           StrategyChoice* choice) {
+    default_choice(defaults, choice);
+    if (unavailable & (1u << choice->method)) choice->method = BYPASS_NONE;
+    
+    pthread_mutex_lock(&g_cache.lock);
+    if (g_cache.entries == NULL) {
+        pthread_mutex_unlock(&g_cache.lock);
+        return;
+    }
+    
+    uint32_t now = (uint32_t)time(NULL);
+    g_cache.stats.lookups++;
+    
+    CacheEntry* entry = find_entry(key);
+    if (entry == NULL) {
+        insert_entry(key, now);
+        pthread_mutex_unlock(&g_cache.lock);
+        return;
+    }
+    entry->last_used = now;
+    
+    // Cheapest known-working method
+    int best = -1;
+    for (int i = 0; i < BYPASS_METHOD_COUNT; i++) {
+        if (!(unavailable & (1u << g_cache.by_cost[i])) &&
+            method_working(&entry->methods[g_cache.by_cost[i]])) {
+            best = i;
+            break;
+        }
+    }
+    
+    if (best >= 0) {
+        BypassMethod method = g_cache.by_cost[best];
+        const MethodRecord* record = &entry->methods[method];
+        choice->method = method;
+        if (record->first_packet_size != 0) choice->first_packet_size = record->first_packet_size;
+        if (record->split_count != 0) choice->split_count = record->split_count;
+        g_cache.stats.known++;
+        
+        // Now and then try something cheaper that has not failed recently
+        if (g_cache.config.probe_interval > 0 && best > 0 &&
+            ++entry->flows >= g_cache.config.probe_interval) {
+            entry->flows = 0;
+            for (int i = 0; i < best; i++) {
+                BypassMethod m = g_cache.by_cost[i];
+                if (METHOD_COST[m] < METHOD_COST[method] && !(unavailable & (1u << m)) &&
+                    method_usable(&entry->methods[m], now)) {
+                    default_choice(defaults, choice);
+                    choice->method = m;
+                    choice->probe = true;
+                    g_cache.stats.probes++;
+                    break;
+                }
+            }
+        }
+        pthread_mutex_unlock(&g_cache.lock);
+        return;
+    }
+    
+    // Nothing works yet: configured method, then the others in cost order,
+    // no bypass last; if all failed recently take the least recent failure
+    BypassMethod order[BYPASS_METHOD_COUNT];
+    int n = 0;
+    order[n++] = choice->method;
+    for (int i = 0; i < BYPASS_METHOD_COUNT; i++) {
+        BypassMethod m = g_cache.by_cost[i];
+        if (m != BYPASS_NONE && m != choice->method && !(unavailable & (1u << m))) order[n++] = m;
+    }
+    if (choice->method != BYPASS_NONE) order[n++] = BYPASS_NONE;
+    
+    BypassMethod pick = order[0];
+    uint32_t oldest = UINT32_MAX;
+    for (int i = 0; i < n; i++) {
+        const MethodRecord* record = &entry->methods[order[i]];
+        if (method_usable(record, now)) {
+            pick = order[i];
+            break;
+        }
+        if (record->last_fail < oldest) {
+            oldest = record->last_fail;
+            pick = order[i];
+        }
+    }
+    choice->method = pick;
+    
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+/**
+ * Record outcome
+ */
+void strategy_cache_report(uint64_t key, const StrategyChoice* choice, StrategyOutcome outcome) {
+    if ((unsigned)outcome >= STRATEGY_OUTCOME_COUNT || (unsigned)choice->method >= BYPASS_METHOD_COUNT) {
+        return;
+    }
+    
+    pthread_mutex_lock(&g_cache.lock);
+    if (g_cache.entries == NULL) {
+        pthread_mutex_unlock(&g_cache.lock);
+        return;
+    }
+    
+    g_cache.stats.outcomes[outcome]++;
+    
+    CacheEntry* entry = find_entry(key);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&g_cache.lock);
+        return;
+    }
+    
+    MethodRecord* record = &entry->methods[choice->method];
+    if (outcome == STRATEGY_OUTCOME_SUCCESS) {
+        if (record->successes < UINT16_MAX) record->successes++;
+        record->fail_streak = 0;
+        record->first_packet_size = choice->first_packet_size;
+        record->split_count = choice->split_count;
+    } else {
+        if (record->fail_streak < UINT8_MAX) record->fail_streak++;
+        record->last_fail = (uint32_t)time(NULL);
+    }
+    
+    LOGD("Outcome %s for %016llx: method=%s%s successes=%u fail_streak=%u",
+         OUTCOME_NAMES[outcome], (unsigned long long)key, dpi_method_name(choice->method),
+         choice->probe ? " (probe)" : "", record->successes, record->fail_streak);
+    
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+/**
+ * Forget all hosts
+ */
+void strategy_cache_clear(void) {
+    pthread_mutex_lock(&g_cache.lock);
+    if (g_cache.entries != NULL) {
+        memset(g_cache.entries, 0, (size_t)(g_cache.mask + 1) * sizeof(CacheEntry));
+        g_cache.count = 0;
+    }
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+/**
+ * Get counters
+ */
+void strategy_cache_get_stats(StrategyCacheStats* stats) {
+    if (stats == NULL) return;
+    pthread_mutex_lock(&g_cache.lock);
+    *stats = g_cache.stats;
+    stats->entries = g_cache.count;
+    stats->capacity = g_cache.entries != NULL ? g_cache.mask + 1 : 0;
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+/**
+ * Get outcome name
+ */
+const char* strategy_outcome_name(StrategyOutcome outcome) {
+    if ((unsigned)outcome >= STRATEGY_OUTCOME_COUNT) return "unknown";
+    return OUTCOME_NAMES[outcome];
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+static CacheEntry* find_entry(uint64_t key) {
+    uint32_t start = (uint32_t)(key ^ (key >> 32));
+    for (uint32_t i = 0; i < PROBE_WINDOW; i++) {
+        CacheEntry* entry = &g_cache.entries[(start + i) & g_cache.mask];
+        if (entry->key == key) return entry;
+    }
+    return NULL;
+}
+
+/**
+ * Take a free slot of the window, or the least recently used one
+ */
+static CacheEntry* insert_entry(uint64_t key, uint32_t now) {
+    uint32_t start = (uint32_t)(key ^ (key >> 32));
+    CacheEntry* victim = NULL;
+    
+    for (uint32_t i = 0; i < PROBE_WINDOW; i++) {
+        CacheEntry* entry = &g_cache.entries[(start + i) & g_cache.mask];
+        if (entry->key == 0) {
+            victim = entry;
+            break;
+        }
+        if (victim == NULL || entry->last_used < victim->last_used) victim = entry;
+    }
+    
+    if (victim->key != 0) {
+        g_cache.stats.evictions++;
+    } else {
+        g_cache.count++;
+    }
+    
+    memset(victim, 0, sizeof(*victim));
+    victim->key = key;
+    victim->last_used = now;
+    return victim;
+}
+
+/**
+ * Proven and not demoted by repeated failures
+ */
+static bool method_working(const MethodRecord* record) {
+    return record->successes > 0 && record->fail_streak < DEMOTE_FAILURES;
+}
+
+/**
+ * Never failed, or failed long enough ago to try again
+ */
+static bool method_usable(const MethodRecord* record, uint32_t now) {
+    return record->fail_streak == 0 || now - record->last_fail >= g_cache.config.retry_after_sec;
+}
+
+static void default_choice(const DpiBypassSettings* defaults, StrategyChoice* choice) {
+    choice->method = defaults->method;
+    choice->first_packet_size = defaults->first_packet_size;
+    choice->split_count = defaults->split_count;
+    choice->split_delay_us = defaults->split_delay_ms * 1000;
+    choice->probe = false;
+    choice->clamp_pending = false;
+}
+
+/**
+ * Order methods by METHOD_COST, ties in enum order (insertion sort, stable)
+ */
+static void sort_by_cost(void) {
+    for (int m = 0; m < BYPASS_METHOD_COUNT; m++) {
+        int i = m;
+        while (i > 0 && METHOD_COST[g_cache.by_cost[i - 1]] > METHOD_COST[m]) {
+            g_cache.by_cost[i] = g_cache.by_cost[i - 1];
+            i--;
+        }
+        g_cache.by_cost[i] = (BypassMethod)m;
+    }
+}
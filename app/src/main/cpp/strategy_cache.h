@@ -0,0 +1,133 @@
+/**
+ * strategy_cache.h
+ *
+ * Per-host bypass strategy cache.
+ * Remembers, per SNI/Host (or destination IP when there is none), which
+ * bypass methods led to a completed handshake and which failed, and picks
+ * the cheapest known-working method for each new flow. Entries live in a
+ * fixed-size memory-mapped file so a restarted daemon starts warm.
+ */
+
+#ifndef STRATEGY_CACHE_H
+#define STRATEGY_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dpi_bypass.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Handshake outcome observed for a flow
+typedef enum {
+    STRATEGY_OUTCOME_SUCCESS = 0,   // Server answered (its data was acknowledged)
+    STRATEGY_OUTCOME_RST,           // Connection reset before an answer
+    STRATEGY_OUTCOME_TIMEOUT,       // No answer within the flow timeout
+    STRATEGY_OUTCOME_RETRANSMIT,    // ClientHello / request retransmitted
+    STRATEGY_OUTCOME_COUNT
+} StrategyOutcome;
+
+// Strategy applied to one flow
+typedef struct {
+    BypassMethod method;           // Bypass method
+    uint16_t first_packet_size;    // Split position
+    uint8_t split_count;           // Fragments for disorder
+    uint32_t split_delay_us;       // Delay between fragments
+    bool probe;                    // Cheaper method tried on a host with a working one
+    bool clamp_pending;            // WINDOW_CLAMP chosen after the SYN: this flow is
+                                   // split, the clamp starts with the next connection
+} StrategyChoice;
+
+// Cache configuration
+typedef struct {
+    const char* path;              // Backing file (NULL = in memory only)
+    uint32_t capacity;             // Entries, power of two (default: 4096)
+    uint32_t probe_interval;       // Flows between probes of a cheaper method (0 = never)
+    uint32_t retry_after_sec;      // Retry a failed method after this long (default: 3600)
+} StrategyCacheConfig;
+
+// Cache counters (since open)
+typedef struct {
+    uint32_t entries;              // Hosts in the cache
+    uint32_t capacity;             // Cache capacity
+    uint64_t lookups;              // Strategy selections
+    uint64_t known;                // Selections that used a known-working method
+    uint64_t probes;               // Selections that probed a cheaper method
+    uint64_t evictions;            // Entries replaced to make room
+    uint64_t outcomes[STRATEGY_OUTCOME_COUNT];  // Reported outcomes
+} StrategyCacheStats;
+
+/**
+ * Open (or create) the cache
+ * An existing file with a matching layout is reused; anything else is
+ * reinitialized.
+ * @param config Cache configuration
+ * @return 0 on success, -1 on error
+ */
+int strategy_cache_open(const StrategyCacheConfig* config);
+
+/**
+ * Flush and close the cache
+ */
+void strategy_cache_close(void);
+
+/**
+ * Check if the cache is open
+ * @return true if open
+ */
+bool strategy_cache_enabled(void);
+
+/**
+ * Cache key for a destination
+ * @param host SNI / Host (NULL or "" to key by address)
+ * @param dst_ip Destination IP (network byte order)
+ * @return Non-zero key
+ */
+uint64_t strategy_cache_key(const char* host, uint32_t dst_ip);
+
+/**
+ * Choose the strategy for a new flow
+ * Known-working methods win (cheapest first, with an occasional probe of
+ * a cheaper one); otherwise the configured method is tried first and
+ * failed methods are skipped in cost order until retry_after_sec passes.
+ * @param key Destination key
+ * @param defaults Settings used for unknown hosts
+ * @param unavailable Methods that cannot run for this flow (1 << BypassMethod),
+ *                    never picked
+ * @param choice Output strategy
+ */
+void strategy_cache_select(uint64_t key, const DpiBypassSettings* defaults, uint32_t unavailable,
+                           StrategyChoice* choice);
+
+/**
+ * Record the outcome of a flow
+ * @param key Destination key
+ * @param choice Strategy the flow used
+ * @param outcome Observed outcome
+ */
+void strategy_cache_report(uint64_t key, const StrategyChoice* choice, StrategyOutcome outcome);
+
+/**
+ * Forget all hosts
+ */
+void strategy_cache_clear(void);
+
+/**
+ * Get cache counters
+ * @param stats Output counters
+ */
+void strategy_cache_get_stats(StrategyCacheStats* stats);
+
+/**
+ * Get short name of an outcome (for logs and metrics)
+ * @param outcome Outcome
+ * @return Static string, "unknown" if out of range
+ */
+const char* strategy_outcome_name(StrategyOutcome outcome);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STRATEGY_CACHE_H
@@ -0,0 +1,106 @@
+/**
+ * uid_stats.c
+ *
+ * Per-app traffic counters implementation.
+ * Small open-addressing table keyed by UID; a device has a few hundred
+ * apps at most and only the ones with HTTP(S) traffic ever show up.
+ */
+
+#include "uid_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Table size (power of two)
+#define UID_SLOTS 256
+
+// Global state
+static struct {
+    UidStatsEntry slots[UID_SLOTS];
+    bool used[UID_SLOTS];
+    uint64_t overflows;
+    pthread_mutex_t lock;
+} g_uids = {
+    .overflows = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// Forward declarations
+static int compare_packets(const void* a, const void* b);
+
+/**
+ * Count a processed packet
+ */
+void uid_stats_record(const NfqueuePacket* packet, bool bypassed) {
+    if (packet == NULL) return;
+    uint32_t uid = packet->has_uid ? packet->uid : UID_STATS_UNKNOWN;
+    
+    pthread_mutex_lock(&g_uids.lock);
+    
+    uint32_t slot = (uid * 2654435761U) & (UID_SLOTS - 1);
+    for (uint32_t probe = 0; probe < UID_SLOTS; probe++) {
+        uint32_t i = (slot + probe) & (UID_SLOTS - 1);
+        if (!g_uids.used[i]) {
+            g_uids.used[i] = true;
+            g_uids.slots[i].uid = uid;
+        } else if (g_uids.slots[i].uid != uid) {
+            continue;
+        }
+        g_uids.slots[i].packets++;
+        g_uids.slots[i].bytes += packet->payload_len;
+        if (bypassed) g_uids.slots[i].bypassed++;
+        pthread_mutex_unlock(&g_uids.lock);
+        return;
+    }
+    
+    g_uids.overflows++;
+    pthread_mutex_unlock(&g_uids.lock);
+}
+
+/**
+ * Copy the counters, busiest UID first
+ */
+uint32_t uid_stats_snapshot(UidStatsEntry* entries, uint32_t max, uint64_t* overflows) {
+    UidStatsEntry all[UID_SLOTS];
+    uint32_t count = 0;
+    
+    pthread_mutex_lock(&g_uids.lock);
+    for (uint32_t i = 0; i < UID_SLOTS; i++) {
+        if (g_uids.used[i]) all[count++] = g_uids.slots[i];
+    }
+    if (overflows) *overflows = g_uids.overflows;
+    pthread_mutex_unlock(&g_uids.lock);
+    
+    qsort(all, count, sizeof(all[0]), compare_packets);
+    if (count > max) count = max;
+    if (entries != NULL && count > 0) {
+        memcpy(entries, all, count * sizeof(all[0]));
+    }
+    return count;
+}
+
+/**
+ * Reset all counters
+ */
+void uid_stats_clear(void) {
+    pthread_mutex_lock(&g_uids.lock);
+    memset(g_uids.slots, 0, sizeof(g_uids.slots));
+    memset(g_uids.used, 0, sizeof(g_uids.used));
+    g_uids.overflows = 0;
+    pthread_mutex_unlock(&g_uids.lock);
+}
+
+// ============================================================================
+// Internal functions
+// ============================================================================
+
+/**
+ * qsort comparator: more packets first
+ */
+static int compare_packets(const void* a, const void* b) {
+    const UidStatsEntry* ea = (const UidStatsEntry*)a;
+    const UidStatsEntry* eb = (const UidStatsEntry*)b;
+    if (ea->packets != eb->packets) return ea->packets > eb->packets ? -1 : 1;
+    return ea->uid < eb->uid ? -1 : (ea->uid > eb->uid);
+}
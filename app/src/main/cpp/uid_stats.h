@@ -0,0 +1,58 @@
+/**
+ * uid_stats.h
+ *
+ * Per-app traffic counters.
+ * Breaks queued packets down by the UID owning the sending socket (as
+ * reported by NFQA_UID when the queue requests NFQA_CFG_F_UID_GID), so
+ * the apps that actually need unblocking can be told apart from background
+ * traffic and targeted with owner-scoped queue rules.
+ */
+
+#ifndef UID_STATS_H
+#define UID_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nfqueue_handler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// UID under which packets without a socket owner are counted
+#define UID_STATS_UNKNOWN 0xFFFFFFFFU
+
+// Counters of one UID
+typedef struct {
+    uint32_t uid;                  // Socket owner (UID_STATS_UNKNOWN = not reported)
+    uint64_t packets;              // Packets queued
+    uint64_t bytes;                // Bytes queued
+    uint64_t bypassed;             // Packets replaced by injected fragments
+} UidStatsEntry;
+
+/**
+ * Count a processed packet
+ * @param packet Queued packet (uid taken from has_uid/uid)
+ * @param bypassed true if the packet was desynced
+ */
+void uid_stats_record(const NfqueuePacket* packet, bool bypassed);
+
+/**
+ * Copy the counters, busiest UID first
+ * @param entries Output array
+ * @param max Capacity of entries
+ * @param overflows Output: packets not counted because the table was full (may be NULL)
+ * @return Number of entries written
+ */
+uint32_t uid_stats_snapshot(UidStatsEntry* entries, uint32_t max, uint64_t* overflows);
+
+/**
+ * Reset all counters
+ */
+void uid_stats_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UID_STATS_H
@@ -9,6 +9,7 @@ import org.json.JSONObject
 import java.io.BufferedReader
 import java.io.File
 import java.io.FileOutputStream
+import java.io.IOException
 import java.io.InputStreamReader
 import java.io.OutputStreamWriter
 import java.net.Socket
@@ -311,6 +312,7 @@ object DaemonController {
             // Ignore, daemon might already be stopped
         }
         
+        NfqueueBridge.daemonDisconnect()
         Thread.sleep(200)
         
         // Force kill if still running
@@ -412,6 +414,10 @@ object DaemonController {
                 val response = sendCommandOnce(command)
                 Log.d(TAG, "[DEBUG] Command response: $response")
                 return response
+            } catch (e: IOException) {
+                // Sent but unanswered: the daemon may have run it, don't resend
+                Log.e(TAG, "[DEBUG] Command attempt ${attempt + 1} got no reply: ${e.message}")
+                throw e
             } catch (e: Exception) {
                 Log.w(TAG, "[DEBUG] Command attempt ${attempt + 1} failed: ${e.message}")
                 lastException = e
@@ -428,13 +434,12 @@ object DaemonController {
     private fun sendCommandOnce(command: String): String {
         Log.d(TAG, "[DEBUG] sendCommandOnce: $command")
         
-        // Check if nc (netcat) is available
-        val ncCheck = RootHelper.executeAsRoot("which nc 2>/dev/null || which netcat 2>/dev/null || echo 'not found'")
-        Log.d(TAG, "[DEBUG] nc location: ${ncCheck.output.trim()}")
+        // Method 1: Persistent native connection (socket is 0666, no su needed)
+        // Only a failed connect falls through; a lost reply throws IOException
+        NfqueueBridge.daemonCommand(SOCKET_PATH, command)?.let { return it.trim() }
+        Log.d(TAG, "[DEBUG] Direct socket connect failed, falling back to su")
         
-        // Try different methods to communicate with daemon
-        
-        // Method 1: Use nc with Unix socket
+        // Method 2: Use nc with Unix socket
         Log.d(TAG, "[DEBUG] Trying nc -U $SOCKET_PATH...")
         var result = RootHelper.executeAsRoot(
             "echo '$command' | nc -U $SOCKET_PATH 2>&1"
@@ -445,7 +450,7 @@ object DaemonController {
             return result.output.trim()
         }
         
-        // Method 2: Use socat
+        // Method 3: Use socat
         Log.d(TAG, "[DEBUG] Trying socat...")
         result = RootHelper.executeAsRoot(
             "echo '$command' | socat - UNIX-CONNECT:$SOCKET_PATH 2>&1"
@@ -456,7 +461,7 @@ object DaemonController {
             return result.output.trim()
         }
         
-        // Method 3: Direct file-based fallback (for testing)
+        // Method 4: Direct file-based fallback (for testing)
         Log.d(TAG, "[DEBUG] Falling back to error response...")
         
         throw Exception("Could not connect to daemon socket. nc output: ${result.output}, error: ${result.error}")
@@ -482,10 +487,15 @@ data class NfqueueSettings(
     val desyncHttps: Boolean = true,
     val desyncHttp: Boolean = true,
     val mixHostCase: Boolean = true,
-    val blockQuic: Boolean = true
+    val blockQuic: Boolean = true,
+    val targetUids: List<Int> = emptyList(),          // Apps to queue (empty = all apps)
+    val targetPackages: List<String> = emptyList(),   // Resolved to UIDs by the daemon
+    val bpfClassifier: Boolean = false                // Queue only handshake packets (xt_bpf)
 ) {
     fun toJson(): String {
-        return """{"method":"$method","first_packet_size":$firstPacketSize,"split_delay":$splitDelay,"split_count":$splitCount,"desync_https":$desyncHttps,"desync_http":$desyncHttp,"block_quic":$blockQuic}"""
+        val uids = targetUids.joinToString(",")
+        val packages = targetPackages.joinToString(",") { "\"$it\"" }
+        return """{"method":"$method","first_packet_size":$firstPacketSize,"split_delay":$splitDelay,"split_count":$splitCount,"desync_https":$desyncHttps,"desync_http":$desyncHttp,"block_quic":$blockQuic,"uids":[$uids],"packages":[$packages],"bpf_classifier":$bpfClassifier}"""
     }
 }
 
@@ -3,6 +3,7 @@ package com.enki.netrix.native
 import android.util.Log
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.withContext
+import java.nio.ByteBuffer
 import java.util.concurrent.atomic.AtomicBoolean
 
 /**
@@ -14,6 +15,8 @@ import java.util.concurrent.atomic.AtomicBoolean
  * 2. Setup iptables: RootHelper.setupIptables()
  * 3. Initialize: NfqueueBridge.init(0)
  * 4. Set callback: NfqueueBridge.setCallback(myCallback)
+ *    (or setDirectCallback for zero-copy delivery, setBatchCallback for one
+ *    upcall per netlink read)
  * 5. Start: NfqueueBridge.start()
  * 6. Stop: NfqueueBridge.stop()
  * 7. Cleanup: NfqueueBridge.cleanup()
@@ -28,6 +31,8 @@ object NfqueueBridge {
     
     // Current callback
     private var currentCallback: PacketCallback? = null
+    private var currentDirectCallback: DirectPacketCallback? = null
+    private var currentBatchCallback: BatchPacketCallback? = null
     
     // Verdict constants (match native enum)
     const val VERDICT_DROP = 0
@@ -39,6 +44,12 @@ object NfqueueBridge {
     const val PROTOCOL_TCP = 6
     const val PROTOCOL_UDP = 17
     
+    // Packet classes (match native DpiPacketClass)
+    const val CLASS_OTHER = 0
+    const val CLASS_TLS_CLIENT_HELLO = 1
+    const val CLASS_HTTP_REQUEST = 2
+    const val CLASS_QUIC_INITIAL = 3
+    
     init {
         try {
             System.loadLibrary("nfqueue_handler")
@@ -102,6 +113,8 @@ object NfqueueBridge {
         if (!libraryLoaded.get()) return
         
         currentCallback = callback
+        currentDirectCallback = null
+        currentBatchCallback = null
         
         // Create wrapper that implements the JNI interface
         val wrapper = if (callback != null) {
@@ -113,7 +126,12 @@ object NfqueueBridge {
                     dstIp: Int,
                     srcPort: Int,
                     dstPort: Int,
-                    payload: ByteArray?
+                    payload: ByteArray?,
+                    packetClass: Int,
+                    dataOffset: Int,
+                    hostOffset: Int,
+                    hostLength: Int,
+                    hostname: String?
                 ): Int {
                     val packet = NfqueuePacket(
                         packetId = packetId,
@@ -122,7 +140,8 @@ object NfqueueBridge {
                         dstIp = dstIp,
                         srcPort = srcPort,
                         dstPort = dstPort,
-                        payload = payload
+                        payload = payload,
+                        handshake = handshakeInfo(packetClass, dataOffset, hostOffset, hostLength, hostname)
                     )
                     return callback.onPacketReceived(packet)
                 }
@@ -132,6 +151,147 @@ object NfqueueBridge {
         nativeSetCallback(wrapper)
     }
     
+    /**
+     * Set zero-copy packet callback.
+     * Packets are delivered as a read-only view of the native receive
+     * buffer instead of a copied ByteArray.
+     * @param callback Callback to receive packets, or null to clear
+     */
+    fun setDirectCallback(callback: DirectPacketCallback?) {
+        if (!libraryLoaded.get()) return
+        
+        currentCallback = null
+        currentDirectCallback = callback
+        currentBatchCallback = null
+        
+        val wrapper = if (callback != null) {
+            object : NativeDirectPacketCallback {
+                // Native side always passes the same buffer; wrap it once
+                private var source: ByteBuffer? = null
+                private var view: ByteBuffer? = null
+                
+                override fun onPacketDirect(
+                    packetId: Int,
+                    protocol: Int,
+                    srcIp: Int,
+                    dstIp: Int,
+                    srcPort: Int,
+                    dstPort: Int,
+                    buffer: ByteBuffer,
+                    offset: Int,
+                    length: Int,
+                    packetClass: Int,
+                    dataOffset: Int,
+                    hostOffset: Int,
+                    hostLength: Int,
+                    hostname: String?
+                ): Int {
+                    if (buffer !== source) {
+                        source = buffer
+                        view = buffer.asReadOnlyBuffer()
+                    }
+                    val packet = view!!
+                    packet.clear()
+                    packet.limit(offset + length)
+                    packet.position(offset)
+                    return callback.onPacketReceived(
+                        packetId, protocol, srcIp, dstIp, srcPort, dstPort, packet,
+                        handshakeInfo(packetClass, dataOffset, hostOffset, hostLength, hostname)
+                    )
+                }
+            }
+        } else null
+        
+        nativeSetCallback(wrapper)
+    }
+    
+    /**
+     * Set batched packet callback.
+     * One upcall per netlink read instead of one per packet; verdicts
+     * are written back into a shared buffer and sent in one message.
+     * @param callback Callback to receive batches, or null to clear
+     */
+    fun setBatchCallback(callback: BatchPacketCallback?) {
+        if (!libraryLoaded.get()) return
+        
+        currentCallback = null
+        currentDirectCallback = null
+        currentBatchCallback = callback
+        
+        val wrapper = if (callback != null) {
+            object : NativeBatchPacketCallback {
+                // Native side always passes the same buffers; wrap them once
+                private var batch: PacketBatch? = null
+                private var source: ByteBuffer? = null
+                
+                override fun onPackets(packets: ByteBuffer, descriptors: ByteBuffer, count: Int) {
+                    if (packets !== source) {
+                        source = packets
+                        batch = PacketBatch(packets, descriptors)
+                    }
+                    val current = batch!!
+                    current.size = count
+                    callback.onPacketsReceived(current)
+                }
+            }
+        } else null
+        
+        nativeSetCallback(wrapper)
+    }
+    
+    /**
+     * Enable or disable the native prefilter.
+     * When enabled (default), packets that can never need bypass (ACKs,
+     * mid-stream data, non-web ports) get ACCEPT natively and only
+     * ClientHello / HTTP request / QUIC Initial packets reach the callback.
+     */
+    fun setPrefilter(enabled: Boolean) {
+        if (!libraryLoaded.get()) return
+        nativeSetPrefilter(enabled)
+    }
+    
+    /**
+     * Get prefilter counters
+     * @return Pair of (packets seen, packets delivered to the callback)
+     */
+    fun getPrefilterStats(): Pair<Long, Long> {
+        if (!libraryLoaded.get()) return Pair(0L, 0L)
+        val stats = nativeGetPrefilterStats()
+        return Pair(stats[0], stats[1])
+    }
+    
+    /**
+     * Send a command to the root daemon over its control socket.
+     * The socket is world-writable, so no su process is needed; the
+     * connection is kept open between calls.
+     * @return JSON reply, or null if the socket could not be connected
+     * @throws java.io.IOException if the command was sent but no reply
+     *         arrived; the daemon may have run it, so it must not be resent
+     */
+    fun daemonCommand(socketPath: String, command: String): String? {
+        if (!libraryLoaded.get()) return null
+        return nativeDaemonCommand(socketPath, command)
+    }
+    
+    /**
+     * Close the daemon control connection
+     */
+    fun daemonDisconnect() {
+        if (!libraryLoaded.get()) return
+        nativeDaemonDisconnect()
+    }
+    
+    private fun handshakeInfo(
+        packetClass: Int,
+        dataOffset: Int,
+        hostOffset: Int,
+        hostLength: Int,
+        hostname: String?
+    ): HandshakeInfo? {
+        if (packetClass == CLASS_OTHER) return null
+        return HandshakeInfo(packetClass, dataOffset, hostOffset, hostLength, hostname)
+    }
+    
     /**
      * Start NFQUEUE processing (blocking)
      * Call from background thread!
@@ -172,6 +332,8 @@ object NfqueueBridge {
         nativeCleanup()
         initialized.set(false)
         currentCallback = null
+        currentDirectCallback = null
+        currentBatchCallback = null
     }
     
     /**
@@ -196,13 +358,17 @@ object NfqueueBridge {
     // ========================================================================
     
     private external fun nativeInit(queueNum: Int): Boolean
-    private external fun nativeSetCallback(callback: NativePacketCallback?): Boolean
+    private external fun nativeSetCallback(callback: Any?): Boolean
     private external fun nativeStart(): Boolean
     private external fun nativeStop()
     private external fun nativeCleanup()
     private external fun nativeIsRunning(): Boolean
     private external fun nativeSetVerdict(packetId: Int, verdict: Int, modifiedPayload: ByteArray?): Boolean
     private external fun nativeGetError(): String
+    private external fun nativeSetPrefilter(enabled: Boolean)
+    private external fun nativeGetPrefilterStats(): LongArray
+    private external fun nativeDaemonCommand(socketPath: String, command: String): String?
+    private external fun nativeDaemonDisconnect()
 }
 
 /**
@@ -216,7 +382,40 @@ private interface NativePacketCallback {
         dstIp: Int,
         srcPort: Int,
         dstPort: Int,
-        payload: ByteArray?
+        payload: ByteArray?,
+        packetClass: Int,
+        dataOffset: Int,
+        hostOffset: Int,
+        hostLength: Int,
+        hostname: String?
+    ): Int
+}
+
+/**
+ * Internal interface for zero-copy JNI callback
+ */
+private interface NativeDirectPacketCallback {
+    fun onPacketDirect(
+        packetId: Int,
+        protocol: Int,
+        srcIp: Int,
+        dstIp: Int,
+        srcPort: Int,
+        dstPort: Int,
+        buffer: ByteBuffer,
+        offset: Int,
+        length: Int,
+        packetClass: Int,
+        dataOffset: Int,
+        hostOffset: Int,
+        hostLength: Int,
+        hostname: String?
     ): Int
 }
 
+/**
+ * Internal interface for batched JNI callback
+ */
+private interface NativeBatchPacketCallback {
+    fun onPackets(packets: ByteBuffer, descriptors: ByteBuffer, count: Int)
+}
@@ -1,6 +1,30 @@
 package com.enki.netrix.native
 
 import java.net.InetAddress
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.IntBuffer
+
+/**
+ * Handshake details pre-parsed by the native prefilter.
+ * Offsets are from the start of the IP packet.
+ */
+data class HandshakeInfo(
+    /** Packet class: NfqueueBridge.CLASS_TLS_CLIENT_HELLO, CLASS_HTTP_REQUEST, ... */
+    val packetClass: Int,
+    
+    /** Offset of application data (TLS record / HTTP request line) */
+    val dataOffset: Int,
+    
+    /** Offset of SNI / Host value, 0 if not found */
+    val hostOffset: Int,
+    
+    /** Length of SNI / Host value */
+    val hostLength: Int,
+    
+    /** SNI / Host value, null if not found */
+    val hostname: String?
+)
 
 /**
  * Data class representing a packet from NFQUEUE
@@ -12,10 +36,10 @@ data class NfqueuePacket(
     /** IP protocol (6=TCP, 17=UDP) */
     val protocol: Int,
     
-    /** Source IP in network byte order */
+    /** Source IP in network byte order (IPv6: address folded to 32 bits) */
     val srcIp: Int,
     
-    /** Destination IP in network byte order */
+    /** Destination IP in network byte order (IPv6: address folded to 32 bits) */
     val dstIp: Int,
     
     /** Source port in host byte order */
@@ -25,7 +49,10 @@ data class NfqueuePacket(
     val dstPort: Int,
     
     /** Raw packet payload (IP header + data) */
-    val payload: ByteArray?
+    val payload: ByteArray?,
+    
+    /** Native prefilter result, null for non-handshake packets */
+    val handshake: HandshakeInfo? = null
 ) {
     /** Check if TCP packet */
     val isTcp: Boolean get() = protocol == NfqueueBridge.PROTOCOL_TCP
@@ -39,23 +66,42 @@ data class NfqueuePacket(
     /** Check if HTTP (port 80) */
     val isHttp: Boolean get() = dstPort == 80
     
+    /** IP version from the header (4 or 6), 0 without payload */
+    val ipVersion: Int
+        get() = if (payload != null && payload.isNotEmpty()) {
+            (payload[0].toInt() shr 4) and 0x0F
+        } else 0
+    
+    /** Check if IPv6 packet */
+    val isIpv6: Boolean get() = ipVersion == 6
+    
     /** Get source IP as string */
-    val srcIpString: String get() = intToIpString(srcIp)
+    val srcIpString: String get() = ipString(srcIp, IPV6_SRC_OFFSET)
     
     /** Get destination IP as string */
-    val dstIpString: String get() = intToIpString(dstIp)
+    val dstIpString: String get() = ipString(dstIp, IPV6_DST_OFFSET)
     
-    /** Get IP header length */
+    /**
+     * Get IP header length; for IPv6 including extension headers.
+     * 0 if the header is truncated or there is no transport header
+     * (non-first fragment)
+     */
     val ipHeaderLength: Int
-        get() = if (payload != null && payload.isNotEmpty()) {
-            (payload[0].toInt() and 0x0F) * 4
-        } else 0
+        get() {
+            if (payload == null || payload.isEmpty()) return 0
+            return when (ipVersion) {
+                4 -> (payload[0].toInt() and 0x0F) * 4
+                6 -> ipv6TransportOffset(payload)
+                else -> 0
+            }
+        }
     
     /** Get TCP/UDP payload (after IP header) */
     val transportPayload: ByteArray?
         get() {
-            if (payload == null || payload.size <= ipHeaderLength) return null
-            return payload.copyOfRange(ipHeaderLength, payload.size)
+            val headerLen = ipHeaderLength
+            if (payload == null || headerLen == 0 || payload.size <= headerLen) return null
+            return payload.copyOfRange(headerLen, payload.size)
         }
     
     /** Get TCP data offset (header length) */
@@ -196,6 +242,7 @@ data class NfqueuePacket(
     
     /** Get hostname (SNI for HTTPS, Host header for HTTP) */
     fun getHostname(): String? {
+        handshake?.hostname?.let { return it }
         return if (isHttps) extractSni() else extractHttpHost()
     }
     
@@ -214,10 +261,67 @@ data class NfqueuePacket(
                "len=${payload?.size ?: 0})"
     }
     
+    /**
+     * IPv4: dotted quad of the native value. IPv6: the address from the
+     * header, or the folded native value marked as such without payload
+     */
+    private fun ipString(ip: Int, v6Offset: Int): String {
+        if (!isIpv6) return intToIpString(ip)
+        if (payload != null && payload.size >= IPV6_HEADER_LENGTH) {
+            return InetAddress.getByAddress(payload.copyOfRange(v6Offset, v6Offset + 16)).hostAddress
+                ?: foldedIpString(ip)
+        }
+        return foldedIpString(ip)
+    }
+    
     companion object {
+        private const val IPV6_HEADER_LENGTH = 40
+        private const val IPV6_SRC_OFFSET = 8
+        private const val IPV6_DST_OFFSET = 24
+        
+        /** IPv4 address in network byte order as a dotted quad */
         fun intToIpString(ip: Int): String {
             return "${ip and 0xFF}.${(ip shr 8) and 0xFF}.${(ip shr 16) and 0xFF}.${(ip shr 24) and 0xFF}"
         }
+        
+        /** IPv6 address folded to 32 bits by the native side (not an address) */
+        fun foldedIpString(ip: Int): String = "v6#%08x".format(ip)
+        
+        /**
+         * Offset of the transport header of an IPv6 packet, walking
+         * extension headers like ipv6_transport_offset() in ipv6.c.
+         * 0 if truncated or at a non-first fragment
+         */
+        fun ipv6TransportOffset(packet: ByteArray): Int {
+            if (packet.size < IPV6_HEADER_LENGTH) return 0
+            var next = packet[6].toInt() and 0xFF
+            var offset = IPV6_HEADER_LENGTH
+            
+            while (true) {
+                when (next) {
+                    0, 43, 60 -> {           // Hop-by-Hop, Routing, Destination Options
+                        if (offset + 8 > packet.size) return 0
+                        next = packet[offset].toInt() and 0xFF
+                        offset += ((packet[offset + 1].toInt() and 0xFF) + 1) * 8
+                    }
+                    44 -> {                  // Fragment: only the first one has the transport header
+                        if (offset + 8 > packet.size) return 0
+                        val fragOffset = ((packet[offset + 2].toInt() and 0xFF) shl 8) or
+                                         (packet[offset + 3].toInt() and 0xF8)
+                        if (fragOffset != 0) return 0
+                        next = packet[offset].toInt() and 0xFF
+                        offset += 8
+                    }
+                    51 -> {                  // AH: length in 4-byte units minus 2
+                        if (offset + 8 > packet.size) return 0
+                        next = packet[offset].toInt() and 0xFF
+                        offset += ((packet[offset + 1].toInt() and 0xFF) + 2) * 4
+                    }
+                    else -> return offset
+                }
+                if (offset > packet.size) return 0
+            }
+        }
     }
 }
 
@@ -232,11 +336,144 @@ interface PacketCallback {
      * @return Verdict: NfqueueBridge.VERDICT_ACCEPT, VERDICT_DROP, etc.
      * 
      * Note: This is called from a native thread. Be careful with
-     * thread safety and avoid long-running operations.
+     * thread safety and avoid long-running operations. With the native
+     * prefilter enabled (default) only handshake packets arrive here.
      */
     fun onPacketReceived(packet: NfqueuePacket): Int
 }
 
+/**
+ * Zero-copy callback interface for receiving packets from NFQUEUE
+ */
+interface DirectPacketCallback {
+    /**
+     * Called when a packet is received from NFQUEUE
+     * 
+     * @param packetId Unique packet ID for verdict
+     * @param protocol IP protocol (6=TCP, 17=UDP)
+     * @param srcIp Source IP in network byte order (IPv6: folded to 32 bits)
+     * @param dstIp Destination IP in network byte order (IPv6: folded to 32 bits)
+     * @param srcPort Source port in host byte order
+     * @param dstPort Destination port in host byte order
+     * @param packet Read-only view of the raw packet (IP header + data)
+     *               between position and limit
+     * @param handshake Native prefilter result, null for non-handshake packets;
+     *                  offsets are relative to the buffer position
+     * @return Verdict: NfqueueBridge.VERDICT_ACCEPT, VERDICT_DROP, etc.
+     * 
+     * Note: The buffer is reused for the next packet. Do not keep a
+     * reference to it after returning; copy what you need.
+     */
+    fun onPacketReceived(
+        packetId: Int,
+        protocol: Int,
+        srcIp: Int,
+        dstIp: Int,
+        srcPort: Int,
+        dstPort: Int,
+        packet: ByteBuffer,
+        handshake: HandshakeInfo?
+    ): Int
+}
+
+/**
+ * View over one batch of packets delivered by NfqueueBridge.setBatchCallback.
+ * Reused for every batch; only valid during onPacketsReceived.
+ */
+class PacketBatch internal constructor(packets: ByteBuffer, descriptors: ByteBuffer) {
+    
+    private val buffer: ByteBuffer = packets.asReadOnlyBuffer()
+    
+    // Absolute reads for hostname(); packet() narrows the limit of buffer
+    private val whole: ByteBuffer = packets.asReadOnlyBuffer()
+    private val desc: IntBuffer = descriptors.order(ByteOrder.nativeOrder()).asIntBuffer()
+    
+    /** Number of packets in this batch */
+    var size: Int = 0
+        internal set
+    
+    fun packetId(i: Int): Int = field(i, DESC_ID)
+    fun protocol(i: Int): Int = field(i, DESC_PROTOCOL)
+    fun srcIp(i: Int): Int = field(i, DESC_SRC_IP)
+    fun dstIp(i: Int): Int = field(i, DESC_DST_IP)
+    fun srcPort(i: Int): Int = field(i, DESC_SRC_PORT)
+    fun dstPort(i: Int): Int = field(i, DESC_DST_PORT)
+    fun length(i: Int): Int = field(i, DESC_LENGTH)
+    
+    /** Packet class: NfqueueBridge.CLASS_* */
+    fun packetClass(i: Int): Int = field(i, DESC_CLASS)
+    
+    /** Offset of application data from packet start */
+    fun dataOffset(i: Int): Int = field(i, DESC_DATA_OFFSET)
+    
+    /** Offset of SNI / Host value from packet start, 0 if not found */
+    fun hostOffset(i: Int): Int = field(i, DESC_HOST_OFFSET)
+    
+    fun hostLength(i: Int): Int = field(i, DESC_HOST_LENGTH)
+    
+    /**
+     * Read-only view of packet i (IP header + data) between position and limit.
+     * The returned buffer is shared; the next call repositions it.
+     */
+    fun packet(i: Int): ByteBuffer {
+        val offset = field(i, DESC_OFFSET)
+        buffer.clear()
+        buffer.limit(offset + field(i, DESC_LENGTH))
+        buffer.position(offset)
+        return buffer
+    }
+    
+    /** SNI / Host value of packet i, null if not found */
+    fun hostname(i: Int): String? {
+        val len = hostLength(i)
+        if (len <= 0) return null
+        val start = field(i, DESC_OFFSET) + hostOffset(i)
+        val bytes = ByteArray(len)
+        for (k in 0 until len) bytes[k] = whole.get(start + k)
+        return String(bytes, Charsets.US_ASCII)
+    }
+    
+    /** Set verdict for packet i (default: VERDICT_ACCEPT) */
+    fun setVerdict(i: Int, verdict: Int) {
+        desc.put(i * DESC_INTS + DESC_VERDICT, verdict)
+    }
+    
+    private fun field(i: Int, index: Int): Int = desc.get(i * DESC_INTS + index)
+    
+    internal companion object {
+        // Descriptor layout, must match nfqueue_jni.c
+        const val DESC_ID = 0
+        const val DESC_PROTOCOL = 1
+        const val DESC_SRC_IP = 2
+        const val DESC_DST_IP = 3
+        const val DESC_SRC_PORT = 4
+        const val DESC_DST_PORT = 5
+        const val DESC_OFFSET = 6
+        const val DESC_LENGTH = 7
+        const val DESC_CLASS = 8
+        const val DESC_DATA_OFFSET = 9
+        const val DESC_HOST_OFFSET = 10
+        const val DESC_HOST_LENGTH = 11
+        const val DESC_VERDICT = 12
+        const val DESC_INTS = 13
+    }
+}
+
+/**
+ * Batched callback interface for receiving packets from NFQUEUE
+ */
+interface BatchPacketCallback {
+    /**
+     * Called once per netlink read with every packet that passed the
+     * native prefilter. Set verdicts with batch.setVerdict(); packets
+     * left untouched are accepted. All verdicts go back to the kernel
+     * in a single netlink message.
+     * 
+     * @param batch Packets of this batch; do not keep it after returning
+     */
+    fun onPacketsReceived(batch: PacketBatch)
+}
+
 /**
  * Simple callback that accepts all packets
  */
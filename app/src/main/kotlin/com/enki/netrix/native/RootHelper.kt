@@ -145,7 +145,8 @@ object RootHelper {
     
     /**
      * Setup iptables rules for NFQUEUE
-     * Routes TCP traffic on ports 80 and 443 to NFQUEUE
+     * Routes TCP traffic on ports 80 and 443 to NFQUEUE (IPv6 too when
+     * ip6tables is available)
      */
     fun setupIptables(): Boolean {
         if (!isRooted()) {
@@ -178,6 +179,8 @@ object RootHelper {
             return false
         }
         
+        setupIp6tables(443, 80)
+        
         Log.i(TAG, "iptables rules set up successfully")
         return true
     }
@@ -205,10 +208,29 @@ object RootHelper {
             }
         }
         
+        setupIp6tables(*ports)
+        
         Log.i(TAG, "iptables rules set up for ports: ${ports.joinToString()}")
         return true
     }
     
+    /**
+     * Add the same NFQUEUE rules for IPv6
+     * Best effort: without ip6tables, IPv6 traffic is simply not queued.
+     */
+    private fun setupIp6tables(vararg ports: Int) {
+        for (port in ports) {
+            val result = executeAsRoot(
+                "ip6tables -A OUTPUT -p tcp --dport $port -j NFQUEUE --queue-num $QUEUE_NUM"
+            )
+            
+            if (!result.success) {
+                Log.w(TAG, "IPv6 rule for port $port failed, IPv6 not queued: ${result.error}")
+                return
+            }
+        }
+    }
+    
     /**
      * Clear NFQUEUE iptables rules
      */
@@ -228,6 +250,12 @@ object RootHelper {
             executeAsRoot(
                 "iptables -D OUTPUT -p tcp --dport 80 -j NFQUEUE --queue-num $QUEUE_NUM 2>/dev/null"
             )
+            executeAsRoot(
+                "ip6tables -D OUTPUT -p tcp --dport 443 -j NFQUEUE --queue-num $QUEUE_NUM 2>/dev/null"
+            )
+            executeAsRoot(
+                "ip6tables -D OUTPUT -p tcp --dport 80 -j NFQUEUE --queue-num $QUEUE_NUM 2>/dev/null"
+            )
         }
         
         return true
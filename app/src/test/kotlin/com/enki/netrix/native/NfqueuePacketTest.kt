@@ -0,0 +1,85 @@
+package com.enki.netrix.native
+
+import org.junit.Assert.assertArrayEquals
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertNull
+import org.junit.Test
+
+class NfqueuePacketTest {
+
+    private val tcpData = "GET / HTTP/1.1\r\nHost: v6.example\r\n\r\n".toByteArray(Charsets.US_ASCII)
+
+    /** IPv6 packet 2001:db8::1 -> 2001:db8::2, optional 8-byte extension header before TCP */
+    private fun ipv6Packet(extension: Int? = null, fragmentOffset: Int = 0): ByteArray {
+        val extLength = if (extension != null) 8 else 0
+        val packet = ByteArray(40 + extLength + 20 + tcpData.size)
+        packet[0] = 0x6A.toByte()          // Version 6, traffic class bits set
+        packet[6] = (extension ?: NfqueueBridge.PROTOCOL_TCP).toByte()
+        packet[7] = 64
+        packet[8] = 0x20; packet[9] = 0x01; packet[10] = 0x0d; packet[11] = 0xb8.toByte(); packet[23] = 1
+        packet[24] = 0x20; packet[25] = 0x01; packet[26] = 0x0d; packet[27] = 0xb8.toByte(); packet[39] = 2
+
+        if (extension != null) {
+            packet[40] = NfqueueBridge.PROTOCOL_TCP.toByte()
+            packet[42] = (fragmentOffset shr 8).toByte()
+            packet[43] = (fragmentOffset and 0xF8).toByte()
+        }
+
+        val tcp = 40 + extLength
+        packet[tcp + 2] = 0
+        packet[tcp + 3] = 80
+        packet[tcp + 12] = 0x50            // Data offset 5
+        packet[tcp + 13] = 0x18            // PSH ACK
+        tcpData.copyInto(packet, tcp + 20)
+        return packet
+    }
+
+    private fun packet(payload: ByteArray) = NfqueuePacket(
+        packetId = 1,
+        protocol = NfqueueBridge.PROTOCOL_TCP,
+        srcIp = 0x12345678,
+        dstIp = 0x0A0B0C0D,
+        srcPort = 40000,
+        dstPort = 80,
+        payload = payload
+    )
+
+    @Test
+    fun ipv6HeaderLengthIgnoresTrafficClass() {
+        val p = packet(ipv6Packet())
+        assertEquals(40, p.ipHeaderLength)
+        assertArrayEquals(tcpData, p.tcpData)
+        assertEquals("v6.example", p.extractHttpHost())
+    }
+
+    @Test
+    fun ipv6HeaderLengthSkipsExtensionHeaders() {
+        assertEquals(48, packet(ipv6Packet(extension = 60)).ipHeaderLength)
+        assertEquals(48, packet(ipv6Packet(extension = 44)).ipHeaderLength)
+        assertEquals("v6.example", packet(ipv6Packet(extension = 60)).extractHttpHost())
+    }
+
+    @Test
+    fun ipv6LaterFragmentHasNoTransportPayload() {
+        val p = packet(ipv6Packet(extension = 44, fragmentOffset = 1448))
+        assertEquals(0, p.ipHeaderLength)
+        assertNull(p.transportPayload)
+        assertNull(p.tcpData)
+    }
+
+    @Test
+    fun ipv6AddressesPrintedFromHeader() {
+        val p = packet(ipv6Packet())
+        assertEquals("2001:db8:0:0:0:0:0:1", p.srcIpString)
+        assertEquals("2001:db8:0:0:0:0:0:2", p.dstIpString)
+    }
+
+    @Test
+    fun ipv4Unchanged() {
+        val payload = ByteArray(40)
+        payload[0] = 0x45
+        val p = packet(payload).copy(srcIp = 0x0100000A)
+        assertEquals(20, p.ipHeaderLength)
+        assertEquals("10.0.0.1", p.srcIpString)
+    }
+}
@@ -0,0 +1,55 @@
+package com.enki.netrix.native
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import org.junit.Assert.assertEquals
+import org.junit.Test
+
+class PacketBatchTest {
+
+    private val hosts = listOf("first.example", "second.example.org")
+
+    /**
+     * Lay out one packet per host as nfqueue_jni.c does: packets back to
+     * back in one buffer, each with its host value after a 40-byte header
+     */
+    private fun batch(): PacketBatch {
+        val packets = ByteBuffer.allocateDirect(4096)
+        val descriptors = ByteBuffer.allocateDirect(hosts.size * PacketBatch.DESC_INTS * 4)
+            .order(ByteOrder.nativeOrder())
+
+        var offset = 0
+        hosts.forEachIndexed { i, host ->
+            val length = 40 + host.length
+            packets.position(offset + 40)
+            packets.put(host.toByteArray(Charsets.US_ASCII))
+
+            val base = i * PacketBatch.DESC_INTS * 4
+            descriptors.putInt(base + PacketBatch.DESC_OFFSET * 4, offset)
+            descriptors.putInt(base + PacketBatch.DESC_LENGTH * 4, length)
+            descriptors.putInt(base + PacketBatch.DESC_HOST_OFFSET * 4, 40)
+            descriptors.putInt(base + PacketBatch.DESC_HOST_LENGTH * 4, host.length)
+            offset += length
+        }
+
+        return PacketBatch(packets, descriptors).also { it.size = hosts.size }
+    }
+
+    @Test
+    fun hostnameAfterPacketOfEarlierIndex() {
+        val batch = batch()
+        for (i in 0 until batch.size - 1) {
+            batch.packet(i)
+            assertEquals(hosts[i + 1], batch.hostname(i + 1))
+        }
+    }
+
+    @Test
+    fun packetViewCoversOnePacket() {
+        val batch = batch()
+        val view = batch.packet(1)
+        assertEquals(40 + hosts[0].length, view.position())
+        assertEquals(40 + hosts[1].length, view.remaining())
+        assertEquals(hosts[0], batch.hostname(0))
+    }
+}